@@ -0,0 +1,482 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Benchmarks of the library's overhead, for tracking regressions and for
+ * comparing backends (Go vs. EASYPROM_NATIVE_BACKEND) and modes (direct,
+ * native metrics, async recorder). Results are printed as CSV (default) or
+ * JSON, one row per measurement.
+ *
+ * Usage: cppbench [--format=csv|json] [--threads=N] [--duration-ms=N]
+ *                 [--label-ops=N] [--max-series=N] [--port=N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "promClient.h"
+
+using namespace std;
+using namespace EasyProm;
+
+#ifdef EASYPROM_NATIVE_BACKEND
+#define BACKEND "native"
+#else
+#define BACKEND "go"
+#endif
+
+struct Options {
+    bool json = false;
+    unsigned maxThreads = 0; // 0 means the number of hardware threads
+    unsigned durationMs = 200;
+    unsigned labelOps = 20000; // Per thread, for the label cache miss/delete benchmarks
+    unsigned maxSeries = 1000000;
+    unsigned port = 12399;
+};
+
+struct Result {
+    string benchmark;
+    unsigned threads = 0;
+    uint64_t series = 0;
+    uint64_t ops = 0;
+    double seconds = 0;
+    uint64_t bytes = 0;
+};
+
+static Options opts;
+static vector<Result> results;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void printResults() {
+    if (opts.json) {
+        printf("[\n");
+    } else {
+        printf("backend,benchmark,threads,series,ops,ns_per_op,ops_per_sec,latency_ms,bytes\n");
+    }
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        // ns/op is per thread (i.e. the latency of one op), ops/sec is aggregate
+        double nsPerOp = r.ops ? r.seconds * 1e9 * r.threads / r.ops : 0;
+        double opsPerSec = r.seconds > 0 ? r.ops / r.seconds : 0;
+        double latencyMs = r.ops ? r.seconds * 1e3 / r.ops : 0;
+
+        if (opts.json) {
+            printf("  {\"backend\": \"%s\", \"benchmark\": \"%s\", \"threads\": %u, "
+                    "\"series\": %llu, \"ops\": %llu, \"ns_per_op\": %.2f, "
+                    "\"ops_per_sec\": %.0f, \"latency_ms\": %.3f, \"bytes\": %llu}%s\n",
+                    BACKEND, r.benchmark.c_str(), r.threads, (unsigned long long)r.series,
+                    (unsigned long long)r.ops, nsPerOp, opsPerSec, latencyMs,
+                    (unsigned long long)r.bytes, (i + 1 < results.size()) ? "," : "");
+        } else {
+            printf("%s,%s,%u,%llu,%llu,%.2f,%.0f,%.3f,%llu\n", BACKEND, r.benchmark.c_str(),
+                    r.threads, (unsigned long long)r.series, (unsigned long long)r.ops,
+                    nsPerOp, opsPerSec, latencyMs, (unsigned long long)r.bytes);
+        }
+    }
+
+    if (opts.json) {
+        printf("]\n");
+    }
+}
+
+/* ========== THROUGHPUT BENCHMARKS ========== */
+// Runs 'op(thread, i)' in a loop on 'nThreads' threads for opts.durationMs
+static void runTimed(const string& name, unsigned nThreads,
+        const function<void(unsigned, uint64_t)>& op) {
+    atomic<bool> start{false}, stop{false};
+    atomic<uint64_t> totalOps{0};
+    vector<thread> threads;
+
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t]() {
+            while (!start.load(memory_order_acquire)) {}
+
+            uint64_t i = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                for (unsigned j = 0; j < 256; j++, i++) {
+                    op(t, i);
+                }
+            }
+            totalOps.fetch_add(i);
+        });
+    }
+
+    auto begin = chrono::steady_clock::now();
+    start.store(true, memory_order_release);
+    this_thread::sleep_for(chrono::milliseconds(opts.durationMs));
+    stop.store(true);
+    for (thread& th : threads) {
+        th.join();
+    }
+
+    Result r;
+    r.benchmark = name;
+    r.threads = nThreads;
+    r.ops = totalOps.load();
+    r.seconds = secondsSince(begin);
+    results.push_back(r);
+}
+
+// Runs 'op(thread, i)' exactly opts.labelOps times on each of 'nThreads' threads
+static void runCounted(const string& name, unsigned nThreads,
+        const function<void(unsigned, uint64_t)>& op) {
+    atomic<bool> start{false};
+    vector<thread> threads;
+
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t]() {
+            while (!start.load(memory_order_acquire)) {}
+            for (uint64_t i = 0; i < opts.labelOps; i++) {
+                op(t, i);
+            }
+        });
+    }
+
+    auto begin = chrono::steady_clock::now();
+    start.store(true, memory_order_release);
+    for (thread& th : threads) {
+        th.join();
+    }
+
+    Result r;
+    r.benchmark = name;
+    r.threads = nThreads;
+    r.ops = (uint64_t)opts.labelOps * nThreads;
+    r.seconds = secondsSince(begin);
+    results.push_back(r);
+}
+
+static vector<unsigned> threadCounts() {
+    vector<unsigned> counts;
+    for (unsigned n = 1; n < opts.maxThreads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(opts.maxThreads);
+
+    return counts;
+}
+
+// Unique label value per (thread, iteration, round)
+static string labelValue(unsigned thread, uint64_t i, unsigned round) {
+    char buf[48];
+    int len = snprintf(buf, sizeof(buf), "r%u-t%u-%llu", round, thread, (unsigned long long)i);
+    return string(buf, len);
+}
+
+static void benchUpdates() {
+    Gauge gauge("bench_gauge", "Benchmark gauge");
+    Counter counter("bench_counter", "Benchmark counter");
+    Summary summary("bench_summary", "Benchmark summary", {{0.5, 0.05}, {0.99, 0.001}});
+    Histogram histogram("bench_histogram", "Benchmark histogram", ExponentialBuckets(1, 2, 16));
+    NativeCounter nativeCounter("bench_native_counter", "Benchmark native counter");
+    NativeGauge nativeGauge("bench_native_gauge", "Benchmark native gauge");
+    NativeHistogram nativeHistogram("bench_native_histogram", "Benchmark native histogram",
+                                    ExponentialBuckets(1, 2, 16));
+    NativeSummary nativeSummary("bench_native_summary", "Benchmark native summary",
+                                {{0.5, 0.05}, {0.99, 0.001}});
+
+    TickClock::Calibrate();
+    for (unsigned n : threadCounts()) {
+        runTimed("GaugeSet", n, [&](unsigned, uint64_t i) { gauge.Set(i); });
+        runTimed("CounterAdd", n, [&](unsigned, uint64_t) { counter.Add(1); });
+        runTimed("SummaryObserve", n, [&](unsigned, uint64_t i) { summary.Observe(i & 1023); });
+        runTimed("HistogramObserve", n, [&](unsigned, uint64_t i) { histogram.Observe(i & 1023); });
+        runTimed("NativeGaugeSet", n, [&](unsigned, uint64_t i) { nativeGauge.Set(i); });
+        runTimed("NativeCounterAdd", n, [&](unsigned, uint64_t) { nativeCounter.Add(1); });
+        runTimed("NativeSummaryObserve", n,
+                [&](unsigned, uint64_t i) { nativeSummary.Observe(i & 1023); });
+        runTimed("NativeHistogramObserve", n,
+                [&](unsigned, uint64_t i) { nativeHistogram.Observe(i & 1023); });
+
+        // Timing an empty block, with steady_clock vs. a ScopedTimer
+        runTimed("NativeHistogramSteadyClockTimer", n, [&](unsigned, uint64_t) {
+            auto start = chrono::steady_clock::now();
+            nativeHistogram.Observe(secondsSince(start));
+        });
+        runTimed("NativeHistogramScopedTimer", n,
+                [&](unsigned, uint64_t) { ScopedTimer<NativeHistogram> timer(nativeHistogram); });
+    }
+
+    AsyncRecorder::Start();
+    for (unsigned n : threadCounts()) {
+        runTimed("AsyncGaugeSet", n, [&](unsigned, uint64_t i) { gauge.Set(i); });
+        runTimed("AsyncCounterAdd", n, [&](unsigned, uint64_t) { counter.Add(1); });
+    }
+    AsyncRecorder::Stop();
+}
+
+static void benchLabels() {
+    GaugeVec gaugeVec("bench_gauge_vec", "Benchmark gauge vec", {"route", "code"});
+    gaugeVec.WithLabelValues({"/api", "200"});
+
+    unsigned round = 0;
+    for (unsigned n : threadCounts()) {
+        runTimed("GaugeWithLabelValues/hit", n, [&](unsigned, uint64_t) {
+            gaugeVec.WithLabelValues({"/api", "200"});
+        });
+
+        // Every lookup creates a child...
+        vector<vector<string>> created(n);
+        runCounted("GaugeWithLabelValues/miss", n, [&](unsigned t, uint64_t i) {
+            created[t].push_back(labelValue(t, i, round));
+            gaugeVec.WithLabelValues({"/api", created[t].back()});
+        });
+
+        // ...which is then deleted
+        runCounted("GaugeDeleteLabelValues", n, [&](unsigned t, uint64_t i) {
+            gaugeVec.DeleteLabelValues({"/api", created[t][i]});
+        });
+
+        round++;
+    }
+}
+
+/* ========== SCRAPE BENCHMARKS ========== */
+// Fetches 'path' from the local handler; returns the body's size, or -1
+static long long httpGet(const char* path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // HTTP/1.0, so the response isn't chunked and the connection is closed after it
+    string request = string("GET ") + path + " HTTP/1.0\r\nHost: localhost\r\n\r\n";
+    if (send(fd, request.data(), request.size(), 0) != (ssize_t)request.size()) {
+        close(fd);
+        return -1;
+    }
+
+    string header;
+    long long total = 0, headerLen = -1;
+    char buf[65536];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        if (headerLen < 0) {
+            header.append(buf, n);
+            size_t end = header.find("\r\n\r\n");
+            if (end != string::npos) {
+                headerLen = end + 4;
+            }
+        }
+        total += n;
+    }
+    close(fd);
+
+    return (headerLen < 0) ? -1 : total - headerLen;
+}
+
+static uint64_t scrapeSeries = 0; // Series created by benchScrapes()
+
+static void benchScrapes() {
+    char listen[16];
+    snprintf(listen, sizeof(listen), ":%u", opts.port);
+    StartPromHandler(listen, "/bench-metrics");
+
+    // Wait for the handler to come up
+    for (int i = 0; i < 100 && httpGet("/bench-metrics") < 0; i++) {
+        usleep(10000);
+    }
+
+    GaugeVec seriesVec("bench_scrape_series", "Benchmark scrape series", {"shard", "id"});
+    uint64_t nSeries = 0;
+    for (uint64_t target = 1000; target <= opts.maxSeries; target *= 10) {
+        for (; nSeries < target; nSeries++) {
+            char shard[16], id[24];
+            int shardLen = snprintf(shard, sizeof(shard), "%llu", (unsigned long long)(nSeries % 16));
+            int idLen = snprintf(id, sizeof(id), "%llu", (unsigned long long)nSeries);
+            seriesVec.WithLabelValues({string_view(shard, shardLen), string_view(id, idLen)})
+                .Set(nSeries);
+        }
+
+        // Median of a few scrapes
+        const int nScrapes = 5;
+        vector<double> latencies;
+        long long bytes = 0;
+        for (int i = 0; i < nScrapes; i++) {
+            auto begin = chrono::steady_clock::now();
+            bytes = httpGet("/bench-metrics");
+            latencies.push_back(secondsSince(begin));
+        }
+        sort(latencies.begin(), latencies.end());
+
+        Result r;
+        scrapeSeries = nSeries;
+        r.benchmark = "Scrape";
+        r.threads = 1;
+        r.series = nSeries;
+        r.ops = 1;
+        r.seconds = latencies[nScrapes / 2];
+        r.bytes = bytes < 0 ? 0 : bytes;
+        results.push_back(r);
+    }
+}
+
+/* ========== REMOTE WRITE BENCHMARKS ========== */
+// Stub remote-write receiver: accepts any POST with a 200, counting requests
+// and body bytes (i.e. compressed, as sent on the wire)
+static atomic<uint64_t> stubRequests{0};
+static atomic<uint64_t> stubBytes{0};
+
+static void serveStubRequest(int fd) {
+    string request;
+    char buf[65536];
+    size_t headerLen = string::npos, contentLen = 0;
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        request.append(buf, n);
+        if (headerLen == string::npos && (headerLen = request.find("\r\n\r\n")) != string::npos) {
+            headerLen += 4;
+            size_t pos = request.find("Content-Length: ");
+            contentLen = (pos < headerLen) ? strtoull(request.c_str() + pos + 16, nullptr, 10) : 0;
+        }
+        if (headerLen != string::npos && request.size() >= headerLen + contentLen) {
+            break;
+        }
+    }
+
+    if (headerLen != string::npos) {
+        stubRequests++;
+        stubBytes += contentLen;
+        const char* response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send(fd, response, strlen(response), MSG_NOSIGNAL);
+    }
+    close(fd);
+}
+
+static bool startStubReceiver(unsigned port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        return false;
+    }
+
+    thread([fd]() {
+        while (true) {
+            int connFd = accept(fd, nullptr, nullptr);
+            if (connFd >= 0) {
+                thread(serveStubRequest, connFd).detach();
+            }
+        }
+    }).detach();
+
+    return true;
+}
+
+// Pushes the registry, with the scrape benchmark's series, once per shard
+// count, via the final flush of StopRemoteWrite. Ops are those series (other
+// samples are comparatively few), and bytes are as sent on the wire.
+static void benchRemoteWrite() {
+    if (!startStubReceiver(opts.port + 1)) {
+        fprintf(stderr, "Unable to start the stub remote-write receiver, skipping\n");
+        return;
+    }
+
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/api/v1/write", opts.port + 1);
+
+    for (unsigned nShards : {1u, 4u}) {
+        RemoteWriteOpts rwOpts = {};
+        rwOpts.nShards = nShards;
+        rwOpts.queueCapacity = 1 << 20; // Never drop, so all samples are counted
+
+        uint64_t requestsBefore = stubRequests, bytesBefore = stubBytes;
+        auto begin = chrono::steady_clock::now();
+        StartRemoteWrite(url, 3600 * 1000, &rwOpts);
+        StopRemoteWrite(600 * 1000);
+
+        Result r;
+        r.benchmark = "RemoteWrite";
+        r.threads = nShards;
+        r.series = scrapeSeries;
+        r.ops = scrapeSeries;
+        r.seconds = secondsSince(begin);
+        r.bytes = stubBytes - bytesBefore;
+        results.push_back(r);
+
+        if (stubRequests == requestsBefore) {
+            fprintf(stderr, "No remote-write requests received\n");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--format=json") == 0) {
+            opts.json = true;
+        } else if (strcmp(arg, "--format=csv") == 0) {
+            opts.json = false;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            opts.maxThreads = atoi(arg + 10);
+        } else if (strncmp(arg, "--duration-ms=", 14) == 0) {
+            opts.durationMs = atoi(arg + 14);
+        } else if (strncmp(arg, "--label-ops=", 12) == 0) {
+            opts.labelOps = atoi(arg + 12);
+        } else if (strncmp(arg, "--max-series=", 13) == 0) {
+            opts.maxSeries = atoi(arg + 13);
+        } else if (strncmp(arg, "--port=", 7) == 0) {
+            opts.port = atoi(arg + 7);
+        } else {
+            fprintf(stderr, "Usage: %s [--format=csv|json] [--threads=N] [--duration-ms=N] "
+                    "[--label-ops=N] [--max-series=N] [--port=N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.maxThreads == 0) {
+        opts.maxThreads = max(thread::hardware_concurrency(), 1u);
+    }
+
+    benchUpdates();
+    benchLabels();
+    benchScrapes();
+    benchRemoteWrite();
+    printResults();
+
+    return 0;
+}
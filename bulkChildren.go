@@ -0,0 +1,219 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * BULK CHILD CREATION
+ * =========================================================================== */
+// Creates many children of a Vec in a single call from "C-land", e.g. to
+// pre-create every child of a known label space at startup. Label values
+// are copied out of "C-land" memory once per distinct value rather than once
+// per child, and the handle table is grown once for all of the children.
+
+// Copies strings out of "C-land" memory, sharing one copy between equal ones
+type stringInterner map[string]string
+
+func (in stringInterner) copy(s string) string {
+	if cpy, ok := in[s]; ok {
+		return cpy
+	}
+
+	cpy := stringCopy(s)
+	in[cpy] = cpy
+
+	return cpy
+}
+
+// Splits labelVals into sets of nLabels label values
+func labelTuples(nLabels uint32, labelVals []string) [][]string {
+	if nLabels == 0 {
+		return nil
+	}
+
+	in := make(stringInterner)
+	vals := make([]string, len(labelVals))
+	for i, val := range labelVals {
+		vals[i] = in.copy(val)
+	}
+
+	tuples := make([][]string, len(vals)/int(nLabels))
+	for i := range tuples {
+		tuples[i] = vals[i*int(nLabels) : (i+1)*int(nLabels) : (i+1)*int(nLabels)]
+	}
+
+	return tuples
+}
+
+// Returns every combination of label values, where label i takes each of
+// the next nVals[i] values in vals. The last label's value varies fastest.
+func labelProduct(nVals []uint32, vals []string) [][]string {
+	nLabels := len(nVals)
+	if nLabels == 0 {
+		return nil
+	}
+
+	choices := make([][]string, nLabels)
+	nTuples := 1
+	for i, n := range nVals {
+		choices[i] = make([]string, n)
+		for j := range choices[i] {
+			choices[i][j] = stringCopy(vals[j])
+		}
+		vals = vals[n:]
+		nTuples *= int(n)
+	}
+
+	flat := make([]string, nTuples*nLabels)
+	tuples := make([][]string, nTuples)
+	for i := range tuples {
+		tuple := flat[i*nLabels : (i+1)*nLabels : (i+1)*nLabels]
+		rem := i
+		for label := nLabels - 1; label >= 0; label-- {
+			n := len(choices[label])
+			tuple[label] = choices[label][rem%n]
+			rem /= n
+		}
+		tuples[i] = tuple
+	}
+
+	return tuples
+}
+
+// Creates (or looks up) the child of vec for each set of label values,
+// storing their handles in handles (which is in "C-land" memory)
+func withLabelValuesMany(uPtrVec uintptr, vec interface{}, table *handleTable,
+	create func(labelVals []string) interface{}, tuples [][]string, handles []uintptr) {
+
+	if limits := limitsOf(vec); limits != nil {
+		for i, labelVals := range tuples {
+			handles[i] = limits.withLabelValues(labelVals)
+		}
+		return
+	}
+
+	objs := make([]interface{}, len(tuples))
+	for i, labelVals := range tuples {
+		objs[i] = create(labelVals)
+	}
+	addVecSeries(uPtrVec, int64(table.PutMany(objs, handles)))
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Creates the children for each set of nLabels label values in labelVals
+//export goGaugeWithLabelValuesMany
+func goGaugeWithLabelValuesMany(uPtrGaugeVec uintptr, nLabels uint32, labelVals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		withLabelValuesMany(uPtrGaugeVec, gaugeVec, gaugeHandles,
+			func(labelVals []string) interface{} { return gaugeVec.WithLabelValues(labelVals...) },
+			labelTuples(nLabels, labelVals), handles)
+	}
+}
+
+// Creates the children for every combination of label values (see labelProduct)
+//export goGaugeWithLabelValuesProduct
+func goGaugeWithLabelValuesProduct(uPtrGaugeVec uintptr, nVals []uint32, vals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		withLabelValuesMany(uPtrGaugeVec, gaugeVec, gaugeHandles,
+			func(labelVals []string) interface{} { return gaugeVec.WithLabelValues(labelVals...) },
+			labelProduct(nVals, vals), handles)
+	}
+}
+
+//export goCounterWithLabelValuesMany
+func goCounterWithLabelValuesMany(uPtrCounterVec uintptr, nLabels uint32, labelVals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		withLabelValuesMany(uPtrCounterVec, counterVec, counterHandles,
+			func(labelVals []string) interface{} { return counterVec.WithLabelValues(labelVals...) },
+			labelTuples(nLabels, labelVals), handles)
+	}
+}
+
+//export goCounterWithLabelValuesProduct
+func goCounterWithLabelValuesProduct(uPtrCounterVec uintptr, nVals []uint32, vals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		withLabelValuesMany(uPtrCounterVec, counterVec, counterHandles,
+			func(labelVals []string) interface{} { return counterVec.WithLabelValues(labelVals...) },
+			labelProduct(nVals, vals), handles)
+	}
+}
+
+//export goHistogramWithLabelValuesMany
+func goHistogramWithLabelValuesMany(uPtrHistogramVec uintptr, nLabels uint32, labelVals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		withLabelValuesMany(uPtrHistogramVec, histogramVec, histogramHandles,
+			func(labelVals []string) interface{} { return histogramVec.WithLabelValues(labelVals...) },
+			labelTuples(nLabels, labelVals), handles)
+	}
+}
+
+//export goHistogramWithLabelValuesProduct
+func goHistogramWithLabelValuesProduct(uPtrHistogramVec uintptr, nVals []uint32, vals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		withLabelValuesMany(uPtrHistogramVec, histogramVec, histogramHandles,
+			func(labelVals []string) interface{} { return histogramVec.WithLabelValues(labelVals...) },
+			labelProduct(nVals, vals), handles)
+	}
+}
+
+//export goSummaryWithLabelValuesMany
+func goSummaryWithLabelValuesMany(uPtrSummaryVec uintptr, nLabels uint32, labelVals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		withLabelValuesMany(uPtrSummaryVec, summaryVec, summaryHandles,
+			func(labelVals []string) interface{} { return summaryVec.WithLabelValues(labelVals...) },
+			labelTuples(nLabels, labelVals), handles)
+	}
+}
+
+//export goSummaryWithLabelValuesProduct
+func goSummaryWithLabelValuesProduct(uPtrSummaryVec uintptr, nVals []uint32, vals []string,
+	handles []uintptr) {
+
+	countCall(callWithLabelValues)
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		withLabelValuesMany(uPtrSummaryVec, summaryVec, summaryHandles,
+			func(labelVals []string) interface{} { return summaryVec.WithLabelValues(labelVals...) },
+			labelProduct(nVals, vals), handles)
+	}
+}
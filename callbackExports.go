@@ -0,0 +1,90 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"unsafe"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * CALLBACK METRIC EXPORTS
+ * =========================================================================== */
+// Exports for the metrics whose values come from calling back into "C-land"
+// at scrape time: func metrics (see funcMetrics.go) and native summaries (see
+// nativeSummary.go).
+// NOTE: They can't live next to their collectors, as cgo doesn't allow a file
+// with //export functions to define functions in its preamble, and those
+// files' preambles define the C helpers that make the calls (e.g.
+// callMetricValueFn). The preamble of a file with //export functions is also
+// copied into the generated header, so it must only hold declarations.
+
+// The value is computed by calling 'fn' (a MetricValueFn) with 'ctx'
+//export goNewGaugeFunc
+func goNewGaugeFunc(name, help string, fn, ctx unsafe.Pointer) {
+	countCall(callNew)
+	registerFunc(name, help, prometheus.GaugeValue, fn, ctx)
+}
+
+//export goNewCounterFunc
+func goNewCounterFunc(name, help string, fn, ctx unsafe.Pointer) {
+	countCall(callNew)
+	registerFunc(name, help, prometheus.CounterValue, fn, ctx)
+}
+
+// Series are emitted by calling 'fn' (a MetricEnumFn) with 'ctx'; see
+// funcVecCollector
+//export goNewGaugeVecFunc
+func goNewGaugeVecFunc(name, help string, labels []string, fn, ctx unsafe.Pointer) {
+	countCall(callNew)
+	registerFuncVec(name, help, labels, prometheus.GaugeValue, fn, ctx)
+}
+
+//export goNewCounterVecFunc
+func goNewCounterVecFunc(name, help string, labels []string, fn, ctx unsafe.Pointer) {
+	countCall(callNew)
+	registerFuncVec(name, help, labels, prometheus.CounterValue, fn, ctx)
+}
+
+// The MetricEmitFn passed to MetricEnumFns. 'labelVals' holds as many
+// values as the Vec has labels.
+//export goFuncVecEmit
+func goFuncVecEmit(emitCtx uintptr, labelVals **C.char, val float64) {
+	if emit, ok := funcVecEmits.Load(emitCtx); ok {
+		emit.(*funcVecEmit).add(labelVals, val)
+	}
+}
+
+// Quantile estimates, count and sum are computed by calling 'fn' (a
+// NativeSummaryFn) with 'ctx'; see nativeSummaryCollector
+//export goNewNativeSummary
+func goNewNativeSummary(name, help string, quantiles []float64, fn, ctx unsafe.Pointer) {
+	countCall(callNew)
+	if fn == nil {
+		panic("Invalid callback for native summary")
+	}
+
+	prometheus.MustRegister(&nativeSummaryCollector{
+		desc:      prometheus.NewDesc(stringCopy(name), stringCopy(help), nil, nil),
+		quantiles: bucketsCopy(quantiles),
+		fn:        fn,
+		ctx:       ctx,
+	})
+	trackFamily(stringCopy(name), 1)
+}
@@ -0,0 +1,156 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+/*
+#include <stdint.h>
+
+// Exported by callbackExports.go
+extern void goFuncVecEmit(uintptr_t emitCtx, char** labelVals, double val);
+
+// Calls a MetricValueFn (see promClient.h)
+static inline double callMetricValueFn(void* fn, void* ctx) {
+    return ((double (*)(void*))fn)(ctx);
+}
+
+// Calls a MetricEnumFn (see promClient.h), which emits each series through
+// goFuncVecEmit
+static inline void callMetricEnumFn(void* fn, void* ctx, uintptr_t emitCtx) {
+    ((void (*)(void*, void (*)(void*, const char**, double), void*))fn)(
+        ctx, (void (*)(void*, const char**, double))goFuncVecEmit, (void*)emitCtx);
+}
+*/
+import "C"
+
+import (
+	"sync"
+	"sync/atomic"
+	"unsafe"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * FUNC COLLECTORS
+ * =========================================================================== */
+// Collectors for gauges and counters whose values are only computed when
+// the registry is gathered, by calling a C callback. Nothing is recorded
+// between scrapes, so e.g. a queue depth costs nothing until it's scraped.
+// NOTE: This file has no //export'ed functions, so its preamble may define
+//       functions without them ending up in libpromclient.h.
+type funcCollector struct {
+	desc    *prometheus.Desc
+	valType prometheus.ValueType
+	fn      unsafe.Pointer // MetricValueFn
+	ctx     unsafe.Pointer
+}
+
+func (c *funcCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *funcCollector) Collect(ch chan<- prometheus.Metric) {
+	val := C.callMetricValueFn(c.fn, c.ctx)
+	ch <- prometheus.MustNewConstMetric(c.desc, c.valType, float64(val))
+}
+
+// Like funcCollector, but the callback (a MetricEnumFn) emits any number of
+// series, each with its own label values, through goFuncVecEmit. The label
+// values of the series emitted by one call must be unique.
+type funcVecCollector struct {
+	desc    *prometheus.Desc
+	valType prometheus.ValueType
+	nLabels int
+	fn      unsafe.Pointer // MetricEnumFn
+	ctx     unsafe.Pointer
+	family  *familyInfo
+}
+
+// A collection in progress. C code can't hold Go pointers, so the callback
+// is passed a key into funcVecEmits instead.
+type funcVecEmit struct {
+	collector *funcVecCollector
+	ch        chan<- prometheus.Metric
+	series    int64
+}
+
+var funcVecEmits sync.Map // Key -> *funcVecEmit
+var funcVecEmitKey uintptr
+
+func (c *funcVecCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *funcVecCollector) Collect(ch chan<- prometheus.Metric) {
+	key := atomic.AddUintptr(&funcVecEmitKey, 1)
+	emit := &funcVecEmit{collector: c, ch: ch}
+	funcVecEmits.Store(key, emit)
+	defer funcVecEmits.Delete(key)
+
+	C.callMetricEnumFn(c.fn, c.ctx, C.uintptr_t(key))
+	atomic.StoreInt64(&c.family.series, emit.series)
+}
+
+// Called by goFuncVecEmit. Series with invalid label values are skipped.
+func (e *funcVecEmit) add(labelVals **C.char, val float64) {
+	c := e.collector
+	vals := make([]string, c.nLabels)
+	if c.nLabels > 0 {
+		cVals := (*[1 << 16]*C.char)(unsafe.Pointer(labelVals))[:c.nLabels:c.nLabels]
+		for i, cVal := range cVals {
+			vals[i] = C.GoString(cVal)
+		}
+	}
+
+	if m, err := prometheus.NewConstMetric(c.desc, c.valType, val, vals...); err == nil {
+		e.ch <- m
+		e.series++
+	}
+}
+
+func registerFunc(name, help string, valType prometheus.ValueType, fn, ctx unsafe.Pointer) {
+	if fn == nil {
+		panic("Invalid callback for func metric")
+	}
+
+	prometheus.MustRegister(&funcCollector{
+		desc:    prometheus.NewDesc(stringCopy(name), stringCopy(help), nil, nil),
+		valType: valType,
+		fn:      fn,
+		ctx:     ctx,
+	})
+	trackFamily(stringCopy(name), 1)
+}
+
+func registerFuncVec(name, help string, labels []string, valType prometheus.ValueType,
+	fn, ctx unsafe.Pointer) {
+
+	if fn == nil {
+		panic("Invalid callback for func metric")
+	}
+
+	labelsCopy := make([]string, len(labels))
+	stringSliceCopy(labelsCopy, labels)
+
+	prometheus.MustRegister(&funcVecCollector{
+		desc:    prometheus.NewDesc(stringCopy(name), stringCopy(help), labelsCopy, nil),
+		valType: valType,
+		nLabels: len(labels),
+		fn:      fn,
+		ctx:     ctx,
+		family:  trackFamily(stringCopy(name), 0),
+	})
+}
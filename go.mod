@@ -2,4 +2,8 @@ module github.com/t-lin/easy-prom-client-c
 
 go 1.16
 
-require github.com/prometheus/client_golang v1.11.0
+require (
+	github.com/prometheus/client_golang v1.11.0
+	github.com/prometheus/client_model v0.2.0
+	github.com/prometheus/common v0.26.0
+)
@@ -0,0 +1,252 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import (
+	"sync"
+	"sync/atomic"
+	"unsafe"
+)
+
+/* ===========================================================================
+ * HANDLE TABLE
+ * =========================================================================== */
+// Slot table mapping the opaque handles passed to "C-land" to Go objects.
+// A handle packs a dense slot index (lower 32 bits) with the slot's
+// generation (upper 32 bits). The generation is bumped every time a slot is
+// freed, so a stale handle to a deleted object no longer matches its slot
+// and is rejected, even after the slot is reused.
+//
+// Slots live in fixed-size chunks that are never moved or freed. Readers
+// (Get) only perform atomic loads, and never lock. Writers (Put, Delete) are
+// serialized by a mutex, since they're only on the create/delete paths.
+const (
+	handleChunkBits = 12
+	handleChunkSize = 1 << handleChunkBits // Slots per chunk
+	handleMaxChunks = 1 << 12              // Up to ~16.7M live handles per table
+	handleIdxMask   = 1<<32 - 1
+)
+
+// Immutable once published to a slot, except for lastUsed
+type handleEntry struct {
+	lastUsed int64 // coarseNow when last looked up (see vecLimits.go)
+	obj      interface{}
+	gen      uint32
+}
+
+type handleChunk [handleChunkSize]unsafe.Pointer // Each slot is a *handleEntry
+
+type handleTable struct {
+	chunks [handleMaxChunks]unsafe.Pointer // Each chunk is a *handleChunk
+	misses uint64                          // Lookups of unknown or stale handles
+	kind   string                          // Kind of object, for self-instrumentation
+
+	mu      sync.Mutex              // Serializes writers
+	gens    []uint32                // Last generation handed out per slot
+	free    []uint32                // Indices of free slots
+	handles map[interface{}]uintptr // Reverse lookup, to de-dup objects
+}
+
+// Every table, for self-instrumentation
+var handleTables []*handleTable
+
+func newHandleTable(kind string) *handleTable {
+	t := &handleTable{kind: kind, handles: make(map[interface{}]uintptr)}
+	handleTables = append(handleTables, t)
+
+	return t
+}
+
+func makeHandle(idx, gen uint32) uintptr {
+	return uintptr(gen)<<32 | uintptr(idx)
+}
+
+func (t *handleTable) slot(idx uint32) *unsafe.Pointer {
+	chunk := (*handleChunk)(atomic.LoadPointer(&t.chunks[idx>>handleChunkBits]))
+	if chunk == nil {
+		return nil
+	}
+
+	return &chunk[idx&(handleChunkSize-1)]
+}
+
+// Returns the entry for handle h, or nil if h is unknown or stale
+func (t *handleTable) entry(h uintptr) *handleEntry {
+	idx := uint32(h & handleIdxMask)
+	if idx>>handleChunkBits >= handleMaxChunks {
+		return nil
+	}
+
+	slot := t.slot(idx)
+	if slot == nil {
+		return nil
+	}
+
+	entry := (*handleEntry)(atomic.LoadPointer(slot))
+	if entry == nil || entry.gen != uint32(h>>32) {
+		return nil
+	}
+
+	return entry
+}
+
+// Returns the object for handle h, or nil if h is unknown or stale, and
+// marks it as used. Lock-free; safe to call concurrently with Put and Delete.
+func (t *handleTable) Get(h uintptr) interface{} {
+	entry := t.entry(h)
+	if entry == nil {
+		atomic.AddUint64(&t.misses, 1)
+		return nil
+	}
+
+	// Only written when the coarse clock has ticked, so concurrent lookups
+	// of the same handle don't keep invalidating each other's cache lines
+	if now := atomic.LoadInt64(&coarseNow); atomic.LoadInt64(&entry.lastUsed) != now {
+		atomic.StoreInt64(&entry.lastUsed, now)
+	}
+
+	return entry.obj
+}
+
+// Returns coarseNow as of the last lookup of handle h, or -1 if h is unknown
+// or stale
+func (t *handleTable) LastUsed(h uintptr) int64 {
+	entry := t.entry(h)
+	if entry == nil {
+		return -1
+	}
+
+	return atomic.LoadInt64(&entry.lastUsed)
+}
+
+// Returns the handle for obj, allocating a slot for it if it doesn't have
+// one already (e.g. Vecs return the same child for repeated label values).
+func (t *handleTable) Put(obj interface{}) uintptr {
+	h, _ := t.PutNew(obj)
+	return h
+}
+
+// Like Put, but also reports whether a slot had to be allocated
+func (t *handleTable) PutNew(obj interface{}) (uintptr, bool) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	return t.putLocked(obj)
+}
+
+// Puts every object in objs under a single lock, storing their handles in
+// handles, after growing the table for them up front. Returns the number of
+// slots that had to be allocated.
+func (t *handleTable) PutMany(objs []interface{}, handles []uintptr) int {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	if n := len(objs) - len(t.free); n > 0 && cap(t.gens)-len(t.gens) < n {
+		gens := make([]uint32, len(t.gens), len(t.gens)+n)
+		copy(gens, t.gens)
+		t.gens = gens
+	}
+	if len(objs) > len(t.handles) {
+		// Go maps can't be grown in place, but rehashing once beats
+		// growing step by step as the objects are inserted
+		handleMap := make(map[interface{}]uintptr, len(t.handles)+len(objs))
+		for obj, h := range t.handles {
+			handleMap[obj] = h
+		}
+		t.handles = handleMap
+	}
+
+	nNew := 0
+	for i, obj := range objs {
+		var isNew bool
+		handles[i], isNew = t.putLocked(obj)
+		if isNew {
+			nNew++
+		}
+	}
+
+	return nNew
+}
+
+func (t *handleTable) putLocked(obj interface{}) (uintptr, bool) {
+	if h, ok := t.handles[obj]; ok {
+		return h, false
+	}
+
+	var idx uint32
+	if n := len(t.free); n > 0 {
+		idx = t.free[n-1]
+		t.free = t.free[:n-1]
+	} else {
+		idx = uint32(len(t.gens))
+		if idx>>handleChunkBits >= handleMaxChunks {
+			panic("Handle table is full")
+		}
+		if idx&(handleChunkSize-1) == 0 {
+			atomic.StorePointer(&t.chunks[idx>>handleChunkBits], unsafe.Pointer(new(handleChunk)))
+		}
+		t.gens = append(t.gens, 0)
+	}
+
+	// Generation 0 is skipped so that no valid handle is ever 0 (i.e. NULL)
+	gen := t.gens[idx] + 1
+	if gen == 0 {
+		gen = 1
+	}
+	t.gens[idx] = gen
+
+	h := makeHandle(idx, gen)
+	atomic.StorePointer(t.slot(idx), unsafe.Pointer(&handleEntry{
+		lastUsed: atomic.LoadInt64(&coarseNow),
+		obj:      obj,
+		gen:      gen,
+	}))
+	t.handles[obj] = h
+
+	return h, true
+}
+
+// Frees the slot holding obj, if any. Its handle becomes stale.
+// Returns whether obj had a slot.
+func (t *handleTable) DeleteObj(obj interface{}) bool {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	h, ok := t.handles[obj]
+	if !ok {
+		return false
+	}
+
+	idx := uint32(h & handleIdxMask)
+	atomic.StorePointer(t.slot(idx), nil)
+	delete(t.handles, obj)
+	t.free = append(t.free, idx)
+
+	return true
+}
+
+// Number of live handles
+func (t *handleTable) Len() int {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	return len(t.handles)
+}
+
+// Number of lookups of unknown or stale handles
+func (t *handleTable) Misses() uint64 {
+	return atomic.LoadUint64(&t.misses)
+}
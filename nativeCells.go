@@ -0,0 +1,243 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"math"
+	"strconv"
+	"sync/atomic"
+	"unsafe"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * NATIVE CELL COLLECTOR
+ * =========================================================================== */
+// Collector for metrics whose values live in "C-land" memory, as an array of
+// (typically cache-line-padded) 64-bit cells. The C/C++ side updates its
+// cells with plain atomics and never calls into Go; we only read and sum the
+// cells here, when the registry is gathered during a scrape.
+// The cell memory is owned by "C-land" and must outlive the collector (i.e.
+// it must never be freed, since collectors are never unregistered).
+type nativeCellCollector struct {
+	desc    *prometheus.Desc
+	valType prometheus.ValueType
+	cells   unsafe.Pointer // Address of the first cell
+	nCells  uintptr
+	stride  uintptr // Distance, in bytes, between consecutive cells
+	isInt   bool    // Cells hold uint64 values, rather than float64 bits
+}
+
+func (c *nativeCellCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *nativeCellCollector) Collect(ch chan<- prometheus.Metric) {
+	ch <- prometheus.MustNewConstMetric(c.desc, c.valType, c.sum())
+}
+
+// Sums all cells. Each cell is loaded atomically so a concurrent update in
+// "C-land" can never be observed half-written.
+func (c *nativeCellCollector) sum() float64 {
+	var fSum float64
+	var iSum uint64
+	for i := uintptr(0); i < c.nCells; i++ {
+		bits := atomic.LoadUint64((*uint64)(unsafe.Pointer(uintptr(c.cells) + i*c.stride)))
+		if c.isInt {
+			iSum += bits
+		} else {
+			fSum += math.Float64frombits(bits)
+		}
+	}
+
+	if c.isInt {
+		return float64(iSum)
+	}
+
+	return fSum
+}
+
+func registerNativeCells(name, help string, valType prometheus.ValueType,
+	cells unsafe.Pointer, nCells, stride uint32, isInt bool) {
+
+	if cells == nil || nCells == 0 {
+		panic("Invalid cell array for native metric")
+	}
+
+	prometheus.MustRegister(&nativeCellCollector{
+		desc:    prometheus.NewDesc(stringCopy(name), stringCopy(help), nil, nil),
+		valType: valType,
+		cells:   cells,
+		nCells:  uintptr(nCells),
+		stride:  uintptr(stride),
+		isInt:   isInt,
+	})
+	trackFamily(stringCopy(name), 1)
+}
+
+/* ===========================================================================
+ * PER-PROCESS CELL COLLECTOR
+ * =========================================================================== */
+// Collector for metrics whose cells live in memory shared by several
+// processes (see SharedMetrics in promClient.h), laid out as a slab per
+// process. Each slab starts with the int64 pid of the process owning it (0
+// if none, negative while it's being claimed or released), and the metric's
+// cell is at the same offset in every slab. Each owned slab's cell is
+// exported as a series labeled with its pid.
+type nativePerProcessCollector struct {
+	desc    *prometheus.Desc
+	valType prometheus.ValueType
+	slabs   unsafe.Pointer // Address of the first slab
+	nSlabs  uintptr
+	stride  uintptr // Distance, in bytes, between consecutive slabs
+	offset  uintptr // Of the cell, within each slab
+}
+
+func (c *nativePerProcessCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *nativePerProcessCollector) Collect(ch chan<- prometheus.Metric) {
+	for i := uintptr(0); i < c.nSlabs; i++ {
+		pid := atomic.LoadInt64((*int64)(unsafe.Pointer(uintptr(c.slabs) + i*c.stride)))
+		if pid <= 0 {
+			continue
+		}
+
+		bits := atomic.LoadUint64((*uint64)(unsafe.Pointer(uintptr(c.slabs) + i*c.stride + c.offset)))
+		ch <- prometheus.MustNewConstMetric(c.desc, c.valType, math.Float64frombits(bits),
+			strconv.FormatInt(pid, 10))
+	}
+}
+
+/* ===========================================================================
+ * NATIVE HISTOGRAM COLLECTOR
+ * =========================================================================== */
+// Collector for histograms whose bucket counts live in "C-land" memory, split
+// into per-thread shards. Each shard is laid out as len(bounds)+1 uint64
+// bucket counts (non-cumulative, the last one being the +Inf bucket),
+// followed by the float64 bits of the shard's sum of observations.
+// Shards are summed and made cumulative only when the registry is gathered.
+// NOTE: Counts and sums are read without a snapshot, so a scrape concurrent
+//       with observations may see a sum that's off by the in-flight values.
+type nativeHistogramCollector struct {
+	desc    *prometheus.Desc
+	bounds  []float64 // Upper bounds, excluding +Inf
+	cells   unsafe.Pointer
+	nShards uintptr
+	stride  uintptr // Distance, in bytes, between consecutive shards
+}
+
+func (c *nativeHistogramCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *nativeHistogramCollector) Collect(ch chan<- prometheus.Metric) {
+	nBuckets := uintptr(len(c.bounds)) + 1
+	counts := make([]uint64, nBuckets)
+	var sum float64
+
+	for s := uintptr(0); s < c.nShards; s++ {
+		shard := s * c.stride
+		for i := uintptr(0); i < nBuckets; i++ {
+			counts[i] += atomic.LoadUint64((*uint64)(unsafe.Pointer(uintptr(c.cells) + shard + i*8)))
+		}
+		sum += math.Float64frombits(atomic.LoadUint64(
+			(*uint64)(unsafe.Pointer(uintptr(c.cells) + shard + nBuckets*8))))
+	}
+
+	buckets := make(map[float64]uint64, len(c.bounds))
+	var cumCount uint64
+	for i, bound := range c.bounds {
+		cumCount += counts[i]
+		buckets[bound] = cumCount
+	}
+	cumCount += counts[nBuckets-1]
+
+	ch <- prometheus.MustNewConstHistogram(c.desc, cumCount, sum, buckets)
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Each cell holds the bits of a float64; the counter's value is their sum.
+//export goNewNativeCounter
+func goNewNativeCounter(name, help string, cells unsafe.Pointer, nCells, stride uint32) {
+	countCall(callNew)
+	registerNativeCells(name, help, prometheus.CounterValue, cells, nCells, stride, false)
+}
+
+// Each cell holds a uint64; the counter's value is their sum.
+//export goNewNativeIntCounter
+func goNewNativeIntCounter(name, help string, cells unsafe.Pointer, nCells, stride uint32) {
+	countCall(callNew)
+	registerNativeCells(name, help, prometheus.CounterValue, cells, nCells, stride, true)
+}
+
+// Each cell holds the bits of a float64; the gauge's value is their sum.
+//export goNewNativeGauge
+func goNewNativeGauge(name, help string, cells unsafe.Pointer, nCells, stride uint32) {
+	countCall(callNew)
+	registerNativeCells(name, help, prometheus.GaugeValue, cells, nCells, stride, false)
+}
+
+// The cell layout of each shard is described by nativeHistogramCollector
+//export goNewNativeHistogram
+func goNewNativeHistogram(name, help string, bounds []float64, cells unsafe.Pointer, nShards, stride uint32) {
+	countCall(callNew)
+	if cells == nil || nShards == 0 || uintptr(stride) < (uintptr(len(bounds))+2)*8 {
+		panic("Invalid cell array for native histogram")
+	}
+
+	prometheus.MustRegister(&nativeHistogramCollector{
+		desc:    prometheus.NewDesc(stringCopy(name), stringCopy(help), nil, nil),
+		bounds:  bucketsCopy(bounds),
+		cells:   cells,
+		nShards: uintptr(nShards),
+		stride:  uintptr(stride),
+	})
+	trackFamily(stringCopy(name), 1)
+}
+
+// Cells hold the bits of float64s; their layout is described by
+// nativePerProcessCollector
+//export goNewNativePerProcess
+func goNewNativePerProcess(name, help string, isGauge bool, slabs unsafe.Pointer,
+	nSlabs, slabSize, offset uint32) {
+
+	countCall(callNew)
+	if slabs == nil || nSlabs == 0 || offset < 8 || offset+8 > slabSize {
+		panic("Invalid slab array for per-process metric")
+	}
+
+	valType := prometheus.CounterValue
+	if isGauge {
+		valType = prometheus.GaugeValue
+	}
+
+	prometheus.MustRegister(&nativePerProcessCollector{
+		desc:    prometheus.NewDesc(stringCopy(name), stringCopy(help), []string{"pid"}, nil),
+		valType: valType,
+		slabs:   slabs,
+		nSlabs:  uintptr(nSlabs),
+		stride:  uintptr(slabSize),
+		offset:  uintptr(offset),
+	})
+	trackFamily(stringCopy(name), 1)
+}
@@ -0,0 +1,73 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+/*
+#include <stdint.h>
+
+// Calls a NativeSummaryFn (see promClient.h)
+static inline void callNativeSummaryFn(void* fn, void* ctx, const double* quantiles,
+        int nQuantiles, double* values, uint64_t* count, double* sum) {
+    ((void (*)(void*, const double*, int, double*, uint64_t*, double*))fn)(
+        ctx, quantiles, nQuantiles, values, count, sum);
+}
+*/
+import "C"
+
+import (
+	"unsafe"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * NATIVE SUMMARY COLLECTOR
+ * =========================================================================== */
+// Collector for summaries whose state lives in "C-land" (e.g. a sketch).
+// Unlike the native cell collectors, the layout isn't known here: at scrape
+// time, a C callback computes the quantile estimates, count and sum.
+// NOTE: This file has no //export'ed functions, so its preamble may define
+//       functions without them ending up in libpromclient.h.
+type nativeSummaryCollector struct {
+	desc      *prometheus.Desc
+	quantiles []float64
+	fn        unsafe.Pointer // NativeSummaryFn
+	ctx       unsafe.Pointer
+}
+
+func (c *nativeSummaryCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.desc
+}
+
+func (c *nativeSummaryCollector) Collect(ch chan<- prometheus.Metric) {
+	values := make([]float64, len(c.quantiles))
+	var count C.uint64_t
+	var sum C.double
+
+	var pQuantiles, pValues *C.double
+	if len(c.quantiles) > 0 {
+		pQuantiles = (*C.double)(&c.quantiles[0])
+		pValues = (*C.double)(&values[0])
+	}
+	C.callNativeSummaryFn(c.fn, c.ctx, pQuantiles, C.int(len(c.quantiles)), pValues, &count, &sum)
+
+	quantiles := make(map[float64]float64, len(c.quantiles))
+	for i, q := range c.quantiles {
+		quantiles[q] = values[i]
+	}
+
+	ch <- prometheus.MustNewConstSummary(c.desc, uint64(count), float64(sum), quantiles)
+}
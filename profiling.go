@@ -0,0 +1,151 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"fmt"
+	"net/http/pprof"
+	"os"
+	"path/filepath"
+	"runtime"
+	runtimePprof "runtime/pprof"
+	"sync"
+	"time"
+)
+
+/* ===========================================================================
+ * PROFILING
+ * =========================================================================== */
+// Opt-in profiling of the exporter side (cgo transitions, GC, gathers) under
+// real load. Go's pprof handlers can be mounted on a metrics endpoint's
+// server, and profiles can be written to files from "C-land", for hosts
+// where no debug port may be exposed.
+// NOTE: Mutex and block profiles are empty unless their rates are set.
+const pprofPath = "/debug/pprof/"
+
+var cpuProfileMu sync.Mutex // Serializes starting and stopping CPU profiles
+var cpuProfileRunning bool  // Guarded by cpuProfileMu
+
+// Profiles are written to a temporary file next to path, and only renamed
+// over path once complete, so that failures never clobber an existing file
+func createProfileFile(path string) (*os.File, error) {
+	return os.CreateTemp(filepath.Dir(path), filepath.Base(path)+".*.tmp")
+}
+
+// Closes f and renames it to path if err is nil, or removes it otherwise.
+// Returns the first error.
+func commitProfileFile(f *os.File, path string, err error) error {
+	if closeErr := f.Close(); err == nil {
+		err = closeErr
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), path)
+	}
+	if err != nil {
+		os.Remove(f.Name())
+	}
+
+	return err
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Mounts the pprof handlers at /debug/pprof/ on the server of promEndpoint,
+// starting it if it isn't running yet
+//export goStartPprofHandler
+func goStartPprofHandler(promEndpoint string) {
+	mux := promMux(stringCopy(promEndpoint), 0, 0)
+	mux.HandleFunc(pprofPath, pprof.Index)
+	mux.HandleFunc(pprofPath+"cmdline", pprof.Cmdline)
+	mux.HandleFunc(pprofPath+"profile", pprof.Profile)
+	mux.HandleFunc(pprofPath+"symbol", pprof.Symbol)
+	mux.HandleFunc(pprofPath+"trace", pprof.Trace)
+}
+
+// On average, one in 'rate' mutex contention events is sampled (0 disables
+// sampling). Returns the previous rate.
+//export goSetMutexProfileFraction
+func goSetMutexProfileFraction(rate int32) int32 {
+	return int32(runtime.SetMutexProfileFraction(int(rate)))
+}
+
+// On average, one blocking event per 'rate' nanoseconds spent blocked is
+// sampled (0 disables sampling)
+//export goSetBlockProfileRate
+func goSetBlockProfileRate(rate int32) {
+	runtime.SetBlockProfileRate(int(rate))
+}
+
+// Profiles the CPU for durationMs in the background, then writes the
+// profile to path. Returns -1 if the file can't be created or a CPU
+// profile is already running, leaving path untouched.
+//export goStartCPUProfile
+func goStartCPUProfile(path string, durationMs uint32) int32 {
+	cpuProfileMu.Lock()
+	defer cpuProfileMu.Unlock()
+	if cpuProfileRunning {
+		return -1
+	}
+
+	path = stringCopy(path)
+	f, err := createProfileFile(path)
+	if err != nil {
+		return -1
+	}
+	if err := runtimePprof.StartCPUProfile(f); err != nil {
+		commitProfileFile(f, path, err)
+		return -1
+	}
+	cpuProfileRunning = true
+
+	go func() {
+		time.Sleep(time.Duration(durationMs) * time.Millisecond)
+
+		cpuProfileMu.Lock()
+		defer cpuProfileMu.Unlock()
+		runtimePprof.StopCPUProfile()
+		cpuProfileRunning = false
+		if err := commitProfileFile(f, path, nil); err != nil {
+			fmt.Fprintf(os.Stderr, "easyprom: writing CPU profile to %s failed: %v\n", path, err)
+		}
+	}()
+
+	return 0
+}
+
+// Writes the named profile ("heap", "goroutine", "mutex", "block", etc.) to
+// path, returning -1 if the profile doesn't exist or can't be written
+//export goWriteProfile
+func goWriteProfile(name, path string) int32 {
+	profile := runtimePprof.Lookup(name)
+	if profile == nil {
+		return -1
+	}
+
+	path = stringCopy(path)
+	f, err := createProfileFile(path)
+	if err != nil {
+		return -1
+	}
+	if err := commitProfileFile(f, path, profile.WriteTo(f, 0)); err != nil {
+		return -1
+	}
+
+	return 0
+}
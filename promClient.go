@@ -18,12 +18,9 @@ package main
 import "C"
 
 import (
-	"net/http"
-	"reflect"
 	"time"
 
 	"github.com/prometheus/client_golang/prometheus"
-	"github.com/prometheus/client_golang/prometheus/promauto"
 	"github.com/prometheus/client_golang/prometheus/promhttp"
 )
 
@@ -31,17 +28,18 @@ var (
 	// Since we're allocating in "Go-land" and passing "pointers" back to
 	// "C-land", there's the risk that the Go GC will reap the Go objects.
 	// To avoid this, we keep a handle in Go-land to all objects created.
-	// Note that the "pointers" we pass back are raw unsigned integers,
-	// essentially a unique ID to the object (same concept as pointer).
+	// Note that the "pointers" we pass back are not real pointers, but
+	// handles into these tables (see handleTable.go), which are safe to
+	// read concurrently from any number of threads.
 	// Use a separate function for explicit deletion of objects.
-	gaugeHandles      = make(map[uintptr]prometheus.Gauge)
-	gaugeVecHandles   = make(map[uintptr]*prometheus.GaugeVec)
-	counterHandles    = make(map[uintptr]prometheus.Counter)
-	counterVecHandles = make(map[uintptr]*prometheus.CounterVec)
-	//histogramHandles    = make(map[uintptr]prometheus.Histogram)
-	//histogramVecHandles = make(map[uintptr]*prometheus.HistogramVec)
-	summaryHandles    = make(map[uintptr]prometheus.Observer)
-	summaryVecHandles = make(map[uintptr]*prometheus.SummaryVec)
+	gaugeHandles        = newHandleTable("gauge")
+	gaugeVecHandles     = newHandleTable("gauge_vec")
+	counterHandles      = newHandleTable("counter")
+	counterVecHandles   = newHandleTable("counter_vec")
+	histogramHandles    = newHandleTable("histogram")
+	histogramVecHandles = newHandleTable("histogram_vec")
+	summaryHandles      = newHandleTable("summary")
+	summaryVecHandles   = newHandleTable("summary_vec")
 )
 
 /* ===========================================================================
@@ -103,29 +101,39 @@ func makeObjectives(quantiles, errors []float64) map[float64]float64 {
  * =========================================================================== */
 //export goStartPromHandler
 func goStartPromHandler(promEndpoint, metricsPath string) {
-	http.Handle(stringCopy(metricsPath), promhttp.Handler())
-	go http.ListenAndServe(stringCopy(promEndpoint), nil)
+	promMux(stringCopy(promEndpoint), 0, 0).Handle(stringCopy(metricsPath),
+		instrumentScrapes(promhttp.Handler()))
 }
 
 //export goNewGauge
 func goNewGauge(name, help string) uintptr {
-	gauge := promauto.NewGauge(prometheus.GaugeOpts{
+	countCall(callNew)
+	return newGauge(nil, name, help)
+}
+
+func newGauge(r *registry, name, help string) uintptr {
+	gauge := r.factory(name).NewGauge(prometheus.GaugeOpts{
 		Name: stringCopy(name),
 		Help: stringCopy(help),
 	})
 
-	gaugeHandles[reflect.ValueOf(gauge).Pointer()] = gauge
+	trackFamily(stringCopy(name), 1)
 
-	return reflect.ValueOf(gauge).Pointer()
+	return gaugeHandles.Put(gauge)
 }
 
 //export goNewGaugeVec
 func goNewGaugeVec(name, help string, labels []string) uintptr {
+	countCall(callNew)
+	return newGaugeVec(nil, name, help, labels)
+}
+
+func newGaugeVec(r *registry, name, help string, labels []string) uintptr {
 	// Since the labels slice was created in C, its pointers may not be
 	// valid after this call. Thus, perform deep copy of labels.
 	labelsCopy := make([]string, len(labels))
 	stringSliceCopy(labelsCopy, labels)
-	gaugeVec := promauto.NewGaugeVec(
+	gaugeVec := r.factory(name).NewGaugeVec(
 		prometheus.GaugeOpts{
 			Name: stringCopy(name),
 			Help: stringCopy(help),
@@ -133,22 +141,29 @@ func goNewGaugeVec(name, help string, labels []string) uintptr {
 		labelsCopy,
 	)
 
-	gaugeVecHandles[reflect.ValueOf(gaugeVec).Pointer()] = gaugeVec
+	h := gaugeVecHandles.Put(gaugeVec)
+	trackVecFamily(h, stringCopy(name))
 
-	return reflect.ValueOf(gaugeVec).Pointer()
+	return h
 }
 
 //export goGaugeWithLabelValues
 func goGaugeWithLabelValues(uPtrGaugeVec uintptr, labelVals []string) uintptr {
+	countCall(callWithLabelValues)
 	// Since the labelVals slice was created in C, its pointers may not be
 	// valid after this call. Thus, perform deep copy of labelVals.
 	labelValsCopy := make([]string, len(labelVals))
 	stringSliceCopy(labelValsCopy, labelVals)
-	if gaugeVec, ok := gaugeVecHandles[uPtrGaugeVec]; ok {
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		if limits := limitsOf(gaugeVec); limits != nil {
+			return limits.withLabelValues(labelValsCopy)
+		}
 		gauge := gaugeVec.WithLabelValues(labelValsCopy...)
-		gaugeHandles[reflect.ValueOf(gauge).Pointer()] = gauge
-
-		return reflect.ValueOf(gauge).Pointer()
+		h, isNew := gaugeHandles.PutNew(gauge)
+		if isNew {
+			addVecSeries(uPtrGaugeVec, 1)
+		}
+		return h
 	}
 
 	return 0
@@ -156,53 +171,100 @@ func goGaugeWithLabelValues(uPtrGaugeVec uintptr, labelVals []string) uintptr {
 
 //export goGaugeDeleteLabelValues
 func goGaugeDeleteLabelValues(uPtrGaugeVec uintptr, labelVals []string) {
-	if gaugeVec, ok := gaugeVecHandles[uPtrGaugeVec]; ok {
-		gauge := gaugeVec.WithLabelValues(labelVals...)
-		delete(gaugeHandles, reflect.ValueOf(gauge).Pointer())
-		gaugeVec.DeleteLabelValues(labelVals...)
+	countCall(callDeleteLabelValues)
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		if limits := limitsOf(gaugeVec); limits != nil {
+			limits.deleteLabelValues(labelVals)
+			return
+		}
+		// Looking the child up creates it if it doesn't exist, in which
+		// case the Vec may briefly hold it: copy the label values, as for
+		// creation. Delete() avoids both, given the child's handle.
+		labelValsCopy := make([]string, len(labelVals))
+		stringSliceCopy(labelValsCopy, labelVals)
+		gauge := gaugeVec.WithLabelValues(labelValsCopy...)
+		if gaugeHandles.DeleteObj(gauge) {
+			addVecSeries(uPtrGaugeVec, -1)
+		}
+		gaugeVec.DeleteLabelValues(labelValsCopy...)
 	}
 }
 
 //export goGaugeSet
 func goGaugeSet(uPtrGauge uintptr, val float64) {
-	if gauge, ok := gaugeHandles[uPtrGauge]; ok {
+	countCall(callGaugeSet)
+	if gauge, ok := gaugeHandles.Get(uPtrGauge).(prometheus.Gauge); ok {
 		gauge.Set(val)
 	}
 }
 
 //export goGaugeAdd
 func goGaugeAdd(uPtrGauge uintptr, val float64) {
-	if gauge, ok := gaugeHandles[uPtrGauge]; ok {
+	countCall(callGaugeAdd)
+	if gauge, ok := gaugeHandles.Get(uPtrGauge).(prometheus.Gauge); ok {
 		gauge.Add(val)
 	}
 }
 
 //export goGaugeSub
 func goGaugeSub(uPtrGauge uintptr, val float64) {
-	if gauge, ok := gaugeHandles[uPtrGauge]; ok {
+	countCall(callGaugeSub)
+	if gauge, ok := gaugeHandles.Get(uPtrGauge).(prometheus.Gauge); ok {
 		gauge.Sub(val)
 	}
 }
 
+// Batched variants: one call from "C-land" applies every value, amortizing
+// the cost of crossing into Go. uPtrGauges[i] is updated with vals[i].
+//export goGaugeSetBatch
+func goGaugeSetBatch(uPtrGauges []uintptr, vals []float64) {
+	countCall(callBatch)
+	for i := 0; i < len(uPtrGauges) && i < len(vals); i++ {
+		if gauge, ok := gaugeHandles.Get(uPtrGauges[i]).(prometheus.Gauge); ok {
+			gauge.Set(vals[i])
+		}
+	}
+}
+
+//export goGaugeAddBatch
+func goGaugeAddBatch(uPtrGauges []uintptr, vals []float64) {
+	countCall(callBatch)
+	for i := 0; i < len(uPtrGauges) && i < len(vals); i++ {
+		if gauge, ok := gaugeHandles.Get(uPtrGauges[i]).(prometheus.Gauge); ok {
+			gauge.Add(vals[i])
+		}
+	}
+}
+
 //export goNewCounter
 func goNewCounter(name, help string) uintptr {
-	counter := promauto.NewCounter(prometheus.CounterOpts{
+	countCall(callNew)
+	return newCounter(nil, name, help)
+}
+
+func newCounter(r *registry, name, help string) uintptr {
+	counter := r.factory(name).NewCounter(prometheus.CounterOpts{
 		Name: stringCopy(name),
 		Help: stringCopy(help),
 	})
 
-	counterHandles[reflect.ValueOf(counter).Pointer()] = counter
+	trackFamily(stringCopy(name), 1)
 
-	return reflect.ValueOf(counter).Pointer()
+	return counterHandles.Put(counter)
 }
 
 //export goNewCounterVec
 func goNewCounterVec(name, help string, labels []string) uintptr {
+	countCall(callNew)
+	return newCounterVec(nil, name, help, labels)
+}
+
+func newCounterVec(r *registry, name, help string, labels []string) uintptr {
 	// Since the labels slice was created in C, its pointers may not be
 	// valid after this call. Thus, perform deep copy of labels.
 	labelsCopy := make([]string, len(labels))
 	stringSliceCopy(labelsCopy, labels)
-	counterVec := promauto.NewCounterVec(
+	counterVec := r.factory(name).NewCounterVec(
 		prometheus.CounterOpts{
 			Name: stringCopy(name),
 			Help: stringCopy(help),
@@ -210,22 +272,29 @@ func goNewCounterVec(name, help string, labels []string) uintptr {
 		labelsCopy,
 	)
 
-	counterVecHandles[reflect.ValueOf(counterVec).Pointer()] = counterVec
+	h := counterVecHandles.Put(counterVec)
+	trackVecFamily(h, stringCopy(name))
 
-	return reflect.ValueOf(counterVec).Pointer()
+	return h
 }
 
 //export goCounterWithLabelValues
 func goCounterWithLabelValues(uPtrCounterVec uintptr, labelVals []string) uintptr {
+	countCall(callWithLabelValues)
 	// Since the labelVals slice was created in C, its pointers may not be
 	// valid after this call. Thus, perform deep copy of labelVals.
 	labelValsCopy := make([]string, len(labelVals))
 	stringSliceCopy(labelValsCopy, labelVals)
-	if counterVec, ok := counterVecHandles[uPtrCounterVec]; ok {
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		if limits := limitsOf(counterVec); limits != nil {
+			return limits.withLabelValues(labelValsCopy)
+		}
 		counter := counterVec.WithLabelValues(labelValsCopy...)
-		counterHandles[reflect.ValueOf(counter).Pointer()] = counter
-
-		return reflect.ValueOf(counter).Pointer()
+		h, isNew := counterHandles.PutNew(counter)
+		if isNew {
+			addVecSeries(uPtrCounterVec, 1)
+		}
+		return h
 	}
 
 	return 0
@@ -233,33 +302,179 @@ func goCounterWithLabelValues(uPtrCounterVec uintptr, labelVals []string) uintpt
 
 //export goCounterDeleteLabelValues
 func goCounterDeleteLabelValues(uPtrCounterVec uintptr, labelVals []string) {
-	if counterVec, ok := counterVecHandles[uPtrCounterVec]; ok {
-		counter := counterVec.WithLabelValues(labelVals...)
-		delete(counterHandles, reflect.ValueOf(counter).Pointer())
-		counterVec.DeleteLabelValues(labelVals...)
+	countCall(callDeleteLabelValues)
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		if limits := limitsOf(counterVec); limits != nil {
+			limits.deleteLabelValues(labelVals)
+			return
+		}
+		// Looking the child up creates it if it doesn't exist, in which
+		// case the Vec may briefly hold it: copy the label values, as for
+		// creation. Delete() avoids both, given the child's handle.
+		labelValsCopy := make([]string, len(labelVals))
+		stringSliceCopy(labelValsCopy, labelVals)
+		counter := counterVec.WithLabelValues(labelValsCopy...)
+		if counterHandles.DeleteObj(counter) {
+			addVecSeries(uPtrCounterVec, -1)
+		}
+		counterVec.DeleteLabelValues(labelValsCopy...)
 	}
 }
 
 //export goCounterAdd
 func goCounterAdd(uPtrCounter uintptr, val float64) {
-	if counter, ok := counterHandles[uPtrCounter]; ok {
+	countCall(callCounterAdd)
+	if counter, ok := counterHandles.Get(uPtrCounter).(prometheus.Counter); ok {
 		counter.Add(val)
 	}
 }
 
+// uPtrCounters[i] is incremented by vals[i]
+//export goCounterAddBatch
+func goCounterAddBatch(uPtrCounters []uintptr, vals []float64) {
+	countCall(callBatch)
+	for i := 0; i < len(uPtrCounters) && i < len(vals); i++ {
+		if counter, ok := counterHandles.Get(uPtrCounters[i]).(prometheus.Counter); ok {
+			counter.Add(vals[i])
+		}
+	}
+}
+
+// Used to copy the buckets of Histogram metrics out of "C-land" memory.
+// An empty slice means the Prometheus default buckets.
+func bucketsCopy(buckets []float64) []float64 {
+	if len(buckets) == 0 {
+		return nil
+	}
+
+	cpy := make([]float64, len(buckets))
+	copy(cpy, buckets)
+
+	return cpy
+}
+
 //export goNewHistogram
+func goNewHistogram(name, help string, buckets []float64) uintptr {
+	countCall(callNew)
+	return newHistogram(nil, name, help, buckets)
+}
+
+func newHistogram(r *registry, name, help string, buckets []float64) uintptr {
+	histogram := r.factory(name).NewHistogram(prometheus.HistogramOpts{
+		Name:    stringCopy(name),
+		Help:    stringCopy(help),
+		Buckets: bucketsCopy(buckets),
+	})
+
+	trackFamily(stringCopy(name), 1)
+
+	return histogramHandles.Put(histogram)
+}
+
 //export goNewHistogramVec
+func goNewHistogramVec(name, help string, labels []string, buckets []float64) uintptr {
+	countCall(callNew)
+	return newHistogramVec(nil, name, help, labels, buckets)
+}
+
+func newHistogramVec(r *registry, name, help string, labels []string, buckets []float64) uintptr {
+	// Since the labels slice was created in C, its pointers may not be
+	// valid after this call. Thus, perform deep copy of labels.
+	labelsCopy := make([]string, len(labels))
+	stringSliceCopy(labelsCopy, labels)
+	histogramVec := r.factory(name).NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name:    stringCopy(name),
+			Help:    stringCopy(help),
+			Buckets: bucketsCopy(buckets),
+		},
+		labelsCopy,
+	)
+
+	h := histogramVecHandles.Put(histogramVec)
+	trackVecFamily(h, stringCopy(name))
+
+	return h
+}
+
+//export goHistogramWithLabelValues
+func goHistogramWithLabelValues(uPtrHistogramVec uintptr, labelVals []string) uintptr {
+	countCall(callWithLabelValues)
+	// Since the labelVals slice was created in C, its pointers may not be
+	// valid after this call. Thus, perform deep copy of labelVals.
+	labelValsCopy := make([]string, len(labelVals))
+	stringSliceCopy(labelValsCopy, labelVals)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		if limits := limitsOf(histogramVec); limits != nil {
+			return limits.withLabelValues(labelValsCopy)
+		}
+		histogram := histogramVec.WithLabelValues(labelValsCopy...)
+		h, isNew := histogramHandles.PutNew(histogram)
+		if isNew {
+			addVecSeries(uPtrHistogramVec, 1)
+		}
+		return h
+	}
+
+	return 0
+}
+
+//export goHistogramDeleteLabelValues
+func goHistogramDeleteLabelValues(uPtrHistogramVec uintptr, labelVals []string) {
+	countCall(callDeleteLabelValues)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		if limits := limitsOf(histogramVec); limits != nil {
+			limits.deleteLabelValues(labelVals)
+			return
+		}
+		// Looking the child up creates it if it doesn't exist, in which
+		// case the Vec may briefly hold it: copy the label values, as for
+		// creation. Delete() avoids both, given the child's handle.
+		labelValsCopy := make([]string, len(labelVals))
+		stringSliceCopy(labelValsCopy, labelVals)
+		histogram := histogramVec.WithLabelValues(labelValsCopy...)
+		if histogramHandles.DeleteObj(histogram) {
+			addVecSeries(uPtrHistogramVec, -1)
+		}
+		histogramVec.DeleteLabelValues(labelValsCopy...)
+	}
+}
+
 //export goHistogramObserve
+func goHistogramObserve(uPtrHistogram uintptr, val float64) {
+	countCall(callHistogramObserve)
+	if histogram, ok := histogramHandles.Get(uPtrHistogram).(prometheus.Observer); ok {
+		histogram.Observe(val)
+	}
+}
+
+// All values are observed by the same histogram, so it's only looked up once
+//export goHistogramObserveBatch
+func goHistogramObserveBatch(uPtrHistogram uintptr, vals []float64) {
+	countCall(callBatch)
+	if histogram, ok := histogramHandles.Get(uPtrHistogram).(prometheus.Observer); ok {
+		for _, val := range vals {
+			histogram.Observe(val)
+		}
+	}
+}
 
 // Specify maxAge in seconds
 //export goNewSummary
 func goNewSummary(name, help string, quantiles, errors []float64, maxAge, nAgeBkts uint32) uintptr {
+	countCall(callNew)
+	return newSummary(nil, name, help, quantiles, errors, maxAge, nAgeBkts)
+}
+
+func newSummary(r *registry, name, help string, quantiles, errors []float64,
+	maxAge, nAgeBkts uint32) uintptr {
+
 	obj := makeObjectives(quantiles, errors)
 	if obj == nil {
 		panic("Unable to make objectives map for Summary")
 	}
 
-	summary := promauto.NewSummary(prometheus.SummaryOpts{
+	summary := r.factory(name).NewSummary(prometheus.SummaryOpts{
 		Name:       stringCopy(name),
 		Help:       stringCopy(help),
 		Objectives: obj,
@@ -267,15 +482,22 @@ func goNewSummary(name, help string, quantiles, errors []float64, maxAge, nAgeBk
 		AgeBuckets: nAgeBkts,
 	})
 
-	summaryHandles[reflect.ValueOf(summary).Pointer()] = summary
+	trackFamily(stringCopy(name), 1)
 
-	return reflect.ValueOf(summary).Pointer()
+	return summaryHandles.Put(summary)
 }
 
 //export goNewSummaryVec
 func goNewSummaryVec(name, help string, labels []string,
 	quantiles, errors []float64, maxAge, nAgeBkts uint32) uintptr {
 
+	countCall(callNew)
+	return newSummaryVec(nil, name, help, labels, quantiles, errors, maxAge, nAgeBkts)
+}
+
+func newSummaryVec(r *registry, name, help string, labels []string,
+	quantiles, errors []float64, maxAge, nAgeBkts uint32) uintptr {
+
 	obj := makeObjectives(quantiles, errors)
 	if obj == nil {
 		panic("Unable to make objectives map for Summary")
@@ -285,7 +507,7 @@ func goNewSummaryVec(name, help string, labels []string,
 	// valid after this call. Thus, perform deep copy of labels.
 	labelsCopy := make([]string, len(labels))
 	stringSliceCopy(labelsCopy, labels)
-	summaryVec := promauto.NewSummaryVec(
+	summaryVec := r.factory(name).NewSummaryVec(
 		prometheus.SummaryOpts{
 			Name:       stringCopy(name),
 			Help:       stringCopy(help),
@@ -296,22 +518,29 @@ func goNewSummaryVec(name, help string, labels []string,
 		labelsCopy,
 	)
 
-	summaryVecHandles[reflect.ValueOf(summaryVec).Pointer()] = summaryVec
+	h := summaryVecHandles.Put(summaryVec)
+	trackVecFamily(h, stringCopy(name))
 
-	return reflect.ValueOf(summaryVec).Pointer()
+	return h
 }
 
 //export goSummaryWithLabelValues
 func goSummaryWithLabelValues(uPtrSummaryVec uintptr, labelVals []string) uintptr {
+	countCall(callWithLabelValues)
 	// Since the labelVals slice was created in C, its pointers may not be
 	// valid after this call. Thus, perform deep copy of labelVals.
 	labelValsCopy := make([]string, len(labelVals))
 	stringSliceCopy(labelValsCopy, labelVals)
-	if summaryVec, ok := summaryVecHandles[uPtrSummaryVec]; ok {
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		if limits := limitsOf(summaryVec); limits != nil {
+			return limits.withLabelValues(labelValsCopy)
+		}
 		summary := summaryVec.WithLabelValues(labelValsCopy...)
-		summaryHandles[reflect.ValueOf(summary).Pointer()] = summary
-
-		return reflect.ValueOf(summary).Pointer()
+		h, isNew := summaryHandles.PutNew(summary)
+		if isNew {
+			addVecSeries(uPtrSummaryVec, 1)
+		}
+		return h
 	}
 
 	return 0
@@ -319,18 +548,129 @@ func goSummaryWithLabelValues(uPtrSummaryVec uintptr, labelVals []string) uintpt
 
 //export goSummaryDeleteLabelValues
 func goSummaryDeleteLabelValues(uPtrSummaryVec uintptr, labelVals []string) {
-	if summaryVec, ok := summaryVecHandles[uPtrSummaryVec]; ok {
-		summary := summaryVec.WithLabelValues(labelVals...)
-		delete(summaryHandles, reflect.ValueOf(summary).Pointer())
-		summaryVec.DeleteLabelValues(labelVals...)
+	countCall(callDeleteLabelValues)
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		if limits := limitsOf(summaryVec); limits != nil {
+			limits.deleteLabelValues(labelVals)
+			return
+		}
+		// Looking the child up creates it if it doesn't exist, in which
+		// case the Vec may briefly hold it: copy the label values, as for
+		// creation. Delete() avoids both, given the child's handle.
+		labelValsCopy := make([]string, len(labelVals))
+		stringSliceCopy(labelValsCopy, labelVals)
+		summary := summaryVec.WithLabelValues(labelValsCopy...)
+		if summaryHandles.DeleteObj(summary) {
+			addVecSeries(uPtrSummaryVec, -1)
+		}
+		summaryVec.DeleteLabelValues(labelValsCopy...)
 	}
 }
 
 //export goSummaryObserve
 func goSummaryObserve(uPtrSummary uintptr, val float64) {
-	if summary, ok := summaryHandles[uPtrSummary]; ok {
+	countCall(callSummaryObserve)
+	if summary, ok := summaryHandles.Get(uPtrSummary).(prometheus.Observer); ok {
 		summary.Observe(val)
 	}
 }
 
+// All values are observed by the same summary, so it's only looked up once
+//export goSummaryObserveBatch
+func goSummaryObserveBatch(uPtrSummary uintptr, vals []float64) {
+	countCall(callBatch)
+	if summary, ok := summaryHandles.Get(uPtrSummary).(prometheus.Observer); ok {
+		for _, val := range vals {
+			summary.Observe(val)
+		}
+	}
+}
+
+// Kinds of the metrics created by goNewMetrics. These must match the
+// EASYPROM_KIND_* values in promClient.h.
+const (
+	kindGauge = iota
+	kindGaugeVec
+	kindCounter
+	kindCounterVec
+	kindHistogram
+	kindHistogramVec
+)
+
+// Creates len(kinds) metrics in a single call, storing their handles in
+// handles (which is in "C-land" memory). The i'th metric takes the next
+// nLabels[i] entries of labels and the next nBuckets[i] entries of buckets.
+//export goNewMetrics
+func goNewMetrics(kinds []uint8, names, helps []string, nLabels []uint32, labels []string,
+	nBuckets []uint32, buckets []float64, handles []uintptr) {
+
+	countCall(callNew)
+	for i, kind := range kinds {
+		metricLabels := labels[:nLabels[i]]
+		labels = labels[nLabels[i]:]
+		metricBuckets := buckets[:nBuckets[i]]
+		buckets = buckets[nBuckets[i]:]
+
+		switch kind {
+		case kindGauge:
+			handles[i] = newGauge(nil, names[i], helps[i])
+		case kindGaugeVec:
+			handles[i] = newGaugeVec(nil, names[i], helps[i], metricLabels)
+		case kindCounter:
+			handles[i] = newCounter(nil, names[i], helps[i])
+		case kindCounterVec:
+			handles[i] = newCounterVec(nil, names[i], helps[i], metricLabels)
+		case kindHistogram:
+			handles[i] = newHistogram(nil, names[i], helps[i], metricBuckets)
+		case kindHistogramVec:
+			handles[i] = newHistogramVec(nil, names[i], helps[i], metricLabels, metricBuckets)
+		default:
+			panic("Unknown metric kind")
+		}
+	}
+}
+
+// Operation codes of the records passed to goApplyRecords. These must match
+// the EASYPROM_OP_* values in promClient.h.
+const (
+	opGaugeSet = iota
+	opGaugeAdd
+	opCounterAdd
+	opSummaryObserve
+	opHistogramObserve
+)
+
+// Applies a batch of heterogeneous updates: the i'th record applies
+// operation ops[i] with value vals[i] to the metric with handle uPtrs[i].
+// Records are applied in order, and records with unknown handles or
+// operations are skipped.
+//export goApplyRecords
+func goApplyRecords(uPtrs []uintptr, ops []uint8, vals []float64) {
+	countCall(callApplyRecords)
+	for i := 0; i < len(uPtrs) && i < len(ops) && i < len(vals); i++ {
+		switch ops[i] {
+		case opGaugeSet:
+			if gauge, ok := gaugeHandles.Get(uPtrs[i]).(prometheus.Gauge); ok {
+				gauge.Set(vals[i])
+			}
+		case opGaugeAdd:
+			if gauge, ok := gaugeHandles.Get(uPtrs[i]).(prometheus.Gauge); ok {
+				gauge.Add(vals[i])
+			}
+		case opCounterAdd:
+			if counter, ok := counterHandles.Get(uPtrs[i]).(prometheus.Counter); ok {
+				counter.Add(vals[i])
+			}
+		case opSummaryObserve:
+			if summary, ok := summaryHandles.Get(uPtrs[i]).(prometheus.Observer); ok {
+				summary.Observe(vals[i])
+			}
+		case opHistogramObserve:
+			if histogram, ok := histogramHandles.Get(uPtrs[i]).(prometheus.Observer); ok {
+				histogram.Observe(vals[i])
+			}
+		}
+	}
+}
+
 func main() {}
@@ -24,9 +24,15 @@
 #define _PROM_CLIENT_H_
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef EASYPROM_NATIVE_BACKEND
+#include "promClientNative.h"
+#else
 #include "libpromclient.h"
+#endif
 
 /* ========== HELPER FUNCTIONS ========== */
 static inline GoString cStr2GoStr(const char* in) {
@@ -34,19 +40,216 @@ static inline GoString cStr2GoStr(const char* in) {
     return tmp;
 }
 
+// For strings with a known length, which needn't be null-terminated
+static inline GoString cStrLen2GoStr(const char* in, size_t len) {
+    GoString tmp = {in, (ptrdiff_t)len};
+    return tmp;
+}
+
+
+// Converts 'n' c-strings to a GoSlice of GoStrings, allocated on the heap as
+// 'n' may be too large for the stack. Free with free(slice.data).
+static inline GoSlice cStrs2GoSlice(const char** strs, size_t n) {
+    GoString* gsStrs = (GoString*)malloc((n > 0 ? n : 1) * sizeof(GoString));
+    assert(gsStrs != NULL);
+    for (size_t i = 0; i < n; i++) {
+        gsStrs[i] = cStr2GoStr(strs[i]);
+    }
+
+    GoSlice slice = {(void*)gsStrs, (GoInt)n, (GoInt)n};
+    return slice;
+}
+
+
+#ifdef __cplusplus
+#define EASYPROM_CONSTEXPR constexpr
+#else
+#define EASYPROM_CONSTEXPR
+#endif
+
+static inline EASYPROM_CONSTEXPR int isNameChar(char c, int allowColon) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '_' || (allowColon && c == ':');
+}
+
+// Whether 'name' is a valid metric name, i.e. matches [a-zA-Z_:][a-zA-Z0-9_:]*
+static inline EASYPROM_CONSTEXPR int IsValidMetricName(const char* name) {
+    if (name == NULL || name[0] == '\0' || (name[0] >= '0' && name[0] <= '9')) {
+        return 0;
+    }
+    for (const char* c = name; *c != '\0'; c++) {
+        if (!isNameChar(*c, 1)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Whether 'name' is a valid label name, i.e. matches [a-zA-Z_][a-zA-Z0-9_]*
+// and doesn't start with "__" (which is reserved)
+static inline EASYPROM_CONSTEXPR int IsValidLabelName(const char* name) {
+    if (name == NULL || name[0] == '\0' || (name[0] >= '0' && name[0] <= '9') ||
+            (name[0] == '_' && name[1] == '_')) {
+        return 0;
+    }
+    for (const char* c = name; *c != '\0'; c++) {
+        if (!isNameChar(*c, 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Called when the process starts exporting metrics (i.e. by StartPromHandler()
+// and the like). Set by the C++ static metrics, to register those declared
+// as globals (see RegisterStaticMetrics() below).
+static void (*onExportStart)(void) = NULL;
+
+static inline void runOnExportStart(void) {
+    if (onExportStart != NULL) {
+        onExportStart();
+    }
+}
+
 
 /* ========== WRAPPER FUNCTIONS FOR GO CODE ========== */
+// Serves the default registry at metricsPath on promEndpoint, "host:port" or
+// "unix:<path>" for a Unix domain socket (for hosts where no port may be opened)
 void StartPromHandler(const char* promEndpoint, const char* metricsPath) {
     GoString gsPromEnd = cStr2GoStr(promEndpoint);
     GoString gsMetricsPath = cStr2GoStr(metricsPath);
+    runOnExportStart();
     goStartPromHandler(gsPromEnd, gsMetricsPath);
 
     return;
 }
 
+/* Options for StartPromHandlerWithOpts(). Zero disables the respective
+ * feature, so a zeroed struct behaves like StartPromHandler().
+ */
+typedef struct {
+    unsigned int coalesceWindowMs; // Scrapes within this long of a gather's start share its result
+    unsigned int cacheTtlMs;       // Reuse a finished gather's response for this long
+    int gzip;                      // Also keep a gzipped response, for clients accepting it
+    unsigned int maxInFlight;      // Max concurrent gathers; scrapes beyond it get a 503
+    unsigned int readTimeoutMs;    // Server read timeout
+    unsigned int writeTimeoutMs;   // Server write timeout
+} PromHandlerOpts;
+
+/* Starts a metrics handler that can share registry gathers between scrapes.
+ * Handlers on the same endpoint share one server, which uses the timeouts
+ * passed when it was first started. Like StartPromHandler(), an endpoint of
+ * the form "unix:<path>" listens on a Unix domain socket instead of a port.
+ */
+void StartPromHandlerWithOpts(const char* promEndpoint, const char* metricsPath,
+                                const PromHandlerOpts* opts) {
+    GoString gsPromEnd = cStr2GoStr(promEndpoint);
+    GoString gsMetricsPath = cStr2GoStr(metricsPath);
+    runOnExportStart();
+    goStartPromHandlerOpts(gsPromEnd, gsMetricsPath, opts->coalesceWindowMs, opts->cacheTtlMs,
+                            opts->gzip != 0, opts->maxInFlight, opts->readTimeoutMs,
+                            opts->writeTimeoutMs);
+
+    return;
+}
+
+/* Options for StartRemoteWrite(). Zero means the default given for each. */
+typedef struct {
+    unsigned int maxSamplesPerSend; // Samples per request (default 2000)
+    unsigned int nShards;           // Concurrent senders, each sending a subset of series (default 1)
+    unsigned int queueCapacity;     // Requests queued per shard before dropping the oldest (default 16)
+    unsigned int minBackoffMs;      // First retry delay, doubled per retry (default 30)
+    unsigned int maxBackoffMs;      // Max retry delay (default 5000)
+    unsigned int maxRetries;        // Retries before dropping a request (default 10)
+    unsigned int timeoutMs;         // Per-request timeout (default 30000)
+} RemoteWriteOpts;
+
+/* Pushes the registry to a Prometheus remote-write endpoint every
+ * 'intervalMs', for processes that can't be scraped. Only one remote writer
+ * may run at a time. 'opts' may be NULL, for the defaults.
+ */
+void StartRemoteWrite(const char* url, unsigned int intervalMs, const RemoteWriteOpts* opts) {
+    RemoteWriteOpts defaults;
+    memset(&defaults, 0, sizeof(defaults)); // Unlike {0}, warning-free in C++
+    if (opts == NULL) {
+        opts = &defaults;
+    }
+
+    runOnExportStart();
+    goStartRemoteWrite(cStr2GoStr(url), intervalMs, opts->maxSamplesPerSend, opts->nShards,
+                        opts->queueCapacity, opts->minBackoffMs, opts->maxBackoffMs,
+                        opts->maxRetries, opts->timeoutMs);
+
+    return;
+}
+
+/* Pushes a final snapshot, and waits up to 'flushTimeoutMs' for it and any
+ * queued requests to be sent. Returns 0 on timeout.
+ */
+int StopRemoteWrite(unsigned int flushTimeoutMs) {
+    return goStopRemoteWrite(flushTimeoutMs);
+}
+
+/* Renders the registry (NULL being the default one) to the file at 'path'
+ * every 'intervalMs' (0 means 15s), for node_exporter's textfile collector.
+ * The file is replaced atomically, through a rename of 'path'.tmp, and isn't
+ * rewritten while the rendering is unchanged. Use a registry of your own:
+ * the default one's go_* and process_* metrics clash with node_exporter's.
+ */
+void StartTextfileExport(void* pRegistry, const char* path, unsigned int intervalMs) {
+    runOnExportStart();
+    goStartTextfileExport((GoUintptr)pRegistry, cStr2GoStr(path), intervalMs);
+
+    return;
+}
+
+/* ========== PROFILING WRAPPER FUNCTIONS ========== */
+/* Opt-in profiling of the library's side of the process (cgo transitions, Go
+ * GC, gathers), for the Go backend only. StartPprofHandler() mounts Go's
+ * pprof handlers (CPU, heap, goroutine, mutex and block profiles, and
+ * execution traces) at /debug/pprof/ on the server of 'promEndpoint',
+ * starting it if needed. Note that a handler's write timeout (see
+ * PromHandlerOpts) also bounds the duration of CPU profiles and traces.
+ */
+void StartPprofHandler(const char* promEndpoint) {
+    goStartPprofHandler(cStr2GoStr(promEndpoint));
+    return;
+}
+
+// Samples one in 'rate' mutex contention events on average (0 disables the
+// mutex profile, which is the default). Returns the previous rate.
+int SetMutexProfileFraction(int rate) {
+    return goSetMutexProfileFraction(rate);
+}
+
+// Samples one blocking event per 'rateNs' nanoseconds spent blocked on
+// average (1 samples every event; 0 disables the block profile, the default)
+void SetBlockProfileRate(int rateNs) {
+    goSetBlockProfileRate(rateNs);
+    return;
+}
+
+/* Profiles the CPU for 'durationMs' in the background, then writes the
+ * profile to the file at 'path', for `go tool pprof`. Returns 0 once the
+ * profile has started, or -1 if the file can't be created or a CPU profile
+ * is already running. The profile is written to a temporary file in the same
+ * directory, which replaces 'path' only once complete.
+ */
+int StartCPUProfile(const char* path, unsigned int durationMs) {
+    return goStartCPUProfile(cStr2GoStr(path), durationMs);
+}
+
+// Writes the named profile ("heap", "allocs", "goroutine", "mutex", "block"
+// or "threadcreate") to the file at 'path'. Returns 0 on success, or -1.
+int WriteProfile(const char* name, const char* path) {
+    return goWriteProfile(cStr2GoStr(name), cStr2GoStr(path));
+}
+
 /* ========== GAUGE WRAPPER FUNCTIONS ========== */
 void* NewGauge(const char* name, const char* help) {
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -63,7 +266,7 @@ void* NewGaugeVec(const char* name, const char* help, int nLabels, const char**
 
     GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
 
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -94,6 +297,32 @@ void GaugeDeleteLabelValues(void* pGaugeVec, int nLabelVals, const char** labelV
     return goGaugeDeleteLabelValues((GoUintptr)pGaugeVec, gLabValSlice);
 }
 
+// Same as GaugeWithLabelValues, but with the length of each label value given in
+// 'labelLens', so the values needn't be null-terminated (and aren't strlen'd)
+void* GaugeWithLabelValuesLen(void* pGaugeVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return (void*)goGaugeWithLabelValues((GoUintptr)pGaugeVec, gLabValSlice);
+}
+
+void GaugeDeleteLabelValuesLen(void* pGaugeVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return goGaugeDeleteLabelValues((GoUintptr)pGaugeVec, gLabValSlice);
+}
+
 static inline void GaugeSet(void* pGauge, double val) {
     goGaugeSet((GoUintptr)pGauge, (GoFloat64)val);
 
@@ -112,9 +341,27 @@ static inline void GaugeSub(void* pGauge, double val) {
     return;
 }
 
+// Batched updates, costing a single call into Go for the whole batch.
+// pGauges[i] is updated with vals[i], for i in [0, nVals).
+static inline void GaugeSetBatch(void** pGauges, const double* vals, size_t nVals) {
+    GoSlice gGaugeSlice = {(void*)pGauges, (GoInt)nVals, (GoInt)nVals};
+    GoSlice gValSlice = {(void*)vals, (GoInt)nVals, (GoInt)nVals};
+    goGaugeSetBatch(gGaugeSlice, gValSlice);
+
+    return;
+}
+
+static inline void GaugeAddBatch(void** pGauges, const double* vals, size_t nVals) {
+    GoSlice gGaugeSlice = {(void*)pGauges, (GoInt)nVals, (GoInt)nVals};
+    GoSlice gValSlice = {(void*)vals, (GoInt)nVals, (GoInt)nVals};
+    goGaugeAddBatch(gGaugeSlice, gValSlice);
+
+    return;
+}
+
 /* ========== COUNTER WRAPPER FUNCTIONS ========== */
 void* NewCounter(const char* name, const char* help) {
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -131,7 +378,7 @@ void* NewCounterVec(const char* name, const char* help, int nLabels, const char*
 
     GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
 
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -162,17 +409,169 @@ void CounterDeleteLabelValues(void* pCounterVec, int nLabelVals, const char** la
     return goCounterDeleteLabelValues((GoUintptr)pCounterVec, gLabValSlice);
 }
 
+// Same as CounterWithLabelValues, but with the length of each label value given in
+// 'labelLens', so the values needn't be null-terminated (and aren't strlen'd)
+void* CounterWithLabelValuesLen(void* pCounterVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return (void*)goCounterWithLabelValues((GoUintptr)pCounterVec, gLabValSlice);
+}
+
+void CounterDeleteLabelValuesLen(void* pCounterVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return goCounterDeleteLabelValues((GoUintptr)pCounterVec, gLabValSlice);
+}
+
 static inline void CounterAdd(void* pCounter, double val) {
     goCounterAdd((GoUintptr)pCounter, (GoFloat64)val);
 
     return;
 }
 
+// Batched update, costing a single call into Go for the whole batch.
+// pCounters[i] is incremented by vals[i], for i in [0, nVals).
+static inline void CounterAddBatch(void** pCounters, const double* vals, size_t nVals) {
+    GoSlice gCounterSlice = {(void*)pCounters, (GoInt)nVals, (GoInt)nVals};
+    GoSlice gValSlice = {(void*)vals, (GoInt)nVals, (GoInt)nVals};
+    goCounterAddBatch(gCounterSlice, gValSlice);
+
+    return;
+}
+
+/* ========== HISTOGRAM WRAPPER FUNCTIONS ========== */
+// Fills 'buckets' with 'count' upper bounds, the lowest being 'start' and
+// each subsequent one 'width' higher than the previous.
+void LinearBuckets(double start, double width, int count, double* buckets) {
+    assert(count >= 1);
+    for (int i = 0; i < count; i++) {
+        buckets[i] = start + i * width;
+    }
+}
+
+// Fills 'buckets' with 'count' upper bounds, the lowest being 'start' and
+// each subsequent one 'factor' times the previous.
+void ExponentialBuckets(double start, double factor, int count, double* buckets) {
+    assert(count >= 1 && start > 0 && factor > 1);
+    for (int i = 0; i < count; i++) {
+        buckets[i] = start;
+        start *= factor;
+    }
+}
+
+// nBuckets: The number of upper bounds in 'buckets' (0 for the defaults)
+// buckets: Sorted array of bucket upper bounds
+void* NewHistogram(const char* name, const char* help, int nBuckets, const double* buckets) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    GoSlice gBucketSlice = {(void*)buckets, (GoInt)nBuckets, (GoInt)nBuckets};
+
+    return (void*)goNewHistogram(gsName, gsHelp, gBucketSlice);
+}
+
+// nLabels: The number of labels in 'labels'
+// labels: Array of c-string labels
+void* NewHistogramVec(const char* name, const char* help, int nLabels, const char** labels,
+        int nBuckets, const double* buckets) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    GoSlice gBucketSlice = {(void*)buckets, (GoInt)nBuckets, (GoInt)nBuckets};
+
+    return (void*)goNewHistogramVec(gsName, gsHelp, gLabelSlice, gBucketSlice);
+}
+
+// nLabels: The number of label values in 'labelVals'
+// labelVals: Array of c-string label values
+void* HistogramWithLabelValues(void* pHistogramVec, int nLabelVals, const char** labelVals) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return (void*)goHistogramWithLabelValues((GoUintptr)pHistogramVec, gLabValSlice);
+}
+
+void HistogramDeleteLabelValues(void* pHistogramVec, int nLabelVals, const char** labelVals) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return goHistogramDeleteLabelValues((GoUintptr)pHistogramVec, gLabValSlice);
+}
+
+// Same as HistogramWithLabelValues, but with the length of each label value given in
+// 'labelLens', so the values needn't be null-terminated (and aren't strlen'd)
+void* HistogramWithLabelValuesLen(void* pHistogramVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return (void*)goHistogramWithLabelValues((GoUintptr)pHistogramVec, gLabValSlice);
+}
+
+void HistogramDeleteLabelValuesLen(void* pHistogramVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return goHistogramDeleteLabelValues((GoUintptr)pHistogramVec, gLabValSlice);
+}
+
+static inline void HistogramObserve(void* pHistogram, double val) {
+    goHistogramObserve((GoUintptr)pHistogram, (GoFloat64)val);
+
+    return;
+}
+
+// Observes all 'nVals' values, costing a single call into Go for the batch
+static inline void HistogramObserveBatch(void* pHistogram, const double* vals, size_t nVals) {
+    GoSlice gValSlice = {(void*)vals, (GoInt)nVals, (GoInt)nVals};
+    goHistogramObserveBatch((GoUintptr)pHistogram, gValSlice);
+
+    return;
+}
+
 /* ========== SUMMARY WRAPPER FUNCTIONS ========== */
 void* NewSummary(const char* name, const char* help,
         int nQuantiles, const double* quantiles, const double* errors,
         int maxAge, int nAgeBkts) {
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -194,7 +593,7 @@ void* NewSummaryVec(const char* name, const char* help, int nLabels, const char*
 
     GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
 
-    // TODO: Check to ensure name has no dashes
+    assert(IsValidMetricName(name));
     GoString gsName = cStr2GoStr(name);
     GoString gsHelp = cStr2GoStr(help);
 
@@ -228,244 +627,4054 @@ void SummaryDeleteLabelValues(void* pSummaryVec, int nLabelVals, const char** la
     return goSummaryDeleteLabelValues((GoUintptr)pSummaryVec, gLabValSlice);
 }
 
+// Same as SummaryWithLabelValues, but with the length of each label value given in
+// 'labelLens', so the values needn't be null-terminated (and aren't strlen'd)
+void* SummaryWithLabelValuesLen(void* pSummaryVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return (void*)goSummaryWithLabelValues((GoUintptr)pSummaryVec, gLabValSlice);
+}
+
+void SummaryDeleteLabelValuesLen(void* pSummaryVec, int nLabelVals,
+        const char** labelVals, const size_t* labelLens) {
+    GoString gsLabelVals[nLabelVals];
+    for (int i = 0; i < nLabelVals; i++) {
+        gsLabelVals[i] = cStrLen2GoStr(labelVals[i], labelLens[i]);
+    }
+
+    GoSlice gLabValSlice = {(void*)gsLabelVals, (GoInt)nLabelVals, (GoInt)nLabelVals};
+
+    return goSummaryDeleteLabelValues((GoUintptr)pSummaryVec, gLabValSlice);
+}
+
 static inline void SummaryObserve(void* pSummary, double val) {
     goSummaryObserve((GoUintptr)pSummary, (GoFloat64)val);
 
     return;
 }
 
-#ifdef __cplusplus
-#include <string>
-#include <vector>
-#include <unordered_map>
+// Observes all 'nVals' values, costing a single call into Go for the batch
+static inline void SummaryObserveBatch(void* pSummary, const double* vals, size_t nVals) {
+    GoSlice gValSlice = {(void*)vals, (GoInt)nVals, (GoInt)nVals};
+    goSummaryObserveBatch((GoUintptr)pSummary, gValSlice);
 
-using std::string;
-using std::vector;
-using std::unordered_map;
+    return;
+}
 
-/* ========== C++ CLASSES ========== */
-// Simply implement them as wrappers around the C functions
-// TODO: Make base Metric class and derive everything else from it?
+/* Like NewSummary(), for values sampled in C/C++ (see SampledSummary in the
+ * C++ API): each sample is observed with SummaryObserveWeighted(), and the
+ * exported count and sum are scaled by the samples' weights. Only the default
+ * registry is supported.
+ */
+void* NewSampledSummary(const char* name, const char* help,
+        int nQuantiles, const double* quantiles, const double* errors,
+        int maxAge, int nAgeBkts) {
+    assert(IsValidMetricName(name));
+    GoSlice gQuantSlice = {(void*)quantiles, (GoInt)nQuantiles, (GoInt)nQuantiles};
+    GoSlice gErrSlice = {(void*)errors, (GoInt)nQuantiles, (GoInt)nQuantiles};
 
-namespace EasyProm {
-class Gauge {
-    private:
-        void* _metric = nullptr; // "Pointer" to go-land object
+    return (void*)goNewSampledSummary(cStr2GoStr(name), cStr2GoStr(help), gQuantSlice,
+                                        gErrSlice, maxAge, nAgeBkts);
+}
 
-    public:
-        Gauge() {}
+// Observes 'val' as standing for 'weight' observations (e.g. N, when one in
+// N values is sampled). Summaries not created by NewSampledSummary() on the
+// Go backend ignore the weight.
+static inline void SummaryObserveWeighted(void* pSummary, double val, unsigned int weight) {
+    goSummaryObserveWeighted((GoUintptr)pSummary, (GoFloat64)val, (GoUint32)weight);
 
-        Gauge(string name, string help) {
-            _metric = NewGauge(name.c_str(), help.c_str());
-        }
+    return;
+}
 
-        // Mainly used by GaugeVec, regular users likely wouldn't use this
-        // constructor. If the user has a raw pointer to the Go Gauge object,
-        // they can use this constructor to wrap it into a C++ object.
-        Gauge(void* pGauge) {
-            assert(pGauge != nullptr);
-            _metric = pGauge;
-        }
+/* ========== REGISTRY WRAPPER FUNCTIONS ========== */
+/* Creates a registry separate from the default one (which also holds the Go
+ * runtime and process metrics), e.g. to expose a subsystem on its own path.
+ * Its families are spread over 'nShards' shards (0 means 1), which are
+ * gathered and rendered in parallel.
+ */
+void* NewRegistry(int nShards) {
+    return (void*)goNewRegistry(nShards);
+}
 
-        ~Gauge() {}
+/* Starts a handler for the registry, like StartPromHandlerWithOpts(). A NULL
+ * registry means the default one, and NULL 'opts' the default options.
+ */
+void StartRegistryHandler(void* pRegistry, const char* promEndpoint, const char* metricsPath,
+                            const PromHandlerOpts* opts) {
+    PromHandlerOpts defaults;
+    memset(&defaults, 0, sizeof(defaults)); // Unlike {0}, warning-free in C++
+    if (opts == NULL) {
+        opts = &defaults;
+    }
 
-        void Set(double val) {
-            GaugeSet(_metric, val);
-        }
+    runOnExportStart();
+    goStartRegistryHandlerOpts((GoUintptr)pRegistry, cStr2GoStr(promEndpoint),
+                                cStr2GoStr(metricsPath), opts->coalesceWindowMs,
+                                opts->cacheTtlMs, opts->gzip != 0, opts->maxInFlight,
+                                opts->readTimeoutMs, opts->writeTimeoutMs);
 
-        void Add(double val) {
-            GaugeAdd(_metric, val);
-        }
+    return;
+}
 
-        void Sub(double val) {
-            GaugeSub(_metric, val);
+// The New*In() functions are like their New*() counterparts, creating the
+// metric in 'pRegistry' (NULL being the default registry) instead
+void* NewGaugeIn(void* pRegistry, const char* name, const char* help) {
+    assert(IsValidMetricName(name));
+    return (void*)goNewGaugeIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help));
+}
+
+void* NewGaugeVecIn(void* pRegistry, const char* name, const char* help, int nLabels,
+        const char** labels) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewGaugeVecIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                    gLabelSlice);
+}
+
+void* NewCounterIn(void* pRegistry, const char* name, const char* help) {
+    assert(IsValidMetricName(name));
+    return (void*)goNewCounterIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help));
+}
+
+void* NewCounterVecIn(void* pRegistry, const char* name, const char* help, int nLabels,
+        const char** labels) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewCounterVecIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                    gLabelSlice);
+}
+
+void* NewHistogramIn(void* pRegistry, const char* name, const char* help, int nBuckets,
+        const double* buckets) {
+    GoSlice gBucketSlice = {(void*)buckets, (GoInt)nBuckets, (GoInt)nBuckets};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewHistogramIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                    gBucketSlice);
+}
+
+void* NewHistogramVecIn(void* pRegistry, const char* name, const char* help, int nLabels,
+        const char** labels, int nBuckets, const double* buckets) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gBucketSlice = {(void*)buckets, (GoInt)nBuckets, (GoInt)nBuckets};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewHistogramVecIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                        gLabelSlice, gBucketSlice);
+}
+
+void* NewSummaryIn(void* pRegistry, const char* name, const char* help,
+        int nQuantiles, const double* quantiles, const double* errors,
+        int maxAge, int nAgeBkts) {
+    GoSlice gQuantSlice = {(void*)quantiles, (GoInt)nQuantiles, (GoInt)nQuantiles};
+    GoSlice gErrSlice = {(void*)errors, (GoInt)nQuantiles, (GoInt)nQuantiles};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewSummaryIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                    gQuantSlice, gErrSlice, maxAge, nAgeBkts);
+}
+
+void* NewSummaryVecIn(void* pRegistry, const char* name, const char* help, int nLabels,
+        const char** labels, int nQuantiles, const double* quantiles, const double* errors,
+        int maxAge, int nAgeBkts) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gQuantSlice = {(void*)quantiles, (GoInt)nQuantiles, (GoInt)nQuantiles};
+    GoSlice gErrSlice = {(void*)errors, (GoInt)nQuantiles, (GoInt)nQuantiles};
+
+    assert(IsValidMetricName(name));
+    return (void*)goNewSummaryVecIn((GoUintptr)pRegistry, cStr2GoStr(name), cStr2GoStr(help),
+                                    gLabelSlice, gQuantSlice, gErrSlice, maxAge, nAgeBkts);
+}
+
+/* ========== BULK CHILD WRAPPER FUNCTIONS ========== */
+// These create (or look up) many children of a Vec in a single call into
+// Go, e.g. to pre-create a known label space at startup. The handle of each
+// child is stored in 'children' (NULL if rejected by the Vec's series limit).
+
+// nLabels: The number of labels of the Vec
+// nChildren: The number of children to create
+// labelVals: nChildren * nLabels c-string label values, the i'th child's
+//            being labelVals[i * nLabels] to labelVals[(i + 1) * nLabels - 1]
+void GaugeWithLabelValuesMany(void* pGaugeVec, int nLabels, int nChildren,
+        const char** labelVals, void** children) {
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gLabelValSlice = cStrs2GoSlice(labelVals, (size_t)nLabels * nChildren);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goGaugeWithLabelValuesMany((GoUintptr)pGaugeVec, nLabels, gLabelValSlice, gChildSlice);
+    free(gLabelValSlice.data);
+
+    return;
+}
+
+// Creates the children for every combination of label values.
+// nLabels: The number of labels of the Vec
+// nVals: The number of values of each label
+// vals: The values of label 0, followed by those of label 1, etc.
+// children: Holds the product of nVals, in row-major order (i.e. the last
+//           label's value varies fastest)
+void GaugeWithLabelValuesProduct(void* pGaugeVec, int nLabels, const int* nVals,
+        const char** vals, void** children) {
+    GoUint32 counts[nLabels];
+    size_t nTotalVals = 0;
+    size_t nChildren = 1;
+    for (int i = 0; i < nLabels; i++) {
+        counts[i] = (GoUint32)nVals[i];
+        nTotalVals += nVals[i];
+        nChildren *= nVals[i];
+    }
+
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gCountSlice = {(void*)counts, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = cStrs2GoSlice(vals, nTotalVals);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goGaugeWithLabelValuesProduct((GoUintptr)pGaugeVec, gCountSlice, gValSlice, gChildSlice);
+    free(gValSlice.data);
+
+    return;
+}
+
+void CounterWithLabelValuesMany(void* pCounterVec, int nLabels, int nChildren,
+        const char** labelVals, void** children) {
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gLabelValSlice = cStrs2GoSlice(labelVals, (size_t)nLabels * nChildren);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goCounterWithLabelValuesMany((GoUintptr)pCounterVec, nLabels, gLabelValSlice, gChildSlice);
+    free(gLabelValSlice.data);
+
+    return;
+}
+
+void CounterWithLabelValuesProduct(void* pCounterVec, int nLabels, const int* nVals,
+        const char** vals, void** children) {
+    GoUint32 counts[nLabels];
+    size_t nTotalVals = 0;
+    size_t nChildren = 1;
+    for (int i = 0; i < nLabels; i++) {
+        counts[i] = (GoUint32)nVals[i];
+        nTotalVals += nVals[i];
+        nChildren *= nVals[i];
+    }
+
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gCountSlice = {(void*)counts, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = cStrs2GoSlice(vals, nTotalVals);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goCounterWithLabelValuesProduct((GoUintptr)pCounterVec, gCountSlice, gValSlice, gChildSlice);
+    free(gValSlice.data);
+
+    return;
+}
+
+void HistogramWithLabelValuesMany(void* pHistogramVec, int nLabels, int nChildren,
+        const char** labelVals, void** children) {
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gLabelValSlice = cStrs2GoSlice(labelVals, (size_t)nLabels * nChildren);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goHistogramWithLabelValuesMany((GoUintptr)pHistogramVec, nLabels, gLabelValSlice, gChildSlice);
+    free(gLabelValSlice.data);
+
+    return;
+}
+
+void HistogramWithLabelValuesProduct(void* pHistogramVec, int nLabels, const int* nVals,
+        const char** vals, void** children) {
+    GoUint32 counts[nLabels];
+    size_t nTotalVals = 0;
+    size_t nChildren = 1;
+    for (int i = 0; i < nLabels; i++) {
+        counts[i] = (GoUint32)nVals[i];
+        nTotalVals += nVals[i];
+        nChildren *= nVals[i];
+    }
+
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gCountSlice = {(void*)counts, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = cStrs2GoSlice(vals, nTotalVals);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goHistogramWithLabelValuesProduct((GoUintptr)pHistogramVec, gCountSlice, gValSlice, gChildSlice);
+    free(gValSlice.data);
+
+    return;
+}
+
+void SummaryWithLabelValuesMany(void* pSummaryVec, int nLabels, int nChildren,
+        const char** labelVals, void** children) {
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gLabelValSlice = cStrs2GoSlice(labelVals, (size_t)nLabels * nChildren);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goSummaryWithLabelValuesMany((GoUintptr)pSummaryVec, nLabels, gLabelValSlice, gChildSlice);
+    free(gLabelValSlice.data);
+
+    return;
+}
+
+void SummaryWithLabelValuesProduct(void* pSummaryVec, int nLabels, const int* nVals,
+        const char** vals, void** children) {
+    GoUint32 counts[nLabels];
+    size_t nTotalVals = 0;
+    size_t nChildren = 1;
+    for (int i = 0; i < nLabels; i++) {
+        counts[i] = (GoUint32)nVals[i];
+        nTotalVals += nVals[i];
+        nChildren *= nVals[i];
+    }
+
+    memset(children, 0, nChildren * sizeof(void*));
+    GoSlice gCountSlice = {(void*)counts, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = cStrs2GoSlice(vals, nTotalVals);
+    GoSlice gChildSlice = {(void*)children, (GoInt)nChildren, (GoInt)nChildren};
+    goSummaryWithLabelValuesProduct((GoUintptr)pSummaryVec, gCountSlice, gValSlice, gChildSlice);
+    free(gValSlice.data);
+
+    return;
+}
+
+/* ========== SERIES LIMIT WRAPPER FUNCTIONS ========== */
+// Bounds on the children (series) of a Vec. Once a Vec has maxSeries
+// children, children for new label values are either rejected (the
+// *WithLabelValues functions return NULL, and updates to NULL are ignored) or,
+// with foldOverflow, all share one child whose label values are all "other".
+// Children that aren't updated for idleTtlSec seconds are deleted by a
+// background sweeper, and their pointers become invalid (updates to them are
+// ignored), so look children up again rather than holding on to them.
+// 'evictions', if not NULL, is atomically incremented after each sweep that
+// deleted children; it must never be freed.
+// The limits must be set before the Vec's first child is created.
+typedef struct {
+    unsigned maxSeries;  // 0 means no limit
+    int foldOverflow;
+    unsigned idleTtlSec; // 0 means children never expire
+    uint64_t* evictions;
+} VecLimits;
+
+void GaugeVecSetLimits(void* pGaugeVec, const VecLimits* limits) {
+    goGaugeVecSetLimits((GoUintptr)pGaugeVec, limits->maxSeries, limits->foldOverflow != 0,
+                        limits->idleTtlSec, limits->evictions);
+}
+
+void CounterVecSetLimits(void* pCounterVec, const VecLimits* limits) {
+    goCounterVecSetLimits((GoUintptr)pCounterVec, limits->maxSeries, limits->foldOverflow != 0,
+                        limits->idleTtlSec, limits->evictions);
+}
+
+void HistogramVecSetLimits(void* pHistogramVec, const VecLimits* limits) {
+    goHistogramVecSetLimits((GoUintptr)pHistogramVec, limits->maxSeries,
+                        limits->foldOverflow != 0, limits->idleTtlSec, limits->evictions);
+}
+
+void SummaryVecSetLimits(void* pSummaryVec, const VecLimits* limits) {
+    goSummaryVecSetLimits((GoUintptr)pSummaryVec, limits->maxSeries, limits->foldOverflow != 0,
+                        limits->idleTtlSec, limits->evictions);
+}
+
+/* ========== SERIES DELETION WRAPPER FUNCTIONS ========== */
+/* Deletes the child 'pGauge' (as returned by GaugeWithLabelValues()) from the
+ * Vec, without looking it up by its label values, which for the Go backend
+ * also means it's never recreated just to be deleted. Returns 1 if it was
+ * deleted, or 0 if it wasn't (or is no longer) one of the Vec's children.
+ */
+int GaugeDelete(void* pGaugeVec, void* pGauge) {
+    return goGaugeDelete((GoUintptr)pGaugeVec, (GoUintptr)pGauge);
+}
+
+/* Deletes every child of the Vec whose labels include the 'nLabels' given
+ * ones (label labelNames[i] having value labelVals[i]), e.g. every series of
+ * one tenant, in a single call. Returns how many children were deleted.
+ */
+int GaugeDeletePartialMatch(void* pGaugeVec, int nLabels, const char** labelNames,
+        const char** labelVals) {
+    GoString gsLabelNames[nLabels + 1];
+    GoString gsLabelVals[nLabels + 1];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabelNames[i] = cStr2GoStr(labelNames[i]);
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gNameSlice = {(void*)gsLabelNames, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = {(void*)gsLabelVals, (GoInt)nLabels, (GoInt)nLabels};
+
+    return (int)goGaugeDeletePartialMatch((GoUintptr)pGaugeVec, gNameSlice, gValSlice);
+}
+
+int CounterDelete(void* pCounterVec, void* pCounter) {
+    return goCounterDelete((GoUintptr)pCounterVec, (GoUintptr)pCounter);
+}
+
+int CounterDeletePartialMatch(void* pCounterVec, int nLabels, const char** labelNames,
+        const char** labelVals) {
+    GoString gsLabelNames[nLabels + 1];
+    GoString gsLabelVals[nLabels + 1];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabelNames[i] = cStr2GoStr(labelNames[i]);
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gNameSlice = {(void*)gsLabelNames, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = {(void*)gsLabelVals, (GoInt)nLabels, (GoInt)nLabels};
+
+    return (int)goCounterDeletePartialMatch((GoUintptr)pCounterVec, gNameSlice, gValSlice);
+}
+
+int HistogramDelete(void* pHistogramVec, void* pHistogram) {
+    return goHistogramDelete((GoUintptr)pHistogramVec, (GoUintptr)pHistogram);
+}
+
+int HistogramDeletePartialMatch(void* pHistogramVec, int nLabels, const char** labelNames,
+        const char** labelVals) {
+    GoString gsLabelNames[nLabels + 1];
+    GoString gsLabelVals[nLabels + 1];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabelNames[i] = cStr2GoStr(labelNames[i]);
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gNameSlice = {(void*)gsLabelNames, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = {(void*)gsLabelVals, (GoInt)nLabels, (GoInt)nLabels};
+
+    return (int)goHistogramDeletePartialMatch((GoUintptr)pHistogramVec, gNameSlice, gValSlice);
+}
+
+int SummaryDelete(void* pSummaryVec, void* pSummary) {
+    return goSummaryDelete((GoUintptr)pSummaryVec, (GoUintptr)pSummary);
+}
+
+int SummaryDeletePartialMatch(void* pSummaryVec, int nLabels, const char** labelNames,
+        const char** labelVals) {
+    GoString gsLabelNames[nLabels + 1];
+    GoString gsLabelVals[nLabels + 1];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabelNames[i] = cStr2GoStr(labelNames[i]);
+        gsLabelVals[i] = cStr2GoStr(labelVals[i]);
+    }
+
+    GoSlice gNameSlice = {(void*)gsLabelNames, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gValSlice = {(void*)gsLabelVals, (GoInt)nLabels, (GoInt)nLabels};
+
+    return (int)goSummaryDeletePartialMatch((GoUintptr)pSummaryVec, gNameSlice, gValSlice);
+}
+
+/* ========== NATIVE CELL WRAPPER FUNCTIONS ========== */
+// The metric's value is the sum of 'nCells' 64-bit cells living in
+// caller-owned memory, each 'cellStride' bytes apart. The cells are only read
+// (atomically) at scrape time, so updating them never calls into Go.
+// NOTE: The cell memory must never be freed after registering it.
+
+// Cells hold the bits of doubles
+void RegisterNativeCounter(const char* name, const char* help,
+        void* cells, int nCells, int cellStride) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewNativeCounter(gsName, gsHelp, cells, (GoUint32)nCells, (GoUint32)cellStride);
+}
+
+// Cells hold uint64_t values
+void RegisterNativeIntCounter(const char* name, const char* help,
+        void* cells, int nCells, int cellStride) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewNativeIntCounter(gsName, gsHelp, cells, (GoUint32)nCells, (GoUint32)cellStride);
+}
+
+// Cells hold the bits of doubles
+void RegisterNativeGauge(const char* name, const char* help,
+        void* cells, int nCells, int cellStride) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewNativeGauge(gsName, gsHelp, cells, (GoUint32)nCells, (GoUint32)cellStride);
+}
+
+// Histogram over 'nBounds' sorted upper bounds (excluding +Inf). 'cells' holds
+// 'nShards' shards, each 'shardStride' bytes apart, laid out as nBounds + 1
+// uint64_t bucket counts (non-cumulative, the last being +Inf) followed by
+// the bits of the shard's sum of observations as a double. Unlike for
+// NewHistogram(), no bounds means only the +Inf bucket rather than the
+// default buckets, as the cells must match the bounds (the C++ classes pass
+// the default buckets explicitly).
+void RegisterNativeHistogram(const char* name, const char* help,
+        int nBounds, const double* bounds, void* cells, int nShards, int shardStride) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    GoSlice gBoundSlice = {(void*)bounds, (GoInt)nBounds, (GoInt)nBounds};
+
+    goNewNativeHistogram(gsName, gsHelp, gBoundSlice, cells,
+                            (GoUint32)nShards, (GoUint32)shardStride);
+}
+
+// Per-process counter or gauge, over 'nSlabs' slabs of shared memory, each
+// 'slabSize' bytes apart. Each slab starts with the int64_t pid of the
+// process owning it (0 if none), and holds the metric's cell (the bits of a
+// double) at 'offset'. Exported as a series per owned slab, labeled "pid".
+void RegisterNativePerProcess(const char* name, const char* help, int isGauge,
+        void* slabs, int nSlabs, int slabSize, int offset) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewNativePerProcess(gsName, gsHelp, isGauge, slabs,
+                            (GoUint32)nSlabs, (GoUint32)slabSize, (GoUint32)offset);
+}
+
+// Summary whose state lives in "C-land". At scrape time, 'fn' is called with
+// 'ctx' to fill in values[i] (the estimate of quantiles[i]), the count and
+// the sum. It's called from a Go thread, so it must not call back into Go.
+typedef void (*NativeSummaryFn)(void* ctx, const double* quantiles, int nQuantiles,
+                                double* values, uint64_t* count, double* sum);
+
+void RegisterNativeSummary(const char* name, const char* help,
+        int nQuantiles, const double* quantiles, NativeSummaryFn fn, void* ctx) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    GoSlice gQuantileSlice = {(void*)quantiles, (GoInt)nQuantiles, (GoInt)nQuantiles};
+
+    goNewNativeSummary(gsName, gsHelp, gQuantileSlice, (void*)fn, ctx);
+}
+
+/* ========== FUNC METRIC WRAPPER FUNCTIONS ========== */
+// Gauges and counters whose values are computed by a callback, called only
+// at scrape time, so nothing needs to be recorded between scrapes. Callbacks
+// are called from a Go thread, so they must not call back into Go (i.e. into
+// any function in this file). 'ctx' must outlive the metric.
+
+// Returns the metric's current value
+typedef double (*MetricValueFn)(void* ctx);
+
+void NewGaugeFunc(const char* name, const char* help, MetricValueFn fn, void* ctx) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewGaugeFunc(gsName, gsHelp, (void*)fn, ctx);
+}
+
+void NewCounterFunc(const char* name, const char* help, MetricValueFn fn, void* ctx) {
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewCounterFunc(gsName, gsHelp, (void*)fn, ctx);
+}
+
+// For Vecs, the callback enumerates the current series by calling 'emit'
+// (with 'emitCtx') once per series, with as many label values as the Vec has
+// labels. Label values must be unique within one call.
+typedef void (*MetricEmitFn)(void* emitCtx, const char** labelVals, double val);
+typedef void (*MetricEnumFn)(void* ctx, MetricEmitFn emit, void* emitCtx);
+
+void NewGaugeVecFunc(const char* name, const char* help, int nLabels, const char** labels,
+        MetricEnumFn fn, void* ctx) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewGaugeVecFunc(gsName, gsHelp, gLabelSlice, (void*)fn, ctx);
+}
+
+void NewCounterVecFunc(const char* name, const char* help, int nLabels, const char** labels,
+        MetricEnumFn fn, void* ctx) {
+    GoString gsLabels[nLabels];
+    for (int i = 0; i < nLabels; i++) {
+        gsLabels[i] = cStr2GoStr(labels[i]);
+    }
+
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+
+    assert(IsValidMetricName(name));
+    GoString gsName = cStr2GoStr(name);
+    GoString gsHelp = cStr2GoStr(help);
+
+    goNewCounterVecFunc(gsName, gsHelp, gLabelSlice, (void*)fn, ctx);
+}
+
+/* ========== BULK REGISTRATION WRAPPER FUNCTIONS ========== */
+// Kinds of metric for MetricSpec
+enum {
+    EASYPROM_KIND_GAUGE = 0,
+    EASYPROM_KIND_GAUGE_VEC,
+    EASYPROM_KIND_COUNTER,
+    EASYPROM_KIND_COUNTER_VEC,
+    EASYPROM_KIND_HISTOGRAM,
+    EASYPROM_KIND_HISTOGRAM_VEC
+};
+
+typedef struct {
+    int kind;               // An EASYPROM_KIND_* value
+    const char* name;
+    const char* help;
+    int nLabels;            // Vecs only
+    const char** labels;
+    int nBuckets;           // Histograms only; 0 means the Prometheus default buckets
+    const double* buckets;
+} MetricSpec;
+
+/* Creates the 'nSpecs' metrics described by 'specs' in a single call into
+ * Go, rather than one call per metric, storing the handle of each (i.e. what
+ * e.g. NewGauge() or NewCounterVec() would have returned) in 'metrics'.
+ * Does nothing if 'nSpecs' is 0.
+ */
+void NewMetrics(const MetricSpec* specs, int nSpecs, void** metrics) {
+    if (nSpecs <= 0) { // The arrays below mustn't be zero-length
+        return;
+    }
+
+    int nLabels = 0;
+    int nBuckets = 0;
+    for (int i = 0; i < nSpecs; i++) {
+        assert(IsValidMetricName(specs[i].name));
+        nLabels += specs[i].nLabels;
+        nBuckets += specs[i].nBuckets;
+    }
+
+    GoUint8 kinds[nSpecs];
+    GoString gsNames[nSpecs];
+    GoString gsHelps[nSpecs];
+    GoUint32 labelCounts[nSpecs];
+    GoUint32 bucketCounts[nSpecs];
+    GoString gsLabels[nLabels + 1]; // Never zero-length
+    double buckets[nBuckets + 1];
+
+    int iLabel = 0;
+    int iBucket = 0;
+    for (int i = 0; i < nSpecs; i++) {
+        kinds[i] = (GoUint8)specs[i].kind;
+        gsNames[i] = cStr2GoStr(specs[i].name);
+        gsHelps[i] = cStr2GoStr(specs[i].help);
+        labelCounts[i] = (GoUint32)specs[i].nLabels;
+        bucketCounts[i] = (GoUint32)specs[i].nBuckets;
+        for (int j = 0; j < specs[i].nLabels; j++) {
+            gsLabels[iLabel++] = cStr2GoStr(specs[i].labels[j]);
+        }
+        for (int j = 0; j < specs[i].nBuckets; j++) {
+            buckets[iBucket++] = specs[i].buckets[j];
+        }
+    }
+
+    GoSlice gKindSlice = {(void*)kinds, (GoInt)nSpecs, (GoInt)nSpecs};
+    GoSlice gNameSlice = {(void*)gsNames, (GoInt)nSpecs, (GoInt)nSpecs};
+    GoSlice gHelpSlice = {(void*)gsHelps, (GoInt)nSpecs, (GoInt)nSpecs};
+    GoSlice gLabelCountSlice = {(void*)labelCounts, (GoInt)nSpecs, (GoInt)nSpecs};
+    GoSlice gLabelSlice = {(void*)gsLabels, (GoInt)nLabels, (GoInt)nLabels};
+    GoSlice gBucketCountSlice = {(void*)bucketCounts, (GoInt)nSpecs, (GoInt)nSpecs};
+    GoSlice gBucketSlice = {(void*)buckets, (GoInt)nBuckets, (GoInt)nBuckets};
+    GoSlice gMetricSlice = {(void*)metrics, (GoInt)nSpecs, (GoInt)nSpecs};
+    goNewMetrics(gKindSlice, gNameSlice, gHelpSlice, gLabelCountSlice, gLabelSlice,
+                    gBucketCountSlice, gBucketSlice, gMetricSlice);
+
+    return;
+}
+
+/* ========== BATCHED RECORD WRAPPER FUNCTIONS ========== */
+// Operation codes for ApplyRecords()
+enum {
+    EASYPROM_OP_GAUGE_SET = 0,
+    EASYPROM_OP_GAUGE_ADD,
+    EASYPROM_OP_COUNTER_ADD,
+    EASYPROM_OP_SUMMARY_OBSERVE,
+    EASYPROM_OP_HISTOGRAM_OBSERVE
+};
+
+// Applies 'nRecords' heterogeneous updates in a single call into Go. The
+// i'th record applies operation ops[i] (an EASYPROM_OP_* value) with value
+// vals[i] to the metric pMetrics[i]. Records are applied in order.
+static inline void ApplyRecords(void** pMetrics, const unsigned char* ops,
+        const double* vals, int nRecords) {
+    GoSlice gMetricSlice = {(void*)pMetrics, (GoInt)nRecords, (GoInt)nRecords};
+    GoSlice gOpSlice = {(void*)ops, (GoInt)nRecords, (GoInt)nRecords};
+    GoSlice gValSlice = {(void*)vals, (GoInt)nRecords, (GoInt)nRecords};
+    goApplyRecords(gMetricSlice, gOpSlice, gValSlice);
+
+    return;
+}
+
+/* ========== RENDER WRAPPER FUNCTIONS ========== */
+// Exposition formats for RenderMetrics() and OpenRenderStream()
+enum {
+    EASYPROM_FORMAT_TEXT = 0,   // Text format, version 0.0.4
+    EASYPROM_FORMAT_PROTOBUF    // Length-delimited MetricFamily messages (Go backend only)
+};
+
+/* Renders the registry (NULL being the default one) into 'buf', for programs
+ * that serve /metrics from their own HTTP stack instead of StartPromHandler().
+ * Nothing is allocated for the caller and no thread is started. Returns 0 if
+ * the rendering fit within 'cap' bytes, 1 if it didn't (only its first 'cap'
+ * bytes are written; retry with a larger buffer), or -1 if the format isn't
+ * supported or gathering the registry failed (e.g. on inconsistent metrics).
+ * Unless -1 is returned, '*needed' is set to the rendering's full size, which
+ * may grow by the next call. The rendering isn't null-terminated.
+ */
+int RenderRegistryMetrics(void* pRegistry, char* buf, size_t cap, size_t* needed, int format) {
+    assert(needed != NULL);
+    runOnExportStart();
+    int64_t size = goRenderMetrics((GoUintptr)pRegistry, (void*)buf, (GoUint64)cap,
+                                    (GoUint32)format);
+    if (size < 0) {
+        return -1;
+    }
+
+    *needed = (size_t)size;
+    return ((size_t)size <= cap) ? 0 : 1;
+}
+
+int RenderMetrics(char* buf, size_t cap, size_t* needed, int format) {
+    return RenderRegistryMetrics(NULL, buf, cap, needed, format);
+}
+
+/* Opens a stream over a rendering of the registry (NULL being the default
+ * one), which is gathered once, here. Each ReadRenderStream() call then only
+ * renders as many families as needed to fill its buffer, so a large registry
+ * can be written out in socket-sized chunks without ever being held whole.
+ * Returns NULL if the format isn't supported or gathering the registry
+ * failed. Streams aren't thread-safe.
+ */
+void* OpenRenderStream(void* pRegistry, int format) {
+    runOnExportStart();
+    return (void*)goOpenRenderStream((GoUintptr)pRegistry, (GoUint32)format);
+}
+
+// Copies up to 'cap' bytes of the rendering into 'buf', returning the number
+// of bytes copied, which is 0 only once the whole rendering has been read
+size_t ReadRenderStream(void* stream, char* buf, size_t cap) {
+    return (size_t)goReadRenderStream((GoUintptr)stream, (void*)buf, (GoUint64)cap);
+}
+
+void CloseRenderStream(void* stream) {
+    goCloseRenderStream((GoUintptr)stream);
+    return;
+}
+
+#ifdef __cplusplus
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <functional>
+#include <initializer_list>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <ratio>
+#include <shared_mutex>
+#include <signal.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <unordered_map>
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+
+// Number of per-thread cells backing each Native* counter. Threads are
+// assigned to cells round-robin, so with at most this many threads updating
+// a counter, no two of them ever touch the same cache line.
+#ifndef EASYPROM_NUM_SHARDS
+#define EASYPROM_NUM_SHARDS 32
+#endif
+
+#ifndef EASYPROM_CACHE_LINE
+#define EASYPROM_CACHE_LINE 64
+#endif
+
+// Scoped timers read the TSC on x86, unless EASYPROM_NO_TSC is defined
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(EASYPROM_NO_TSC)
+#define EASYPROM_USE_TSC 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+/* ========== C++ CLASSES ========== */
+// Simply implement them as wrappers around the C functions
+// TODO: Make base Metric class and derive everything else from it?
+
+namespace EasyProm {
+namespace detail {
+// Appends the update to the calling thread's ring if the asynchronous
+// recorder is running (see AsyncRecorder below), returning false otherwise.
+static inline bool AsyncRecord(void* pMetric, unsigned char op, double val);
+
+// FNV-1a over the label values. Each value is followed by a 0xff byte (which
+// never appears in UTF-8) so that e.g. {"ab", "c"} and {"a", "bc"} differ.
+static inline uint64_t HashLabelValues(const std::string_view* labelVals, size_t n) {
+    const uint64_t kPrime = 1099511628211ULL;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++) {
+        for (char c : labelVals[i]) {
+            hash = (hash ^ (unsigned char)c) * kPrime;
+        }
+        hash = (hash ^ 0xff) * kPrime;
+    }
+
+    return hash;
+}
+
+// Cache of a Vec's children, keyed by the hash of their label values. It's
+// split into independently locked shards, and lookups only take a shard's
+// lock in shared mode, so concurrent hits from many threads don't serialize.
+// Lookups compare the caller's string_views against the stored values, so a
+// hit allocates nothing and never calls into Go.
+class ChildCache {
+    private:
+        static const unsigned kNumShards = 16;
+
+        struct Entry {
+            vector<string> labelVals;
+            void* child;
+        };
+
+        struct alignas(EASYPROM_CACHE_LINE) Shard {
+            mutable std::shared_mutex mu;
+            unordered_map<uint64_t, vector<Entry>> entries; // Keyed by hash
+            // Child -> hashes of its entries, for EraseChild(). A child can have
+            // several, e.g. the "other" child label sets are folded into.
+            unordered_map<void*, vector<uint64_t>> hashes;
+        };
+
+        Shard _shards[kNumShards];
+
+        // Incremented by the Go side when it evicts children (see VecLimits).
+        // Leaked, since Go may still write it after the cache is destroyed.
+        std::atomic<uint64_t>* _evictions = new std::atomic<uint64_t>(0);
+        std::atomic<uint64_t> _seenEvictions{0};
+
+        Shard& shardFor(uint64_t hash) {
+            return _shards[hash >> 60]; // Top bits, as the map buckets use the low ones
+        }
+
+        static bool matches(const Entry& entry, const std::string_view* labelVals, size_t n) {
+            if (entry.labelVals.size() != n) {
+                return false;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (entry.labelVals[i] != labelVals[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Flushes every shard if children were evicted since the last flush,
+        // as their cached pointers are now stale
+        void syncEvictions() {
+            uint64_t evictions = _evictions->load(std::memory_order_acquire);
+            if (evictions == _seenEvictions.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            Clear();
+            _seenEvictions.store(evictions, std::memory_order_relaxed);
+        }
+
+        // Records that the bucket of 'hash' has an entry for 'child'. The
+        // shard must be locked.
+        static void linkLocked(Shard& shard, void* child, uint64_t hash) {
+            vector<uint64_t>& hashes = shard.hashes[child];
+            if (std::find(hashes.begin(), hashes.end(), hash) == hashes.end()) {
+                hashes.push_back(hash);
+            }
+        }
+
+        // Drops 'hash' from the hashes of 'child', once the child has no entry
+        // left in the hash's bucket. The shard must be locked.
+        static void unlinkLocked(Shard& shard, void* child, uint64_t hash,
+                const vector<Entry>& bucket) {
+            for (const Entry& entry : bucket) {
+                if (entry.child == child) {
+                    return;
+                }
+            }
+
+            auto iter = shard.hashes.find(child);
+            if (iter == shard.hashes.end()) {
+                return;
+            }
+            vector<uint64_t>& hashes = iter->second;
+            hashes.erase(std::remove(hashes.begin(), hashes.end(), hash), hashes.end());
+            if (hashes.empty()) {
+                shard.hashes.erase(iter);
+            }
+        }
+
+        // Erases every entry for 'child' from the shard, which must be locked
+        static void eraseChildLocked(Shard& shard, void* child) {
+            auto hashes = shard.hashes.find(child);
+            if (hashes == shard.hashes.end()) {
+                return;
+            }
+
+            for (uint64_t hash : hashes->second) {
+                auto iter = shard.entries.find(hash);
+                if (iter == shard.entries.end()) {
+                    continue;
+                }
+
+                vector<Entry>& bucket = iter->second;
+                bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+                                [child](const Entry& entry) { return entry.child == child; }),
+                            bucket.end());
+                if (bucket.empty()) {
+                    shard.entries.erase(iter);
+                }
+            }
+            shard.hashes.erase(hashes);
+        }
+
+    public:
+        uint64_t* Evictions() {
+            return reinterpret_cast<uint64_t*>(_evictions);
+        }
+
+        // Returns nullptr on a miss
+        void* Find(uint64_t hash, const std::string_view* labelVals, size_t n) {
+            syncEvictions();
+
+            Shard& shard = shardFor(hash);
+            std::shared_lock<std::shared_mutex> lock(shard.mu);
+            auto iter = shard.entries.find(hash);
+            if (iter != shard.entries.end()) {
+                for (const Entry& entry : iter->second) {
+                    if (matches(entry, labelVals, n)) {
+                        return entry.child;
+                    }
+                }
+            }
+
+            return nullptr;
+        }
+
+        void Insert(uint64_t hash, vector<string> labelVals, void* child) {
+            Shard& shard = shardFor(hash);
+            std::unique_lock<std::shared_mutex> lock(shard.mu);
+            vector<Entry>& bucket = shard.entries[hash];
+            linkLocked(shard, child, hash);
+            for (Entry& entry : bucket) {
+                if (entry.labelVals == labelVals) {
+                    void* replaced = entry.child;
+                    entry.child = child;
+                    if (replaced != child) {
+                        unlinkLocked(shard, replaced, hash, bucket);
+                    }
+                    return;
+                }
+            }
+            bucket.push_back(Entry{std::move(labelVals), child});
+        }
+
+        void Erase(uint64_t hash, const std::string_view* labelVals, size_t n) {
+            Shard& shard = shardFor(hash);
+            std::unique_lock<std::shared_mutex> lock(shard.mu);
+            auto iter = shard.entries.find(hash);
+            if (iter == shard.entries.end()) {
+                return;
+            }
+
+            vector<Entry>& bucket = iter->second;
+            for (size_t i = 0; i < bucket.size(); i++) {
+                if (matches(bucket[i], labelVals, n)) {
+                    void* child = bucket[i].child;
+                    bucket.erase(bucket.begin() + i);
+                    unlinkLocked(shard, child, hash, bucket);
+                    break;
+                }
+            }
+            if (bucket.empty()) {
+                shard.entries.erase(iter);
+            }
+        }
+
+        // Erases every entry whose child is 'child'. Its entries may be in any
+        // shard, so shards are probed under their shared locks first.
+        void EraseChild(void* child) {
+            for (Shard& shard : _shards) {
+                {
+                    std::shared_lock<std::shared_mutex> lock(shard.mu);
+                    if (shard.hashes.find(child) == shard.hashes.end()) {
+                        continue;
+                    }
+                }
+
+                std::unique_lock<std::shared_mutex> lock(shard.mu);
+                eraseChildLocked(shard, child);
+            }
+        }
+
+        void Clear() {
+            for (Shard& shard : _shards) {
+                std::unique_lock<std::shared_mutex> lock(shard.mu);
+                shard.entries.clear();
+                shard.hashes.clear();
+            }
+        }
+};
+
+// Splits string_views into the pointer and length arrays of the *Len C API.
+// Up to kInline values are split into zeroed arrays on the stack, so that
+// vecs with few labels stay allocation-free; more go to the heap.
+class SplitViews {
+    private:
+        static const size_t kInline = 16;
+
+        const char* _inlinePtrs[kInline] = {};
+        size_t _inlineLens[kInline] = {};
+        vector<const char*> _heapPtrs;
+        vector<size_t> _heapLens;
+
+    public:
+        const char** ptrs = _inlinePtrs;
+        size_t* lens = _inlineLens;
+
+        SplitViews(const std::string_view* views, size_t n) {
+            if (n > kInline) {
+                _heapPtrs.resize(n);
+                _heapLens.resize(n);
+                ptrs = _heapPtrs.data();
+                lens = _heapLens.data();
+            }
+            for (size_t i = 0; i < n; i++) {
+                ptrs[i] = views[i].data();
+                lens[i] = views[i].size();
+            }
+        }
+
+        SplitViews(const SplitViews&) = delete;
+        SplitViews& operator=(const SplitViews&) = delete;
+};
+
+// Returns the cached child for the label values, or creates it through
+// 'create' (a wrapper around the *WithLabelValuesLen C function) on a miss.
+// 'cache' may be null, in which case every call goes through 'create'.
+template <typename CreateFn>
+static inline void* CachedChild(ChildCache* cache, const std::string_view* labelVals,
+        size_t n, CreateFn create) {
+    uint64_t hash = 0;
+    if (cache != nullptr) {
+        hash = HashLabelValues(labelVals, n);
+        if (void* child = cache->Find(hash, labelVals, n)) {
+            return child;
+        }
+    }
+
+    SplitViews split(labelVals, n);
+    void* child = create(n, split.ptrs, split.lens);
+    if (cache != nullptr && child != nullptr) {
+        cache->Insert(hash, vector<string>(labelVals, labelVals + n), child);
+    }
+
+    return child;
+}
+
+// Evicts the child from the cache, then deletes it through 'del' (a wrapper
+// around the *DeleteLabelValuesLen C function).
+template <typename DeleteFn>
+static inline void EvictChild(ChildCache* cache, const std::string_view* labelVals,
+        size_t n, DeleteFn del) {
+    if (cache != nullptr) {
+        cache->Erase(HashLabelValues(labelVals, n), labelVals, n);
+    }
+
+    SplitViews split(labelVals, n);
+    del(n, split.ptrs, split.lens);
+}
+
+// Deletes the children matching 'labels' through 'del' (a wrapper around
+// the *DeletePartialMatch C function), then flushes the cache, as which
+// children were deleted isn't known
+template <typename DeleteFn>
+static inline size_t DeletePartialMatch(ChildCache* cache,
+        const vector<std::pair<string, string>>& labels, DeleteFn del) {
+    vector<const char*> names(labels.size() + 1, nullptr);
+    vector<const char*> vals(labels.size() + 1, nullptr);
+    for (size_t i = 0; i < labels.size(); i++) {
+        names[i] = labels[i].first.c_str();
+        vals[i] = labels[i].second.c_str();
+    }
+
+    size_t n = del(labels.size(), names.data(), vals.data());
+    if (cache != nullptr && n > 0) {
+        cache->Clear();
+    }
+
+    return n;
+}
+
+// Flattens sets of label values into the array taken by the
+// *WithLabelValuesMany C functions. Every set must have the same size.
+static inline vector<const char*> FlattenLabelValues(const vector<vector<string>>& labelVals) {
+    size_t nLabels = labelVals.empty() ? 0 : labelVals[0].size();
+    vector<const char*> flat;
+    flat.reserve(labelVals.size() * nLabels);
+    for (const vector<string>& tuple : labelVals) {
+        assert(tuple.size() == nLabels);
+        for (const string& val : tuple) {
+            flat.push_back(val.c_str());
+        }
+    }
+
+    return flat;
+}
+
+// Wraps and caches the children created by a *WithLabelValuesMany or
+// *WithLabelValuesProduct C function. The i'th child's label values are
+// labelVals[i * nLabels] to labelVals[(i + 1) * nLabels - 1].
+template <typename Metric>
+static inline vector<Metric> CacheChildren(ChildCache* cache, size_t nLabels,
+        const char* const* labelVals, const vector<void*>& children) {
+    vector<Metric> metrics;
+    metrics.reserve(children.size());
+    for (size_t i = 0; i < children.size(); i++) {
+        if (children[i] == nullptr) { // Rejected by the series limit
+            metrics.push_back(Metric());
+            continue;
+        }
+
+        if (cache != nullptr) {
+            std::string_view views[nLabels];
+            for (size_t j = 0; j < nLabels; j++) {
+                views[j] = labelVals[i * nLabels + j];
+            }
+            cache->Insert(HashLabelValues(views, nLabels), vector<string>(views, views + nLabels),
+                            children[i]);
+        }
+        metrics.push_back(Metric(children[i]));
+    }
+
+    return metrics;
+}
+
+// Creates the children through 'createMany' (a wrapper around the
+// *WithLabelValuesMany C function), then caches them
+template <typename Metric, typename CreateManyFn>
+static inline vector<Metric> ChildrenMany(ChildCache* cache, size_t nLabels, size_t nChildren,
+        const char** labelVals, CreateManyFn createMany) {
+    vector<void*> children(nChildren);
+    createMany(nLabels, nChildren, labelVals, children.data());
+
+    return CacheChildren<Metric>(cache, nLabels, labelVals, children);
+}
+
+// Creates the children for every combination of label values through
+// 'createProduct' (a wrapper around the *WithLabelValuesProduct C function),
+// then caches them
+template <typename Metric, typename CreateProductFn>
+static inline vector<Metric> ChildrenProduct(ChildCache* cache,
+        const vector<vector<string>>& valsPerLabel, CreateProductFn createProduct) {
+    size_t nLabels = valsPerLabel.size();
+    int nVals[nLabels + 1];
+    vector<const char*> vals;
+    size_t nChildren = nLabels > 0 ? 1 : 0;
+    for (size_t i = 0; i < nLabels; i++) {
+        nVals[i] = valsPerLabel[i].size();
+        nChildren *= valsPerLabel[i].size();
+        for (const string& val : valsPerLabel[i]) {
+            vals.push_back(val.c_str());
+        }
+    }
+
+    vector<void*> children(nChildren);
+    createProduct(nLabels, nVals, vals.data(), children.data());
+
+    // The label values of each child, in the same (row-major) order
+    vector<const char*> labelVals(nChildren * nLabels);
+    for (size_t i = 0; i < nChildren; i++) {
+        size_t rem = i;
+        for (size_t label = nLabels; label-- > 0;) {
+            labelVals[i * nLabels + label] = valsPerLabel[label][rem % nVals[label]].c_str();
+            rem /= nVals[label];
+        }
+    }
+
+    return CacheChildren<Metric>(cache, nLabels, labelVals.data(), children);
+}
+} // End namespace detail
+
+// A registry to create metrics in (see NewRegistry()). Metrics constructed
+// without one are created in the default registry.
+class Registry {
+    private:
+        void* _registry = nullptr; // "Pointer" to go-land object; null is the default registry
+
+    public:
+        // The default registry
+        Registry() {}
+
+        explicit Registry(int nShards) {
+            _registry = NewRegistry(nShards);
+        }
+
+        ~Registry() {}
+
+        void* Handle() const {
+            return _registry;
+        }
+
+        // Exposes the registry on the endpoint and path (see StartRegistryHandler())
+        void StartHandler(const char* promEndpoint, const char* metricsPath,
+                const PromHandlerOpts* opts = nullptr) const {
+            StartRegistryHandler(_registry, promEndpoint, metricsPath, opts);
+        }
+
+        // Exports the registry to a file (see StartTextfileExport())
+        void StartTextfileExport(const char* path, unsigned int intervalMs = 0) const {
+            ::StartTextfileExport(_registry, path, intervalMs);
+        }
+};
+
+class Gauge {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+
+    public:
+        Gauge() {}
+
+        Gauge(string name, string help) : Gauge(Registry(), name, help) {}
+
+        Gauge(const Registry& registry, string name, string help) {
+            _metric = NewGaugeIn(registry.Handle(), name.c_str(), help.c_str());
+        }
+
+        // Mainly used by GaugeVec, regular users likely wouldn't use this
+        // constructor. If the user has a raw pointer to the Go Gauge object,
+        // they can use this constructor to wrap it into a C++ object.
+        Gauge(void* pGauge) {
+            assert(pGauge != nullptr);
+            _metric = pGauge;
+        }
+
+        ~Gauge() {}
+
+        void* Handle() const {
+            return _metric;
+        }
+
+        void Set(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_GAUGE_SET, val)) {
+                return;
+            }
+            GaugeSet(_metric, val);
+        }
+
+        void Add(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_GAUGE_ADD, val)) {
+                return;
+            }
+            GaugeAdd(_metric, val);
+        }
+
+        void Sub(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_GAUGE_ADD, -val)) {
+                return;
+            }
+            GaugeSub(_metric, val);
+        }
+
+        // Sets gauges[i] to vals[i] for i in [0, n), with one call into Go per
+        // chunk of up to kChunk gauges (see GaugeSetBatch()). While the
+        // AsyncRecorder runs, each update is recorded like Set() instead.
+        static void SetMany(const Gauge* gauges, const double* vals, size_t n) {
+            // Keeps the updates ordered after the ones already in the ring
+            size_t done = 0;
+            while (done < n && detail::AsyncRecord(gauges[done]._metric, EASYPROM_OP_GAUGE_SET, vals[done])) {
+                done++;
+            }
+
+            // Handles are gathered in fixed-size chunks to bound stack usage
+            const size_t kChunk = 1024;
+            void* pGauges[kChunk];
+            for (size_t off = done; off < n; off += kChunk) {
+                size_t nChunk = (n - off < kChunk) ? n - off : kChunk;
+                for (size_t i = 0; i < nChunk; i++) {
+                    pGauges[i] = gauges[off + i]._metric;
+                }
+
+                GaugeSetBatch(pGauges, vals + off, nChunk);
+            }
+        }
+
+        static void SetMany(const vector<Gauge>& gauges, const vector<double>& vals) {
+            assert(gauges.size() == vals.size());
+            SetMany(gauges.data(), vals.data(), vals.size());
+        }
+};
+
+class GaugeVec {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+        std::shared_ptr<detail::ChildCache> _cache; // Shared by all copies
+
+    public:
+        GaugeVec() {}
+
+        GaugeVec(string name, string help, vector<string> labels)
+            : GaugeVec(Registry(), name, help, labels) {}
+
+        GaugeVec(const Registry& registry, string name, string help, vector<string> labels) {
+            const char* cStrLabels[labels.size()];
+            for (unsigned int i = 0; i < labels.size(); i++) {
+                cStrLabels[i] = labels[i].c_str();
+            }
+            _metric = NewGaugeVecIn(registry.Handle(), name.c_str(), help.c_str(), labels.size(),
+                                    cStrLabels);
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        // If the user has a raw pointer to the Go GaugeVec object (e.g. from
+        // NewMetrics()), they can use this constructor to wrap it into a C++ object.
+        GaugeVec(void* pGaugeVec) {
+            assert(pGaugeVec != nullptr);
+            _metric = pGaugeVec;
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        ~GaugeVec() {}
+
+        // Bounds the Vec's children; see VecLimits. Must be called before
+        // any child is created. The cache of children is flushed whenever
+        // idle ones are evicted, so 'limits.evictions' is ignored.
+        void SetLimits(VecLimits limits) {
+            limits.evictions = _cache->Evictions();
+            GaugeVecSetLimits(_metric, &limits);
+        }
+
+        // Children are cached in C++, so looking up an existing child only
+        // costs a hash and a compare, without allocating or calling into Go.
+        Gauge WithLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            return WithLabelValues(views, labelVals.size());
+        }
+
+        Gauge WithLabelValues(std::initializer_list<std::string_view> labelVals) {
+            return WithLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        Gauge WithLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            void* pGauge = detail::CachedChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    return GaugeWithLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+            return pGauge ? Gauge(pGauge) : Gauge(); // Null if rejected by the series limit
+        }
+
+        // Creates (or looks up) the child for each set of label values in a
+        // single call into Go, e.g. to pre-create a known label space at
+        // startup. Children rejected by the series limit are null.
+        vector<Gauge> WithLabelValuesMany(const vector<vector<string>>& labelVals) {
+            vector<const char*> flat = detail::FlattenLabelValues(labelVals);
+            size_t nLabels = labelVals.empty() ? 0 : labelVals[0].size();
+            return WithLabelValuesMany(nLabels, labelVals.size(), flat.data());
+        }
+
+        // The i'th child's label values are labelVals[i * nLabels] to
+        // labelVals[(i + 1) * nLabels - 1]
+        vector<Gauge> WithLabelValuesMany(size_t nLabels, size_t nChildren, const char** labelVals) {
+            return detail::ChildrenMany<Gauge>(_cache.get(), nLabels, nChildren, labelVals,
+                [this](int nLabels, int nChildren, const char** labelVals, void** children) {
+                    GaugeWithLabelValuesMany(_metric, nLabels, nChildren, labelVals, children);
+                });
+        }
+
+        // Like WithLabelValuesMany(), for every combination of the values of
+        // each label, e.g. {{"GET", "POST"}, {"200", "404"}}. Children are
+        // returned in row-major order (the last label's value varies fastest).
+        vector<Gauge> WithLabelValuesProduct(const vector<vector<string>>& valsPerLabel) {
+            return detail::ChildrenProduct<Gauge>(_cache.get(), valsPerLabel,
+                [this](int nLabels, const int* nVals, const char** vals, void** children) {
+                    GaugeWithLabelValuesProduct(_metric, nLabels, nVals, vals, children);
+                });
+        }
+
+        void DeleteLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            DeleteLabelValues(views, labelVals.size());
+        }
+
+        void DeleteLabelValues(std::initializer_list<std::string_view> labelVals) {
+            DeleteLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        void DeleteLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            detail::EvictChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    GaugeDeleteLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+        }
+
+        // Deletes the child, given as returned by WithLabelValues(), without
+        // looking it up by its label values. Returns false if it isn't (or is
+        // no longer) one of the Vec's children.
+        bool Delete(const Gauge& child) {
+            _cache->EraseChild(child.Handle());
+            return GaugeDelete(_metric, child.Handle()) != 0;
+        }
+
+        // Deletes every child whose labels include the given ones, e.g.
+        // {{"tenant", "acme"}}, returning how many were deleted. The cache of
+        // children is flushed if any were.
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return detail::DeletePartialMatch(_cache.get(), labels,
+                [this](int n, const char** labelNames, const char** labelVals) {
+                    return GaugeDeletePartialMatch(_metric, n, labelNames, labelVals);
+                });
+        }
+};
+
+class Counter {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+
+    public:
+        Counter() {}
+
+        Counter(string name, string help) : Counter(Registry(), name, help) {}
+
+        Counter(const Registry& registry, string name, string help) {
+            _metric = NewCounterIn(registry.Handle(), name.c_str(), help.c_str());
+        }
+
+        // Mainly used by CounterVec, regular users likely wouldn't use this
+        // constructor. If the user has a raw pointer to the Go Counter object,
+        // they can use this constructor to wrap it into a C++ object.
+        Counter(void* pCounter) {
+            assert(pCounter != nullptr);
+            _metric = pCounter;
+        }
+
+        ~Counter() {}
+
+        void* Handle() const {
+            return _metric;
+        }
+
+        void Add(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_COUNTER_ADD, val)) {
+                return;
+            }
+            CounterAdd(_metric, val);
+        }
+
+        // Adds vals[i] to counters[i] for i in [0, n), with one call into Go per
+        // chunk of up to kChunk counters (see CounterAddBatch()). While the
+        // AsyncRecorder runs, each update is recorded like Add() instead.
+        static void AddMany(const Counter* counters, const double* vals, size_t n) {
+            // Keeps the updates ordered after the ones already in the ring
+            size_t done = 0;
+            while (done < n && detail::AsyncRecord(counters[done]._metric, EASYPROM_OP_COUNTER_ADD, vals[done])) {
+                done++;
+            }
+
+            // Handles are gathered in fixed-size chunks to bound stack usage
+            const size_t kChunk = 1024;
+            void* pCounters[kChunk];
+            for (size_t off = done; off < n; off += kChunk) {
+                size_t nChunk = (n - off < kChunk) ? n - off : kChunk;
+                for (size_t i = 0; i < nChunk; i++) {
+                    pCounters[i] = counters[off + i]._metric;
+                }
+
+                CounterAddBatch(pCounters, vals + off, nChunk);
+            }
+        }
+
+        static void AddMany(const vector<Counter>& counters, const vector<double>& vals) {
+            assert(counters.size() == vals.size());
+            AddMany(counters.data(), vals.data(), vals.size());
+        }
+};
+
+class CounterVec {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+        std::shared_ptr<detail::ChildCache> _cache; // Shared by all copies
+
+    public:
+        CounterVec() {}
+
+        CounterVec(string name, string help, vector<string> labels)
+            : CounterVec(Registry(), name, help, labels) {}
+
+        CounterVec(const Registry& registry, string name, string help, vector<string> labels) {
+            const char* cStrLabels[labels.size()];
+            for (unsigned int i = 0; i < labels.size(); i++) {
+                cStrLabels[i] = labels[i].c_str();
+            }
+            _metric = NewCounterVecIn(registry.Handle(), name.c_str(), help.c_str(), labels.size(),
+                                        cStrLabels);
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        // If the user has a raw pointer to the Go CounterVec object (e.g. from
+        // NewMetrics()), they can use this constructor to wrap it into a C++ object.
+        CounterVec(void* pCounterVec) {
+            assert(pCounterVec != nullptr);
+            _metric = pCounterVec;
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        ~CounterVec() {}
+
+        // Bounds the Vec's children; see VecLimits. Must be called before
+        // any child is created. The cache of children is flushed whenever
+        // idle ones are evicted, so 'limits.evictions' is ignored.
+        void SetLimits(VecLimits limits) {
+            limits.evictions = _cache->Evictions();
+            CounterVecSetLimits(_metric, &limits);
+        }
+
+        // Children are cached in C++, so looking up an existing child only
+        // costs a hash and a compare, without allocating or calling into Go.
+        Counter WithLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            return WithLabelValues(views, labelVals.size());
+        }
+
+        Counter WithLabelValues(std::initializer_list<std::string_view> labelVals) {
+            return WithLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        Counter WithLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            void* pCounter = detail::CachedChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    return CounterWithLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+            return pCounter ? Counter(pCounter) : Counter(); // Null if rejected by the series limit
+        }
+
+        // Creates (or looks up) the child for each set of label values in a
+        // single call into Go, e.g. to pre-create a known label space at
+        // startup. Children rejected by the series limit are null.
+        vector<Counter> WithLabelValuesMany(const vector<vector<string>>& labelVals) {
+            vector<const char*> flat = detail::FlattenLabelValues(labelVals);
+            size_t nLabels = labelVals.empty() ? 0 : labelVals[0].size();
+            return WithLabelValuesMany(nLabels, labelVals.size(), flat.data());
+        }
+
+        // The i'th child's label values are labelVals[i * nLabels] to
+        // labelVals[(i + 1) * nLabels - 1]
+        vector<Counter> WithLabelValuesMany(size_t nLabels, size_t nChildren, const char** labelVals) {
+            return detail::ChildrenMany<Counter>(_cache.get(), nLabels, nChildren, labelVals,
+                [this](int nLabels, int nChildren, const char** labelVals, void** children) {
+                    CounterWithLabelValuesMany(_metric, nLabels, nChildren, labelVals, children);
+                });
+        }
+
+        // Like WithLabelValuesMany(), for every combination of the values of
+        // each label, e.g. {{"GET", "POST"}, {"200", "404"}}. Children are
+        // returned in row-major order (the last label's value varies fastest).
+        vector<Counter> WithLabelValuesProduct(const vector<vector<string>>& valsPerLabel) {
+            return detail::ChildrenProduct<Counter>(_cache.get(), valsPerLabel,
+                [this](int nLabels, const int* nVals, const char** vals, void** children) {
+                    CounterWithLabelValuesProduct(_metric, nLabels, nVals, vals, children);
+                });
+        }
+
+        void DeleteLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            DeleteLabelValues(views, labelVals.size());
+        }
+
+        void DeleteLabelValues(std::initializer_list<std::string_view> labelVals) {
+            DeleteLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        void DeleteLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            detail::EvictChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    CounterDeleteLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+        }
+
+        bool Delete(const Counter& child) {
+            _cache->EraseChild(child.Handle());
+            return CounterDelete(_metric, child.Handle()) != 0;
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return detail::DeletePartialMatch(_cache.get(), labels,
+                [this](int n, const char** labelNames, const char** labelVals) {
+                    return CounterDeletePartialMatch(_metric, n, labelNames, labelVals);
+                });
+        }
+};
+
+class Histogram {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+
+    public:
+        Histogram() {}
+
+        // An empty 'buckets' means the Prometheus default buckets
+        Histogram(string name, string help, vector<double> buckets = {})
+            : Histogram(Registry(), name, help, buckets) {}
+
+        Histogram(const Registry& registry, string name, string help, vector<double> buckets = {}) {
+            _metric = NewHistogramIn(registry.Handle(), name.c_str(), help.c_str(), buckets.size(),
+                                        buckets.data());
+        }
+
+        // Mainly used by HistogramVec, regular users likely wouldn't use this
+        // constructor. If the user has a raw pointer to the Go Histogram object,
+        // they can use this constructor to wrap it into a C++ object.
+        Histogram(void* pHistogram) {
+            assert(pHistogram != nullptr);
+            _metric = pHistogram;
+        }
+
+        ~Histogram() {}
+
+        void* Handle() const {
+            return _metric;
+        }
+
+        void Observe(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_HISTOGRAM_OBSERVE, val)) {
+                return;
+            }
+            HistogramObserve(_metric, val);
+        }
+
+        // Observes a contiguous range of values in a single call into Go. While
+        // the AsyncRecorder runs, each value is recorded like Observe() instead.
+        void ObserveMany(const double* vals, size_t n) {
+            // Keeps the values ordered after the ones already in the ring
+            size_t done = 0;
+            while (done < n && detail::AsyncRecord(_metric, EASYPROM_OP_HISTOGRAM_OBSERVE, vals[done])) {
+                done++;
+            }
+
+            if (done < n) {
+                HistogramObserveBatch(_metric, vals + done, n - done);
+            }
+        }
+
+        void ObserveMany(const vector<double>& vals) {
+            ObserveMany(vals.data(), vals.size());
+        }
+};
+
+class HistogramVec {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+        std::shared_ptr<detail::ChildCache> _cache; // Shared by all copies
+
+    public:
+        HistogramVec() {}
+
+        HistogramVec(string name, string help, vector<string> labels,
+                vector<double> buckets = {})
+            : HistogramVec(Registry(), name, help, labels, buckets) {}
+
+        HistogramVec(const Registry& registry, string name, string help, vector<string> labels,
+                vector<double> buckets = {}) {
+            const char* cStrLabels[labels.size()];
+            for (unsigned int i = 0; i < labels.size(); i++) {
+                cStrLabels[i] = labels[i].c_str();
+            }
+
+            _metric = NewHistogramVecIn(registry.Handle(), name.c_str(), help.c_str(),
+                                        labels.size(), cStrLabels, buckets.size(), buckets.data());
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        // If the user has a raw pointer to the Go HistogramVec object (e.g. from
+        // NewMetrics()), they can use this constructor to wrap it into a C++ object.
+        HistogramVec(void* pHistogramVec) {
+            assert(pHistogramVec != nullptr);
+            _metric = pHistogramVec;
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        ~HistogramVec() {}
+
+        // Bounds the Vec's children; see VecLimits. Must be called before
+        // any child is created. The cache of children is flushed whenever
+        // idle ones are evicted, so 'limits.evictions' is ignored.
+        void SetLimits(VecLimits limits) {
+            limits.evictions = _cache->Evictions();
+            HistogramVecSetLimits(_metric, &limits);
+        }
+
+        // Children are cached in C++, so looking up an existing child only
+        // costs a hash and a compare, without allocating or calling into Go.
+        Histogram WithLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            return WithLabelValues(views, labelVals.size());
+        }
+
+        Histogram WithLabelValues(std::initializer_list<std::string_view> labelVals) {
+            return WithLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        Histogram WithLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            void* pHistogram = detail::CachedChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    return HistogramWithLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+            return pHistogram ? Histogram(pHistogram) : Histogram(); // Null if rejected by the series limit
+        }
+
+        // Creates (or looks up) the child for each set of label values in a
+        // single call into Go, e.g. to pre-create a known label space at
+        // startup. Children rejected by the series limit are null.
+        vector<Histogram> WithLabelValuesMany(const vector<vector<string>>& labelVals) {
+            vector<const char*> flat = detail::FlattenLabelValues(labelVals);
+            size_t nLabels = labelVals.empty() ? 0 : labelVals[0].size();
+            return WithLabelValuesMany(nLabels, labelVals.size(), flat.data());
+        }
+
+        // The i'th child's label values are labelVals[i * nLabels] to
+        // labelVals[(i + 1) * nLabels - 1]
+        vector<Histogram> WithLabelValuesMany(size_t nLabels, size_t nChildren, const char** labelVals) {
+            return detail::ChildrenMany<Histogram>(_cache.get(), nLabels, nChildren, labelVals,
+                [this](int nLabels, int nChildren, const char** labelVals, void** children) {
+                    HistogramWithLabelValuesMany(_metric, nLabels, nChildren, labelVals, children);
+                });
+        }
+
+        // Like WithLabelValuesMany(), for every combination of the values of
+        // each label, e.g. {{"GET", "POST"}, {"200", "404"}}. Children are
+        // returned in row-major order (the last label's value varies fastest).
+        vector<Histogram> WithLabelValuesProduct(const vector<vector<string>>& valsPerLabel) {
+            return detail::ChildrenProduct<Histogram>(_cache.get(), valsPerLabel,
+                [this](int nLabels, const int* nVals, const char** vals, void** children) {
+                    HistogramWithLabelValuesProduct(_metric, nLabels, nVals, vals, children);
+                });
+        }
+
+        void DeleteLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            DeleteLabelValues(views, labelVals.size());
+        }
+
+        void DeleteLabelValues(std::initializer_list<std::string_view> labelVals) {
+            DeleteLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        void DeleteLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            detail::EvictChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    HistogramDeleteLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+        }
+
+        bool Delete(const Histogram& child) {
+            _cache->EraseChild(child.Handle());
+            return HistogramDelete(_metric, child.Handle()) != 0;
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return detail::DeletePartialMatch(_cache.get(), labels,
+                [this](int n, const char** labelNames, const char** labelVals) {
+                    return HistogramDeletePartialMatch(_metric, n, labelNames, labelVals);
+                });
+        }
+};
+
+// The Prometheus default buckets, used by every histogram created without any
+inline vector<double> DefBuckets() {
+    return {.005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10};
+}
+
+inline vector<double> LinearBuckets(double start, double width, int count) {
+    vector<double> buckets(count);
+    ::LinearBuckets(start, width, count, buckets.data());
+    return buckets;
+}
+
+inline vector<double> ExponentialBuckets(double start, double factor, int count) {
+    vector<double> buckets(count);
+    ::ExponentialBuckets(start, factor, count, buckets.data());
+    return buckets;
+}
+
+class Summary {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+
+    public:
+        Summary() {}
+
+        Summary(string name, string help, unordered_map<double, double> objectives,
+                int maxAge = 60, int nAgeBkts = 5)
+            : Summary(Registry(), name, help, objectives, maxAge, nAgeBkts) {}
+
+        Summary(const Registry& registry, string name, string help,
+                unordered_map<double, double> objectives, int maxAge = 60, int nAgeBkts = 5) {
+            int nQuantiles = objectives.size();
+            double quantiles[nQuantiles];
+            double errors[nQuantiles];
+            auto objIter = objectives.begin();
+            for (int i = 0; i < nQuantiles; i++, objIter++) {
+                quantiles[i] = objIter->first;
+                errors[i] = objIter->second;
+            }
+
+            _metric = NewSummaryIn(registry.Handle(), name.c_str(), help.c_str(), nQuantiles,
+                                    quantiles, errors, maxAge, nAgeBkts);
+        }
+
+        // Mainly used by SummaryVec, regular users likely wouldn't use this
+        // constructor. If the user has a raw pointer to the Go Summary object,
+        // they can use this constructor to wrap it into a C++ object.
+        Summary(void* pSummary) {
+            assert(pSummary != nullptr);
+            _metric = pSummary;
+        }
+
+        ~Summary() {}
+
+        void* Handle() const {
+            return _metric;
+        }
+
+        void Observe(double val) {
+            if (detail::AsyncRecord(_metric, EASYPROM_OP_SUMMARY_OBSERVE, val)) {
+                return;
+            }
+            SummaryObserve(_metric, val);
+        }
+
+        // Observes a contiguous range of values in a single call into Go. While
+        // the AsyncRecorder runs, each value is recorded like Observe() instead.
+        void ObserveMany(const double* vals, size_t n) {
+            // Keeps the values ordered after the ones already in the ring
+            size_t done = 0;
+            while (done < n && detail::AsyncRecord(_metric, EASYPROM_OP_SUMMARY_OBSERVE, vals[done])) {
+                done++;
+            }
+
+            if (done < n) {
+                SummaryObserveBatch(_metric, vals + done, n - done);
+            }
+        }
+
+        void ObserveMany(const vector<double>& vals) {
+            ObserveMany(vals.data(), vals.size());
+        }
+};
+
+class SummaryVec {
+    private:
+        void* _metric = nullptr; // "Pointer" to go-land object
+        std::shared_ptr<detail::ChildCache> _cache; // Shared by all copies
+
+    public:
+        SummaryVec() {}
+
+        SummaryVec(string name, string help, vector<string> labels,
+                unordered_map<double, double> objectives, int maxAge = 60, int nAgeBkts = 5)
+            : SummaryVec(Registry(), name, help, labels, objectives, maxAge, nAgeBkts) {}
+
+        SummaryVec(const Registry& registry, string name, string help, vector<string> labels,
+                unordered_map<double, double> objectives, int maxAge = 60, int nAgeBkts = 5) {
+
+            const char* cStrLabels[labels.size()];
+            for (unsigned int i = 0; i < labels.size(); i++) {
+                cStrLabels[i] = labels[i].c_str();
+            }
+
+            int nQuantiles = objectives.size();
+            double quantiles[nQuantiles];
+            double errors[nQuantiles];
+            auto objIter = objectives.begin();
+            for (int i = 0; i < nQuantiles; i++, objIter++) {
+                quantiles[i] = objIter->first;
+                errors[i] = objIter->second;
+            }
+
+            _metric = NewSummaryVecIn(registry.Handle(), name.c_str(), help.c_str(), labels.size(),
+                                        cStrLabels, nQuantiles, quantiles, errors, maxAge,
+                                        nAgeBkts);
+            _cache = std::make_shared<detail::ChildCache>();
+        }
+
+        ~SummaryVec() {}
+
+        // Bounds the Vec's children; see VecLimits. Must be called before
+        // any child is created. The cache of children is flushed whenever
+        // idle ones are evicted, so 'limits.evictions' is ignored.
+        void SetLimits(VecLimits limits) {
+            limits.evictions = _cache->Evictions();
+            SummaryVecSetLimits(_metric, &limits);
+        }
+
+        // Children are cached in C++, so looking up an existing child only
+        // costs a hash and a compare, without allocating or calling into Go.
+        Summary WithLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            return WithLabelValues(views, labelVals.size());
+        }
+
+        Summary WithLabelValues(std::initializer_list<std::string_view> labelVals) {
+            return WithLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        Summary WithLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            void* pSummary = detail::CachedChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    return SummaryWithLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+            return pSummary ? Summary(pSummary) : Summary(); // Null if rejected by the series limit
+        }
+
+        // Creates (or looks up) the child for each set of label values in a
+        // single call into Go, e.g. to pre-create a known label space at
+        // startup. Children rejected by the series limit are null.
+        vector<Summary> WithLabelValuesMany(const vector<vector<string>>& labelVals) {
+            vector<const char*> flat = detail::FlattenLabelValues(labelVals);
+            size_t nLabels = labelVals.empty() ? 0 : labelVals[0].size();
+            return WithLabelValuesMany(nLabels, labelVals.size(), flat.data());
+        }
+
+        // The i'th child's label values are labelVals[i * nLabels] to
+        // labelVals[(i + 1) * nLabels - 1]
+        vector<Summary> WithLabelValuesMany(size_t nLabels, size_t nChildren, const char** labelVals) {
+            return detail::ChildrenMany<Summary>(_cache.get(), nLabels, nChildren, labelVals,
+                [this](int nLabels, int nChildren, const char** labelVals, void** children) {
+                    SummaryWithLabelValuesMany(_metric, nLabels, nChildren, labelVals, children);
+                });
+        }
+
+        // Like WithLabelValuesMany(), for every combination of the values of
+        // each label, e.g. {{"GET", "POST"}, {"200", "404"}}. Children are
+        // returned in row-major order (the last label's value varies fastest).
+        vector<Summary> WithLabelValuesProduct(const vector<vector<string>>& valsPerLabel) {
+            return detail::ChildrenProduct<Summary>(_cache.get(), valsPerLabel,
+                [this](int nLabels, const int* nVals, const char** vals, void** children) {
+                    SummaryWithLabelValuesProduct(_metric, nLabels, nVals, vals, children);
+                });
+        }
+
+        void DeleteLabelValues(const vector<string>& labelVals) {
+            std::string_view views[labelVals.size()];
+            for (unsigned int i = 0; i < labelVals.size(); i++) {
+                views[i] = labelVals[i];
+            }
+
+            DeleteLabelValues(views, labelVals.size());
+        }
+
+        void DeleteLabelValues(std::initializer_list<std::string_view> labelVals) {
+            DeleteLabelValues(labelVals.begin(), labelVals.size());
+        }
+
+        void DeleteLabelValues(const std::string_view* labelVals, size_t nLabelVals) {
+            detail::EvictChild(_cache.get(), labelVals, nLabelVals,
+                [this](int n, const char** labelVals, const size_t* labelLens) {
+                    SummaryDeleteLabelValuesLen(_metric, n, labelVals, labelLens);
+                });
+        }
+
+        bool Delete(const Summary& child) {
+            _cache->EraseChild(child.Handle());
+            return SummaryDelete(_metric, child.Handle()) != 0;
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return detail::DeletePartialMatch(_cache.get(), labels,
+                [this](int n, const char** labelNames, const char** labelVals) {
+                    return SummaryDeletePartialMatch(_metric, n, labelNames, labelVals);
+                });
+        }
+};
+
+/* ========== FIXED-ARITY METRIC VECTORS ========== */
+// Variants of the Vec classes with the number of labels, N, in their type,
+// e.g. Typed::CounterVec<2>. Passing the wrong number of label values is a
+// compile error rather than a panic in Go, and label values are passed down
+// as pointer + length pairs, without strlen or heap allocations (other than
+// when a child is first created and cached). Label values are only taken as
+// N separate arguments: an array parameter would also accept a braced list of
+// fewer than N values, padding it with empty strings.
+namespace Typed {
+template <size_t N>
+class GaugeVec {
+    static_assert(N > 0, "Use Gauge for metrics without labels");
+
+    private:
+        EasyProm::GaugeVec _vec;
+
+    public:
+        GaugeVec() {}
+
+        GaugeVec(string name, string help, const std::array<string, N>& labels)
+            : _vec(name, help, vector<string>(labels.begin(), labels.end())) {}
+
+        GaugeVec(const Registry& registry, string name, string help,
+                const std::array<string, N>& labels)
+            : _vec(registry, name, help, vector<string>(labels.begin(), labels.end())) {}
+
+        explicit GaugeVec(void* pGaugeVec) : _vec(pGaugeVec) {}
+
+        ~GaugeVec() {}
+
+        void SetLimits(const VecLimits& limits) {
+            _vec.SetLimits(limits);
+        }
+
+        template <typename... Vals>
+        Gauge WithLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            return _vec.WithLabelValues(views.data(), N);
+        }
+
+        vector<Gauge> WithLabelValuesMany(const vector<std::array<string, N>>& labelVals) {
+            vector<const char*> flat;
+            flat.reserve(labelVals.size() * N);
+            for (const std::array<string, N>& tuple : labelVals) {
+                for (const string& val : tuple) {
+                    flat.push_back(val.c_str());
+                }
+            }
+
+            return _vec.WithLabelValuesMany(N, labelVals.size(), flat.data());
+        }
+
+        vector<Gauge> WithLabelValuesProduct(const std::array<vector<string>, N>& valsPerLabel) {
+            return _vec.WithLabelValuesProduct(
+                vector<vector<string>>(valsPerLabel.begin(), valsPerLabel.end()));
+        }
+
+        template <typename... Vals>
+        void DeleteLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            _vec.DeleteLabelValues(views.data(), N);
+        }
+
+        bool Delete(const Gauge& child) {
+            return _vec.Delete(child);
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return _vec.DeletePartialMatch(labels);
+        }
+};
+
+template <size_t N>
+class CounterVec {
+    static_assert(N > 0, "Use Counter for metrics without labels");
+
+    private:
+        EasyProm::CounterVec _vec;
+
+    public:
+        CounterVec() {}
+
+        CounterVec(string name, string help, const std::array<string, N>& labels)
+            : _vec(name, help, vector<string>(labels.begin(), labels.end())) {}
+
+        CounterVec(const Registry& registry, string name, string help,
+                const std::array<string, N>& labels)
+            : _vec(registry, name, help, vector<string>(labels.begin(), labels.end())) {}
+
+        explicit CounterVec(void* pCounterVec) : _vec(pCounterVec) {}
+
+        ~CounterVec() {}
+
+        void SetLimits(const VecLimits& limits) {
+            _vec.SetLimits(limits);
+        }
+
+        template <typename... Vals>
+        Counter WithLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            return _vec.WithLabelValues(views.data(), N);
+        }
+
+        vector<Counter> WithLabelValuesMany(const vector<std::array<string, N>>& labelVals) {
+            vector<const char*> flat;
+            flat.reserve(labelVals.size() * N);
+            for (const std::array<string, N>& tuple : labelVals) {
+                for (const string& val : tuple) {
+                    flat.push_back(val.c_str());
+                }
+            }
+
+            return _vec.WithLabelValuesMany(N, labelVals.size(), flat.data());
+        }
+
+        vector<Counter> WithLabelValuesProduct(const std::array<vector<string>, N>& valsPerLabel) {
+            return _vec.WithLabelValuesProduct(
+                vector<vector<string>>(valsPerLabel.begin(), valsPerLabel.end()));
+        }
+
+        template <typename... Vals>
+        void DeleteLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            _vec.DeleteLabelValues(views.data(), N);
+        }
+
+        bool Delete(const Counter& child) {
+            return _vec.Delete(child);
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return _vec.DeletePartialMatch(labels);
+        }
+};
+
+template <size_t N>
+class HistogramVec {
+    static_assert(N > 0, "Use Histogram for metrics without labels");
+
+    private:
+        EasyProm::HistogramVec _vec;
+
+    public:
+        HistogramVec() {}
+
+        HistogramVec(string name, string help, const std::array<string, N>& labels,
+                vector<double> buckets = {})
+            : _vec(name, help, vector<string>(labels.begin(), labels.end()), buckets) {}
+
+        HistogramVec(const Registry& registry, string name, string help,
+                const std::array<string, N>& labels, vector<double> buckets = {})
+            : _vec(registry, name, help, vector<string>(labels.begin(), labels.end()), buckets) {}
+
+        explicit HistogramVec(void* pHistogramVec) : _vec(pHistogramVec) {}
+
+        ~HistogramVec() {}
+
+        void SetLimits(const VecLimits& limits) {
+            _vec.SetLimits(limits);
+        }
+
+        template <typename... Vals>
+        Histogram WithLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            return _vec.WithLabelValues(views.data(), N);
+        }
+
+        vector<Histogram> WithLabelValuesMany(const vector<std::array<string, N>>& labelVals) {
+            vector<const char*> flat;
+            flat.reserve(labelVals.size() * N);
+            for (const std::array<string, N>& tuple : labelVals) {
+                for (const string& val : tuple) {
+                    flat.push_back(val.c_str());
+                }
+            }
+
+            return _vec.WithLabelValuesMany(N, labelVals.size(), flat.data());
+        }
+
+        vector<Histogram> WithLabelValuesProduct(const std::array<vector<string>, N>& valsPerLabel) {
+            return _vec.WithLabelValuesProduct(
+                vector<vector<string>>(valsPerLabel.begin(), valsPerLabel.end()));
+        }
+
+        template <typename... Vals>
+        void DeleteLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            _vec.DeleteLabelValues(views.data(), N);
+        }
+
+        bool Delete(const Histogram& child) {
+            return _vec.Delete(child);
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return _vec.DeletePartialMatch(labels);
+        }
+};
+
+template <size_t N>
+class SummaryVec {
+    static_assert(N > 0, "Use Summary for metrics without labels");
+
+    private:
+        EasyProm::SummaryVec _vec;
+
+    public:
+        SummaryVec() {}
+
+        SummaryVec(string name, string help, const std::array<string, N>& labels,
+                unordered_map<double, double> objectives, int maxAge = 60, int nAgeBkts = 5)
+            : _vec(name, help, vector<string>(labels.begin(), labels.end()),
+                    objectives, maxAge, nAgeBkts) {}
+
+        SummaryVec(const Registry& registry, string name, string help,
+                const std::array<string, N>& labels, unordered_map<double, double> objectives,
+                int maxAge = 60, int nAgeBkts = 5)
+            : _vec(registry, name, help, vector<string>(labels.begin(), labels.end()),
+                    objectives, maxAge, nAgeBkts) {}
+
+        ~SummaryVec() {}
+
+        void SetLimits(const VecLimits& limits) {
+            _vec.SetLimits(limits);
+        }
+
+        template <typename... Vals>
+        Summary WithLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            return _vec.WithLabelValues(views.data(), N);
+        }
+
+        vector<Summary> WithLabelValuesMany(const vector<std::array<string, N>>& labelVals) {
+            vector<const char*> flat;
+            flat.reserve(labelVals.size() * N);
+            for (const std::array<string, N>& tuple : labelVals) {
+                for (const string& val : tuple) {
+                    flat.push_back(val.c_str());
+                }
+            }
+
+            return _vec.WithLabelValuesMany(N, labelVals.size(), flat.data());
+        }
+
+        vector<Summary> WithLabelValuesProduct(const std::array<vector<string>, N>& valsPerLabel) {
+            return _vec.WithLabelValuesProduct(
+                vector<vector<string>>(valsPerLabel.begin(), valsPerLabel.end()));
+        }
+
+        template <typename... Vals>
+        void DeleteLabelValues(const Vals&... labelVals) {
+            static_assert(sizeof...(Vals) == N, "Wrong number of label values");
+            const std::array<std::string_view, N> views = {std::string_view(labelVals)...};
+            _vec.DeleteLabelValues(views.data(), N);
+        }
+
+        bool Delete(const Summary& child) {
+            return _vec.Delete(child);
+        }
+
+        size_t DeletePartialMatch(const vector<std::pair<string, string>>& labels) {
+            return _vec.DeletePartialMatch(labels);
+        }
+};
+} // End namespace Typed
+
+/* ========== STATIC METRICS ========== */
+// Metrics that can be declared as globals. Constructing one never calls into
+// Go (whose runtime may not have started before main()), it only queues the
+// metric, and all queued metrics are then created in a single call into Go
+// when StartPromHandler() (or Init()) is called. Their names and labels come
+// from a MetricDesc, which validates them at compile time if it's constexpr:
+//     constexpr MetricDesc kRequestsDesc{"requests_total", "Requests served", "method"};
+//     StaticCounterVec<1> requests{kRequestsDesc};
+//     ...
+//     requests->WithLabelValues("GET").Add(1); // Only once registered
+namespace detail {
+// Throwing makes a constant expression ill-formed, so an invalid name in a
+// constexpr MetricDesc fails to compile (and throws if evaluated at runtime)
+constexpr const char* CheckMetricName(const char* name) {
+    return IsValidMetricName(name) ? name : throw std::invalid_argument("Invalid metric name");
+}
+
+constexpr const char* CheckLabelName(const char* name) {
+    return IsValidLabelName(name) ? name : throw std::invalid_argument("Invalid label name");
+}
+} // End namespace detail
+
+template <size_t N>
+struct MetricDesc {
+    const char* name;
+    const char* help;
+    std::array<const char*, N> labels;
+
+    template <typename... Labels>
+    constexpr MetricDesc(const char* metricName, const char* metricHelp, Labels... labelNames)
+            : name(detail::CheckMetricName(metricName)), help(metricHelp),
+              labels{{detail::CheckLabelName(labelNames)...}} {
+        static_assert(sizeof...(Labels) == N, "Wrong number of labels");
+    }
+};
+
+template <typename... Labels>
+MetricDesc(const char*, const char*, Labels...) -> MetricDesc<sizeof...(Labels)>;
+
+namespace detail {
+class StaticMetricBase {
+    public:
+        StaticMetricBase() {}
+        StaticMetricBase(const StaticMetricBase&) = delete;
+        StaticMetricBase& operator=(const StaticMetricBase&) = delete;
+        virtual ~StaticMetricBase() {}
+
+        virtual void Spec(MetricSpec* spec) = 0;
+        virtual void Adopt(void* pMetric) = 0;
+};
+
+struct StaticMetricsState {
+    std::mutex mu;
+    vector<StaticMetricBase*> pending;
+    bool registered = false;
+};
+
+static inline StaticMetricsState& StaticMetrics() {
+    static StaticMetricsState* state = new StaticMetricsState; // Leaked, as globals may outlive it
+    return *state;
+}
+
+// Creates the metrics in a single call into Go. The caller holds the lock.
+static inline void RegisterStatics(const vector<StaticMetricBase*>& metrics) {
+    if (metrics.empty()) { // e.g. Init() without any static metrics
+        return;
+    }
+
+    vector<MetricSpec> specs(metrics.size());
+    vector<void*> pMetrics(metrics.size());
+    for (size_t i = 0; i < metrics.size(); i++) {
+        metrics[i]->Spec(&specs[i]);
+    }
+
+    NewMetrics(specs.data(), specs.size(), pMetrics.data());
+    for (size_t i = 0; i < metrics.size(); i++) {
+        metrics[i]->Adopt(pMetrics[i]);
+    }
+}
+
+static inline void RegisterPendingStatics() {
+    StaticMetricsState& state = StaticMetrics();
+    std::lock_guard<std::mutex> lock(state.mu);
+    if (!state.registered) {
+        RegisterStatics(state.pending);
+        state.pending.clear();
+        state.registered = true;
+    }
+}
+
+// Metrics constructed once the pending ones are registered (e.g. function
+// statics) are registered right away
+static inline void AddStatic(StaticMetricBase* metric) {
+    StaticMetricsState& state = StaticMetrics();
+    std::lock_guard<std::mutex> lock(state.mu);
+    if (state.registered) {
+        RegisterStatics({metric});
+        return;
+    }
+
+    state.pending.push_back(metric);
+    onExportStart = RegisterPendingStatics;
+}
+
+static inline void RemoveStatic(StaticMetricBase* metric) {
+    StaticMetricsState& state = StaticMetrics();
+    std::lock_guard<std::mutex> lock(state.mu);
+    state.pending.erase(std::remove(state.pending.begin(), state.pending.end(), metric),
+                        state.pending.end());
+}
+} // End namespace detail
+
+// Registers the static metrics constructed so far. This is done by every
+// entry point that exports metrics: StartPromHandler(),
+// StartPromHandlerWithOpts(), StartRegistryHandler(), StartRemoteWrite(),
+// StartTextfileExport(), RenderMetrics(), RenderRegistryMetrics() and
+// OpenRenderStream() (and the C++ wrappers of these). So it's only needed to
+// update static metrics before any of them is called. Static metrics
+// constructed later are registered as they're constructed.
+static inline void Init() {
+    detail::RegisterPendingStatics();
+}
+
+// A metric of type Metric, e.g. Gauge or Typed::CounterVec<N>, whose Go
+// object is created when static metrics are registered (see above). Use the
+// aliases below rather than this template.
+template <typename Metric, int Kind, size_t N>
+class StaticMetric final : public detail::StaticMetricBase {
+    private:
+        static const bool kIsHistogram =
+            (Kind == EASYPROM_KIND_HISTOGRAM || Kind == EASYPROM_KIND_HISTOGRAM_VEC);
+
+        MetricDesc<N> _desc;
+        vector<double> _buckets; // Histograms only
+        Metric _metric;
+        bool _registered = false;
+
+    public:
+        explicit StaticMetric(const MetricDesc<N>& desc) : _desc(desc) {
+            detail::AddStatic(this);
+        }
+
+        // An empty 'buckets' means the Prometheus default buckets
+        StaticMetric(const MetricDesc<N>& desc, vector<double> buckets)
+                : _desc(desc), _buckets(std::move(buckets)) {
+            static_assert(kIsHistogram, "Only histograms have buckets");
+            detail::AddStatic(this);
+        }
+
+        ~StaticMetric() {
+            detail::RemoveStatic(this);
+        }
+
+        void Spec(MetricSpec* spec) override {
+            spec->kind = Kind;
+            spec->name = _desc.name;
+            spec->help = _desc.help;
+            spec->nLabels = N;
+            spec->labels = _desc.labels.data();
+            spec->nBuckets = _buckets.size();
+            spec->buckets = _buckets.data();
+        }
+
+        void Adopt(void* pMetric) override {
+            _metric = Metric(pMetric);
+            _registered = true;
+        }
+
+        // Must not be called before the metric is registered
+        Metric& Get() {
+            assert(_registered && "Static metric used before registration (see Init())");
+            return _metric;
+        }
+
+        Metric* operator->() {
+            return &Get();
+        }
+};
+
+using StaticGauge = StaticMetric<Gauge, EASYPROM_KIND_GAUGE, 0>;
+using StaticCounter = StaticMetric<Counter, EASYPROM_KIND_COUNTER, 0>;
+using StaticHistogram = StaticMetric<Histogram, EASYPROM_KIND_HISTOGRAM, 0>;
+
+template <size_t N>
+using StaticGaugeVec = StaticMetric<Typed::GaugeVec<N>, EASYPROM_KIND_GAUGE_VEC, N>;
+
+template <size_t N>
+using StaticCounterVec = StaticMetric<Typed::CounterVec<N>, EASYPROM_KIND_COUNTER_VEC, N>;
+
+template <size_t N>
+using StaticHistogramVec = StaticMetric<Typed::HistogramVec<N>, EASYPROM_KIND_HISTOGRAM_VEC, N>;
+
+/* ========== FUNC METRICS ========== */
+// Gauges and counters computed by a callback at scrape time (see
+// NewGaugeFunc()). Callbacks run on a Go thread during the gather, and may
+// run concurrently with the program's threads, so they must synchronize
+// access to whatever they read. The callbacks are intentionally never
+// freed, since Go keeps calling them for as long as the process lives.
+namespace detail {
+typedef std::function<double()> ValueFunc;
+
+static inline double CallValueFunc(void* ctx) {
+    return (*static_cast<ValueFunc*>(ctx))();
+}
+} // End namespace detail
+
+// Passed to the callback of a GaugeVecFunc or CounterVecFunc, which calls
+// Emit() once per series
+class FuncVecEmitter {
+    private:
+        MetricEmitFn _emit;
+        void* _emitCtx;
+        size_t _nLabels;
+
+    public:
+        FuncVecEmitter(MetricEmitFn emit, void* emitCtx, size_t nLabels)
+            : _emit(emit), _emitCtx(emitCtx), _nLabels(nLabels) {}
+
+        void Emit(const vector<string>& labelVals, double val) {
+            assert(labelVals.size() == _nLabels && "Wrong number of label values");
+            const char* cStrLabelVals[_nLabels + 1];
+            for (size_t i = 0; i < _nLabels; i++) {
+                cStrLabelVals[i] = labelVals[i].c_str();
+            }
+            _emit(_emitCtx, cStrLabelVals, val);
+        }
+};
+
+namespace detail {
+struct EnumFunc {
+    std::function<void(FuncVecEmitter&)> fn;
+    size_t nLabels;
+};
+
+static inline void CallEnumFunc(void* ctx, MetricEmitFn emit, void* emitCtx) {
+    EnumFunc* enumFunc = static_cast<EnumFunc*>(ctx);
+    FuncVecEmitter emitter(emit, emitCtx, enumFunc->nLabels);
+    enumFunc->fn(emitter);
+}
+
+static inline vector<const char*> CStrs(const vector<string>& strs) {
+    vector<const char*> cStrs;
+    for (const string& str : strs) {
+        cStrs.push_back(str.c_str());
+    }
+    return cStrs;
+}
+} // End namespace detail
+
+class GaugeFunc {
+    public:
+        GaugeFunc() {}
+
+        GaugeFunc(string name, string help, std::function<double()> fn) {
+            NewGaugeFunc(name.c_str(), help.c_str(), &detail::CallValueFunc,
+                            new detail::ValueFunc(std::move(fn)));
+        }
+
+        ~GaugeFunc() {}
+};
+
+// The callback must return a value that never decreases
+class CounterFunc {
+    public:
+        CounterFunc() {}
+
+        CounterFunc(string name, string help, std::function<double()> fn) {
+            NewCounterFunc(name.c_str(), help.c_str(), &detail::CallValueFunc,
+                            new detail::ValueFunc(std::move(fn)));
+        }
+
+        ~CounterFunc() {}
+};
+
+// e.g. GaugeVecFunc("queue_depth", "...", {"queue"}, [&](FuncVecEmitter& e) {
+//          for (auto& q : queues) e.Emit({q.name}, q.Depth());
+//      });
+class GaugeVecFunc {
+    public:
+        GaugeVecFunc() {}
+
+        GaugeVecFunc(string name, string help, vector<string> labels,
+                std::function<void(FuncVecEmitter&)> fn) {
+            vector<const char*> cStrLabels = detail::CStrs(labels);
+            NewGaugeVecFunc(name.c_str(), help.c_str(), labels.size(), cStrLabels.data(),
+                            &detail::CallEnumFunc, new detail::EnumFunc{std::move(fn), labels.size()});
+        }
+
+        ~GaugeVecFunc() {}
+};
+
+class CounterVecFunc {
+    public:
+        CounterVecFunc() {}
+
+        CounterVecFunc(string name, string help, vector<string> labels,
+                std::function<void(FuncVecEmitter&)> fn) {
+            vector<const char*> cStrLabels = detail::CStrs(labels);
+            NewCounterVecFunc(name.c_str(), help.c_str(), labels.size(), cStrLabels.data(),
+                            &detail::CallEnumFunc, new detail::EnumFunc{std::move(fn), labels.size()});
+        }
+
+        ~CounterVecFunc() {}
+};
+
+/* ========== NATIVE (C++-RESIDENT) METRICS ========== */
+// Unlike the classes above, these keep their values in C++ memory and are
+// updated with plain atomics; Go only reads them when the registry is
+// gathered. Updating them never crosses into Go.
+namespace detail {
+struct alignas(EASYPROM_CACHE_LINE) Cell {
+    std::atomic<uint64_t> bits;
+};
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+        "Go reads cells as raw uint64 values");
+
+// Cells are intentionally never freed, since Go keeps reading them for as
+// long as the process lives (same as the Go-land objects of other metrics).
+static inline Cell* NewCells(unsigned nCells) {
+    void* mem = nullptr;
+    int ret = posix_memalign(&mem, EASYPROM_CACHE_LINE, sizeof(Cell) * nCells);
+    assert(ret == 0 && mem != nullptr);
+    (void)ret;
+
+    Cell* cells = static_cast<Cell*>(mem);
+    for (unsigned i = 0; i < nCells; i++) {
+        new (&cells[i]) Cell;
+        cells[i].bits.store(0, std::memory_order_relaxed);
+    }
+
+    return cells;
+}
+
+static inline uint64_t DoubleToBits(double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+static inline double BitsToDouble(uint64_t bits) {
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static inline void AtomicAddDouble(std::atomic<uint64_t>& bits, double val) {
+    uint64_t oldBits = bits.load(std::memory_order_relaxed);
+    while (!bits.compare_exchange_weak(oldBits, DoubleToBits(BitsToDouble(oldBits) + val),
+                                        std::memory_order_relaxed)) {}
+}
+
+// Branch-free lower bound: returns the number of entries in 'bounds' that are
+// less than 'val', i.e. the index of the histogram bucket 'val' falls in.
+// 'nBounds' must be a power of two and bounds[nBounds - 1] must be +Inf, so
+// the search always takes log2(nBounds) steps, each compiling down to a
+// conditional move. For ~20 buckets, that's 5 steps over one or two
+// cache lines, with no mispredictions regardless of the value distribution.
+// NOTE: NaN is never less than any bound, so callers must handle it.
+static inline unsigned BucketIndex(const double* bounds, unsigned nBounds, double val) {
+    const double* base = bounds;
+    unsigned n = nBounds;
+    while (n > 1) {
+        unsigned half = n / 2;
+        base = (base[half - 1] < val) ? base + half : base;
+        n -= half;
+    }
+
+    return (base - bounds) + (*base < val);
+}
+
+// Index of the calling thread's cell, assigned once per thread
+static inline unsigned ThreadShard() {
+    static std::atomic<unsigned> nextShard{0};
+    static thread_local unsigned shard =
+        nextShard.fetch_add(1, std::memory_order_relaxed) % EASYPROM_NUM_SHARDS;
+    return shard;
+}
+} // End namespace detail
+
+// Floating point counter. Each thread adds into its own cell, so the
+// compare-and-swap needed for doubles almost never retries.
+class NativeCounter {
+    private:
+        detail::Cell* _cells = nullptr;
+
+    public:
+        NativeCounter() {}
+
+        NativeCounter(string name, string help) {
+            _cells = detail::NewCells(EASYPROM_NUM_SHARDS);
+            RegisterNativeCounter(name.c_str(), help.c_str(), _cells,
+                                    EASYPROM_NUM_SHARDS, sizeof(detail::Cell));
+        }
+
+        ~NativeCounter() {}
+
+        void Add(double val) {
+            detail::AtomicAddDouble(_cells[detail::ThreadShard()].bits, val);
+        }
+
+        void Inc() {
+            Add(1);
+        }
+
+        // Sums all cells; intended for tests and debugging, not hot paths
+        double Value() const {
+            double sum = 0;
+            for (unsigned i = 0; i < EASYPROM_NUM_SHARDS; i++) {
+                sum += detail::BitsToDouble(_cells[i].bits.load(std::memory_order_relaxed));
+            }
+            return sum;
+        }
+};
+
+// Integer counter, updated with a single fetch_add (no compare-and-swap loop)
+class NativeIntCounter {
+    private:
+        detail::Cell* _cells = nullptr;
+
+    public:
+        NativeIntCounter() {}
+
+        NativeIntCounter(string name, string help) {
+            _cells = detail::NewCells(EASYPROM_NUM_SHARDS);
+            RegisterNativeIntCounter(name.c_str(), help.c_str(), _cells,
+                                        EASYPROM_NUM_SHARDS, sizeof(detail::Cell));
+        }
+
+        ~NativeIntCounter() {}
+
+        void Add(uint64_t val) {
+            _cells[detail::ThreadShard()].bits.fetch_add(val, std::memory_order_relaxed);
+        }
+
+        void Inc() {
+            Add(1);
+        }
+
+        // Sums all cells; intended for tests and debugging, not hot paths
+        uint64_t Value() const {
+            uint64_t sum = 0;
+            for (unsigned i = 0; i < EASYPROM_NUM_SHARDS; i++) {
+                sum += _cells[i].bits.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+};
+
+// A gauge must support Set(), which can't be split across per-thread cells,
+// so it's backed by a single padded cell.
+class NativeGauge {
+    private:
+        detail::Cell* _cell = nullptr;
+
+    public:
+        NativeGauge() {}
+
+        NativeGauge(string name, string help) {
+            _cell = detail::NewCells(1);
+            RegisterNativeGauge(name.c_str(), help.c_str(), _cell, 1, sizeof(detail::Cell));
+        }
+
+        ~NativeGauge() {}
+
+        void Set(double val) {
+            _cell->bits.store(detail::DoubleToBits(val), std::memory_order_relaxed);
+        }
+
+        void Add(double val) {
+            detail::AtomicAddDouble(_cell->bits, val);
+        }
+
+        void Sub(double val) {
+            detail::AtomicAddDouble(_cell->bits, -val);
+        }
+
+        double Value() const {
+            return detail::BitsToDouble(_cell->bits.load(std::memory_order_relaxed));
+        }
+};
+// Histogram with bucket counts kept in C++, in per-thread shards. Observing
+// finds the bucket with a branch-free search (see detail::BucketIndex) and
+// does a single fetch_add; Go only reads the shards at scrape time.
+class NativeHistogram {
+    private:
+        struct State {
+            double* searchBounds;       // Padded to a power of two with +Inf
+            unsigned nSearchBounds;
+            unsigned nBounds;           // Excluding +Inf
+            std::atomic<uint64_t>* cells;
+            size_t shardWords;          // uint64_t words per shard, padded
+        };
+
+        // Shared by all copies of this object, and never freed since Go
+        // keeps reading the cells for as long as the process lives.
+        State* _state = nullptr;
+
+    public:
+        NativeHistogram() {}
+
+        // 'buckets' are the sorted upper bounds, excluding +Inf. Like
+        // Histogram, an empty 'buckets' means the Prometheus default buckets.
+        NativeHistogram(string name, string help, vector<double> buckets = {}) {
+            if (buckets.empty()) {
+                buckets = DefBuckets();
+            }
+            while (!buckets.empty() && buckets.back() == HUGE_VAL) {
+                buckets.pop_back();
+            }
+            for (size_t i = 1; i < buckets.size(); i++) {
+                assert(buckets[i - 1] < buckets[i] && "Buckets must be sorted");
+            }
+
+            State* state = new State;
+            state->nBounds = buckets.size();
+
+            state->nSearchBounds = 1;
+            while (state->nSearchBounds < state->nBounds + 1) {
+                state->nSearchBounds *= 2;
+            }
+            state->searchBounds = new double[state->nSearchBounds];
+            for (unsigned i = 0; i < state->nSearchBounds; i++) {
+                state->searchBounds[i] = (i < state->nBounds) ? buckets[i] : HUGE_VAL;
+            }
+
+            // Each shard: nBounds + 1 counts, then the sum; padded to a cache line
+            const size_t wordsPerLine = EASYPROM_CACHE_LINE / sizeof(uint64_t);
+            state->shardWords = (state->nBounds + 2 + wordsPerLine - 1) / wordsPerLine * wordsPerLine;
+
+            size_t nWords = state->shardWords * EASYPROM_NUM_SHARDS;
+            void* mem = nullptr;
+            int ret = posix_memalign(&mem, EASYPROM_CACHE_LINE, nWords * sizeof(uint64_t));
+            assert(ret == 0 && mem != nullptr);
+            (void)ret;
+
+            state->cells = static_cast<std::atomic<uint64_t>*>(mem);
+            for (size_t i = 0; i < nWords; i++) {
+                new (&state->cells[i]) std::atomic<uint64_t>(0);
+            }
+
+            _state = state;
+            RegisterNativeHistogram(name.c_str(), help.c_str(), buckets.size(), buckets.data(),
+                                    state->cells, EASYPROM_NUM_SHARDS,
+                                    state->shardWords * sizeof(uint64_t));
+        }
+
+        ~NativeHistogram() {}
+
+        void Observe(double val) {
+            // NaN goes into the +Inf bucket, like in the Go client
+            unsigned idx = (val == val) ?
+                detail::BucketIndex(_state->searchBounds, _state->nSearchBounds, val) :
+                _state->nBounds;
+            std::atomic<uint64_t>* shard =
+                _state->cells + detail::ThreadShard() * _state->shardWords;
+
+            shard[idx].fetch_add(1, std::memory_order_relaxed);
+            detail::AtomicAddDouble(shard[_state->nBounds + 1], val);
+        }
+};
+
+// Options for NativeSummary's sketch. Values whose magnitude is within
+// [minValue, maxValue] are tracked with the given relative accuracy; smaller
+// magnitudes are counted as 0, and larger ones as maxValue.
+// Memory: nShards + nAgeBkts sketches of (2 * nBins + 3) * 8 bytes, where
+// nBins = ln(maxValue / minValue) / ln((1 + accuracy) / (1 - accuracy)),
+// i.e. ~22KB per sketch with the defaults.
+struct NativeSummaryOpts {
+    double relativeAccuracy = 0.01;
+    double minValue = 1e-6;
+    double maxValue = 1e6;
+    unsigned nShards = 8; // Sketches updated by disjoint sets of threads
+};
+
+namespace detail {
+// Background thread calling each registered function at the start of every
+// period of its own (e.g. a NativeSummary's age bucket), on the steady clock.
+// Started by the first registration; like the functions' contexts, it lives
+// for as long as the process.
+struct AgeTicker {
+    struct Entry {
+        void (*fn)(void* ctx);
+        void* ctx;
+        int64_t periodNanos;
+    };
+
+    std::mutex mu; // Guards 'entries'
+    std::condition_variable cv;
+    vector<Entry> entries;
+    bool started = false;
+};
+
+// Intentionally leaked, like Async()
+static inline AgeTicker& Ticker() {
+    static AgeTicker* ticker = new AgeTicker;
+    return *ticker;
+}
+
+static inline void AddAgeTick(void (*fn)(void* ctx), void* ctx, int64_t periodNanos) {
+    AgeTicker& ticker = Ticker();
+    std::lock_guard<std::mutex> lock(ticker.mu);
+    ticker.entries.push_back({fn, ctx, periodNanos});
+    ticker.cv.notify_one(); // Its next wake-up may be earlier now
+    if (ticker.started) {
+        return;
+    }
+
+    ticker.started = true;
+    std::thread([&ticker]() {
+        std::unique_lock<std::mutex> lock(ticker.mu);
+        while (true) {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            int64_t next = INT64_MAX;
+            for (const AgeTicker::Entry& entry : ticker.entries) {
+                next = std::min(next, (now / entry.periodNanos + 1) * entry.periodNanos);
+            }
+
+            ticker.cv.wait_until(lock, std::chrono::steady_clock::time_point(
+                                        std::chrono::nanoseconds(next)));
+
+            // The functions take their own locks, so entries can be added meanwhile
+            vector<AgeTicker::Entry> entries = ticker.entries;
+            lock.unlock();
+            for (const AgeTicker::Entry& entry : entries) {
+                entry.fn(entry.ctx);
+            }
+            lock.lock();
+        }
+    }).detach();
+}
+} // End namespace detail
+
+// Summary backed by a DDSketch (log-bucketed histogram) kept in C++, in
+// per-thread shards, instead of the Go client's mutex-guarded CKMS stream.
+// Observing does two fetch_adds (count and bucket) plus a compare-and-swap
+// on the shard's sum, which only contends with threads sharing the shard.
+// That makes it lock-free, but not wait-free: the compare-and-swap may retry
+// while other threads of the shard update the sum.
+// Every quantile estimate is within 'relativeAccuracy' of the true value at
+// that rank (for magnitudes within [minValue, maxValue]); the error values of
+// the objectives are ignored.
+//
+// The sliding window (maxAge split into nAgeBkts buckets) is kept as
+// snapshots of the cumulative shards, which a background thread takes at the
+// start of every age bucket (see AgeTicker). Quantiles cover everything
+// since the snapshot of the oldest age bucket in the window, whatever the
+// scrape interval. Count and sum are cumulative, as in the Go client.
+class NativeSummary {
+    private:
+        struct Snapshot {
+            int64_t epoch; // Age bucket index, since the steady clock's epoch
+            vector<uint64_t> bins;
+        };
+
+        struct State {
+            // Sketch mapping: bin k covers (gamma^(k + minKey - 1), gamma^(k + minKey)]
+            double gamma;
+            double invLogGamma;
+            double minValue;
+            int minKey;
+            unsigned nBins;       // Per sign
+
+            // Each shard: count, sum bits, zero bin, negative bins, positive
+            // bins; padded to a cache line
+            std::atomic<uint64_t>* cells;
+            unsigned nShards;
+            size_t shardWords;
+
+            int64_t ageBucketNanos;
+            unsigned nAgeBkts;
+
+            std::mutex mu; // Guards 'snapshots', never taken by Observe()
+            vector<Snapshot> snapshots;
+        };
+
+        // Never freed, since Go keeps scraping it for as long as the process lives
+        State* _state = nullptr;
+
+        static int64_t epochNow(const State* state) {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            return now / state->ageBucketNanos;
+        }
+
+        // Word index of 'val's bin within a shard
+        static size_t binWord(const State* state, double val) {
+            double mag = fabs(val);
+            if (mag < state->minValue) {
+                return 2;
+            }
+
+            // Clamped as a double first, so +Inf stays well-defined
+            double key = ceil(log(mag) * state->invLogGamma) - state->minKey;
+            key = fmin(fmax(key, 0), state->nBins - 1);
+
+            return (val < 0 ? 3 : 3 + state->nBins) + (size_t)key;
+        }
+
+        // Representative value of merged bin 'idx', within the relative
+        // accuracy of every value in the bin
+        static double binValue(const State* state, size_t idx) {
+            if (idx == 0) {
+                return 0;
+            }
+
+            bool negative = idx <= state->nBins;
+            int key = (int)(negative ? idx - 1 : idx - 1 - state->nBins) + state->minKey;
+            double val = 2 * pow(state->gamma, key) / (state->gamma + 1);
+
+            return negative ? -val : val;
+        }
+
+        // Merges the shards' bins (zero bin, negative bins, positive bins),
+        // returning the merged count and sum through 'count' and 'sum'
+        static vector<uint64_t> mergeShards(const State* state, uint64_t* count, double* sum) {
+            size_t nMerged = 2 * state->nBins + 1;
+            vector<uint64_t> bins(nMerged);
+            *count = 0;
+            *sum = 0;
+            for (unsigned s = 0; s < state->nShards; s++) {
+                const std::atomic<uint64_t>* shard = state->cells + s * state->shardWords;
+                *count += shard[0].load(std::memory_order_relaxed);
+                *sum += detail::BitsToDouble(shard[1].load(std::memory_order_relaxed));
+                for (size_t i = 0; i < nMerged; i++) {
+                    bins[i] += shard[2 + i].load(std::memory_order_relaxed);
+                }
+            }
+
+            return bins;
+        }
+
+        // Snapshots 'bins' if it's the first time in the current age bucket,
+        // and drops the snapshots that start before the window. Requires
+        // state->mu.
+        static void rotate(State* state, int64_t epoch, const vector<uint64_t>& bins) {
+            vector<Snapshot>& snapshots = state->snapshots;
+            if (snapshots.back().epoch < epoch) {
+                snapshots.push_back({epoch, bins});
+            }
+
+            size_t nExpired = 0;
+            while (snapshots[nExpired].epoch <= epoch - (int64_t)state->nAgeBkts) {
+                nExpired++;
+            }
+            snapshots.erase(snapshots.begin(), snapshots.begin() + nExpired);
+        }
+
+        // Called by the AgeTicker at the start of every age bucket
+        static void tick(void* ctx) {
+            State* state = static_cast<State*>(ctx);
+            std::lock_guard<std::mutex> lock(state->mu);
+            int64_t epoch = epochNow(state);
+            if (state->snapshots.back().epoch < epoch) {
+                uint64_t count;
+                double sum;
+                rotate(state, epoch, mergeShards(state, &count, &sum));
+            }
+        }
+
+        static void scrape(void* ctx, const double* quantiles, int nQuantiles,
+                double* values, uint64_t* count, double* sum) {
+            State* state = static_cast<State*>(ctx);
+            size_t nMerged = 2 * state->nBins + 1;
+
+            // Merged under the lock, so no snapshot is newer than 'bins'
+            std::lock_guard<std::mutex> lock(state->mu);
+            vector<uint64_t> bins = mergeShards(state, count, sum);
+            rotate(state, epochNow(state), bins); // In case the scrape beats the ticker
+            const vector<Snapshot>& snapshots = state->snapshots;
+
+            // Observations in the window, ordered from the most negative
+            // bin to the most positive one
+            const vector<uint64_t>& base = snapshots.front().bins;
+            vector<size_t> order;
+            order.reserve(nMerged);
+            for (size_t i = state->nBins; i >= 1; i--) {
+                order.push_back(i);
+            }
+            order.push_back(0);
+            for (size_t i = state->nBins + 1; i < nMerged; i++) {
+                order.push_back(i);
+            }
+
+            uint64_t total = 0;
+            for (size_t i = 0; i < nMerged; i++) {
+                total += bins[i] - base[i];
+            }
+
+            for (int q = 0; q < nQuantiles; q++) {
+                if (total == 0) {
+                    values[q] = NAN;
+                    continue;
+                }
+
+                double rank = quantiles[q] * (total - 1);
+                uint64_t cumCount = 0;
+                values[q] = binValue(state, order.back());
+                for (size_t idx : order) {
+                    cumCount += bins[idx] - base[idx];
+                    if (cumCount > rank) {
+                        values[q] = binValue(state, idx);
+                        break;
+                    }
+                }
+            }
+        }
+
+    public:
+        NativeSummary() {}
+
+        // 'maxAge' is in seconds. As in the Go client, 0 for 'maxAge' or
+        // 'nAgeBkts' means 10 minutes or 5 buckets, respectively.
+        NativeSummary(string name, string help, unordered_map<double, double> objectives,
+                int maxAge = 60, int nAgeBkts = 5, NativeSummaryOpts opts = NativeSummaryOpts()) {
+            assert(opts.relativeAccuracy > 0 && opts.relativeAccuracy < 1);
+            assert(opts.minValue > 0 && opts.minValue < opts.maxValue);
+            assert(opts.nShards > 0);
+
+            State* state = new State;
+            state->gamma = (1 + opts.relativeAccuracy) / (1 - opts.relativeAccuracy);
+            state->invLogGamma = 1 / log(state->gamma);
+            state->minValue = opts.minValue;
+            state->minKey = (int)ceil(log(opts.minValue) * state->invLogGamma);
+            state->nBins = (int)ceil(log(opts.maxValue) * state->invLogGamma) - state->minKey + 1;
+
+            const size_t wordsPerLine = EASYPROM_CACHE_LINE / sizeof(uint64_t);
+            state->nShards = opts.nShards;
+            state->shardWords = (2 * state->nBins + 3 + wordsPerLine - 1) / wordsPerLine * wordsPerLine;
+
+            size_t nWords = state->shardWords * state->nShards;
+            void* mem = nullptr;
+            int ret = posix_memalign(&mem, EASYPROM_CACHE_LINE, nWords * sizeof(uint64_t));
+            assert(ret == 0 && mem != nullptr);
+            (void)ret;
+
+            state->cells = static_cast<std::atomic<uint64_t>*>(mem);
+            for (size_t i = 0; i < nWords; i++) {
+                new (&state->cells[i]) std::atomic<uint64_t>(0);
+            }
+
+            state->nAgeBkts = nAgeBkts > 0 ? nAgeBkts : 5;
+            int64_t maxAgeNanos = (maxAge > 0 ? maxAge : 600) * 1000000000LL;
+            state->ageBucketNanos = std::max<int64_t>(maxAgeNanos / state->nAgeBkts, 1);
+            state->snapshots.push_back({epochNow(state), vector<uint64_t>(2 * state->nBins + 1)});
+
+            vector<double> quantiles;
+            for (auto& objective : objectives) {
+                quantiles.push_back(objective.first);
+            }
+
+            _state = state;
+            RegisterNativeSummary(name.c_str(), help.c_str(), quantiles.size(), quantiles.data(),
+                                    &NativeSummary::scrape, state);
+            detail::AddAgeTick(&NativeSummary::tick, state, state->ageBucketNanos);
+        }
+
+        ~NativeSummary() {}
+
+        void Observe(double val) {
+            std::atomic<uint64_t>* shard =
+                _state->cells + (detail::ThreadShard() % _state->nShards) * _state->shardWords;
+
+            shard[0].fetch_add(1, std::memory_order_relaxed);
+            detail::AtomicAddDouble(shard[1], val);
+            if (val == val) { // NaN only counts towards the count and sum
+                shard[binWord(_state, val)].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+};
+
+/* ========== MULTI-PROCESS (SHARED MEMORY) METRICS ========== */
+// For pre-fork servers, whose workers can't call into Go (the Go runtime
+// doesn't survive fork()). SharedMetrics::Init() maps a region of shared
+// memory holding a slab per process, and each Shared* metric gets the same
+// fixed offset into every slab. Both must happen in the parent, before it
+// forks. Each worker then calls SharedMetrics::Attach() to claim a slab, and
+// updates its cells with plain atomics. The parent (the only process that
+// serves scrapes) aggregates the slabs at scrape time: summed into one
+// series, or as a series per process labeled with its pid.
+// When a worker exits, the parent should call SharedMetrics::Release() with
+// its pid. Summed counters and histograms keep its counts, so they never go
+// backwards; gauges and per-process counters are reset.
+enum class SharedAggregation {
+    Sum,        // One series, summed over all processes
+    PerProcess  // One series per process, labeled "pid"
+};
+
+struct SharedMetricsOpts {
+    unsigned maxProcesses = 64;         // Including the parent
+    unsigned bytesPerProcess = 65536;   // Cell space of each slab
+};
+
+namespace detail {
+struct SharedState {
+    char* region = nullptr; // nSlabs slabs, each slabSize bytes
+    unsigned nSlabs = 0;
+    size_t slabSize = 0;
+    size_t used = EASYPROM_CACHE_LINE;  // Per slab; the first line holds the owner's pid
+
+    // The calling process's slab. Until a forked worker attaches, it's a
+    // private scratch slab whose updates are never exported.
+    char* slab = nullptr;
+    char* scratch = nullptr;
+
+    // Cell ranges reset whenever a slab changes owner (gauges and
+    // per-process counters)
+    vector<std::pair<size_t, size_t>> resetRanges;
+};
+
+static inline SharedState& Shared() {
+    static SharedState* state = new SharedState;
+    return *state;
+}
+
+static inline std::atomic<int64_t>& SlabOwner(char* slab) {
+    return *reinterpret_cast<std::atomic<int64_t>*>(slab);
+}
+
+static inline std::atomic<uint64_t>& SharedCell(size_t offset) {
+    return *reinterpret_cast<std::atomic<uint64_t>*>(Shared().slab + offset);
+}
+
+// Hands the slab over from 'owner' to 'newOwner'. The owner is negative in
+// between, so scrapes skip the slab while its cells are reset.
+static inline bool TransferSlab(char* slab, int64_t owner, int64_t newOwner) {
+    if (!SlabOwner(slab).compare_exchange_strong(owner, -1)) {
+        return false;
+    }
+
+    for (auto& range : Shared().resetRanges) {
+        for (size_t off = range.first; off < range.first + range.second; off += sizeof(uint64_t)) {
+            reinterpret_cast<std::atomic<uint64_t>*>(slab + off)->store(0, std::memory_order_relaxed);
+        }
+    }
+    SlabOwner(slab).store(newOwner, std::memory_order_release);
+
+    return true;
+}
+
+// Claims a free slab or, failing that, the slab of a process that has exited
+// without being released. Returns nullptr if every slab is taken.
+static inline char* ClaimSlab() {
+    SharedState& state = Shared();
+    int64_t pid = getpid();
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < state.nSlabs; i++) {
+            char* slab = state.region + i * state.slabSize;
+            int64_t owner = SlabOwner(slab).load(std::memory_order_relaxed);
+            bool claimable = (owner == 0) ||
+                (pass == 1 && owner > 0 && kill(owner, 0) != 0 && errno == ESRCH);
+            if (claimable && TransferSlab(slab, owner, pid)) {
+                return slab;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+// Reserves 'bytes' in every slab, returning their offset
+static inline size_t SharedAlloc(size_t bytes, bool resetOnTransfer) {
+    SharedState& state = Shared();
+    assert(state.region != nullptr && "SharedMetrics::Init() must be called first");
+
+    bytes = (bytes + EASYPROM_CACHE_LINE - 1) / EASYPROM_CACHE_LINE * EASYPROM_CACHE_LINE;
+    assert(state.used + bytes <= state.slabSize && "SharedMetricsOpts::bytesPerProcess exceeded");
+
+    size_t offset = state.used;
+    state.used += bytes;
+    if (resetOnTransfer) {
+        state.resetRanges.emplace_back(offset, bytes);
+    }
+
+    return offset;
+}
+} // End namespace detail
+
+class SharedMetrics {
+    public:
+        // Maps the shared region and claims a slab for the calling process.
+        // Call once, in the parent, before creating any Shared* metric.
+        static void Init(SharedMetricsOpts opts = SharedMetricsOpts()) {
+            detail::SharedState& state = detail::Shared();
+            assert(state.region == nullptr && "SharedMetrics::Init() called twice");
+            assert(opts.maxProcesses > 0);
+
+            state.nSlabs = opts.maxProcesses;
+            state.slabSize = (EASYPROM_CACHE_LINE + opts.bytesPerProcess + EASYPROM_CACHE_LINE - 1) /
+                                EASYPROM_CACHE_LINE * EASYPROM_CACHE_LINE;
+
+            // Anonymous shared memory is zeroed, and inherited across fork()
+            void* mem = mmap(nullptr, state.nSlabs * state.slabSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            assert(mem != MAP_FAILED);
+            state.region = static_cast<char*>(mem);
+            state.scratch = static_cast<char*>(calloc(1, state.slabSize));
+
+            state.slab = detail::ClaimSlab();
+            pthread_atfork(nullptr, nullptr, []() { detail::Shared().slab = detail::Shared().scratch; });
+        }
+
+        // Claims a slab for the calling (forked) process. Returns false if
+        // every slab is owned by a live process, in which case the process's
+        // updates aren't exported.
+        static bool Attach() {
+            detail::SharedState& state = detail::Shared();
+            char* slab = detail::ClaimSlab();
+            if (slab == nullptr) {
+                fprintf(stderr, "easyprom: no free shared metrics slab for pid %d\n", (int)getpid());
+                state.slab = state.scratch;
+                return false;
+            }
+
+            state.slab = slab;
+            return true;
+        }
+
+        // Frees the slab of an exited process, e.g. after waitpid()
+        static void Release(pid_t pid) {
+            detail::SharedState& state = detail::Shared();
+            for (unsigned i = 0; i < state.nSlabs; i++) {
+                if (detail::TransferSlab(state.region + i * state.slabSize, pid, 0)) {
+                    return;
+                }
+            }
         }
 };
 
-class GaugeVec {
+class SharedCounter {
     private:
-        void* _metric = nullptr; // "Pointer" to go-land object
+        size_t _offset = 0;
 
     public:
-        GaugeVec() {}
+        SharedCounter() {}
 
-        GaugeVec(string name, string help, vector<string> labels) {
-            const char* cStrLabels[labels.size()];
-            for (unsigned int i = 0; i < labels.size(); i++) {
-                cStrLabels[i] = labels[i].c_str();
+        SharedCounter(string name, string help, SharedAggregation agg = SharedAggregation::Sum) {
+            detail::SharedState& state = detail::Shared();
+            bool perProcess = (agg == SharedAggregation::PerProcess);
+            _offset = detail::SharedAlloc(sizeof(uint64_t), perProcess);
+
+            if (perProcess) {
+                RegisterNativePerProcess(name.c_str(), help.c_str(), 0, state.region,
+                                            state.nSlabs, state.slabSize, _offset);
+            } else {
+                RegisterNativeCounter(name.c_str(), help.c_str(), state.region + _offset,
+                                        state.nSlabs, state.slabSize);
             }
-            _metric = NewGaugeVec(name.c_str(), help.c_str(), labels.size(), cStrLabels);
         }
 
-        ~GaugeVec() {}
+        ~SharedCounter() {}
 
-        Gauge WithLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+        void Add(double val) {
+            detail::AtomicAddDouble(detail::SharedCell(_offset), val);
+        }
+
+        void Inc() {
+            Add(1);
+        }
+
+        // The calling process's count
+        double Value() const {
+            return detail::BitsToDouble(detail::SharedCell(_offset).load(std::memory_order_relaxed));
+        }
+};
+
+class SharedGauge {
+    private:
+        size_t _offset = 0;
+
+    public:
+        SharedGauge() {}
+
+        SharedGauge(string name, string help, SharedAggregation agg = SharedAggregation::Sum) {
+            detail::SharedState& state = detail::Shared();
+            _offset = detail::SharedAlloc(sizeof(uint64_t), true);
+
+            if (agg == SharedAggregation::PerProcess) {
+                RegisterNativePerProcess(name.c_str(), help.c_str(), 1, state.region,
+                                            state.nSlabs, state.slabSize, _offset);
+            } else {
+                RegisterNativeGauge(name.c_str(), help.c_str(), state.region + _offset,
+                                    state.nSlabs, state.slabSize);
             }
+        }
+
+        ~SharedGauge() {}
 
-            void* pGauge = GaugeWithLabelValues(_metric, labelVals.size(), cStrLabelVals);
-            return Gauge(pGauge);
+        void Set(double val) {
+            detail::SharedCell(_offset).store(detail::DoubleToBits(val), std::memory_order_relaxed);
         }
 
-        void DeleteLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+        void Add(double val) {
+            detail::AtomicAddDouble(detail::SharedCell(_offset), val);
+        }
+
+        void Sub(double val) {
+            detail::AtomicAddDouble(detail::SharedCell(_offset), -val);
+        }
+
+        // The calling process's value
+        double Value() const {
+            return detail::BitsToDouble(detail::SharedCell(_offset).load(std::memory_order_relaxed));
+        }
+};
+
+// Always summed over all processes. Each slab holds one NativeHistogram shard.
+class SharedHistogram {
+    private:
+        struct State {
+            double* searchBounds;       // Padded to a power of two with +Inf
+            unsigned nSearchBounds;
+            unsigned nBounds;           // Excluding +Inf
+            size_t offset;
+        };
+
+        State* _state = nullptr;
+
+    public:
+        SharedHistogram() {}
+
+        // 'buckets' are the sorted upper bounds, excluding +Inf. Like
+        // Histogram, an empty 'buckets' means the Prometheus default buckets.
+        SharedHistogram(string name, string help, vector<double> buckets = {}) {
+            if (buckets.empty()) {
+                buckets = DefBuckets();
+            }
+            while (!buckets.empty() && buckets.back() == HUGE_VAL) {
+                buckets.pop_back();
+            }
+            for (size_t i = 1; i < buckets.size(); i++) {
+                assert(buckets[i - 1] < buckets[i] && "Buckets must be sorted");
+            }
+
+            State* state = new State;
+            state->nBounds = buckets.size();
+
+            state->nSearchBounds = 1;
+            while (state->nSearchBounds < state->nBounds + 1) {
+                state->nSearchBounds *= 2;
             }
+            state->searchBounds = new double[state->nSearchBounds];
+            for (unsigned i = 0; i < state->nSearchBounds; i++) {
+                state->searchBounds[i] = (i < state->nBounds) ? buckets[i] : HUGE_VAL;
+            }
+
+            // nBounds + 1 counts, then the sum
+            state->offset = detail::SharedAlloc((state->nBounds + 2) * sizeof(uint64_t), false);
+
+            _state = state;
+            detail::SharedState& shared = detail::Shared();
+            RegisterNativeHistogram(name.c_str(), help.c_str(), buckets.size(), buckets.data(),
+                                    shared.region + state->offset, shared.nSlabs, shared.slabSize);
+        }
 
-            GaugeDeleteLabelValues(_metric, labelVals.size(), cStrLabelVals);
+        ~SharedHistogram() {}
+
+        void Observe(double val) {
+            // NaN goes into the +Inf bucket, like in the Go client
+            unsigned idx = (val == val) ?
+                detail::BucketIndex(_state->searchBounds, _state->nSearchBounds, val) :
+                _state->nBounds;
+
+            detail::SharedCell(_state->offset + idx * sizeof(uint64_t))
+                .fetch_add(1, std::memory_order_relaxed);
+            detail::AtomicAddDouble(
+                detail::SharedCell(_state->offset + (_state->nBounds + 1) * sizeof(uint64_t)), val);
         }
 };
 
-class Counter {
+/* ========== SCOPED TIMERS ========== */
+// Clock for timing code blocks. Where the CPU has an invariant TSC (one that
+// ticks at a constant rate, in sync across cores), reading it is a single
+// instruction, rather than the vDSO call behind steady_clock. Ticks are
+// converted to seconds with a factor calibrated against steady_clock on
+// first use (a ~2ms busy wait), so call Calibrate() at startup to keep that
+// off hot paths. Without an invariant TSC, ticks are steady_clock nanoseconds.
+class TickClock {
     private:
-        void* _metric = nullptr; // "Pointer" to go-land object
+        struct State {
+            bool useTsc = false;
+            double secondsPerTick = 1e-9;
+        };
+
+        static uint64_t steadyNanos() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static const State& state() {
+            static const State state = []() {
+                State s;
+#ifdef EASYPROM_USE_TSC
+                unsigned eax, ebx, ecx, edx;
+                if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8))) {
+                    uint64_t startNanos = steadyNanos();
+                    uint64_t startTicks = __rdtsc();
+                    while (steadyNanos() - startNanos < 2000000) {}
+                    uint64_t nanos = steadyNanos() - startNanos;
+                    uint64_t ticks = __rdtsc() - startTicks;
+
+                    s.useTsc = (ticks > 0);
+                    s.secondsPerTick = s.useTsc ? nanos * 1e-9 / ticks : 1e-9;
+                }
+#endif
+                return s;
+            }();
+
+            return state;
+        }
 
     public:
-        Counter() {}
+        static void Calibrate() {
+            state();
+        }
 
-        Counter(string name, string help) {
-            _metric = NewCounter(name.c_str(), help.c_str());
+        static bool UsesTsc() {
+            return state().useTsc;
         }
 
-        // Mainly used by CounterVec, regular users likely wouldn't use this
-        // constructor. If the user has a raw pointer to the Go Counter object,
-        // they can use this constructor to wrap it into a C++ object.
-        Counter(void* pCounter) {
-            assert(pCounter != nullptr);
-            _metric = pCounter;
+        static double SecondsPerTick() {
+            return state().secondsPerTick;
         }
 
-        ~Counter() {}
+        // For the start of a timed block
+        static uint64_t Now() {
+#ifdef EASYPROM_USE_TSC
+            if (__builtin_expect(state().useTsc, 1)) {
+                return __rdtsc();
+            }
+#endif
+            return steadyNanos();
+        }
 
-        void Add(double val) {
-            CounterAdd(_metric, val);
+        // For the end of a timed block: rdtscp waits for the block's
+        // instructions to complete before reading the TSC
+        static uint64_t NowAfter() {
+#ifdef EASYPROM_USE_TSC
+            if (__builtin_expect(state().useTsc, 1)) {
+                unsigned aux;
+                return __rdtscp(&aux);
+            }
+#endif
+            return steadyNanos();
         }
 };
 
-class CounterVec {
+// Move-only RAII timer: observes the time elapsed since its construction
+// into 'metric' (anything with Observe(double), e.g. a Summary or Histogram)
+// when destroyed. 'Unit' is the unit of the observed values, as a ratio of
+// seconds (e.g. std::milli), so the scaling is folded into one constant.
+template <typename Metric, typename Unit = std::ratio<1>>
+class ScopedTimer {
     private:
-        void* _metric = nullptr; // "Pointer" to go-land object
+        Metric* _metric;
+        uint64_t _start;
 
     public:
-        CounterVec() {}
+        explicit ScopedTimer(Metric& metric) : _metric(&metric), _start(TickClock::Now()) {}
 
-        CounterVec(string name, string help, vector<string> labels) {
-            const char* cStrLabels[labels.size()];
-            for (unsigned int i = 0; i < labels.size(); i++) {
-                cStrLabels[i] = labels[i].c_str();
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        ScopedTimer(ScopedTimer&& other) : _metric(other._metric), _start(other._start) {
+            other._metric = nullptr;
+        }
+
+        ScopedTimer& operator=(ScopedTimer&& other) = delete;
+
+        ~ScopedTimer() {
+            if (_metric != nullptr) {
+                _metric->Observe(Elapsed());
             }
-            _metric = NewCounterVec(name.c_str(), help.c_str(), labels.size(), cStrLabels);
         }
 
-        ~CounterVec() {}
+        // Time elapsed so far, in 'Unit's
+        double Elapsed() const {
+            static const double unitsPerTick =
+                TickClock::SecondsPerTick() * Unit::den / Unit::num;
+            return (TickClock::NowAfter() - _start) * unitsPerTick;
+        }
 
-        Counter WithLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+        // Discards the timing, so nothing is observed
+        void Cancel() {
+            _metric = nullptr;
+        }
+};
+
+// auto timer = ObserveDuration(summary); or, for milliseconds,
+// auto timer = ObserveDuration<std::milli>(summary);
+template <typename Unit = std::ratio<1>, typename Metric>
+ScopedTimer<Metric, Unit> ObserveDuration(Metric& metric) {
+    return ScopedTimer<Metric, Unit>(metric);
+}
+
+/* ========== ASYNCHRONOUS RECORDER ========== */
+// Opt-in mode where Gauge, Counter, Summary and Histogram updates only append
+// a (metric, op, value) record to a ring buffer owned by the calling thread.
+// A background thread periodically drains every ring and applies the records
+// in large batches (see ApplyRecords()), so latency-critical threads never
+// call into Go. The batch methods (SetMany(), AddMany() and ObserveMany())
+// append one record per element rather than calling Go directly. Updates from
+// one thread, single or batched, are applied in order; updates from different
+// threads are not ordered relative to each other.
+enum class AsyncOverflow {
+    Drop,   // Discard the update (counted in easyprom_async_dropped_records_total)
+    Block   // Wait for the background thread to make room
+};
+
+struct AsyncRecorderOpts {
+    unsigned flushIntervalMs = 100;
+    unsigned ringCapacity = 8192; // Records per thread, rounded up to a power of two
+    AsyncOverflow overflow = AsyncOverflow::Drop;
+};
+
+namespace detail {
+struct AsyncRecordEntry {
+    void* pMetric;
+    double val;
+    unsigned char op;
+};
+
+// Single-producer (the owning thread), single-consumer (whoever holds the
+// drain lock) ring of records.
+struct AsyncRing {
+    alignas(EASYPROM_CACHE_LINE) std::atomic<size_t> head{0}; // Next record to drain
+    alignas(EASYPROM_CACHE_LINE) std::atomic<size_t> tail{0}; // Next record to fill
+    std::atomic<bool> orphaned{false}; // Owning thread exited; free once drained
+    size_t mask = 0;
+    AsyncRecordEntry* records = nullptr;
+};
+
+struct AsyncState {
+    std::atomic<bool> enabled{false};
+    AsyncRecorderOpts opts;
+
+    std::mutex ringsMu; // Guards 'rings'
+    vector<AsyncRing*> rings;
+
+    std::mutex drainMu; // Serializes consumers (background thread and Flush())
+    vector<AsyncRing*> drainRings;
+    vector<void*> batchMetrics;
+    vector<unsigned char> batchOps;
+    vector<double> batchVals;
+
+    std::mutex wakeMu;
+    std::condition_variable wakeCv;
+    bool stopping = false;
+    std::thread flusher;
+
+    std::atomic<uint64_t>* dropped = nullptr; // Cell exported as a metric
+};
+
+// Intentionally leaked, so it outlives any thread-local ring owners that are
+// destroyed during process exit.
+static inline AsyncState& Async() {
+    static AsyncState* state = new AsyncState;
+    return *state;
+}
+
+struct AsyncRingOwner {
+    AsyncRing* ring = nullptr;
+
+    ~AsyncRingOwner() {
+        if (ring != nullptr) {
+            ring->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static inline AsyncRing* ThreadRing() {
+    static thread_local AsyncRingOwner owner;
+    if (__builtin_expect(owner.ring == nullptr, 0)) {
+        AsyncState& state = Async();
+        size_t capacity = 1;
+        while (capacity < state.opts.ringCapacity) {
+            capacity *= 2;
+        }
+
+        AsyncRing* ring = new AsyncRing;
+        ring->mask = capacity - 1;
+        ring->records = new AsyncRecordEntry[capacity];
+
+        std::lock_guard<std::mutex> lock(state.ringsMu);
+        state.rings.push_back(ring);
+        owner.ring = ring;
+    }
+
+    return owner.ring;
+}
+
+static inline bool AsyncRecord(void* pMetric, unsigned char op, double val) {
+    AsyncState& state = Async();
+    if (!state.enabled.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    AsyncRing* ring = ThreadRing();
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    while (tail - ring->head.load(std::memory_order_acquire) > ring->mask) {
+        if (state.opts.overflow == AsyncOverflow::Drop) {
+            state.dropped->fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Nobody will drain the ring once the recorder is stopped
+        if (!state.enabled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        state.wakeCv.notify_one();
+        std::this_thread::yield();
+    }
+
+    ring->records[tail & ring->mask] = {pMetric, val, op};
+    ring->tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+static inline void AsyncApplyBatch(AsyncState& state) {
+    if (!state.batchMetrics.empty()) {
+        ApplyRecords(state.batchMetrics.data(), state.batchOps.data(),
+                        state.batchVals.data(), state.batchMetrics.size());
+        state.batchMetrics.clear();
+        state.batchOps.clear();
+        state.batchVals.clear();
+    }
+}
+
+// Applies every record appended before this call
+static inline void AsyncDrain() {
+    const size_t kBatchSize = 8192;
+    AsyncState& state = Async();
+    std::lock_guard<std::mutex> drainLock(state.drainMu);
+
+    {
+        std::lock_guard<std::mutex> lock(state.ringsMu);
+        state.drainRings = state.rings;
+    }
+
+    for (AsyncRing* ring : state.drainRings) {
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        size_t tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const AsyncRecordEntry& rec = ring->records[head & ring->mask];
+            state.batchMetrics.push_back(rec.pMetric);
+            state.batchOps.push_back(rec.op);
+            state.batchVals.push_back(rec.val);
+            if (state.batchMetrics.size() == kBatchSize) {
+                ring->head.store(head + 1, std::memory_order_release);
+                AsyncApplyBatch(state);
             }
+        }
+        ring->head.store(head, std::memory_order_release);
+    }
+    AsyncApplyBatch(state);
 
-            void* pCounter = CounterWithLabelValues(_metric, labelVals.size(), cStrLabelVals);
-            return Counter(pCounter);
+    // Free the rings of exited threads once they've been fully drained
+    std::lock_guard<std::mutex> lock(state.ringsMu);
+    for (size_t i = 0; i < state.rings.size();) {
+        AsyncRing* ring = state.rings[i];
+        if (ring->orphaned.load(std::memory_order_acquire) &&
+                ring->head.load(std::memory_order_relaxed) ==
+                ring->tail.load(std::memory_order_acquire)) {
+            state.rings[i] = state.rings.back();
+            state.rings.pop_back();
+            delete[] ring->records;
+            delete ring;
+        } else {
+            i++;
         }
+    }
+}
+} // End namespace detail
 
-        void DeleteLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+class AsyncRecorder {
+    public:
+        // Switches all Gauge, Counter, Summary and Histogram objects to
+        // asynchronous recording. No-op if the recorder is already running.
+        static void Start(AsyncRecorderOpts opts = AsyncRecorderOpts()) {
+            detail::AsyncState& state = detail::Async();
+            if (state.flusher.joinable()) {
+                return;
+            }
+
+            if (state.dropped == nullptr) {
+                detail::Cell* cell = detail::NewCells(1);
+                state.dropped = &cell->bits;
+                RegisterNativeIntCounter("easyprom_async_dropped_records_total",
+                        "Updates dropped because a thread's async recorder ring was full",
+                        cell, 1, sizeof(detail::Cell));
             }
 
-            CounterDeleteLabelValues(_metric, labelVals.size(), cStrLabelVals);
+            state.opts = opts;
+            state.stopping = false;
+            state.flusher = std::thread([&state]() {
+                std::unique_lock<std::mutex> lock(state.wakeMu);
+                while (!state.stopping) {
+                    state.wakeCv.wait_for(lock, std::chrono::milliseconds(state.opts.flushIntervalMs));
+                    lock.unlock();
+                    detail::AsyncDrain();
+                    lock.lock();
+                }
+            });
+            state.enabled.store(true, std::memory_order_release);
+        }
+
+        // Switches back to synchronous recording, after applying all pending
+        // records. Updates racing with Stop() may be applied by a later
+        // Flush() rather than by Stop() itself.
+        static void Stop() {
+            detail::AsyncState& state = detail::Async();
+            if (!state.flusher.joinable()) {
+                return;
+            }
+
+            state.enabled.store(false, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(state.wakeMu);
+                state.stopping = true;
+            }
+            state.wakeCv.notify_one();
+            state.flusher.join();
+            detail::AsyncDrain();
+        }
+
+        // Barrier: returns once every update recorded before the call has
+        // been applied. Call before shutdown or an explicit consistent read.
+        static void Flush() {
+            detail::AsyncDrain();
+        }
+
+        static uint64_t Dropped() {
+            detail::AsyncState& state = detail::Async();
+            return state.dropped ? state.dropped->load(std::memory_order_relaxed) : 0;
         }
 };
 
-class Summary {
+/* ========== EMBEDDED RENDERING ========== */
+// Appends the rendering of the registry to 'out' (e.g. a std::string or
+// std::vector<char> the caller reuses across scrapes), growing it as needed.
+// Returns false, leaving 'out' unchanged, if the format isn't supported or
+// gathering the registry failed.
+template <typename Buffer>
+bool AppendMetrics(Buffer& out, const Registry& registry = Registry(),
+        int format = EASYPROM_FORMAT_TEXT) {
+    size_t start = out.size();
+    size_t cap = std::max<size_t>(out.capacity() - start, 4096);
+    while (true) {
+        size_t needed = 0;
+        out.resize(start + cap);
+        int rc = RenderRegistryMetrics(registry.Handle(), out.data() + start, cap, &needed, format);
+        if (rc <= 0) {
+            out.resize((rc == 0) ? start + needed : start);
+            return rc == 0;
+        }
+
+        cap = needed + needed / 8; // Headroom, in case metrics were added meanwhile
+    }
+}
+
+// A rendering read in chunks (see OpenRenderStream()), closed on destruction
+class RenderStream {
     private:
-        void* _metric = nullptr; // "Pointer" to go-land object
+        void* _stream = nullptr;
 
     public:
-        Summary() {}
+        explicit RenderStream(const Registry& registry = Registry(),
+                int format = EASYPROM_FORMAT_TEXT) {
+            _stream = OpenRenderStream(registry.Handle(), format);
+        }
 
-        Summary(string name, string help, unordered_map<double, double> objectives,
-                int maxAge = 60, int nAgeBkts = 5) {
-            int nQuantiles = objectives.size();
-            double quantiles[nQuantiles];
-            double errors[nQuantiles];
-            auto objIter = objectives.begin();
-            for (int i = 0; i < nQuantiles; i++, objIter++) {
-                quantiles[i] = objIter->first;
-                errors[i] = objIter->second;
+        ~RenderStream() {
+            if (_stream != nullptr) {
+                CloseRenderStream(_stream);
             }
-
-            _metric = NewSummary(name.c_str(), help.c_str(), nQuantiles,
-                                    quantiles, errors, maxAge, nAgeBkts);
         }
 
-        // Mainly used by SummaryVec, regular users likely wouldn't use this
-        // constructor. If the user has a raw pointer to the Go Summary object,
-        // they can use this constructor to wrap it into a C++ object.
-        Summary(void* pSummary) {
-            assert(pSummary != nullptr);
-            _metric = pSummary;
+        RenderStream(const RenderStream&) = delete;
+        RenderStream& operator=(const RenderStream&) = delete;
+
+        // False if the format isn't supported or gathering the registry failed
+        bool Valid() const {
+            return _stream != nullptr;
         }
 
-        ~Summary() {}
+        // Returns the bytes copied into 'buf'; 0 once the rendering is done
+        size_t Read(char* buf, size_t cap) {
+            return (_stream != nullptr) ? ReadRenderStream(_stream, buf, cap) : 0;
+        }
 
-        void Observe(double val) {
-            SummaryObserve(_metric, val);
+        // Appends up to 'maxBytes' of the rendering to 'out', returning the
+        // bytes appended
+        template <typename Buffer>
+        size_t AppendTo(Buffer& out, size_t maxBytes) {
+            size_t start = out.size();
+            out.resize(start + maxBytes);
+            size_t n = Read(out.data() + start, maxBytes);
+            out.resize(start + n);
+            return n;
         }
 };
 
-class SummaryVec {
+/* ========== SAMPLED SUMMARIES ========== */
+namespace detail {
+// xorshift64* generator, one per thread, for sampling decisions. Seeded on
+// first use, differently in each thread.
+static inline uint64_t SampleRandom() {
+    static thread_local uint64_t state = 0;
+    if (state == 0) {
+        state = ((uint64_t)(uintptr_t)&state ^
+                (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count()) | 1;
+    }
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+// True with probability 1/n, using a multiply rather than a division
+static inline bool SampleOneIn(uint64_t n) {
+    return (uint64_t)(((unsigned __int128)SampleRandom() * n) >> 64) == 0;
+}
+
+// Sampling rate of a SampledSummary, shared by its copies
+struct SamplerState {
+    static constexpr int64_t kWindowNanos = 100000000; // Adaptation period
+
+    std::atomic<uint32_t> oneIn{1};
+    uint32_t maxSamplesPerSec = 0; // 0 means the rate is fixed
+    uint64_t windowBudget = 1;     // Samples per window at maxSamplesPerSec
+    std::atomic<uint64_t> windowSamples{0};
+    std::atomic<int64_t> windowStart{0};
+    Gauge ratio; // 1 / oneIn
+
+    static int64_t nowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+} // End namespace detail
+
+// Options for SampledSummary. Zero means the default for each.
+struct SamplingOpts {
+    uint32_t oneIn;            // Sample one in this many values on average (default 1, i.e. all)
+    uint32_t maxSamplesPerSec; // If set, 'oneIn' is only the initial rate, adapted to
+                               // keep about this many samples per second
+};
+
+// A Summary for paths too hot to observe every value, e.g. at hundreds of
+// millions of calls per second. Observe() keeps each value with probability
+// 1/N, as decided by a thread-local PRNG, so skipped values cost a few
+// instructions and never reach the backend. Kept values are observed with a
+// weight of N, which scales the exported _count and _sum so that rates stay
+// accurate, while quantiles are estimated from the kept values. N is fixed,
+// or re-estimated every 100ms (or sooner, when a window's budget of samples
+// runs out early) to keep about 'maxSamplesPerSec' samples per second. The
+// current 1/N is exported as the gauge <name>_sampling_ratio. Only the
+// default registry is supported.
+class SampledSummary {
     private:
         void* _metric = nullptr; // "Pointer" to go-land object
+        std::shared_ptr<detail::SamplerState> _sampler;
 
-    public:
-        SummaryVec() {}
-
-        SummaryVec(string name, string help, vector<string> labels,
-                unordered_map<double, double> objectives, int maxAge = 60, int nAgeBkts = 5) {
+        // Counts a kept sample towards the window, re-estimating N at its end
+        void adapt() {
+            detail::SamplerState& s = *_sampler;
+            uint64_t samples = s.windowSamples.fetch_add(1, std::memory_order_relaxed) + 1;
+            int64_t now = detail::SamplerState::nowNanos();
+            int64_t start = s.windowStart.load(std::memory_order_relaxed);
+            if (samples < s.windowBudget && now - start < detail::SamplerState::kWindowNanos) {
+                return;
+            }
+            if (!s.windowStart.compare_exchange_strong(start, now)) {
+                return; // Another thread is adapting
+            }
 
-            const char* cStrLabels[labels.size()];
-            for (unsigned int i = 0; i < labels.size(); i++) {
-                cStrLabels[i] = labels[i].c_str();
+            samples = s.windowSamples.exchange(0, std::memory_order_relaxed);
+            double samplesPerSec = samples * 1e9 / std::max<int64_t>(now - start, 1);
+            uint32_t oneIn = s.oneIn.load(std::memory_order_relaxed);
+            double next = oneIn * samplesPerSec / s.maxSamplesPerSec;
+            uint32_t nextOneIn = (uint32_t)(std::min(std::max(next, 1.0), 4294967295.0) + 0.5);
+            if (nextOneIn != oneIn) {
+                s.oneIn.store(nextOneIn, std::memory_order_relaxed);
+                s.ratio.Set(1.0 / nextOneIn);
             }
+        }
 
+    public:
+        SampledSummary() {}
+
+        SampledSummary(string name, string help, unordered_map<double, double> objectives,
+                SamplingOpts sampling, int maxAge = 60, int nAgeBkts = 5) {
             int nQuantiles = objectives.size();
-            double quantiles[nQuantiles];
-            double errors[nQuantiles];
+            double quantiles[nQuantiles + 1];
+            double errors[nQuantiles + 1];
             auto objIter = objectives.begin();
             for (int i = 0; i < nQuantiles; i++, objIter++) {
                 quantiles[i] = objIter->first;
                 errors[i] = objIter->second;
             }
 
-            _metric = NewSummaryVec(name.c_str(), help.c_str(), labels.size(), cStrLabels,
-                                    nQuantiles, quantiles, errors, maxAge, nAgeBkts);
+            _metric = NewSampledSummary(name.c_str(), help.c_str(), nQuantiles, quantiles, errors,
+                                        maxAge, nAgeBkts);
+
+            _sampler = std::make_shared<detail::SamplerState>();
+            _sampler->oneIn = std::max<uint32_t>(sampling.oneIn, 1);
+            _sampler->maxSamplesPerSec = sampling.maxSamplesPerSec;
+            _sampler->windowBudget = std::max<uint64_t>(
+                    (uint64_t)sampling.maxSamplesPerSec * detail::SamplerState::kWindowNanos / 1000000000,
+                    1);
+            _sampler->windowStart = detail::SamplerState::nowNanos();
+            _sampler->ratio = Gauge(name + "_sampling_ratio",
+                                    "Fraction of the observations of " + name + " that are sampled");
+            _sampler->ratio.Set(1.0 / _sampler->oneIn);
         }
 
-        ~SummaryVec() {}
+        ~SampledSummary() {}
 
-        Summary WithLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+        void* Handle() const {
+            return _metric;
+        }
+
+        void Observe(double val) {
+            if (_sampler == nullptr) {
+                return;
             }
 
-            void* pSummary = SummaryWithLabelValues(_metric, labelVals.size(), cStrLabelVals);
-            return Summary(pSummary);
-        }
+            uint32_t oneIn = _sampler->oneIn.load(std::memory_order_relaxed);
+            if (oneIn > 1 && !detail::SampleOneIn(oneIn)) {
+                return;
+            }
 
-        void DeleteLabelValues(vector<string> labelVals) {
-            const char* cStrLabelVals[labelVals.size()];
-            for (unsigned int i = 0; i < labelVals.size(); i++) {
-                cStrLabelVals[i] = labelVals[i].c_str();
+            SummaryObserveWeighted(_metric, val, oneIn);
+            if (_sampler->maxSamplesPerSec > 0) {
+                adapt();
             }
+        }
 
-            SummaryDeleteLabelValues(_metric, labelVals.size(), cStrLabelVals);
+        // The current N, of sampling one in N values
+        uint32_t OneIn() const {
+            return (_sampler == nullptr) ? 1 : _sampler->oneIn.load(std::memory_order_relaxed);
         }
 };
 } // End namespace EasyProm
@@ -0,0 +1,3236 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Pure C++ backend: implements the functions exported by the Go backend
+ * (see promClientNative.h) without embedding a Go runtime. It has its own
+ * metric registry, text exposition renderer and a minimal HTTP listener.
+ *
+ * Behaviour follows the Go backend where it matters to users: invalid or
+ * duplicate registrations and label cardinality mismatches abort (where Go
+ * would panic), and operations on unknown or deleted handles are ignored.
+ * Differences: there are no go_* runtime metrics (process_* ones are
+ * exported) nor cgo call counts, and summary quantiles are estimated from a
+ * bounded uniform sample of each age bucket rather than with the CKMS
+ * algorithm, so the requested error bounds are not used.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "promClientNative.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/* ===========================================================================
+ * HELPER FUNCTIONS
+ * =========================================================================== */
+// Equivalent of a Go panic: report and abort
+[[noreturn]] void fatal(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "panic: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+string goStr2Str(GoString str) {
+    return string(str.p, str.n);
+}
+
+vector<string> goSlice2Strs(GoSlice slice) {
+    const GoString* strs = static_cast<const GoString*>(slice.data);
+    vector<string> out;
+    out.reserve(slice.len);
+    for (GoInt i = 0; i < slice.len; i++) {
+        out.push_back(goStr2Str(strs[i]));
+    }
+
+    return out;
+}
+
+vector<double> goSlice2Doubles(GoSlice slice) {
+    const double* vals = static_cast<const double*>(slice.data);
+    return vector<double>(vals, vals + slice.len);
+}
+
+uint64_t doubleToBits(double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+double bitsToDouble(uint64_t bits) {
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+void atomicAddDouble(std::atomic<uint64_t>& bits, double val) {
+    uint64_t oldBits = bits.load(std::memory_order_relaxed);
+    while (!bits.compare_exchange_weak(oldBits, doubleToBits(bitsToDouble(oldBits) + val),
+                                        std::memory_order_relaxed)) {}
+}
+
+int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool validMetricName(const string& name) {
+    if (name.empty() || isdigit((unsigned char)name[0])) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != ':') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool validLabelName(const string& name) {
+    if (name.empty() || isdigit((unsigned char)name[0]) || name.compare(0, 2, "__") == 0) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '_') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* ===========================================================================
+ * TEXT EXPOSITION FORMAT
+ * =========================================================================== */
+// Shortest representation that parses back to the same double, like Go's
+// strconv.FormatFloat(val, 'g', -1, 64)
+void appendDouble(string& out, double val) {
+    if (isnan(val)) {
+        out += "NaN";
+        return;
+    } else if (isinf(val)) {
+        out += (val > 0) ? "+Inf" : "-Inf";
+        return;
+    }
+
+    // Shortest digits that round-trip, in scientific notation
+    char buf[40];
+    char* end = std::to_chars(buf, buf + sizeof(buf) - 1, val, std::chars_format::scientific).ptr;
+    *end = '\0';
+    char* expPos = std::find(buf, end, 'e');
+    int exp = atoi(expPos + 1);
+
+    // Same choice of notation as Go: exponent notation only below 1e-4 or
+    // from 1e6 upwards
+    if (exp < -4 || exp >= 6) {
+        out.append(buf, end);
+        return;
+    }
+
+    const char* mantissa = buf;
+    if (*mantissa == '-') {
+        out += '-';
+        mantissa++;
+    }
+
+    string digits; // Mantissa without the decimal point
+    for (const char* c = mantissa; c < expPos; c++) {
+        if (*c != '.') {
+            digits += *c;
+        }
+    }
+
+    if (exp < 0) {
+        out += "0.";
+        out.append(-exp - 1, '0');
+        out += digits;
+    } else if ((int)digits.size() <= exp + 1) {
+        out += digits;
+        out.append(exp + 1 - digits.size(), '0');
+    } else {
+        out.append(digits, 0, exp + 1);
+        out += '.';
+        out.append(digits, exp + 1, string::npos);
+    }
+}
+
+// HELP text escapes backslashes and newlines; label values also escape quotes
+void appendEscaped(string& out, const string& str, bool escapeQuotes) {
+    for (char c : str) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '"' && escapeQuotes) {
+            out += "\\\"";
+        } else {
+            out += c;
+        }
+    }
+}
+
+// Appends {name="val",...}, with an optional extra (e.g. "le" or "quantile")
+// label at the end. Appends nothing if there are no labels at all.
+void appendLabels(string& out, const vector<string>& names, const vector<string>& vals,
+        const char* extraName = nullptr, const string* extraVal = nullptr) {
+    if (names.empty() && extraName == nullptr) {
+        return;
+    }
+
+    out += '{';
+    for (size_t i = 0; i < names.size(); i++) {
+        if (i > 0) {
+            out += ',';
+        }
+        out += names[i];
+        out += "=\"";
+        appendEscaped(out, vals[i], true);
+        out += '"';
+    }
+    if (extraName != nullptr) {
+        if (!names.empty()) {
+            out += ',';
+        }
+        out += extraName;
+        out += "=\"";
+        out += *extraVal;
+        out += '"';
+    }
+    out += '}';
+}
+
+void appendSample(string& out, const string& name, const char* suffix,
+        const vector<string>& labelNames, const vector<string>& labelVals, double val,
+        const char* extraName = nullptr, const string* extraVal = nullptr) {
+    out += name;
+    out += suffix;
+    appendLabels(out, labelNames, labelVals, extraName, extraVal);
+    out += ' ';
+    appendDouble(out, val);
+    out += '\n';
+}
+
+void appendHeader(string& out, const string& name, const string& help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    appendEscaped(out, help, false);
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/* ===========================================================================
+ * DEFERRED RECLAMATION
+ * =========================================================================== */
+// Handles are resolved without locks, so a thread may still be using an
+// object for a moment after it's deleted from its handle table. Deleted
+// objects are therefore only freed after a grace period far longer than any
+// single update takes.
+class Reclaimer {
+    private:
+        static const int64_t kGraceNanos = 10LL * 1000 * 1000 * 1000;
+
+        std::mutex _mu;
+        vector<std::pair<int64_t, std::function<void()>>> _retired;
+
+    public:
+        void Retire(std::function<void()> freeFn) {
+            std::lock_guard<std::mutex> lock(_mu);
+            _retired.emplace_back(steadyNanos(), std::move(freeFn));
+            reclaimLocked();
+        }
+
+    private:
+        void reclaimLocked() {
+            int64_t cutoff = steadyNanos() - kGraceNanos;
+            size_t nExpired = 0;
+            while (nExpired < _retired.size() && _retired[nExpired].first < cutoff) {
+                _retired[nExpired].second();
+                nExpired++;
+            }
+            _retired.erase(_retired.begin(), _retired.begin() + nExpired);
+        }
+};
+
+Reclaimer& reclaimer() {
+    static Reclaimer* r = new Reclaimer;
+    return *r;
+}
+
+/* ===========================================================================
+ * HANDLE TABLE
+ * =========================================================================== */
+// Same scheme as the Go backend's handle table (see handleTable.go): a
+// handle packs a dense slot index (lower 32 bits) with the slot's generation
+// (upper 32 bits), which is bumped whenever the slot is freed. Readers only
+// do atomic loads; writers are serialized by a mutex.
+struct Child;
+
+// Seconds on the steady clock, as of the sweeper's last tick (0 until it
+// starts). Children record it when looked up, for idle-TTL eviction.
+std::atomic<int64_t> coarseNow{0};
+
+// Kind-independent part of a handle table, exported by SelfCollector
+class HandleTableBase {
+    protected:
+        std::atomic<uint64_t> _size{0};   // Live handles
+        std::atomic<uint64_t> _misses{0}; // Lookups of unknown or stale handles
+
+    public:
+        const char* kind;
+
+        explicit HandleTableBase(const char* kind);
+
+        uint64_t Size() {
+            return _size.load(std::memory_order_relaxed);
+        }
+
+        uint64_t Misses() {
+            return _misses.load(std::memory_order_relaxed);
+        }
+};
+
+vector<HandleTableBase*>& handleTables() {
+    static vector<HandleTableBase*>* tables = new vector<HandleTableBase*>;
+    return *tables;
+}
+
+HandleTableBase::HandleTableBase(const char* kind) : kind(kind) {
+    handleTables().push_back(this);
+}
+
+template <typename T>
+class HandleTable : public HandleTableBase {
+    private:
+        static const unsigned kChunkBits = 12;
+        static const unsigned kChunkSize = 1 << kChunkBits;
+        static const unsigned kMaxChunks = 1 << 12;
+
+        struct Slot {
+            std::atomic<T*> obj{nullptr};
+            std::atomic<uint32_t> gen{0};
+        };
+
+        std::atomic<Slot*> _chunks[kMaxChunks] = {};
+
+        std::mutex _mu; // Serializes writers
+        vector<uint32_t> _free;
+        uint32_t _next = 0;
+
+        Slot* slot(uint32_t idx) {
+            Slot* chunk = _chunks[idx >> kChunkBits].load(std::memory_order_acquire);
+            return chunk ? &chunk[idx & (kChunkSize - 1)] : nullptr;
+        }
+
+        T* miss() {
+            _misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+    public:
+        explicit HandleTable(const char* kind) : HandleTableBase(kind) {}
+
+        // Returns nullptr for unknown or stale handles
+        T* Get(uintptr_t handle) {
+            uint32_t idx = handle & 0xffffffff;
+            if ((idx >> kChunkBits) >= kMaxChunks) {
+                return miss();
+            }
+
+            Slot* s = slot(idx);
+            if (s == nullptr) {
+                return miss();
+            }
+
+            // The object must be loaded before the generation is checked: a
+            // slot is only reused after its generation has been bumped.
+            T* obj = s->obj.load();
+            if (obj == nullptr || s->gen.load() != (uint32_t)(handle >> 32)) {
+                return miss();
+            }
+
+            if constexpr (std::is_base_of<Child, T>::value) {
+                int64_t now = coarseNow.load(std::memory_order_relaxed);
+                if (obj->lastUsed.load(std::memory_order_relaxed) != now) {
+                    obj->lastUsed.store(now, std::memory_order_relaxed);
+                }
+            }
+
+            return obj;
+        }
+
+        uintptr_t Put(T* obj) {
+            std::lock_guard<std::mutex> lock(_mu);
+            uint32_t idx;
+            if (!_free.empty()) {
+                idx = _free.back();
+                _free.pop_back();
+            } else {
+                idx = _next++;
+                if ((idx >> kChunkBits) >= kMaxChunks) {
+                    fatal("Handle table is full");
+                }
+                if ((idx & (kChunkSize - 1)) == 0) {
+                    _chunks[idx >> kChunkBits].store(new Slot[kChunkSize], std::memory_order_release);
+                }
+            }
+
+            Slot* s = slot(idx);
+            uint32_t gen = s->gen.load();
+            if (gen == 0) { // Fresh slot; generation 0 is never handed out
+                gen = 1;
+                s->gen.store(gen);
+            }
+            s->obj.store(obj);
+            _size.fetch_add(1, std::memory_order_relaxed);
+
+            return (uintptr_t)gen << 32 | idx;
+        }
+
+        void Delete(uintptr_t handle) {
+            std::lock_guard<std::mutex> lock(_mu);
+            uint32_t idx = handle & 0xffffffff;
+            Slot* s = ((idx >> kChunkBits) < kMaxChunks) ? slot(idx) : nullptr;
+            if (s == nullptr || s->gen.load() != (uint32_t)(handle >> 32) || s->obj.load() == nullptr) {
+                return;
+            }
+
+            uint32_t gen = s->gen.load() + 1;
+            s->gen.store(gen ? gen : 1);
+            s->obj.store(nullptr);
+            _free.push_back(idx);
+            _size.fetch_sub(1, std::memory_order_relaxed);
+        }
+};
+
+/* ===========================================================================
+ * REGISTRY
+ * =========================================================================== */
+class Collector {
+    public:
+        string name;
+        string help;
+
+        Collector(string name, string help) : name(std::move(name)), help(std::move(help)) {}
+        virtual ~Collector() {}
+
+        // Appends the collector's metric family in the text exposition format
+        virtual void Render(string& out) = 0;
+
+        // Live series of a metric family created from "C-land", or -1 for
+        // collectors that aren't one (e.g. process metrics)
+        virtual int64_t Series() {
+            return -1;
+        }
+
+        // New series rejected or folded, and idle ones evicted, per the
+        // family's series limits
+        virtual uint64_t Rejected() {
+            return 0;
+        }
+
+        virtual uint64_t Evicted() {
+            return 0;
+        }
+
+        // Evicts series idle since before 'now' minus the idle TTL, if any
+        virtual void Sweep(int64_t now) {}
+};
+
+// Registries other than the default one are created from "C-land", e.g. to
+// expose a subsystem on its own path. With more than one shard, renders
+// split the (name-sorted) collectors into that many contiguous chunks,
+// rendered by concurrent threads and then concatenated.
+class Registry {
+    private:
+        unsigned _nShards;
+        std::mutex _mu;
+        std::map<string, Collector*> _collectors; // Sorted by name, like Go's Gather()
+
+    public:
+        explicit Registry(unsigned nShards = 1) : _nShards(nShards > 0 ? nShards : 1) {}
+
+        void Register(Collector* collector) {
+            if (!validMetricName(collector->name)) {
+                fatal("\"%s\" is not a valid metric name", collector->name.c_str());
+            }
+
+            std::lock_guard<std::mutex> lock(_mu);
+            if (!_collectors.emplace(collector->name, collector).second) {
+                fatal("duplicate metrics collector registration attempted (%s)",
+                        collector->name.c_str());
+            }
+        }
+
+        // Collectors are never unregistered, so a snapshot stays valid
+        vector<Collector*> Collectors() {
+            vector<Collector*> collectors;
+            std::lock_guard<std::mutex> lock(_mu);
+            for (auto& entry : _collectors) {
+                collectors.push_back(entry.second);
+            }
+
+            return collectors;
+        }
+
+        // Rendered without holding the lock, so collectors may use Collectors()
+        string Render() {
+            vector<Collector*> collectors = Collectors();
+            size_t nChunks = std::min<size_t>(_nShards, collectors.size());
+            if (nChunks <= 1) {
+                string out;
+                for (Collector* collector : collectors) {
+                    collector->Render(out);
+                }
+                return out;
+            }
+
+            vector<string> chunks(nChunks);
+            vector<std::thread> threads;
+            for (size_t i = 0; i < nChunks; i++) {
+                threads.emplace_back([&, i]() {
+                    size_t end = (i + 1) * collectors.size() / nChunks;
+                    for (size_t j = i * collectors.size() / nChunks; j < end; j++) {
+                        collectors[j]->Render(chunks[i]);
+                    }
+                });
+            }
+
+            string out;
+            for (size_t i = 0; i < nChunks; i++) {
+                threads[i].join();
+                out += chunks[i];
+            }
+
+            return out;
+        }
+};
+
+Registry& defaultRegistry();
+
+// Every registry, including the default one. Registries are never deleted.
+std::mutex registriesMu;
+vector<Registry*> registries;
+
+// Collectors of every registry, for self-instrumentation and sweeping
+vector<Collector*> allCollectors() {
+    vector<Collector*> collectors = defaultRegistry().Collectors();
+    std::lock_guard<std::mutex> lock(registriesMu);
+    for (Registry* registry : registries) {
+        vector<Collector*> more = registry->Collectors();
+        collectors.insert(collectors.end(), more.begin(), more.end());
+    }
+
+    return collectors;
+}
+void startSweeper();
+
+/* ===========================================================================
+ * METRIC VECTORS
+ * =========================================================================== */
+struct Child {
+    vector<string> labelVals;
+    uintptr_t handle = 0;
+    std::atomic<int64_t> lastUsed{0}; // coarseNow when last looked up
+
+    virtual ~Child() {}
+};
+
+// Family of children distinguished by their label values. Metrics without
+// labels are vecs with no label names and a single child.
+template <typename ChildT>
+class MetricVec : public Collector {
+    protected:
+        vector<string> _labelNames;
+        HandleTable<ChildT>& _handles;
+
+        std::mutex _mu; // Guards _children and the limits
+        std::map<vector<string>, ChildT*> _children;
+
+        // Series limits, as in vecLimits.go
+        size_t _maxSeries = 0; // 0 means no limit
+        bool _fold = false;
+        int64_t _idleTtl = 0; // Seconds; 0 means children never expire
+        uint64_t* _evictions = nullptr;
+        std::atomic<uint64_t> _rejected{0};
+        std::atomic<uint64_t> _evicted{0};
+
+        virtual const char* type() = 0;
+        virtual ChildT* newChild() = 0;
+        virtual void renderChild(string& out, ChildT* child) = 0;
+
+        typename std::map<vector<string>, ChildT*>::iterator deleteLocked(
+                typename std::map<vector<string>, ChildT*>::iterator iter) {
+            ChildT* child = iter->second;
+            _handles.Delete(child->handle);
+            reclaimer().Retire([child]() { delete child; });
+
+            return _children.erase(iter);
+        }
+
+    public:
+        MetricVec(string name, string help, vector<string> labelNames, HandleTable<ChildT>& handles)
+                : Collector(std::move(name), std::move(help)),
+                _labelNames(std::move(labelNames)), _handles(handles) {
+            for (const string& label : _labelNames) {
+                if (!validLabelName(label)) {
+                    fatal("\"%s\" is not a valid label name", label.c_str());
+                }
+            }
+        }
+
+        // Returns the child's handle, creating the child if needed
+        uintptr_t WithLabelValues(vector<string> labelVals) {
+            if (labelVals.size() != _labelNames.size()) {
+                fatal("inconsistent label cardinality: expected %zu label values but got %zu",
+                        _labelNames.size(), labelVals.size());
+            }
+
+            std::lock_guard<std::mutex> lock(_mu);
+            auto iter = _children.find(labelVals);
+            if (iter == _children.end() && _maxSeries > 0 && _children.size() >= _maxSeries) {
+                _rejected.fetch_add(1, std::memory_order_relaxed);
+                if (!_fold) {
+                    return 0;
+                }
+
+                labelVals.assign(labelVals.size(), "other");
+                iter = _children.find(labelVals);
+            }
+
+            if (iter != _children.end()) {
+                iter->second->lastUsed.store(coarseNow.load(std::memory_order_relaxed),
+                                            std::memory_order_relaxed);
+                return iter->second->handle;
+            }
+
+            ChildT* child = newChild();
+            child->labelVals = labelVals;
+            child->lastUsed.store(coarseNow.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            child->handle = _handles.Put(child);
+            _children.emplace(std::move(labelVals), child);
+
+            return child->handle;
+        }
+
+        void DeleteLabelValues(const vector<string>& labelVals) {
+            std::lock_guard<std::mutex> lock(_mu);
+            auto iter = _children.find(labelVals);
+            if (iter != _children.end()) {
+                deleteLocked(iter);
+            }
+        }
+
+        // Returns whether the child with the handle was one of the vec's
+        bool DeleteChild(uintptr_t handle) {
+            std::lock_guard<std::mutex> lock(_mu);
+            ChildT* child = _handles.Get(handle);
+            if (child == nullptr) {
+                return false;
+            }
+
+            auto iter = _children.find(child->labelVals);
+            if (iter == _children.end() || iter->second != child) {
+                return false;
+            }
+            deleteLocked(iter);
+
+            return true;
+        }
+
+        // Deletes the children whose label labelNames[i] has value
+        // labelVals[i] for every i, returning how many were deleted. Unknown
+        // label names match no child.
+        size_t DeletePartialMatch(const vector<string>& labelNames,
+                const vector<string>& labelVals) {
+            vector<std::pair<size_t, const string*>> match; // Label index -> value
+            for (size_t i = 0; i < labelNames.size() && i < labelVals.size(); i++) {
+                auto name = std::find(_labelNames.begin(), _labelNames.end(), labelNames[i]);
+                if (name == _labelNames.end()) {
+                    return 0;
+                }
+                match.emplace_back(name - _labelNames.begin(), &labelVals[i]);
+            }
+
+            std::lock_guard<std::mutex> lock(_mu);
+            size_t n = 0;
+            for (auto iter = _children.begin(); iter != _children.end();) {
+                bool matches = true;
+                for (auto& m : match) {
+                    matches = matches && iter->first[m.first] == *m.second;
+                }
+
+                if (matches) {
+                    iter = deleteLocked(iter);
+                    n++;
+                } else {
+                    ++iter;
+                }
+            }
+
+            return n;
+        }
+
+        void SetLimits(uint32_t maxSeries, bool fold, uint32_t idleTtlSec, void* evictions) {
+            std::lock_guard<std::mutex> lock(_mu);
+            if (!_children.empty()) {
+                fatal("Limits must be set on a Vec before it has any children");
+            } else if (_maxSeries > 0 || _idleTtl > 0) {
+                fatal("Limits have already been set on this Vec");
+            }
+
+            _maxSeries = maxSeries;
+            _fold = fold;
+            _idleTtl = idleTtlSec;
+            _evictions = static_cast<uint64_t*>(evictions);
+            if (_idleTtl > 0) {
+                startSweeper();
+            }
+        }
+
+        uint64_t Rejected() override {
+            return _rejected.load(std::memory_order_relaxed);
+        }
+
+        uint64_t Evicted() override {
+            return _evicted.load(std::memory_order_relaxed);
+        }
+
+        void Sweep(int64_t now) override {
+            std::lock_guard<std::mutex> lock(_mu);
+            if (_idleTtl == 0) {
+                return;
+            }
+
+            uint64_t nEvicted = 0;
+            for (auto iter = _children.begin(); iter != _children.end();) {
+                if (now - iter->second->lastUsed.load(std::memory_order_relaxed) >= _idleTtl) {
+                    iter = deleteLocked(iter);
+                    nEvicted++;
+                } else {
+                    ++iter;
+                }
+            }
+
+            if (nEvicted > 0) {
+                _evicted.fetch_add(nEvicted, std::memory_order_relaxed);
+                if (_evictions != nullptr) {
+                    __atomic_fetch_add(_evictions, 1, __ATOMIC_RELEASE);
+                }
+            }
+        }
+
+        int64_t Series() override {
+            std::lock_guard<std::mutex> lock(_mu);
+            return _children.size();
+        }
+
+        void Render(string& out) override {
+            std::lock_guard<std::mutex> lock(_mu);
+            if (_children.empty()) {
+                return; // Like Go, families without metrics aren't exposed
+            }
+
+            appendHeader(out, name, help, type());
+            for (auto& entry : _children) {
+                renderChild(out, entry.second);
+            }
+        }
+};
+
+/* ========== GAUGES AND COUNTERS ========== */
+struct ValueChild : Child {
+    std::atomic<uint64_t> bits{0}; // Bits of a double
+};
+
+class ValueVec : public MetricVec<ValueChild> {
+    private:
+        const char* _type;
+
+    protected:
+        const char* type() override {
+            return _type;
+        }
+
+        ValueChild* newChild() override {
+            return new ValueChild;
+        }
+
+        void renderChild(string& out, ValueChild* child) override {
+            appendSample(out, name, "", _labelNames, child->labelVals,
+                        bitsToDouble(child->bits.load(std::memory_order_relaxed)));
+        }
+
+    public:
+        ValueVec(string name, string help, vector<string> labelNames,
+                HandleTable<ValueChild>& handles, const char* type)
+                : MetricVec(std::move(name), std::move(help), std::move(labelNames), handles),
+                _type(type) {}
+};
+
+/* ========== HISTOGRAMS ========== */
+// Bucket upper bounds, padded to a power of two with +Inf for the same
+// branch-free search as EasyProm::NativeHistogram
+struct HistogramBounds {
+    vector<double> bounds; // Excluding +Inf
+    vector<double> search;
+
+    explicit HistogramBounds(vector<double> buckets) {
+        if (buckets.empty()) { // Same defaults as the Go client
+            buckets = {.005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10};
+        }
+        while (!buckets.empty() && buckets.back() == HUGE_VAL) {
+            buckets.pop_back();
+        }
+        for (size_t i = 1; i < buckets.size(); i++) {
+            if (!(buckets[i - 1] < buckets[i])) {
+                fatal("histogram buckets must be in increasing order");
+            }
+        }
+
+        bounds = std::move(buckets);
+        size_t nSearch = 1;
+        while (nSearch < bounds.size() + 1) {
+            nSearch *= 2;
+        }
+        search.assign(nSearch, HUGE_VAL);
+        std::copy(bounds.begin(), bounds.end(), search.begin());
+    }
+
+    unsigned Index(double val) const {
+        if (val != val) { // NaN goes into the +Inf bucket
+            return bounds.size();
+        }
+
+        const double* base = search.data();
+        size_t n = search.size();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = (base[half - 1] < val) ? base + half : base;
+            n -= half;
+        }
+
+        return (base - search.data()) + (*base < val);
+    }
+};
+
+struct HistogramChild : Child {
+    const HistogramBounds* bounds;
+    vector<std::atomic<uint64_t>> counts; // Non-cumulative; last one is +Inf
+    std::atomic<uint64_t> sumBits{0};
+
+    explicit HistogramChild(const HistogramBounds* bounds)
+        : bounds(bounds), counts(bounds->bounds.size() + 1) {}
+
+    void Observe(double val) {
+        counts[bounds->Index(val)].fetch_add(1, std::memory_order_relaxed);
+        atomicAddDouble(sumBits, val);
+    }
+};
+
+void renderHistogram(string& out, const string& name, const vector<string>& labelNames,
+        const vector<string>& labelVals, const vector<double>& bounds,
+        const vector<uint64_t>& counts, double sum) {
+    uint64_t cumCount = 0;
+    string le;
+    for (size_t i = 0; i < bounds.size(); i++) {
+        cumCount += counts[i];
+        le.clear();
+        appendDouble(le, bounds[i]);
+        appendSample(out, name, "_bucket", labelNames, labelVals, cumCount, "le", &le);
+    }
+    cumCount += counts[bounds.size()];
+    le = "+Inf";
+    appendSample(out, name, "_bucket", labelNames, labelVals, cumCount, "le", &le);
+    appendSample(out, name, "_sum", labelNames, labelVals, sum);
+    appendSample(out, name, "_count", labelNames, labelVals, cumCount);
+}
+
+class HistogramVec : public MetricVec<HistogramChild> {
+    private:
+        HistogramBounds _bounds;
+
+    protected:
+        const char* type() override {
+            return "histogram";
+        }
+
+        HistogramChild* newChild() override {
+            return new HistogramChild(&_bounds);
+        }
+
+        void renderChild(string& out, HistogramChild* child) override {
+            vector<uint64_t> counts(child->counts.size());
+            for (size_t i = 0; i < counts.size(); i++) {
+                counts[i] = child->counts[i].load(std::memory_order_relaxed);
+            }
+
+            renderHistogram(out, name, _labelNames, child->labelVals, _bounds.bounds, counts,
+                            bitsToDouble(child->sumBits.load(std::memory_order_relaxed)));
+        }
+
+    public:
+        HistogramVec(string name, string help, vector<string> labelNames,
+                HandleTable<HistogramChild>& handles, vector<double> buckets)
+                : MetricVec(std::move(name), std::move(help), std::move(labelNames), handles),
+                _bounds(std::move(buckets)) {}
+};
+
+/* ========== SUMMARIES ========== */
+struct SummaryOpts {
+    vector<double> quantiles; // Sorted
+    int64_t ageBucketNanos;
+    unsigned nAgeBkts;
+};
+
+// Sliding window of age buckets, like the Go client. Each age bucket keeps a
+// bounded uniform (reservoir) sample of its observations, and quantiles are
+// estimated from the samples, weighted by how many observations each stands
+// for. Count and sum are exact and cumulative. Observations sampled in
+// "C-land" (see SampledSummary in promClient.h) carry a weight, which scales
+// count, sum and the observation's share of its age bucket.
+struct SummaryChild : Child {
+    static const size_t kReservoirSize = 1024;
+
+    struct AgeBucket {
+        vector<double> samples;
+        uint64_t seen = 0;
+        double weight = 0; // Observations the bucket stands for
+    };
+
+    const SummaryOpts* opts;
+    std::mutex mu;
+    uint64_t count = 0;
+    double sum = 0;
+    vector<AgeBucket> ageBuckets;
+    size_t head = 0;    // Age bucket currently being filled
+    int64_t epoch;      // Age bucket period of 'head'
+    std::minstd_rand rng;
+
+    explicit SummaryChild(const SummaryOpts* opts)
+        : opts(opts), ageBuckets(opts->nAgeBkts), epoch(steadyNanos() / opts->ageBucketNanos) {}
+
+    // Must be called with 'mu' held
+    void rotate() {
+        int64_t now = steadyNanos() / opts->ageBucketNanos;
+        int64_t nExpired = std::min<int64_t>(now - epoch, opts->nAgeBkts);
+        for (int64_t i = 0; i < nExpired; i++) {
+            head = (head + 1) % ageBuckets.size();
+            ageBuckets[head].samples.clear();
+            ageBuckets[head].seen = 0;
+            ageBuckets[head].weight = 0;
+        }
+        epoch = now;
+    }
+
+    void Observe(double val, uint32_t weight = 1) {
+        std::lock_guard<std::mutex> lock(mu);
+        rotate();
+        count += weight;
+        sum += val * weight;
+
+        AgeBucket& bucket = ageBuckets[head];
+        bucket.seen++;
+        bucket.weight += weight;
+        if (bucket.samples.size() < kReservoirSize) {
+            bucket.samples.push_back(val);
+        } else {
+            uint64_t slot = rng() % bucket.seen;
+            if (slot < kReservoirSize) {
+                bucket.samples[slot] = val;
+            }
+        }
+    }
+
+    // Returns quantile estimates (NaN without observations), plus count and sum
+    vector<double> Snapshot(uint64_t& countOut, double& sumOut) {
+        vector<std::pair<double, double>> weighted; // (value, weight)
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            rotate();
+            countOut = count;
+            sumOut = sum;
+            for (const AgeBucket& bucket : ageBuckets) {
+                double weight = bucket.samples.empty() ? 0 : bucket.weight / bucket.samples.size();
+                for (double sample : bucket.samples) {
+                    weighted.emplace_back(sample, weight);
+                }
+            }
+        }
+
+        vector<double> out(opts->quantiles.size(), NAN);
+        if (weighted.empty()) {
+            return out;
+        }
+
+        std::sort(weighted.begin(), weighted.end());
+        double total = 0;
+        for (auto& entry : weighted) {
+            total += entry.second;
+        }
+
+        size_t idx = 0;
+        double cumWeight = weighted[0].second;
+        for (size_t q = 0; q < out.size(); q++) {
+            double target = opts->quantiles[q] * total;
+            while (cumWeight < target && idx + 1 < weighted.size()) {
+                cumWeight += weighted[++idx].second;
+            }
+            out[q] = weighted[idx].first;
+        }
+
+        return out;
+    }
+};
+
+class SummaryVec : public MetricVec<SummaryChild> {
+    private:
+        SummaryOpts _opts;
+        vector<string> _quantileStrs;
+
+    protected:
+        const char* type() override {
+            return "summary";
+        }
+
+        SummaryChild* newChild() override {
+            return new SummaryChild(&_opts);
+        }
+
+        void renderChild(string& out, SummaryChild* child) override {
+            uint64_t count;
+            double sum;
+            vector<double> quantiles = child->Snapshot(count, sum);
+            for (size_t i = 0; i < quantiles.size(); i++) {
+                appendSample(out, name, "", _labelNames, child->labelVals, quantiles[i],
+                            "quantile", &_quantileStrs[i]);
+            }
+            appendSample(out, name, "_sum", _labelNames, child->labelVals, sum);
+            appendSample(out, name, "_count", _labelNames, child->labelVals, count);
+        }
+
+    public:
+        SummaryVec(string name, string help, vector<string> labelNames,
+                HandleTable<SummaryChild>& handles, vector<double> quantiles,
+                uint32_t maxAge, uint32_t nAgeBkts)
+                : MetricVec(std::move(name), std::move(help), std::move(labelNames), handles) {
+            std::sort(quantiles.begin(), quantiles.end());
+            _opts.quantiles = quantiles;
+
+            // Same defaults as the Go client: 10 minutes, in 5 age buckets
+            _opts.nAgeBkts = nAgeBkts ? nAgeBkts : 5;
+            int64_t maxAgeNanos = (maxAge ? maxAge : 600) * 1000000000LL;
+            _opts.ageBucketNanos = std::max<int64_t>(maxAgeNanos / _opts.nAgeBkts, 1);
+
+            for (double q : quantiles) {
+                string str;
+                appendDouble(str, q);
+                _quantileStrs.push_back(str);
+            }
+        }
+};
+
+/* ========== NATIVE CELLS ========== */
+// Counterparts of the Go collectors in nativeCells.go
+class NativeCellsCollector : public Collector {
+    private:
+        const char* _type;
+        const char* _cells;
+        uint32_t _nCells;
+        uint32_t _stride;
+        bool _isInt;
+
+    public:
+        NativeCellsCollector(string name, string help, const char* type,
+                void* cells, uint32_t nCells, uint32_t stride, bool isInt)
+            : Collector(std::move(name), std::move(help)), _type(type),
+            _cells(static_cast<const char*>(cells)), _nCells(nCells), _stride(stride),
+            _isInt(isInt) {}
+
+        void Render(string& out) override {
+            double fSum = 0;
+            uint64_t iSum = 0;
+            for (uint32_t i = 0; i < _nCells; i++) {
+                uint64_t bits = __atomic_load_n((const uint64_t*)(_cells + (size_t)i * _stride),
+                                                __ATOMIC_RELAXED);
+                if (_isInt) {
+                    iSum += bits;
+                } else {
+                    fSum += bitsToDouble(bits);
+                }
+            }
+
+            appendHeader(out, name, help, _type);
+            appendSample(out, name, "", {}, {}, _isInt ? (double)iSum : fSum);
+        }
+
+        int64_t Series() override {
+            return 1;
+        }
+};
+
+// Counterpart of nativePerProcessCollector in nativeCells.go
+class NativePerProcessCollector : public Collector {
+    private:
+        const char* _type;
+        const char* _slabs;
+        uint32_t _nSlabs;
+        uint32_t _slabSize;
+        uint32_t _offset;
+
+    public:
+        NativePerProcessCollector(string name, string help, const char* type,
+                void* slabs, uint32_t nSlabs, uint32_t slabSize, uint32_t offset)
+            : Collector(std::move(name), std::move(help)), _type(type),
+            _slabs(static_cast<const char*>(slabs)), _nSlabs(nSlabs), _slabSize(slabSize),
+            _offset(offset) {}
+
+        void Render(string& out) override {
+            const vector<string> pidLabel = {"pid"};
+            appendHeader(out, name, help, _type);
+            for (uint32_t i = 0; i < _nSlabs; i++) {
+                const char* slab = _slabs + (size_t)i * _slabSize;
+                int64_t pid = __atomic_load_n((const int64_t*)slab, __ATOMIC_RELAXED);
+                if (pid <= 0) {
+                    continue;
+                }
+
+                uint64_t bits = __atomic_load_n((const uint64_t*)(slab + _offset), __ATOMIC_RELAXED);
+                appendSample(out, name, "", pidLabel, {std::to_string(pid)}, bitsToDouble(bits));
+            }
+        }
+
+        int64_t Series() override {
+            return 1;
+        }
+};
+
+class NativeHistogramCollector : public Collector {
+    private:
+        vector<double> _bounds;
+        const char* _cells;
+        uint32_t _nShards;
+        uint32_t _stride;
+
+    public:
+        NativeHistogramCollector(string name, string help, vector<double> bounds,
+                void* cells, uint32_t nShards, uint32_t stride)
+            : Collector(std::move(name), std::move(help)), _bounds(std::move(bounds)),
+            _cells(static_cast<const char*>(cells)), _nShards(nShards), _stride(stride) {}
+
+        void Render(string& out) override {
+            size_t nBuckets = _bounds.size() + 1;
+            vector<uint64_t> counts(nBuckets);
+            double sum = 0;
+            for (uint32_t s = 0; s < _nShards; s++) {
+                const uint64_t* shard = (const uint64_t*)(_cells + (size_t)s * _stride);
+                for (size_t i = 0; i < nBuckets; i++) {
+                    counts[i] += __atomic_load_n(&shard[i], __ATOMIC_RELAXED);
+                }
+                sum += bitsToDouble(__atomic_load_n(&shard[nBuckets], __ATOMIC_RELAXED));
+            }
+
+            appendHeader(out, name, help, "histogram");
+            renderHistogram(out, name, {}, {}, _bounds, counts, sum);
+        }
+
+        int64_t Series() override {
+            return 1;
+        }
+};
+
+// Quantiles, count and sum come from a NativeSummaryFn (see promClient.h)
+class NativeSummaryCollector : public Collector {
+    private:
+        typedef void (*SummaryFn)(void* ctx, const double* quantiles, int nQuantiles,
+                                    double* values, uint64_t* count, double* sum);
+
+        vector<double> _quantiles; // Sorted
+        vector<string> _quantileStrs;
+        SummaryFn _fn;
+        void* _ctx;
+
+    public:
+        NativeSummaryCollector(string name, string help, vector<double> quantiles,
+                void* fn, void* ctx)
+            : Collector(std::move(name), std::move(help)), _quantiles(std::move(quantiles)),
+            _fn(reinterpret_cast<SummaryFn>(fn)), _ctx(ctx) {
+            std::sort(_quantiles.begin(), _quantiles.end());
+            for (double q : _quantiles) {
+                string str;
+                appendDouble(str, q);
+                _quantileStrs.push_back(str);
+            }
+        }
+
+        void Render(string& out) override {
+            vector<double> values(_quantiles.size());
+            uint64_t count = 0;
+            double sum = 0;
+            _fn(_ctx, _quantiles.data(), _quantiles.size(), values.data(), &count, &sum);
+
+            appendHeader(out, name, help, "summary");
+            for (size_t i = 0; i < values.size(); i++) {
+                appendSample(out, name, "", {}, {}, values[i], "quantile", &_quantileStrs[i]);
+            }
+            appendSample(out, name, "_sum", {}, {}, sum);
+            appendSample(out, name, "_count", {}, {}, count);
+        }
+
+        int64_t Series() override {
+            return 1;
+        }
+};
+
+/* ========== FUNC METRICS ========== */
+// Counterpart of funcCollector and funcVecCollector in funcMetrics.go
+class FuncCollector : public Collector {
+    private:
+        typedef double (*ValueFn)(void* ctx);
+        typedef void (*EmitFn)(void* emitCtx, const char** labelVals, double val);
+        typedef void (*EnumFn)(void* ctx, EmitFn emit, void* emitCtx);
+
+        struct Emit {
+            FuncCollector* collector;
+            string* out;
+            int64_t series;
+        };
+
+        const char* _type;
+        vector<string> _labels;
+        bool _isVec;
+        void* _fn;
+        void* _ctx;
+        std::atomic<int64_t> _series{0};
+
+        static void emit(void* emitCtx, const char** labelVals, double val) {
+            Emit* e = static_cast<Emit*>(emitCtx);
+            vector<string> vals(labelVals, labelVals + e->collector->_labels.size());
+            appendSample(*e->out, e->collector->name, "", e->collector->_labels, vals, val);
+            e->series++;
+        }
+
+    public:
+        FuncCollector(string name, string help, const char* type, vector<string> labels,
+                bool isVec, void* fn, void* ctx)
+            : Collector(std::move(name), std::move(help)), _type(type),
+            _labels(std::move(labels)), _isVec(isVec), _fn(fn), _ctx(ctx) {
+            if (fn == nullptr) {
+                fatal("Invalid callback for func metric");
+            }
+            for (const string& label : _labels) {
+                if (!validLabelName(label)) {
+                    fatal("\"%s\" is not a valid label name", label.c_str());
+                }
+            }
+        }
+
+        void Render(string& out) override {
+            appendHeader(out, name, help, _type);
+            if (!_isVec) {
+                appendSample(out, name, "", {}, {}, reinterpret_cast<ValueFn>(_fn)(_ctx));
+                _series.store(1, std::memory_order_relaxed);
+                return;
+            }
+
+            Emit e = {this, &out, 0};
+            reinterpret_cast<EnumFn>(_fn)(_ctx, &FuncCollector::emit, &e);
+            _series.store(e.series, std::memory_order_relaxed);
+        }
+
+        int64_t Series() override {
+            return _isVec ? _series.load(std::memory_order_relaxed) : 1;
+        }
+};
+
+/* ========== PROCESS METRICS ========== */
+// Subset of the Go client's process collector, read from /proc
+class ProcessCollector : public Collector {
+    public:
+        ProcessCollector() : Collector("process_", "") {}
+
+        void Render(string& out) override {
+            FILE* statFile = fopen("/proc/self/stat", "r");
+            if (statFile == nullptr) {
+                return;
+            }
+
+            char buf[1024];
+            size_t len = fread(buf, 1, sizeof(buf) - 1, statFile);
+            fclose(statFile);
+            buf[len] = '\0';
+
+            // Fields after the command name, which may contain spaces
+            const char* fields = strrchr(buf, ')');
+            if (fields == nullptr) {
+                return;
+            }
+
+            unsigned long utime = 0, stime = 0, vsize = 0;
+            unsigned long long startTime = 0;
+            long rss = 0;
+            if (sscanf(fields + 2,
+                    "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d "
+                    "%*d %*d %llu %lu %ld", &utime, &stime, &startTime, &vsize, &rss) != 5) {
+                return;
+            }
+
+            double ticks = sysconf(_SC_CLK_TCK);
+            double pageSize = sysconf(_SC_PAGESIZE);
+
+            appendHeader(out, "process_cpu_seconds_total",
+                    "Total user and system CPU time spent in seconds.", "counter");
+            appendSample(out, "process_cpu_seconds_total", "", {}, {}, (utime + stime) / ticks);
+
+            struct rlimit fdLimit;
+            if (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0) {
+                appendHeader(out, "process_max_fds", "Maximum number of open file descriptors.",
+                        "gauge");
+                appendSample(out, "process_max_fds", "", {}, {}, fdLimit.rlim_cur);
+            }
+
+            DIR* fdDir = opendir("/proc/self/fd");
+            if (fdDir != nullptr) {
+                int nFds = -1; // Don't count the directory's own descriptor
+                while (readdir(fdDir) != nullptr) {
+                    nFds++;
+                }
+                closedir(fdDir);
+                appendHeader(out, "process_open_fds", "Number of open file descriptors.", "gauge");
+                appendSample(out, "process_open_fds", "", {}, {}, nFds - 2); // "." and ".."
+            }
+
+            appendHeader(out, "process_resident_memory_bytes",
+                    "Resident memory size in bytes.", "gauge");
+            appendSample(out, "process_resident_memory_bytes", "", {}, {}, rss * pageSize);
+
+            appendHeader(out, "process_start_time_seconds",
+                    "Start time of the process since unix epoch in seconds.", "gauge");
+            appendSample(out, "process_start_time_seconds", "", {}, {},
+                        bootTime() + startTime / ticks);
+
+            appendHeader(out, "process_virtual_memory_bytes",
+                    "Virtual memory size in bytes.", "gauge");
+            appendSample(out, "process_virtual_memory_bytes", "", {}, {}, vsize);
+        }
+
+    private:
+        static double bootTime() {
+            FILE* statFile = fopen("/proc/stat", "r");
+            if (statFile == nullptr) {
+                return 0;
+            }
+
+            char line[256];
+            double btime = 0;
+            while (fgets(line, sizeof(line), statFile) != nullptr) {
+                if (sscanf(line, "btime %lf", &btime) == 1) {
+                    break;
+                }
+            }
+            fclose(statFile);
+
+            return btime;
+        }
+};
+
+/* ========== SELF METRICS ========== */
+// Updated by RemoteWriter, as samples are sent, failed or dropped
+struct RemoteWriteStats {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> sentBytes{0};
+    std::atomic<uint64_t> retries{0};
+};
+
+// Counterpart of selfCollector in selfMetrics.go, except that there are no
+// cgo calls to count
+class SelfCollector : public Collector {
+    private:
+        HistogramBounds _scrapeBounds;
+        HistogramChild _scrapeDuration;
+        std::atomic<uint64_t> _scrapeBytes{0};
+
+        static vector<double> scrapeBuckets() {
+            vector<double> buckets;
+            for (double bound = 0.0005; buckets.size() < 16; bound *= 2) {
+                buckets.push_back(bound);
+            }
+            return buckets;
+        }
+
+    public:
+        RemoteWriteStats remoteWrite;
+
+        SelfCollector()
+            : Collector("easyprom_", ""), _scrapeBounds(scrapeBuckets()),
+            _scrapeDuration(&_scrapeBounds) {}
+
+        void RecordScrape(int64_t nanos, size_t bytes) {
+            _scrapeDuration.Observe(nanos / 1e9);
+            _scrapeBytes.store(bytes, std::memory_order_relaxed);
+        }
+
+        void Render(string& out) override {
+            const vector<string> kindLabel = {"kind"};
+            appendHeader(out, "easyprom_handle_table_size",
+                        "Live handles passed to C/C++, by kind of object", "gauge");
+            for (HandleTableBase* table : handleTables()) {
+                appendSample(out, "easyprom_handle_table_size", "", kindLabel, {table->kind},
+                            table->Size());
+            }
+            appendHeader(out, "easyprom_invalid_handle_lookups_total",
+                        "Lookups of unknown or deleted handles, which are ignored", "counter");
+            for (HandleTableBase* table : handleTables()) {
+                appendSample(out, "easyprom_invalid_handle_lookups_total", "", kindLabel,
+                            {table->kind}, table->Misses());
+            }
+
+            appendHeader(out, "easyprom_remote_write_retries_total",
+                        "Retries of failed remote-write requests", "counter");
+            appendSample(out, "easyprom_remote_write_retries_total", "", {}, {},
+                        remoteWrite.retries.load());
+            const vector<string> resultLabel = {"result"};
+            appendHeader(out, "easyprom_remote_write_samples_total",
+                        "Samples pushed by remote write, by result (sent, failed or dropped)", "counter");
+            appendSample(out, "easyprom_remote_write_samples_total", "", resultLabel, {"dropped"},
+                        remoteWrite.dropped.load());
+            appendSample(out, "easyprom_remote_write_samples_total", "", resultLabel, {"failed"},
+                        remoteWrite.failed.load());
+            appendSample(out, "easyprom_remote_write_samples_total", "", resultLabel, {"sent"},
+                        remoteWrite.sent.load());
+            appendHeader(out, "easyprom_remote_write_sent_bytes_total",
+                        "Compressed bytes of successful remote-write requests", "counter");
+            appendSample(out, "easyprom_remote_write_sent_bytes_total", "", {}, {},
+                        remoteWrite.sentBytes.load());
+
+            vector<uint64_t> counts(_scrapeDuration.counts.size());
+            for (size_t i = 0; i < counts.size(); i++) {
+                counts[i] = _scrapeDuration.counts[i].load(std::memory_order_relaxed);
+            }
+            appendHeader(out, "easyprom_scrape_duration_seconds",
+                        "Time taken to gather, render and write each scrape's response", "histogram");
+            renderHistogram(out, "easyprom_scrape_duration_seconds", {}, {}, _scrapeBounds.bounds,
+                            counts, bitsToDouble(_scrapeDuration.sumBits.load(std::memory_order_relaxed)));
+            appendHeader(out, "easyprom_scrape_response_bytes",
+                        "Size of the last scrape's response body, as written (i.e. after compression)",
+                        "gauge");
+            appendSample(out, "easyprom_scrape_response_bytes", "", {}, {},
+                        _scrapeBytes.load(std::memory_order_relaxed));
+
+            const vector<string> familyLabel = {"family"};
+            vector<FamilyTotals> families = familyTotals();
+            appendHeader(out, "easyprom_series", "Live series per metric family created from C/C++",
+                        "gauge");
+            for (const FamilyTotals& family : families) {
+                appendSample(out, "easyprom_series", "", familyLabel, {family.name}, family.series);
+            }
+            appendHeader(out, "easyprom_series_evicted_total",
+                        "Series evicted after being idle for their Vec's TTL", "counter");
+            for (const FamilyTotals& family : families) {
+                appendSample(out, "easyprom_series_evicted_total", "", familyLabel, {family.name},
+                            family.evicted);
+            }
+            appendHeader(out, "easyprom_series_rejected_total",
+                        "New series rejected or folded by their Vec's series limit", "counter");
+            for (const FamilyTotals& family : families) {
+                appendSample(out, "easyprom_series_rejected_total", "", familyLabel, {family.name},
+                            family.rejected);
+            }
+        }
+
+    private:
+        struct FamilyTotals {
+            string name;
+            int64_t series;
+            uint64_t evicted;
+            uint64_t rejected;
+        };
+
+        // Sums the collectors sharing a name, i.e. the same name registered in
+        // several registries, so each family is exported exactly once
+        static vector<FamilyTotals> familyTotals() {
+            vector<FamilyTotals> totals;
+            std::unordered_map<string, size_t> index;
+            for (Collector* collector : allCollectors()) {
+                int64_t series = collector->Series();
+                if (series < 0) {
+                    continue;
+                }
+
+                auto it = index.emplace(collector->name, totals.size()).first;
+                if (it->second == totals.size()) {
+                    totals.push_back({collector->name, 0, 0, 0});
+                }
+                FamilyTotals& family = totals[it->second];
+                family.series += series;
+                family.evicted += collector->Evicted();
+                family.rejected += collector->Rejected();
+            }
+
+            return totals;
+        }
+};
+
+SelfCollector& selfCollector() {
+    static SelfCollector* collector = new SelfCollector;
+    return *collector;
+}
+
+Registry& defaultRegistry() {
+    static Registry* registry = []() {
+        Registry* r = new Registry;
+        r->Register(new ProcessCollector);
+        r->Register(&selfCollector());
+        return r;
+    }();
+
+    return *registry;
+}
+
+// Ticks coarseNow and sweeps every collector once a second
+void startSweeper() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        coarseNow.store(steadyNanos() / 1000000000);
+        std::thread([]() {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                int64_t now = steadyNanos() / 1000000000;
+                coarseNow.store(now);
+                for (Collector* collector : allCollectors()) {
+                    collector->Sweep(now);
+                }
+            }
+        }).detach();
+    });
+}
+
+/* ===========================================================================
+ * HANDLES
+ * =========================================================================== */
+// As in the Go backend, one table per kind of object handed to "C-land"
+HandleTable<ValueChild> gaugeHandles("gauge");
+HandleTable<ValueVec> gaugeVecHandles("gauge_vec");
+HandleTable<ValueChild> counterHandles("counter");
+HandleTable<ValueVec> counterVecHandles("counter_vec");
+HandleTable<HistogramChild> histogramHandles("histogram");
+HandleTable<HistogramVec> histogramVecHandles("histogram_vec");
+HandleTable<SummaryChild> summaryHandles("summary");
+HandleTable<SummaryVec> summaryVecHandles("summary_vec");
+HandleTable<Registry> registryHandles("registry");
+
+// A rendering read incrementally from "C-land": the registry's collectors
+// are snapshotted when the stream is opened, and each read only renders as
+// many of them as it needs
+struct RenderStream {
+    vector<Collector*> collectors;
+    size_t next = 0;    // Next collector to render
+    string pending;     // Rendered but not yet read
+    size_t pendingOff = 0;
+};
+
+HandleTable<RenderStream> renderStreamHandles("render_stream");
+
+// Returns the registry with the handle, or the default one for handle 0
+Registry& registryOf(uintptr_t uPtrRegistry) {
+    if (uPtrRegistry == 0) {
+        return defaultRegistry();
+    }
+
+    Registry* registry = registryHandles.Get(uPtrRegistry);
+    if (registry == nullptr) {
+        fatal("Unknown registry");
+    }
+
+    return *registry;
+}
+
+template <typename VecT>
+VecT* registerVec(VecT* vec, Registry& registry = defaultRegistry()) {
+    registry.Register(vec);
+    return vec;
+}
+
+/* ===========================================================================
+ * SCRAPE HANDLER
+ * =========================================================================== */
+// Counterpart of scrapeHandler in scrapeHandler.go: scrapes arriving while a
+// render is in flight, or within the coalescing window of the last render
+// starting, share its result; finished renders are reused for the cache TTL;
+// and at most maxInFlight renders run at once. Responses aren't gzipped.
+class ScrapeHandler {
+    public:
+        struct Result {
+            int64_t start;
+            int64_t end;
+            string body;
+        };
+
+    private:
+        Registry& _registry;
+        int64_t _coalesceNanos;
+        int64_t _cacheNanos;
+        uint32_t _maxInFlight; // 0 means no limit
+
+        std::mutex _mu;
+        std::condition_variable _cv; // Signalled when a shared render completes
+        bool _pending = false;       // Shared render in flight
+        uint64_t _nRenders = 0;      // Completed shared renders
+        std::shared_ptr<const Result> _last;
+        uint32_t _inFlight = 0;
+
+    public:
+        ScrapeHandler(Registry& registry, uint32_t coalesceWindowMs, uint32_t cacheTtlMs,
+                uint32_t maxInFlight)
+            : _registry(registry), _coalesceNanos(coalesceWindowMs * 1000000LL), _cacheNanos(cacheTtlMs * 1000000LL),
+            _maxInFlight(maxInFlight) {}
+
+        // Returns nullptr if too many renders are in flight
+        std::shared_ptr<const Result> Get() {
+            bool shared = _coalesceNanos > 0 || _cacheNanos > 0;
+
+            std::unique_lock<std::mutex> lock(_mu);
+            if (shared) {
+                int64_t now = steadyNanos();
+                if (_last && (now - _last->start < _coalesceNanos || now - _last->end < _cacheNanos)) {
+                    return _last;
+                }
+                if (_pending) {
+                    uint64_t nRenders = _nRenders;
+                    _cv.wait(lock, [&]() { return _nRenders != nRenders; });
+                    return _last;
+                }
+            }
+
+            if (_maxInFlight > 0 && _inFlight >= _maxInFlight) {
+                return nullptr;
+            }
+            _inFlight++;
+            _pending = shared;
+            lock.unlock();
+
+            auto result = std::make_shared<Result>();
+            result->start = steadyNanos();
+            result->body = _registry.Render();
+            result->end = steadyNanos();
+
+            lock.lock();
+            _inFlight--;
+            if (shared) {
+                _pending = false;
+                _last = result;
+                _nRenders++;
+                _cv.notify_all();
+            }
+
+            return result;
+        }
+};
+
+/* ===========================================================================
+ * HTTP LISTENER
+ * =========================================================================== */
+// Bare-bones HTTP/1.x server: one request per connection, each served by its
+// own thread, with up to kMaxConns at once. Good enough for Prometheus scrapes.
+class HttpListener {
+    private:
+        int _fd;
+        struct timeval _readTimeout;
+        struct timeval _writeTimeout;
+
+        std::mutex _mu; // Guards _handlers
+        std::map<string, std::shared_ptr<ScrapeHandler>> _handlers; // Keyed by path
+
+        // Connections served at once, each on its own thread. Further ones wait
+        // in the listen backlog until a slot frees up.
+        static const int kMaxConns = 64;
+        std::mutex _connsMu;
+        std::condition_variable _connsCv;
+        int _conns = 0;
+
+        void connDone() {
+            std::lock_guard<std::mutex> lock(_connsMu);
+            _conns--;
+            _connsCv.notify_one();
+        }
+
+        static void sendAll(int fd, const char* data, size_t len) {
+            while (len > 0) {
+                ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return;
+                }
+                data += n;
+                len -= n;
+            }
+        }
+
+        void serve(int connFd) {
+            setsockopt(connFd, SOL_SOCKET, SO_RCVTIMEO, &_readTimeout, sizeof(_readTimeout));
+            setsockopt(connFd, SOL_SOCKET, SO_SNDTIMEO, &_writeTimeout, sizeof(_writeTimeout));
+
+            // Only the request line matters, but read the whole header
+            string request;
+            char buf[2048];
+            while (request.find("\r\n\r\n") == string::npos && request.size() < 16384) {
+                ssize_t n = recv(connFd, buf, sizeof(buf), 0);
+                if (n <= 0) {
+                    return;
+                }
+                request.append(buf, n);
+            }
+
+            size_t pathStart = request.find(' ');
+            size_t pathEnd = (pathStart == string::npos) ? string::npos : request.find(' ', pathStart + 1);
+            if (pathEnd == string::npos) {
+                respond(connFd, "400 Bad Request", "text/plain; charset=utf-8", "400 Bad Request\n");
+                return;
+            }
+
+            string path = request.substr(pathStart + 1, pathEnd - pathStart - 1);
+            path = path.substr(0, path.find('?'));
+
+            std::shared_ptr<ScrapeHandler> handler;
+            {
+                std::lock_guard<std::mutex> lock(_mu);
+                auto iter = _handlers.find(path);
+                if (iter != _handlers.end()) {
+                    handler = iter->second;
+                }
+            }
+
+            if (handler == nullptr) {
+                respond(connFd, "404 Not Found", "text/plain; charset=utf-8", "404 page not found\n");
+                return;
+            }
+
+            int64_t start = steadyNanos();
+            std::shared_ptr<const ScrapeHandler::Result> result = handler->Get();
+            if (result == nullptr) {
+                string body = "Too many concurrent gathers, try again later\n";
+                respond(connFd, "503 Service Unavailable", "text/plain; charset=utf-8", body);
+                selfCollector().RecordScrape(steadyNanos() - start, body.size());
+                return;
+            }
+            respond(connFd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", result->body);
+            selfCollector().RecordScrape(steadyNanos() - start, result->body.size());
+        }
+
+        static void respond(int connFd, const char* status, const char* contentType,
+                const string& body) {
+            string header = string("HTTP/1.1 ") + status + "\r\n";
+            header += string("Content-Type: ") + contentType + "\r\n";
+            header += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+            header += "Connection: close\r\n\r\n";
+            sendAll(connFd, header.data(), header.size());
+            sendAll(connFd, body.data(), body.size());
+        }
+
+    public:
+        // Timeouts of 0 mean none
+        HttpListener(int fd, uint32_t readTimeoutMs, uint32_t writeTimeoutMs) : _fd(fd) {
+            _readTimeout.tv_sec = readTimeoutMs / 1000;
+            _readTimeout.tv_usec = (readTimeoutMs % 1000) * 1000;
+            _writeTimeout.tv_sec = writeTimeoutMs / 1000;
+            _writeTimeout.tv_usec = (writeTimeoutMs % 1000) * 1000;
+        }
+
+        void AddHandler(const string& path, std::shared_ptr<ScrapeHandler> handler) {
+            std::lock_guard<std::mutex> lock(_mu);
+            _handlers[path] = std::move(handler);
+        }
+
+        void Run() {
+            const std::chrono::milliseconds kMinBackoff(5), kMaxBackoff(1000);
+            std::chrono::milliseconds backoff(0);
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(_connsMu);
+                    _connsCv.wait(lock, [this]() { return _conns < kMaxConns; });
+                    _conns++;
+                }
+
+                int connFd = accept(_fd, nullptr, nullptr);
+                if (connFd < 0) {
+                    int err = errno;
+                    connDone();
+                    if (err == EINTR || err == ECONNABORTED) {
+                        continue;
+                    }
+
+                    // e.g. out of file descriptors (EMFILE, ENFILE) or memory:
+                    // back off like Go's http.Server, rather than spinning
+                    backoff = (backoff.count() == 0) ? kMinBackoff : std::min(backoff * 2, kMaxBackoff);
+                    std::this_thread::sleep_for(backoff);
+                    continue;
+                }
+                backoff = std::chrono::milliseconds(0);
+
+                try {
+                    std::thread([this, connFd]() {
+                        serve(connFd);
+                        close(connFd);
+                        connDone();
+                    }).detach();
+                } catch (const std::system_error&) { // Out of threads
+                    close(connFd);
+                    connDone();
+                }
+            }
+        }
+
+        // Listens on a Unix domain socket, replacing a stale socket left by an
+        // earlier process (but never any other kind of file)
+        static HttpListener* ListenUnix(const string& path, uint32_t readTimeoutMs,
+                uint32_t writeTimeoutMs) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+                return nullptr;
+            }
+            memcpy(addr.sun_path, path.data(), path.size());
+
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                unlink(path.c_str());
+            }
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) {
+                return nullptr;
+            }
+            if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+                close(fd);
+                return nullptr;
+            }
+
+            return new HttpListener(fd, readTimeoutMs, writeTimeoutMs);
+        }
+
+        // Listens on "host:port" (host may be empty for all interfaces), or on
+        // a Unix domain socket for "unix:<path>". Returns nullptr on failure.
+        static HttpListener* Listen(const string& endpoint, uint32_t readTimeoutMs,
+                uint32_t writeTimeoutMs) {
+            if (endpoint.compare(0, 5, "unix:") == 0) {
+                return ListenUnix(endpoint.substr(5), readTimeoutMs, writeTimeoutMs);
+            }
+
+            size_t colon = endpoint.rfind(':');
+            if (colon == string::npos) {
+                return nullptr;
+            }
+
+            string host = endpoint.substr(0, colon);
+            string port = endpoint.substr(colon + 1);
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+
+            struct addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE;
+
+            struct addrinfo* addrs = nullptr;
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+                return nullptr;
+            }
+
+            // Prefer IPv6 wildcard sockets, which also accept IPv4 (like Go)
+            int fd = -1;
+            for (int pass = 0; pass < 2 && fd < 0; pass++) {
+                for (struct addrinfo* ai = addrs; ai != nullptr; ai = ai->ai_next) {
+                    if ((pass == 0) != (ai->ai_family == AF_INET6)) {
+                        continue;
+                    }
+
+                    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                    if (fd < 0) {
+                        continue;
+                    }
+
+                    int one = 1, zero = 0;
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                    if (ai->ai_family == AF_INET6) {
+                        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+                    }
+                    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 128) == 0) {
+                        break;
+                    }
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(addrs);
+
+            return (fd < 0) ? nullptr : new HttpListener(fd, readTimeoutMs, writeTimeoutMs);
+        }
+};
+
+std::mutex listenersMu;
+std::map<string, HttpListener*> listeners; // Keyed by endpoint
+
+/* ===========================================================================
+ * REMOTE WRITE
+ * =========================================================================== */
+// Counterpart of remoteWriter in remoteWrite.go (see there for the batching,
+// queueing and retry behaviour). Samples are taken from the registry's text
+// rendering, and only plain http:// URLs are supported (there's no TLS).
+struct RwSeries {
+    vector<std::pair<string, string>> labels; // Sorted by name, including __name__
+    double value;
+    int64_t timestamp; // Milliseconds since the epoch
+};
+
+// Parses a sample line of the text exposition format, as rendered by Registry
+bool parseSample(const string& line, int64_t now, RwSeries& series) {
+    size_t pos = line.find_first_of("{ ");
+    if (pos == string::npos || pos == 0) {
+        return false;
+    }
+
+    series.labels.assign(1, {"__name__", line.substr(0, pos)});
+    if (line[pos] == '{') {
+        pos++;
+        while (pos < line.size() && line[pos] != '}') {
+            size_t eq = line.find("=\"", pos);
+            if (eq == string::npos) {
+                return false;
+            }
+
+            string name = line.substr(pos, eq - pos);
+            string val;
+            for (pos = eq + 2; pos < line.size() && line[pos] != '"'; pos++) {
+                if (line[pos] == '\\' && pos + 1 < line.size()) {
+                    pos++;
+                    val += (line[pos] == 'n') ? '\n' : line[pos];
+                } else {
+                    val += line[pos];
+                }
+            }
+            pos++; // Closing quote
+            if (pos < line.size() && line[pos] == ',') {
+                pos++;
+            }
+            series.labels.emplace_back(std::move(name), std::move(val));
+        }
+        pos++; // Closing brace
+    }
+    if (pos >= line.size()) {
+        return false;
+    }
+
+    std::sort(series.labels.begin(), series.labels.end());
+    series.value = strtod(line.c_str() + pos, nullptr); // Also parses +Inf, -Inf and NaN
+    series.timestamp = now;
+
+    return true;
+}
+
+uint64_t fnv64a(const vector<std::pair<string, string>>& labels) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const string& str) {
+        for (unsigned char c : str) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    };
+    for (auto& label : labels) {
+        add(label.first);
+        add(label.second);
+    }
+
+    return hash;
+}
+
+/* ========== PROTOBUF ENCODING ========== */
+// Same WriteRequest encoding as encodeWriteRequest in remoteWrite.go
+void appendVarint(string& buf, uint64_t val) {
+    while (val >= 0x80) {
+        buf += (char)(val | 0x80);
+        val >>= 7;
+    }
+    buf += (char)val;
+}
+
+size_t varintLen(uint64_t val) {
+    size_t n = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        n++;
+    }
+
+    return n;
+}
+
+void appendStringField(string& buf, char tag, const string& str) {
+    buf += tag;
+    appendVarint(buf, str.size());
+    buf += str;
+}
+
+string encodeWriteRequest(const vector<RwSeries>& batch) {
+    string buf;
+    for (const RwSeries& series : batch) {
+        // Sizes are computed up front, as each message is length-prefixed
+        size_t labelsLen = 0;
+        for (auto& label : series.labels) {
+            size_t n = 1 + varintLen(label.first.size()) + label.first.size() +
+                        1 + varintLen(label.second.size()) + label.second.size();
+            labelsLen += 1 + varintLen(n) + n;
+        }
+        size_t sampleLen = 1 + 8 + 1 + varintLen(series.timestamp);
+        size_t seriesLen = labelsLen + 1 + varintLen(sampleLen) + sampleLen;
+
+        buf += '\x0a'; // timeseries, length-delimited
+        appendVarint(buf, seriesLen);
+        for (auto& label : series.labels) {
+            size_t n = 1 + varintLen(label.first.size()) + label.first.size() +
+                        1 + varintLen(label.second.size()) + label.second.size();
+            buf += '\x0a'; // labels
+            appendVarint(buf, n);
+            appendStringField(buf, '\x0a', label.first);
+            appendStringField(buf, '\x12', label.second);
+        }
+
+        buf += '\x12'; // samples
+        appendVarint(buf, sampleLen);
+        buf += '\x09'; // value, fixed64
+        uint64_t bits = doubleToBits(series.value);
+        for (int i = 0; i < 8; i++) {
+            buf += (char)(bits >> (8 * i));
+        }
+        buf += '\x10'; // timestamp, varint
+        appendVarint(buf, series.timestamp);
+    }
+
+    return buf;
+}
+
+/* ========== SNAPPY COMPRESSION ========== */
+// Same block format and match finding as snappyEncode in remoteWrite.go
+const size_t snappyBlockSize = 1 << 16;
+const int snappyHashBits = 14;
+
+void snappyEmitLiteral(string& dst, const char* lit, size_t len) {
+    uint32_t n = len - 1;
+    if (n < 60) {
+        dst += (char)(n << 2);
+    } else if (n < (1 << 8)) {
+        dst += (char)(60 << 2);
+        dst += (char)n;
+    } else { // Literals never exceed a block, so n < 1 << 16
+        dst += (char)(61 << 2);
+        dst += (char)n;
+        dst += (char)(n >> 8);
+    }
+    dst.append(lit, len);
+}
+
+void snappyEmitCopy(string& dst, size_t offset, size_t length) {
+    auto emit2 = [&dst, offset](size_t len) {
+        dst += (char)(((len - 1) << 2) | 2);
+        dst += (char)offset;
+        dst += (char)(offset >> 8);
+    };
+
+    while (length >= 68) {
+        emit2(64);
+        length -= 64;
+    }
+    if (length > 64) {
+        emit2(60);
+        length -= 60;
+    }
+    if (length >= 12 || offset >= 2048) {
+        emit2(length);
+        return;
+    }
+    dst += (char)(((offset >> 8) << 5) | ((length - 4) << 2) | 1);
+    dst += (char)offset;
+}
+
+string snappyEncode(const string& src) {
+    string dst;
+    dst.reserve(src.size() / 2 + 16);
+    appendVarint(dst, src.size());
+
+    auto load32 = [](const char* p) {
+        uint32_t val;
+        memcpy(&val, p, sizeof(val));
+        return val;
+    };
+
+    vector<int32_t> table(1 << snappyHashBits);
+    for (size_t blockStart = 0; blockStart < src.size(); blockStart += snappyBlockSize) {
+        const char* block = src.data() + blockStart;
+        size_t len = std::min(snappyBlockSize, src.size() - blockStart);
+        std::fill(table.begin(), table.end(), -1);
+
+        size_t lit = 0;
+        for (size_t s = 0; s + 4 <= len; ) {
+            uint32_t cur = load32(block + s);
+            uint32_t hash = (cur * 0x1e35a7bd) >> (32 - snappyHashBits);
+            int32_t cand = table[hash];
+            table[hash] = s;
+
+            if (cand < 0 || load32(block + cand) != cur) {
+                s++;
+                continue;
+            }
+
+            if (lit < s) {
+                snappyEmitLiteral(dst, block + lit, s - lit);
+            }
+            size_t length = 4;
+            while (s + length < len && block[cand + length] == block[s + length]) {
+                length++;
+            }
+            snappyEmitCopy(dst, s - cand, length);
+            s += length;
+            lit = s;
+        }
+        if (lit < len) {
+            snappyEmitLiteral(dst, block + lit, len - lit);
+        }
+    }
+
+    return dst;
+}
+
+/* ========== WRITER ========== */
+struct RemoteWriterOpts {
+    uint32_t intervalMs;
+    uint32_t maxSamplesPerSend;
+    uint32_t nShards;
+    uint32_t queueCapacity;
+    uint32_t minBackoffMs;
+    uint32_t maxBackoffMs;
+    uint32_t maxRetries;
+    uint32_t timeoutMs;
+};
+
+// Snapshots the registry every interval on its own thread, with a sender
+// thread per shard. Never freed, as its threads are detached.
+class RemoteWriter {
+    private:
+        struct Shard {
+            std::mutex mu;
+            std::condition_variable cv;
+            std::deque<vector<RwSeries>> queue;
+            bool closed = false;
+        };
+
+        string _host;
+        string _port;
+        string _path;
+        RemoteWriterOpts _opts;
+        struct timeval _timeout;
+        vector<std::unique_ptr<Shard>> _shards;
+
+        std::mutex _mu; // Guards _stopping and _running
+        std::condition_variable _cv;
+        bool _stopping = false;
+        int _running = 0; // Threads yet to exit
+
+        RemoteWriter(string host, string port, string path, const RemoteWriterOpts& opts)
+            : _host(std::move(host)), _port(std::move(port)), _path(std::move(path)), _opts(opts) {
+            _timeout.tv_sec = opts.timeoutMs / 1000;
+            _timeout.tv_usec = (opts.timeoutMs % 1000) * 1000;
+            for (uint32_t i = 0; i < opts.nShards; i++) {
+                _shards.emplace_back(new Shard);
+            }
+        }
+
+        void exited() {
+            std::lock_guard<std::mutex> lock(_mu);
+            _running--;
+            _cv.notify_all();
+        }
+
+        // Renders the registry and queues its samples on the shards
+        void snapshot() {
+            int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+            string text = defaultRegistry().Render();
+
+            vector<vector<RwSeries>> shards(_shards.size());
+            RwSeries series;
+            for (size_t start = 0, end; start < text.size(); start = end + 1) {
+                end = text.find('\n', start);
+                if (end == string::npos) {
+                    end = text.size();
+                }
+                if (text[start] != '#' && parseSample(text.substr(start, end - start), now, series)) {
+                    shards[fnv64a(series.labels) % shards.size()].push_back(std::move(series));
+                }
+            }
+
+            for (size_t i = 0; i < shards.size(); i++) {
+                for (size_t start = 0; start < shards[i].size(); start += _opts.maxSamplesPerSend) {
+                    size_t end = std::min(shards[i].size(), start + _opts.maxSamplesPerSend);
+                    enqueue(*_shards[i], vector<RwSeries>(
+                            std::make_move_iterator(shards[i].begin() + start),
+                            std::make_move_iterator(shards[i].begin() + end)));
+                }
+            }
+        }
+
+        // Queues the batch, dropping the queue's oldest batch if it's full
+        void enqueue(Shard& shard, vector<RwSeries> batch) {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            if (shard.queue.size() >= _opts.queueCapacity) {
+                selfCollector().remoteWrite.dropped += shard.queue.front().size();
+                shard.queue.pop_front();
+            }
+            shard.queue.push_back(std::move(batch));
+            shard.cv.notify_one();
+        }
+
+        void runSnapshots() {
+            std::unique_lock<std::mutex> lock(_mu);
+            auto interval = std::chrono::milliseconds(_opts.intervalMs);
+            while (!_cv.wait_for(lock, interval, [this]() { return _stopping; })) {
+                lock.unlock();
+                snapshot();
+                lock.lock();
+            }
+            lock.unlock();
+
+            snapshot();
+            for (auto& shard : _shards) {
+                std::lock_guard<std::mutex> shardLock(shard->mu);
+                shard->closed = true;
+                shard->cv.notify_one();
+            }
+            exited();
+        }
+
+        void runSender(Shard& shard) {
+            RemoteWriteStats& stats = selfCollector().remoteWrite;
+            while (true) {
+                vector<RwSeries> batch;
+                {
+                    std::unique_lock<std::mutex> lock(shard.mu);
+                    shard.cv.wait(lock, [&shard]() { return !shard.queue.empty() || shard.closed; });
+                    if (shard.queue.empty()) {
+                        break;
+                    }
+                    batch = std::move(shard.queue.front());
+                    shard.queue.pop_front();
+                }
+
+                string body = snappyEncode(encodeWriteRequest(batch));
+                uint32_t backoffMs = _opts.minBackoffMs;
+                for (uint32_t attempt = 0; ; attempt++) {
+                    int status = post(body);
+                    if (status / 100 == 2) {
+                        stats.sent += batch.size();
+                        stats.sentBytes += body.size();
+                        break;
+                    } else if ((status >= 0 && status / 100 != 5 && status != 429) ||
+                                attempt >= _opts.maxRetries) {
+                        stats.failed += batch.size();
+                        break;
+                    }
+
+                    stats.retries++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(backoffMs));
+                    backoffMs = std::min(backoffMs * 2, _opts.maxBackoffMs);
+                }
+            }
+            exited();
+        }
+
+        // Returns the response's status code, or -1 on network errors
+        int post(const string& body) {
+            struct addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            struct addrinfo* addrs = nullptr;
+            if (getaddrinfo(_host.c_str(), _port.c_str(), &hints, &addrs) != 0) {
+                return -1;
+            }
+
+            int fd = -1;
+            for (struct addrinfo* ai = addrs; ai != nullptr && fd < 0; ai = ai->ai_next) {
+                fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0) {
+                    continue;
+                }
+                // On Linux, the send timeout also bounds connect()
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &_timeout, sizeof(_timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &_timeout, sizeof(_timeout));
+                if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(addrs);
+            if (fd < 0) {
+                return -1;
+            }
+
+            string request = "POST " + _path + " HTTP/1.1\r\n";
+            request += "Host: " + _host + ":" + _port + "\r\n";
+            request += "Content-Encoding: snappy\r\n";
+            request += "Content-Type: application/x-protobuf\r\n";
+            request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+            request += "User-Agent: easy-prom-client-c\r\n";
+            request += "X-Prometheus-Remote-Write-Version: 0.1.0\r\n";
+            request += "Connection: close\r\n\r\n";
+            request += body;
+
+            int status = -1;
+            if (sendAll(fd, request.data(), request.size())) {
+                // Read the status line, then drain the response
+                string response;
+                char buf[2048];
+                ssize_t n;
+                while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+                    if (response.size() < 64) {
+                        response.append(buf, n);
+                    }
+                }
+                if (n == 0 && response.compare(0, 5, "HTTP/") == 0) {
+                    size_t space = response.find(' ');
+                    if (space != string::npos) {
+                        status = atoi(response.c_str() + space + 1);
+                    }
+                }
+            }
+            close(fd);
+
+            return status;
+        }
+
+        static bool sendAll(int fd, const char* data, size_t len) {
+            while (len > 0) {
+                ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return false;
+                }
+                data += n;
+                len -= n;
+            }
+
+            return true;
+        }
+
+    public:
+        // Parses "http://host[:port][/path]". Returns nullptr for other URLs.
+        static RemoteWriter* New(const string& url, const RemoteWriterOpts& opts) {
+            const string scheme = "http://";
+            if (url.compare(0, scheme.size(), scheme) != 0) {
+                return nullptr;
+            }
+
+            size_t pathStart = url.find('/', scheme.size());
+            string hostPort = url.substr(scheme.size(), pathStart - scheme.size());
+            string path = (pathStart == string::npos) ? "/" : url.substr(pathStart);
+
+            string host = hostPort;
+            string port = "80";
+            size_t colon = hostPort.rfind(':');
+            if (colon != string::npos && hostPort.find(']', colon) == string::npos) {
+                host = hostPort.substr(0, colon);
+                port = hostPort.substr(colon + 1);
+            }
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+            if (host.empty()) {
+                return nullptr;
+            }
+
+            return new RemoteWriter(host, port, path, opts);
+        }
+
+        void Start() {
+            _running = _shards.size() + 1;
+            for (auto& shard : _shards) {
+                Shard* s = shard.get();
+                std::thread([this, s]() { runSender(*s); }).detach();
+            }
+            std::thread([this]() { runSnapshots(); }).detach();
+        }
+
+        // Returns false if the threads didn't finish within the timeout
+        bool Stop(uint32_t flushTimeoutMs) {
+            std::unique_lock<std::mutex> lock(_mu);
+            _stopping = true;
+            _cv.notify_all();
+
+            return _cv.wait_for(lock, std::chrono::milliseconds(flushTimeoutMs),
+                                [this]() { return _running == 0; });
+        }
+};
+
+std::mutex remoteWriterMu;
+RemoteWriter* activeRemoteWriter = nullptr;
+
+/* ===========================================================================
+ * TEXTFILE EXPORT
+ * =========================================================================== */
+// Counterpart of textfileExporter in textfileExport.go: renders the registry
+// every interval and, if the rendering changed since the last write, writes
+// it to a temporary file that's then renamed over the target, so readers
+// (e.g. node_exporter's textfile collector) never see a partial file.
+class TextfileExporter {
+    private:
+        Registry& _registry;
+        string _path;
+        string _tmpPath; // Doesn't end in ".prom", so the collector ignores it
+        uint32_t _intervalMs;
+
+        string _last; // As last written
+        bool _failed = false; // Whether the last write failed, so failures are only logged once
+
+        bool write(const string& data) {
+            FILE* f = fopen(_tmpPath.c_str(), "w");
+            if (f == nullptr) {
+                return false;
+            }
+
+            bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+            ok = (fclose(f) == 0) && ok;
+            if (ok && rename(_tmpPath.c_str(), _path.c_str()) == 0) {
+                return true;
+            }
+
+            unlink(_tmpPath.c_str());
+            return false;
+        }
+
+        void run() {
+            while (true) {
+                string next = _registry.Render();
+                if (_failed || _last.empty() || next != _last) {
+                    bool ok = write(next);
+                    if (!ok && !_failed) {
+                        fprintf(stderr, "easyprom: textfile export to %s failed: %s\n",
+                                _path.c_str(), strerror(errno));
+                    }
+                    _failed = !ok;
+                    if (ok) {
+                        _last.swap(next);
+                    }
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(_intervalMs));
+            }
+        }
+
+    public:
+        TextfileExporter(Registry& registry, string path, uint32_t intervalMs)
+            : _registry(registry), _path(std::move(path)), _tmpPath(_path + ".tmp"),
+            _intervalMs(intervalMs > 0 ? intervalMs : 15000) {}
+
+        void Start() {
+            std::thread([this]() { run(); }).detach();
+        }
+};
+
+} // End anonymous namespace
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+extern "C" {
+
+void goStartPromHandler(GoString promEndpoint, GoString metricsPath) {
+    goStartPromHandlerOpts(promEndpoint, metricsPath, 0, 0, 0, 0, 0, 0);
+}
+
+// Handlers on the same endpoint share its listener, and the timeouts it was
+// created with. The gzip option is ignored (responses aren't compressed).
+void goStartPromHandlerOpts(GoString promEndpoint, GoString metricsPath,
+        GoUint32 coalesceWindowMs, GoUint32 cacheTTLMs, GoUint8 enableGzip, GoUint32 maxInFlight,
+        GoUint32 readTimeoutMs, GoUint32 writeTimeoutMs) {
+    goStartRegistryHandlerOpts(0, promEndpoint, metricsPath, coalesceWindowMs, cacheTTLMs,
+                                enableGzip, maxInFlight, readTimeoutMs, writeTimeoutMs);
+}
+
+void goStartRegistryHandlerOpts(GoUintptr uPtrRegistry, GoString promEndpoint,
+        GoString metricsPath, GoUint32 coalesceWindowMs, GoUint32 cacheTTLMs, GoUint8 enableGzip,
+        GoUint32 maxInFlight, GoUint32 readTimeoutMs, GoUint32 writeTimeoutMs) {
+    auto handler = std::make_shared<ScrapeHandler>(registryOf(uPtrRegistry), coalesceWindowMs,
+                                                    cacheTTLMs, maxInFlight);
+    string endpoint = goStr2Str(promEndpoint);
+
+    std::lock_guard<std::mutex> lock(listenersMu);
+    auto iter = listeners.find(endpoint);
+    if (iter != listeners.end()) {
+        iter->second->AddHandler(goStr2Str(metricsPath), handler);
+        return;
+    }
+
+    // Like the Go backend, failing to listen isn't fatal
+    HttpListener* listener = HttpListener::Listen(endpoint, readTimeoutMs, writeTimeoutMs);
+    if (listener == nullptr) {
+        fprintf(stderr, "easyprom: unable to listen on %s\n", endpoint.c_str());
+        return;
+    }
+    listener->AddHandler(goStr2Str(metricsPath), handler);
+    listeners[endpoint] = listener;
+    std::thread([listener]() { listener->Run(); }).detach();
+}
+
+/* ========== GAUGES ========== */
+GoUintptr goNewGauge(GoString name, GoString help) {
+    return goNewGaugeIn(0, name, help);
+}
+
+GoUintptr goNewGaugeVec(GoString name, GoString help, GoSlice labels) {
+    return goNewGaugeVecIn(0, name, help, labels);
+}
+
+GoUintptr goGaugeWithLabelValues(GoUintptr uPtrGaugeVec, GoSlice labelVals) {
+    if (ValueVec* vec = gaugeVecHandles.Get(uPtrGaugeVec)) {
+        return vec->WithLabelValues(goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+void goGaugeDeleteLabelValues(GoUintptr uPtrGaugeVec, GoSlice labelVals) {
+    if (ValueVec* vec = gaugeVecHandles.Get(uPtrGaugeVec)) {
+        vec->DeleteLabelValues(goSlice2Strs(labelVals));
+    }
+}
+
+void goGaugeSet(GoUintptr uPtrGauge, GoFloat64 val) {
+    if (ValueChild* gauge = gaugeHandles.Get(uPtrGauge)) {
+        gauge->bits.store(doubleToBits(val), std::memory_order_relaxed);
+    }
+}
+
+void goGaugeAdd(GoUintptr uPtrGauge, GoFloat64 val) {
+    if (ValueChild* gauge = gaugeHandles.Get(uPtrGauge)) {
+        atomicAddDouble(gauge->bits, val);
+    }
+}
+
+void goGaugeSub(GoUintptr uPtrGauge, GoFloat64 val) {
+    goGaugeAdd(uPtrGauge, -val);
+}
+
+void goGaugeSetBatch(GoSlice uPtrGauges, GoSlice vals) {
+    const GoUintptr* handles = static_cast<const GoUintptr*>(uPtrGauges.data);
+    const double* values = static_cast<const double*>(vals.data);
+    for (GoInt i = 0; i < uPtrGauges.len && i < vals.len; i++) {
+        goGaugeSet(handles[i], values[i]);
+    }
+}
+
+void goGaugeAddBatch(GoSlice uPtrGauges, GoSlice vals) {
+    const GoUintptr* handles = static_cast<const GoUintptr*>(uPtrGauges.data);
+    const double* values = static_cast<const double*>(vals.data);
+    for (GoInt i = 0; i < uPtrGauges.len && i < vals.len; i++) {
+        goGaugeAdd(handles[i], values[i]);
+    }
+}
+
+/* ========== COUNTERS ========== */
+GoUintptr goNewCounter(GoString name, GoString help) {
+    return goNewCounterIn(0, name, help);
+}
+
+GoUintptr goNewCounterVec(GoString name, GoString help, GoSlice labels) {
+    return goNewCounterVecIn(0, name, help, labels);
+}
+
+GoUintptr goCounterWithLabelValues(GoUintptr uPtrCounterVec, GoSlice labelVals) {
+    if (ValueVec* vec = counterVecHandles.Get(uPtrCounterVec)) {
+        return vec->WithLabelValues(goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+void goCounterDeleteLabelValues(GoUintptr uPtrCounterVec, GoSlice labelVals) {
+    if (ValueVec* vec = counterVecHandles.Get(uPtrCounterVec)) {
+        vec->DeleteLabelValues(goSlice2Strs(labelVals));
+    }
+}
+
+void goCounterAdd(GoUintptr uPtrCounter, GoFloat64 val) {
+    if (val < 0) {
+        fatal("counter cannot decrease in value");
+    }
+
+    if (ValueChild* counter = counterHandles.Get(uPtrCounter)) {
+        atomicAddDouble(counter->bits, val);
+    }
+}
+
+void goCounterAddBatch(GoSlice uPtrCounters, GoSlice vals) {
+    const GoUintptr* handles = static_cast<const GoUintptr*>(uPtrCounters.data);
+    const double* values = static_cast<const double*>(vals.data);
+    for (GoInt i = 0; i < uPtrCounters.len && i < vals.len; i++) {
+        goCounterAdd(handles[i], values[i]);
+    }
+}
+
+/* ========== HISTOGRAMS ========== */
+GoUintptr goNewHistogram(GoString name, GoString help, GoSlice buckets) {
+    return goNewHistogramIn(0, name, help, buckets);
+}
+
+GoUintptr goNewHistogramVec(GoString name, GoString help, GoSlice labels, GoSlice buckets) {
+    return goNewHistogramVecIn(0, name, help, labels, buckets);
+}
+
+GoUintptr goHistogramWithLabelValues(GoUintptr uPtrHistogramVec, GoSlice labelVals) {
+    if (HistogramVec* vec = histogramVecHandles.Get(uPtrHistogramVec)) {
+        return vec->WithLabelValues(goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+void goHistogramDeleteLabelValues(GoUintptr uPtrHistogramVec, GoSlice labelVals) {
+    if (HistogramVec* vec = histogramVecHandles.Get(uPtrHistogramVec)) {
+        vec->DeleteLabelValues(goSlice2Strs(labelVals));
+    }
+}
+
+void goHistogramObserve(GoUintptr uPtrHistogram, GoFloat64 val) {
+    if (HistogramChild* histogram = histogramHandles.Get(uPtrHistogram)) {
+        histogram->Observe(val);
+    }
+}
+
+void goHistogramObserveBatch(GoUintptr uPtrHistogram, GoSlice vals) {
+    if (HistogramChild* histogram = histogramHandles.Get(uPtrHistogram)) {
+        const double* values = static_cast<const double*>(vals.data);
+        for (GoInt i = 0; i < vals.len; i++) {
+            histogram->Observe(values[i]);
+        }
+    }
+}
+
+/* ========== SUMMARIES ========== */
+static vector<double> summaryQuantiles(GoSlice quantiles, GoSlice errors) {
+    // Same sanity check as makeObjectives() in the Go backend
+    if (quantiles.len != errors.len || quantiles.len == 0) {
+        fatal("Unable to make objectives map for Summary");
+    }
+
+    return goSlice2Doubles(quantiles);
+}
+
+GoUintptr goNewSummary(GoString name, GoString help, GoSlice quantiles, GoSlice errors,
+        GoUint32 maxAge, GoUint32 nAgeBkts) {
+    return goNewSummaryIn(0, name, help, quantiles, errors, maxAge, nAgeBkts);
+}
+
+GoUintptr goNewSummaryVec(GoString name, GoString help, GoSlice labels,
+        GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts) {
+    return goNewSummaryVecIn(0, name, help, labels, quantiles, errors, maxAge, nAgeBkts);
+}
+
+GoUintptr goSummaryWithLabelValues(GoUintptr uPtrSummaryVec, GoSlice labelVals) {
+    if (SummaryVec* vec = summaryVecHandles.Get(uPtrSummaryVec)) {
+        return vec->WithLabelValues(goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+void goSummaryDeleteLabelValues(GoUintptr uPtrSummaryVec, GoSlice labelVals) {
+    if (SummaryVec* vec = summaryVecHandles.Get(uPtrSummaryVec)) {
+        vec->DeleteLabelValues(goSlice2Strs(labelVals));
+    }
+}
+
+void goSummaryObserve(GoUintptr uPtrSummary, GoFloat64 val) {
+    if (SummaryChild* summary = summaryHandles.Get(uPtrSummary)) {
+        summary->Observe(val);
+    }
+}
+
+void goSummaryObserveBatch(GoUintptr uPtrSummary, GoSlice vals) {
+    if (SummaryChild* summary = summaryHandles.Get(uPtrSummary)) {
+        const double* values = static_cast<const double*>(vals.data);
+        for (GoInt i = 0; i < vals.len; i++) {
+            summary->Observe(values[i]);
+        }
+    }
+}
+
+// Summaries weigh their observations natively
+GoUintptr goNewSampledSummary(GoString name, GoString help, GoSlice quantiles, GoSlice errors,
+        GoUint32 maxAge, GoUint32 nAgeBkts) {
+    return goNewSummary(name, help, quantiles, errors, maxAge, nAgeBkts);
+}
+
+void goSummaryObserveWeighted(GoUintptr uPtrSummary, GoFloat64 val, GoUint32 weight) {
+    if (SummaryChild* summary = summaryHandles.Get(uPtrSummary)) {
+        summary->Observe(val, weight);
+    }
+}
+
+/* ========== REGISTRIES ========== */
+GoUintptr goNewRegistry(GoUint32 nShards) {
+    Registry* registry = new Registry(nShards);
+    {
+        std::lock_guard<std::mutex> lock(registriesMu);
+        registries.push_back(registry);
+    }
+
+    return registryHandles.Put(registry);
+}
+
+GoUintptr goNewGaugeIn(GoUintptr uPtrRegistry, GoString name, GoString help) {
+    ValueVec* vec = registerVec(new ValueVec(goStr2Str(name), goStr2Str(help), {},
+                                            gaugeHandles, "gauge"), registryOf(uPtrRegistry));
+    return vec->WithLabelValues({});
+}
+
+GoUintptr goNewGaugeVecIn(GoUintptr uPtrRegistry, GoString name, GoString help, GoSlice labels) {
+    ValueVec* vec = registerVec(new ValueVec(goStr2Str(name), goStr2Str(help),
+                                            goSlice2Strs(labels), gaugeHandles, "gauge"),
+                                registryOf(uPtrRegistry));
+    return gaugeVecHandles.Put(vec);
+}
+
+GoUintptr goNewCounterIn(GoUintptr uPtrRegistry, GoString name, GoString help) {
+    ValueVec* vec = registerVec(new ValueVec(goStr2Str(name), goStr2Str(help), {},
+                                            counterHandles, "counter"), registryOf(uPtrRegistry));
+    return vec->WithLabelValues({});
+}
+
+GoUintptr goNewCounterVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels) {
+    ValueVec* vec = registerVec(new ValueVec(goStr2Str(name), goStr2Str(help),
+                                            goSlice2Strs(labels), counterHandles, "counter"),
+                                registryOf(uPtrRegistry));
+    return counterVecHandles.Put(vec);
+}
+
+GoUintptr goNewHistogramIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice buckets) {
+    HistogramVec* vec = registerVec(new HistogramVec(goStr2Str(name), goStr2Str(help), {},
+                                            histogramHandles, goSlice2Doubles(buckets)),
+                                    registryOf(uPtrRegistry));
+    return vec->WithLabelValues({});
+}
+
+GoUintptr goNewHistogramVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels, GoSlice buckets) {
+    HistogramVec* vec = registerVec(new HistogramVec(goStr2Str(name), goStr2Str(help),
+                                            goSlice2Strs(labels), histogramHandles,
+                                            goSlice2Doubles(buckets)),
+                                    registryOf(uPtrRegistry));
+    return histogramVecHandles.Put(vec);
+}
+
+GoUintptr goNewSummaryIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts) {
+    SummaryVec* vec = registerVec(new SummaryVec(goStr2Str(name), goStr2Str(help), {},
+                                            summaryHandles, summaryQuantiles(quantiles, errors),
+                                            maxAge, nAgeBkts),
+                                registryOf(uPtrRegistry));
+    return vec->WithLabelValues({});
+}
+
+GoUintptr goNewSummaryVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels, GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts) {
+    SummaryVec* vec = registerVec(new SummaryVec(goStr2Str(name), goStr2Str(help),
+                                            goSlice2Strs(labels), summaryHandles,
+                                            summaryQuantiles(quantiles, errors),
+                                            maxAge, nAgeBkts),
+                                registryOf(uPtrRegistry));
+    return summaryVecHandles.Put(vec);
+}
+
+/* ========== BULK REGISTRATION ========== */
+void goNewMetrics(GoSlice kinds, GoSlice names, GoSlice helps, GoSlice nLabels, GoSlice labels,
+        GoSlice nBuckets, GoSlice buckets, GoSlice handles) {
+    const GoUint8* kindCodes = static_cast<const GoUint8*>(kinds.data);
+    const GoString* nameStrs = static_cast<const GoString*>(names.data);
+    const GoString* helpStrs = static_cast<const GoString*>(helps.data);
+    const GoUint32* labelCounts = static_cast<const GoUint32*>(nLabels.data);
+    const GoUint32* bucketCounts = static_cast<const GoUint32*>(nBuckets.data);
+    GoUintptr* out = static_cast<GoUintptr*>(handles.data);
+
+    GoSlice metricLabels = labels;
+    GoSlice metricBuckets = buckets;
+    for (GoInt i = 0; i < kinds.len; i++) {
+        metricLabels.len = metricLabels.cap = labelCounts[i];
+        metricBuckets.len = metricBuckets.cap = bucketCounts[i];
+
+        // Same kinds as EASYPROM_KIND_* in promClient.h
+        switch (kindCodes[i]) {
+            case 0: out[i] = goNewGauge(nameStrs[i], helpStrs[i]); break;
+            case 1: out[i] = goNewGaugeVec(nameStrs[i], helpStrs[i], metricLabels); break;
+            case 2: out[i] = goNewCounter(nameStrs[i], helpStrs[i]); break;
+            case 3: out[i] = goNewCounterVec(nameStrs[i], helpStrs[i], metricLabels); break;
+            case 4: out[i] = goNewHistogram(nameStrs[i], helpStrs[i], metricBuckets); break;
+            case 5:
+                out[i] = goNewHistogramVec(nameStrs[i], helpStrs[i], metricLabels, metricBuckets);
+                break;
+            default: fatal("Unknown metric kind");
+        }
+
+        metricLabels.data = static_cast<GoString*>(metricLabels.data) + labelCounts[i];
+        metricBuckets.data = static_cast<double*>(metricBuckets.data) + bucketCounts[i];
+    }
+}
+
+/* ========== BULK CHILD CREATION ========== */
+// Calls withLabelValues (e.g. goGaugeWithLabelValues) for each set of
+// 'nLabels' label values in 'labelVals'
+static void withLabelValuesMany(GoUintptr (*withLabelValues)(GoUintptr, GoSlice),
+        GoUintptr uPtrVec, GoUint32 nLabels, GoSlice labelVals, GoSlice handles) {
+    GoUintptr* out = static_cast<GoUintptr*>(handles.data);
+    GoSlice tuple = {labelVals.data, (GoInt)nLabels, (GoInt)nLabels};
+    for (GoInt i = 0; nLabels > 0 && i < handles.len && (i + 1) * nLabels <= labelVals.len; i++) {
+        out[i] = withLabelValues(uPtrVec, tuple);
+        tuple.data = static_cast<GoString*>(tuple.data) + nLabels;
+    }
+}
+
+// Like withLabelValuesMany, for every combination of label values, where
+// label i takes each of the next nVals[i] values in 'vals'. The last
+// label's value varies fastest.
+static void withLabelValuesProduct(GoUintptr (*withLabelValues)(GoUintptr, GoSlice),
+        GoUintptr uPtrVec, GoSlice nVals, GoSlice vals, GoSlice handles) {
+    const GoUint32* counts = static_cast<const GoUint32*>(nVals.data);
+    const GoString* values = static_cast<const GoString*>(vals.data);
+    size_t nLabels = nVals.len;
+    if (nLabels == 0) {
+        return;
+    }
+
+    vector<size_t> offsets(nLabels);
+    size_t nTuples = 1;
+    for (size_t label = 0, off = 0; label < nLabels; off += counts[label], label++) {
+        offsets[label] = off;
+        nTuples *= counts[label];
+    }
+
+    GoUintptr* out = static_cast<GoUintptr*>(handles.data);
+    vector<GoString> tuple(nLabels);
+    GoSlice tupleSlice = {tuple.data(), (GoInt)nLabels, (GoInt)nLabels};
+    for (size_t i = 0; i < nTuples && (GoInt)i < handles.len; i++) {
+        size_t rem = i;
+        for (size_t label = nLabels; label-- > 0;) {
+            tuple[label] = values[offsets[label] + rem % counts[label]];
+            rem /= counts[label];
+        }
+        out[i] = withLabelValues(uPtrVec, tupleSlice);
+    }
+}
+
+void goGaugeWithLabelValuesMany(GoUintptr uPtrGaugeVec, GoUint32 nLabels, GoSlice labelVals,
+        GoSlice handles) {
+    withLabelValuesMany(goGaugeWithLabelValues, uPtrGaugeVec, nLabels, labelVals, handles);
+}
+
+void goGaugeWithLabelValuesProduct(GoUintptr uPtrGaugeVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles) {
+    withLabelValuesProduct(goGaugeWithLabelValues, uPtrGaugeVec, nVals, vals, handles);
+}
+
+void goCounterWithLabelValuesMany(GoUintptr uPtrCounterVec, GoUint32 nLabels, GoSlice labelVals,
+        GoSlice handles) {
+    withLabelValuesMany(goCounterWithLabelValues, uPtrCounterVec, nLabels, labelVals, handles);
+}
+
+void goCounterWithLabelValuesProduct(GoUintptr uPtrCounterVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles) {
+    withLabelValuesProduct(goCounterWithLabelValues, uPtrCounterVec, nVals, vals, handles);
+}
+
+void goHistogramWithLabelValuesMany(GoUintptr uPtrHistogramVec, GoUint32 nLabels, GoSlice labelVals,
+        GoSlice handles) {
+    withLabelValuesMany(goHistogramWithLabelValues, uPtrHistogramVec, nLabels, labelVals, handles);
+}
+
+void goHistogramWithLabelValuesProduct(GoUintptr uPtrHistogramVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles) {
+    withLabelValuesProduct(goHistogramWithLabelValues, uPtrHistogramVec, nVals, vals, handles);
+}
+
+void goSummaryWithLabelValuesMany(GoUintptr uPtrSummaryVec, GoUint32 nLabels, GoSlice labelVals,
+        GoSlice handles) {
+    withLabelValuesMany(goSummaryWithLabelValues, uPtrSummaryVec, nLabels, labelVals, handles);
+}
+
+void goSummaryWithLabelValuesProduct(GoUintptr uPtrSummaryVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles) {
+    withLabelValuesProduct(goSummaryWithLabelValues, uPtrSummaryVec, nVals, vals, handles);
+}
+
+/* ========== BATCHED RECORDS ========== */
+void goApplyRecords(GoSlice uPtrs, GoSlice ops, GoSlice vals) {
+    const GoUintptr* handles = static_cast<const GoUintptr*>(uPtrs.data);
+    const GoUint8* opCodes = static_cast<const GoUint8*>(ops.data);
+    const double* values = static_cast<const double*>(vals.data);
+    for (GoInt i = 0; i < uPtrs.len && i < ops.len && i < vals.len; i++) {
+        // Same operation codes as EASYPROM_OP_* in promClient.h
+        switch (opCodes[i]) {
+            case 0: goGaugeSet(handles[i], values[i]); break;
+            case 1: goGaugeAdd(handles[i], values[i]); break;
+            case 2: goCounterAdd(handles[i], values[i]); break;
+            case 3: goSummaryObserve(handles[i], values[i]); break;
+            case 4: goHistogramObserve(handles[i], values[i]); break;
+        }
+    }
+}
+
+/* ========== NATIVE CELLS ========== */
+void goNewNativeCounter(GoString name, GoString help, void* cells, GoUint32 nCells, GoUint32 stride) {
+    defaultRegistry().Register(new NativeCellsCollector(goStr2Str(name), goStr2Str(help),
+                                    "counter", cells, nCells, stride, false));
+}
+
+void goNewNativeIntCounter(GoString name, GoString help, void* cells, GoUint32 nCells, GoUint32 stride) {
+    defaultRegistry().Register(new NativeCellsCollector(goStr2Str(name), goStr2Str(help),
+                                    "counter", cells, nCells, stride, true));
+}
+
+void goNewNativeGauge(GoString name, GoString help, void* cells, GoUint32 nCells, GoUint32 stride) {
+    defaultRegistry().Register(new NativeCellsCollector(goStr2Str(name), goStr2Str(help),
+                                    "gauge", cells, nCells, stride, false));
+}
+
+void goNewNativePerProcess(GoString name, GoString help, GoUint8 isGauge, void* slabs,
+        GoUint32 nSlabs, GoUint32 slabSize, GoUint32 offset) {
+    if (slabs == nullptr || nSlabs == 0 || offset < 8 || offset + 8 > slabSize) {
+        fatal("Invalid slab array for per-process metric");
+    }
+
+    defaultRegistry().Register(new NativePerProcessCollector(goStr2Str(name), goStr2Str(help),
+                                    isGauge ? "gauge" : "counter", slabs, nSlabs, slabSize, offset));
+}
+
+void goNewNativeHistogram(GoString name, GoString help, GoSlice bounds, void* cells,
+        GoUint32 nShards, GoUint32 stride) {
+    if (cells == nullptr || nShards == 0 || stride < (bounds.len + 2) * sizeof(uint64_t)) {
+        fatal("Invalid cell array for native histogram");
+    }
+
+    defaultRegistry().Register(new NativeHistogramCollector(goStr2Str(name), goStr2Str(help),
+                                    goSlice2Doubles(bounds), cells, nShards, stride));
+}
+
+void goNewNativeSummary(GoString name, GoString help, GoSlice quantiles, void* fn, void* ctx) {
+    if (fn == nullptr) {
+        fatal("Invalid callback for native summary");
+    }
+
+    defaultRegistry().Register(new NativeSummaryCollector(goStr2Str(name), goStr2Str(help),
+                                    goSlice2Doubles(quantiles), fn, ctx));
+}
+
+/* ========== FUNC METRICS ========== */
+void goNewGaugeFunc(GoString name, GoString help, void* fn, void* ctx) {
+    defaultRegistry().Register(new FuncCollector(goStr2Str(name), goStr2Str(help), "gauge",
+                                    {}, false, fn, ctx));
+}
+
+void goNewCounterFunc(GoString name, GoString help, void* fn, void* ctx) {
+    defaultRegistry().Register(new FuncCollector(goStr2Str(name), goStr2Str(help), "counter",
+                                    {}, false, fn, ctx));
+}
+
+void goNewGaugeVecFunc(GoString name, GoString help, GoSlice labels, void* fn, void* ctx) {
+    defaultRegistry().Register(new FuncCollector(goStr2Str(name), goStr2Str(help), "gauge",
+                                    goSlice2Strs(labels), true, fn, ctx));
+}
+
+void goNewCounterVecFunc(GoString name, GoString help, GoSlice labels, void* fn, void* ctx) {
+    defaultRegistry().Register(new FuncCollector(goStr2Str(name), goStr2Str(help), "counter",
+                                    goSlice2Strs(labels), true, fn, ctx));
+}
+
+/* ========== SERIES LIMITS ========== */
+void goGaugeVecSetLimits(GoUintptr uPtrGaugeVec, GoUint32 maxSeries, GoUint8 foldOverflow,
+        GoUint32 idleTTLSec, void* evictions) {
+    if (ValueVec* vec = gaugeVecHandles.Get(uPtrGaugeVec)) {
+        vec->SetLimits(maxSeries, foldOverflow, idleTTLSec, evictions);
+    }
+}
+
+void goCounterVecSetLimits(GoUintptr uPtrCounterVec, GoUint32 maxSeries, GoUint8 foldOverflow,
+        GoUint32 idleTTLSec, void* evictions) {
+    if (ValueVec* vec = counterVecHandles.Get(uPtrCounterVec)) {
+        vec->SetLimits(maxSeries, foldOverflow, idleTTLSec, evictions);
+    }
+}
+
+void goHistogramVecSetLimits(GoUintptr uPtrHistogramVec, GoUint32 maxSeries, GoUint8 foldOverflow,
+        GoUint32 idleTTLSec, void* evictions) {
+    if (HistogramVec* vec = histogramVecHandles.Get(uPtrHistogramVec)) {
+        vec->SetLimits(maxSeries, foldOverflow, idleTTLSec, evictions);
+    }
+}
+
+void goSummaryVecSetLimits(GoUintptr uPtrSummaryVec, GoUint32 maxSeries, GoUint8 foldOverflow,
+        GoUint32 idleTTLSec, void* evictions) {
+    if (SummaryVec* vec = summaryVecHandles.Get(uPtrSummaryVec)) {
+        vec->SetLimits(maxSeries, foldOverflow, idleTTLSec, evictions);
+    }
+}
+
+/* ========== REMOTE WRITE ========== */
+// Only http:// URLs are supported; others are reported and ignored, like a
+// failure to listen in goStartPromHandlerOpts
+void goStartRemoteWrite(GoString url, GoUint32 intervalMs, GoUint32 maxSamplesPerSend,
+        GoUint32 nShards, GoUint32 queueCapacity, GoUint32 minBackoffMs, GoUint32 maxBackoffMs,
+        GoUint32 maxRetries, GoUint32 timeoutMs) {
+    auto orDefault = [](uint32_t val, uint32_t def) { return (val == 0) ? def : val; };
+
+    if (intervalMs == 0) {
+        fatal("Remote write interval must be positive");
+    }
+
+    RemoteWriterOpts opts = {
+        intervalMs,
+        orDefault(maxSamplesPerSend, 2000),
+        orDefault(nShards, 1),
+        orDefault(queueCapacity, 16),
+        orDefault(minBackoffMs, 30),
+        orDefault(maxBackoffMs, 5000),
+        orDefault(maxRetries, 10),
+        orDefault(timeoutMs, 30000),
+    };
+
+    std::lock_guard<std::mutex> lock(remoteWriterMu);
+    if (activeRemoteWriter != nullptr) {
+        fatal("Remote write has already been started");
+    }
+
+    RemoteWriter* writer = RemoteWriter::New(goStr2Str(url), opts);
+    if (writer == nullptr) {
+        fprintf(stderr, "easyprom: unsupported remote write URL %s\n", goStr2Str(url).c_str());
+        return;
+    }
+    activeRemoteWriter = writer;
+    writer->Start();
+}
+
+GoUint8 goStopRemoteWrite(GoUint32 flushTimeoutMs) {
+    RemoteWriter* writer;
+    {
+        std::lock_guard<std::mutex> lock(remoteWriterMu);
+        writer = activeRemoteWriter;
+        activeRemoteWriter = nullptr;
+    }
+
+    return (writer == nullptr) ? 1 : writer->Stop(flushTimeoutMs);
+}
+
+/* ========== SERIES DELETION ========== */
+GoUint8 goGaugeDelete(GoUintptr uPtrGaugeVec, GoUintptr uPtrGauge) {
+    if (ValueVec* vec = gaugeVecHandles.Get(uPtrGaugeVec)) {
+        return vec->DeleteChild(uPtrGauge);
+    }
+
+    return 0;
+}
+
+GoUint32 goGaugeDeletePartialMatch(GoUintptr uPtrGaugeVec, GoSlice labelNames, GoSlice labelVals) {
+    if (ValueVec* vec = gaugeVecHandles.Get(uPtrGaugeVec)) {
+        return vec->DeletePartialMatch(goSlice2Strs(labelNames), goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+GoUint8 goCounterDelete(GoUintptr uPtrCounterVec, GoUintptr uPtrCounter) {
+    if (ValueVec* vec = counterVecHandles.Get(uPtrCounterVec)) {
+        return vec->DeleteChild(uPtrCounter);
+    }
+
+    return 0;
+}
+
+GoUint32 goCounterDeletePartialMatch(GoUintptr uPtrCounterVec, GoSlice labelNames, GoSlice labelVals) {
+    if (ValueVec* vec = counterVecHandles.Get(uPtrCounterVec)) {
+        return vec->DeletePartialMatch(goSlice2Strs(labelNames), goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+GoUint8 goHistogramDelete(GoUintptr uPtrHistogramVec, GoUintptr uPtrHistogram) {
+    if (HistogramVec* vec = histogramVecHandles.Get(uPtrHistogramVec)) {
+        return vec->DeleteChild(uPtrHistogram);
+    }
+
+    return 0;
+}
+
+GoUint32 goHistogramDeletePartialMatch(GoUintptr uPtrHistogramVec, GoSlice labelNames, GoSlice labelVals) {
+    if (HistogramVec* vec = histogramVecHandles.Get(uPtrHistogramVec)) {
+        return vec->DeletePartialMatch(goSlice2Strs(labelNames), goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+GoUint8 goSummaryDelete(GoUintptr uPtrSummaryVec, GoUintptr uPtrSummary) {
+    if (SummaryVec* vec = summaryVecHandles.Get(uPtrSummaryVec)) {
+        return vec->DeleteChild(uPtrSummary);
+    }
+
+    return 0;
+}
+
+GoUint32 goSummaryDeletePartialMatch(GoUintptr uPtrSummaryVec, GoSlice labelNames, GoSlice labelVals) {
+    if (SummaryVec* vec = summaryVecHandles.Get(uPtrSummaryVec)) {
+        return vec->DeletePartialMatch(goSlice2Strs(labelNames), goSlice2Strs(labelVals));
+    }
+
+    return 0;
+}
+
+/* ========== TEXTFILE EXPORT ========== */
+// Exporters run until the process exits
+void goStartTextfileExport(GoUintptr uPtrRegistry, GoString path, GoUint32 intervalMs) {
+    TextfileExporter* exporter = new TextfileExporter(registryOf(uPtrRegistry), goStr2Str(path),
+                                                        intervalMs);
+    exporter->Start();
+}
+
+/* ========== PROFILING ========== */
+// There's no Go runtime to profile: use perf or gperftools instead
+void goStartPprofHandler(GoString promEndpoint) {
+    fprintf(stderr, "easyprom: pprof isn't supported by the native backend\n");
+}
+
+GoInt32 goSetMutexProfileFraction(GoInt32 rate) {
+    return 0;
+}
+
+void goSetBlockProfileRate(GoInt32 rate) {}
+
+GoInt32 goStartCPUProfile(GoString path, GoUint32 durationMs) {
+    return -1;
+}
+
+GoInt32 goWriteProfile(GoString name, GoString path) {
+    return -1;
+}
+
+/* ========== RENDERING ========== */
+// Only the text format is supported natively
+GoInt64 goRenderMetrics(GoUintptr uPtrRegistry, void* buf, GoUint64 bufCap, GoUint32 format) {
+    if (format != 0) {
+        return -1;
+    }
+
+    string text = registryOf(uPtrRegistry).Render();
+    if (buf != nullptr) {
+        memcpy(buf, text.data(), std::min<size_t>(text.size(), bufCap));
+    }
+
+    return text.size();
+}
+
+GoUintptr goOpenRenderStream(GoUintptr uPtrRegistry, GoUint32 format) {
+    if (format != 0) {
+        return 0;
+    }
+
+    RenderStream* stream = new RenderStream;
+    stream->collectors = registryOf(uPtrRegistry).Collectors();
+
+    return renderStreamHandles.Put(stream);
+}
+
+GoUint64 goReadRenderStream(GoUintptr uPtrStream, void* buf, GoUint64 bufCap) {
+    RenderStream* stream = renderStreamHandles.Get(uPtrStream);
+    if (stream == nullptr || buf == nullptr) {
+        return 0;
+    }
+
+    if (stream->pendingOff > 0) {
+        stream->pending.erase(0, stream->pendingOff);
+        stream->pendingOff = 0;
+    }
+    while (stream->pending.size() < bufCap && stream->next < stream->collectors.size()) {
+        stream->collectors[stream->next++]->Render(stream->pending);
+    }
+
+    size_t n = std::min<size_t>(stream->pending.size(), bufCap);
+    memcpy(buf, stream->pending.data(), n);
+    stream->pendingOff = n;
+
+    return n;
+}
+
+void goCloseRenderStream(GoUintptr uPtrStream) {
+    RenderStream* stream = renderStreamHandles.Get(uPtrStream);
+    if (stream != nullptr) {
+        renderStreamHandles.Delete(uPtrStream);
+        delete stream;
+    }
+}
+
+} // End extern "C"
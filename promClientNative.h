@@ -0,0 +1,205 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Declarations for the pure C++ backend (promClientNative.cpp), which needs
+ * no Go runtime. It implements the same functions that the Go backend
+ * exports (see the cgo-generated libpromclient.h), with the same signatures
+ * and Go-compatible types, so promClient.h works unchanged on top of either.
+ * promClient.h includes this instead of libpromclient.h when
+ * EASYPROM_NATIVE_BACKEND is defined.
+ *
+ * NOTE: Keep in sync with the //export'ed functions in the *.go files.
+ */
+
+#ifndef _PROM_CLIENT_NATIVE_H_
+#define _PROM_CLIENT_NATIVE_H_
+
+#include <stddef.h>
+
+/* ========== GO-COMPATIBLE TYPES ========== */
+typedef signed char GoInt8;
+typedef unsigned char GoUint8;
+typedef int GoInt32;
+typedef unsigned int GoUint32;
+typedef long long GoInt64;
+typedef unsigned long long GoUint64;
+typedef GoInt64 GoInt;
+typedef size_t GoUintptr;
+typedef double GoFloat64;
+
+typedef struct { const char *p; ptrdiff_t n; } GoString;
+typedef struct { void *data; GoInt len; GoInt cap; } GoSlice;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== HANDLER ========== */
+extern void goStartPromHandler(GoString promEndpoint, GoString metricsPath);
+extern void goStartPromHandlerOpts(GoString promEndpoint, GoString metricsPath,
+        GoUint32 coalesceWindowMs, GoUint32 cacheTTLMs, GoUint8 enableGzip, GoUint32 maxInFlight,
+        GoUint32 readTimeoutMs, GoUint32 writeTimeoutMs);
+extern void goStartRemoteWrite(GoString url, GoUint32 intervalMs, GoUint32 maxSamplesPerSend,
+        GoUint32 nShards, GoUint32 queueCapacity, GoUint32 minBackoffMs, GoUint32 maxBackoffMs,
+        GoUint32 maxRetries, GoUint32 timeoutMs);
+extern GoUint8 goStopRemoteWrite(GoUint32 flushTimeoutMs);
+extern void goStartRegistryHandlerOpts(GoUintptr uPtrRegistry, GoString promEndpoint,
+        GoString metricsPath, GoUint32 coalesceWindowMs, GoUint32 cacheTTLMs, GoUint8 enableGzip,
+        GoUint32 maxInFlight, GoUint32 readTimeoutMs, GoUint32 writeTimeoutMs);
+
+/* ========== GAUGES ========== */
+extern GoUintptr goNewGauge(GoString name, GoString help);
+extern GoUintptr goNewGaugeVec(GoString name, GoString help, GoSlice labels);
+extern GoUintptr goGaugeWithLabelValues(GoUintptr uPtrGaugeVec, GoSlice labelVals);
+extern void goGaugeDeleteLabelValues(GoUintptr uPtrGaugeVec, GoSlice labelVals);
+extern void goGaugeSet(GoUintptr uPtrGauge, GoFloat64 val);
+extern void goGaugeAdd(GoUintptr uPtrGauge, GoFloat64 val);
+extern void goGaugeSub(GoUintptr uPtrGauge, GoFloat64 val);
+extern void goGaugeSetBatch(GoSlice uPtrGauges, GoSlice vals);
+extern void goGaugeAddBatch(GoSlice uPtrGauges, GoSlice vals);
+
+/* ========== COUNTERS ========== */
+extern GoUintptr goNewCounter(GoString name, GoString help);
+extern GoUintptr goNewCounterVec(GoString name, GoString help, GoSlice labels);
+extern GoUintptr goCounterWithLabelValues(GoUintptr uPtrCounterVec, GoSlice labelVals);
+extern void goCounterDeleteLabelValues(GoUintptr uPtrCounterVec, GoSlice labelVals);
+extern void goCounterAdd(GoUintptr uPtrCounter, GoFloat64 val);
+extern void goCounterAddBatch(GoSlice uPtrCounters, GoSlice vals);
+
+/* ========== HISTOGRAMS ========== */
+extern GoUintptr goNewHistogram(GoString name, GoString help, GoSlice buckets);
+extern GoUintptr goNewHistogramVec(GoString name, GoString help, GoSlice labels, GoSlice buckets);
+extern GoUintptr goHistogramWithLabelValues(GoUintptr uPtrHistogramVec, GoSlice labelVals);
+extern void goHistogramDeleteLabelValues(GoUintptr uPtrHistogramVec, GoSlice labelVals);
+extern void goHistogramObserve(GoUintptr uPtrHistogram, GoFloat64 val);
+extern void goHistogramObserveBatch(GoUintptr uPtrHistogram, GoSlice vals);
+
+/* ========== SUMMARIES ========== */
+extern GoUintptr goNewSummary(GoString name, GoString help, GoSlice quantiles, GoSlice errors,
+        GoUint32 maxAge, GoUint32 nAgeBkts);
+extern GoUintptr goNewSummaryVec(GoString name, GoString help, GoSlice labels,
+        GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts);
+extern GoUintptr goSummaryWithLabelValues(GoUintptr uPtrSummaryVec, GoSlice labelVals);
+extern void goSummaryDeleteLabelValues(GoUintptr uPtrSummaryVec, GoSlice labelVals);
+extern void goSummaryObserve(GoUintptr uPtrSummary, GoFloat64 val);
+extern void goSummaryObserveBatch(GoUintptr uPtrSummary, GoSlice vals);
+extern GoUintptr goNewSampledSummary(GoString name, GoString help, GoSlice quantiles,
+        GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts);
+extern void goSummaryObserveWeighted(GoUintptr uPtrSummary, GoFloat64 val, GoUint32 weight);
+
+/* ========== REGISTRIES ========== */
+extern GoUintptr goNewRegistry(GoUint32 nShards);
+extern GoUintptr goNewGaugeIn(GoUintptr uPtrRegistry, GoString name, GoString help);
+extern GoUintptr goNewGaugeVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels);
+extern GoUintptr goNewCounterIn(GoUintptr uPtrRegistry, GoString name, GoString help);
+extern GoUintptr goNewCounterVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels);
+extern GoUintptr goNewHistogramIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice buckets);
+extern GoUintptr goNewHistogramVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels, GoSlice buckets);
+extern GoUintptr goNewSummaryIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts);
+extern GoUintptr goNewSummaryVecIn(GoUintptr uPtrRegistry, GoString name, GoString help,
+        GoSlice labels, GoSlice quantiles, GoSlice errors, GoUint32 maxAge, GoUint32 nAgeBkts);
+
+/* ========== BULK REGISTRATION ========== */
+extern void goNewMetrics(GoSlice kinds, GoSlice names, GoSlice helps, GoSlice nLabels,
+        GoSlice labels, GoSlice nBuckets, GoSlice buckets, GoSlice handles);
+
+/* ========== BULK CHILD CREATION ========== */
+extern void goGaugeWithLabelValuesMany(GoUintptr uPtrGaugeVec, GoUint32 nLabels,
+        GoSlice labelVals, GoSlice handles);
+extern void goGaugeWithLabelValuesProduct(GoUintptr uPtrGaugeVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles);
+extern void goCounterWithLabelValuesMany(GoUintptr uPtrCounterVec, GoUint32 nLabels,
+        GoSlice labelVals, GoSlice handles);
+extern void goCounterWithLabelValuesProduct(GoUintptr uPtrCounterVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles);
+extern void goHistogramWithLabelValuesMany(GoUintptr uPtrHistogramVec, GoUint32 nLabels,
+        GoSlice labelVals, GoSlice handles);
+extern void goHistogramWithLabelValuesProduct(GoUintptr uPtrHistogramVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles);
+extern void goSummaryWithLabelValuesMany(GoUintptr uPtrSummaryVec, GoUint32 nLabels,
+        GoSlice labelVals, GoSlice handles);
+extern void goSummaryWithLabelValuesProduct(GoUintptr uPtrSummaryVec, GoSlice nVals, GoSlice vals,
+        GoSlice handles);
+
+/* ========== BATCHED RECORDS ========== */
+extern void goApplyRecords(GoSlice uPtrs, GoSlice ops, GoSlice vals);
+
+/* ========== NATIVE CELLS ========== */
+extern void goNewNativeCounter(GoString name, GoString help, void* cells,
+        GoUint32 nCells, GoUint32 stride);
+extern void goNewNativeIntCounter(GoString name, GoString help, void* cells,
+        GoUint32 nCells, GoUint32 stride);
+extern void goNewNativeGauge(GoString name, GoString help, void* cells,
+        GoUint32 nCells, GoUint32 stride);
+extern void goNewNativeHistogram(GoString name, GoString help, GoSlice bounds, void* cells,
+        GoUint32 nShards, GoUint32 stride);
+extern void goNewNativeSummary(GoString name, GoString help, GoSlice quantiles, void* fn, void* ctx);
+extern void goNewGaugeFunc(GoString name, GoString help, void* fn, void* ctx);
+extern void goNewCounterFunc(GoString name, GoString help, void* fn, void* ctx);
+extern void goNewGaugeVecFunc(GoString name, GoString help, GoSlice labels, void* fn, void* ctx);
+extern void goNewCounterVecFunc(GoString name, GoString help, GoSlice labels, void* fn, void* ctx);
+extern void goNewNativePerProcess(GoString name, GoString help, GoUint8 isGauge, void* slabs,
+        GoUint32 nSlabs, GoUint32 slabSize, GoUint32 offset);
+
+/* ========== SERIES LIMITS ========== */
+extern void goGaugeVecSetLimits(GoUintptr uPtrGaugeVec, GoUint32 maxSeries,
+        GoUint8 foldOverflow, GoUint32 idleTTLSec, void* evictions);
+extern void goCounterVecSetLimits(GoUintptr uPtrCounterVec, GoUint32 maxSeries,
+        GoUint8 foldOverflow, GoUint32 idleTTLSec, void* evictions);
+extern void goHistogramVecSetLimits(GoUintptr uPtrHistogramVec, GoUint32 maxSeries,
+        GoUint8 foldOverflow, GoUint32 idleTTLSec, void* evictions);
+extern void goSummaryVecSetLimits(GoUintptr uPtrSummaryVec, GoUint32 maxSeries,
+        GoUint8 foldOverflow, GoUint32 idleTTLSec, void* evictions);
+
+/* ========== SERIES DELETION ========== */
+extern GoUint8 goGaugeDelete(GoUintptr uPtrGaugeVec, GoUintptr uPtrGauge);
+extern GoUint32 goGaugeDeletePartialMatch(GoUintptr uPtrGaugeVec, GoSlice labelNames,
+        GoSlice labelVals);
+extern GoUint8 goCounterDelete(GoUintptr uPtrCounterVec, GoUintptr uPtrCounter);
+extern GoUint32 goCounterDeletePartialMatch(GoUintptr uPtrCounterVec, GoSlice labelNames,
+        GoSlice labelVals);
+extern GoUint8 goHistogramDelete(GoUintptr uPtrHistogramVec, GoUintptr uPtrHistogram);
+extern GoUint32 goHistogramDeletePartialMatch(GoUintptr uPtrHistogramVec, GoSlice labelNames,
+        GoSlice labelVals);
+extern GoUint8 goSummaryDelete(GoUintptr uPtrSummaryVec, GoUintptr uPtrSummary);
+extern GoUint32 goSummaryDeletePartialMatch(GoUintptr uPtrSummaryVec, GoSlice labelNames,
+        GoSlice labelVals);
+
+/* ========== TEXTFILE EXPORT ========== */
+extern void goStartTextfileExport(GoUintptr uPtrRegistry, GoString path, GoUint32 intervalMs);
+
+/* ========== PROFILING ========== */
+extern void goStartPprofHandler(GoString promEndpoint);
+extern GoInt32 goSetMutexProfileFraction(GoInt32 rate);
+extern void goSetBlockProfileRate(GoInt32 rate);
+extern GoInt32 goStartCPUProfile(GoString path, GoUint32 durationMs);
+extern GoInt32 goWriteProfile(GoString name, GoString path);
+
+/* ========== RENDERING ========== */
+extern GoInt64 goRenderMetrics(GoUintptr uPtrRegistry, void* buf, GoUint64 bufCap, GoUint32 format);
+extern GoUintptr goOpenRenderStream(GoUintptr uPtrRegistry, GoUint32 format);
+extern GoUint64 goReadRenderStream(GoUintptr uPtrStream, void* buf, GoUint64 bufCap);
+extern void goCloseRenderStream(GoUintptr uPtrStream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
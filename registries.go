@@ -0,0 +1,196 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"hash/fnv"
+	"sort"
+	"sync"
+
+	"github.com/prometheus/client_golang/prometheus"
+	"github.com/prometheus/client_golang/prometheus/promauto"
+	dto "github.com/prometheus/client_model/go"
+)
+
+/* ===========================================================================
+ * REGISTRIES
+ * =========================================================================== */
+// Registries created from "C-land", separate from the default registry
+// (which also holds the Go runtime and process metrics), so that e.g. hot
+// subsystems can be exposed on their own path and scraped at their own
+// interval. A registry's families are spread over its shards by the hash of
+// their name, so each family lives in exactly one shard. With more than one
+// shard, gathers collect (and render, see gatherText) the shards in
+// parallel, then merge them in name order.
+type registry struct {
+	shards []*prometheus.Registry
+}
+
+var registryHandles = newHandleTable("registry")
+
+// Returns the promauto factory registering a family into r, or into the
+// default registry if r is nil
+func (r *registry) factory(name string) promauto.Factory {
+	if r == nil {
+		return promauto.With(prometheus.DefaultRegisterer)
+	}
+
+	h := fnv.New32a()
+	h.Write([]byte(name))
+
+	return promauto.With(r.shards[h.Sum32()%uint32(len(r.shards))])
+}
+
+func (r *registry) Gather() ([]*dto.MetricFamily, error) {
+	if len(r.shards) == 1 {
+		return r.shards[0].Gather()
+	}
+
+	results := make([][]*dto.MetricFamily, len(r.shards))
+	errs := make([]error, len(r.shards))
+	var wg sync.WaitGroup
+	for i, shard := range r.shards {
+		wg.Add(1)
+		go func(i int, shard *prometheus.Registry) {
+			defer wg.Done()
+			results[i], errs[i] = shard.Gather()
+		}(i, shard)
+	}
+	wg.Wait()
+
+	var mfs []*dto.MetricFamily
+	for i, result := range results {
+		if errs[i] != nil {
+			return nil, errs[i]
+		}
+		mfs = append(mfs, result...)
+	}
+	sort.Slice(mfs, func(i, j int) bool { return mfs[i].GetName() < mfs[j].GetName() })
+
+	return mfs, nil
+}
+
+// Returns the registry with handle uPtrRegistry, or nil (i.e. the default
+// registry) for handle 0
+func registryOf(uPtrRegistry uintptr) *registry {
+	if uPtrRegistry == 0 {
+		return nil
+	}
+
+	r, ok := registryHandles.Get(uPtrRegistry).(*registry)
+	if !ok {
+		panic("Unknown registry")
+	}
+
+	return r
+}
+
+// Returns the gatherer of the registry with handle uPtrRegistry, 0 being the
+// default registry
+func gathererOf(uPtrRegistry uintptr) prometheus.Gatherer {
+	if r := registryOf(uPtrRegistry); r != nil {
+		return r
+	}
+
+	return prometheus.DefaultGatherer
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// 0 shards means 1
+//export goNewRegistry
+func goNewRegistry(nShards uint32) uintptr {
+	if nShards == 0 {
+		nShards = 1
+	}
+
+	r := &registry{shards: make([]*prometheus.Registry, nShards)}
+	for i := range r.shards {
+		r.shards[i] = prometheus.NewRegistry()
+	}
+
+	return registryHandles.Put(r)
+}
+
+// Like goStartPromHandlerOpts, for the registry with handle uPtrRegistry
+//export goStartRegistryHandlerOpts
+func goStartRegistryHandlerOpts(uPtrRegistry uintptr, promEndpoint, metricsPath string,
+	coalesceWindowMs, cacheTTLMs uint32, enableGzip bool, maxInFlight, readTimeoutMs,
+	writeTimeoutMs uint32) {
+
+	startScrapeHandler(gathererOf(uPtrRegistry), promEndpoint, metricsPath, coalesceWindowMs, cacheTTLMs,
+		enableGzip, maxInFlight, readTimeoutMs, writeTimeoutMs)
+}
+
+// Like goNewGauge etc., creating the metric in the registry with handle
+// uPtrRegistry (0 being the default registry)
+//export goNewGaugeIn
+func goNewGaugeIn(uPtrRegistry uintptr, name, help string) uintptr {
+	countCall(callNew)
+	return newGauge(registryOf(uPtrRegistry), name, help)
+}
+
+//export goNewGaugeVecIn
+func goNewGaugeVecIn(uPtrRegistry uintptr, name, help string, labels []string) uintptr {
+	countCall(callNew)
+	return newGaugeVec(registryOf(uPtrRegistry), name, help, labels)
+}
+
+//export goNewCounterIn
+func goNewCounterIn(uPtrRegistry uintptr, name, help string) uintptr {
+	countCall(callNew)
+	return newCounter(registryOf(uPtrRegistry), name, help)
+}
+
+//export goNewCounterVecIn
+func goNewCounterVecIn(uPtrRegistry uintptr, name, help string, labels []string) uintptr {
+	countCall(callNew)
+	return newCounterVec(registryOf(uPtrRegistry), name, help, labels)
+}
+
+//export goNewHistogramIn
+func goNewHistogramIn(uPtrRegistry uintptr, name, help string, buckets []float64) uintptr {
+	countCall(callNew)
+	return newHistogram(registryOf(uPtrRegistry), name, help, buckets)
+}
+
+//export goNewHistogramVecIn
+func goNewHistogramVecIn(uPtrRegistry uintptr, name, help string, labels []string,
+	buckets []float64) uintptr {
+
+	countCall(callNew)
+	return newHistogramVec(registryOf(uPtrRegistry), name, help, labels, buckets)
+}
+
+//export goNewSummaryIn
+func goNewSummaryIn(uPtrRegistry uintptr, name, help string, quantiles, errors []float64,
+	maxAge, nAgeBkts uint32) uintptr {
+
+	countCall(callNew)
+	return newSummary(registryOf(uPtrRegistry), name, help, quantiles, errors, maxAge, nAgeBkts)
+}
+
+//export goNewSummaryVecIn
+func goNewSummaryVecIn(uPtrRegistry uintptr, name, help string, labels []string,
+	quantiles, errors []float64, maxAge, nAgeBkts uint32) uintptr {
+
+	countCall(callNew)
+	return newSummaryVec(registryOf(uPtrRegistry), name, help, labels, quantiles, errors,
+		maxAge, nAgeBkts)
+}
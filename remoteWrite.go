@@ -0,0 +1,549 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"bytes"
+	"encoding/binary"
+	"hash/fnv"
+	"io"
+	"io/ioutil"
+	"math"
+	"net/http"
+	"sort"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/prometheus/client_golang/prometheus"
+	"github.com/prometheus/client_golang/prometheus/promauto"
+	dto "github.com/prometheus/client_model/go"
+)
+
+/* ===========================================================================
+ * REMOTE WRITE
+ * =========================================================================== */
+// Pushes periodic snapshots of the default registry to a Prometheus
+// remote-write endpoint, for processes that can't be scraped (short-lived,
+// or behind NAT):
+//   - Every interval, the registry is gathered and its samples are split
+//     into shards by series (so each series' samples stay in order), then
+//     into batches of at most maxSamplesPerSend.
+//   - Each shard has a sender goroutine and a queue of up to queueCapacity
+//     batches. When a queue is full, its oldest batch is dropped.
+//   - Batches are sent as snappy-compressed WriteRequest protobufs. Failed
+//     sends are retried with exponential backoff (from minBackoff, doubling
+//     up to maxBackoff) up to maxRetries times, if the error is retryable
+//     (network errors, 5xx and 429 responses); otherwise they're dropped.
+//   - Stopping takes a final snapshot and waits (up to a timeout) for the
+//     queues to drain.
+// The WriteRequest encoding and snappy compression are implemented below,
+// as they're small and this avoids depending on the Prometheus server's
+// prompb package and a snappy library.
+type rwLabel struct {
+	name  string
+	value string
+}
+
+type rwSeries struct {
+	labels    []rwLabel // Sorted by name
+	value     float64
+	timestamp int64 // Milliseconds since the epoch
+}
+
+type remoteWriter struct {
+	url               string
+	interval          time.Duration
+	maxSamplesPerSend int
+	queueCapacity     int
+	minBackoff        time.Duration
+	maxBackoff        time.Duration
+	maxRetries        int
+	client            *http.Client
+
+	queues  []chan []rwSeries // One per shard
+	senders sync.WaitGroup
+	stop    chan struct{} // Closed to stop snapshotting
+	stopped chan struct{} // Closed once the final snapshot is queued
+}
+
+var remoteWriteSamples = promauto.NewCounterVec(prometheus.CounterOpts{
+	Name: "easyprom_remote_write_samples_total",
+	Help: "Samples handled by the remote-write exporter, by result (sent, failed or dropped)",
+}, []string{"result"})
+
+var remoteWriteSentBytes = promauto.NewCounter(prometheus.CounterOpts{
+	Name: "easyprom_remote_write_sent_bytes_total",
+	Help: "Compressed bytes of the remote-write requests successfully sent",
+})
+
+var remoteWriteRetries = promauto.NewCounter(prometheus.CounterOpts{
+	Name: "easyprom_remote_write_retries_total",
+	Help: "Remote-write requests retried after a retryable error",
+})
+
+func init() {
+	// Exported from the start, so that e.g. failures don't appear as new series
+	for _, result := range []string{"sent", "failed", "dropped"} {
+		remoteWriteSamples.WithLabelValues(result)
+	}
+}
+
+var remoteWriterMu sync.Mutex
+var activeRemoteWriter *remoteWriter
+
+// Appends a series per sample of mf, as Prometheus would store them (e.g. a
+// histogram becomes its _bucket, _sum and _count series)
+func appendSeries(series []rwSeries, mf *dto.MetricFamily, now int64) []rwSeries {
+	name := mf.GetName()
+	for _, m := range mf.GetMetric() {
+		ts := now
+		if m.GetTimestampMs() != 0 {
+			ts = m.GetTimestampMs()
+		}
+
+		add := func(suffix string, value float64, extraName, extraValue string) {
+			labels := make([]rwLabel, 0, len(m.GetLabel())+2)
+			labels = append(labels, rwLabel{"__name__", name + suffix})
+			for _, lp := range m.GetLabel() {
+				labels = append(labels, rwLabel{lp.GetName(), lp.GetValue()})
+			}
+			if extraName != "" {
+				labels = append(labels, rwLabel{extraName, extraValue})
+			}
+			sort.Slice(labels, func(i, j int) bool { return labels[i].name < labels[j].name })
+
+			series = append(series, rwSeries{labels: labels, value: value, timestamp: ts})
+		}
+
+		switch mf.GetType() {
+		case dto.MetricType_COUNTER:
+			add("", m.GetCounter().GetValue(), "", "")
+		case dto.MetricType_GAUGE:
+			add("", m.GetGauge().GetValue(), "", "")
+		case dto.MetricType_UNTYPED:
+			add("", m.GetUntyped().GetValue(), "", "")
+		case dto.MetricType_SUMMARY:
+			for _, q := range m.GetSummary().GetQuantile() {
+				add("", q.GetValue(), "quantile", formatFloat(q.GetQuantile()))
+			}
+			add("_sum", m.GetSummary().GetSampleSum(), "", "")
+			add("_count", float64(m.GetSummary().GetSampleCount()), "", "")
+		case dto.MetricType_HISTOGRAM:
+			for _, b := range m.GetHistogram().GetBucket() {
+				add("_bucket", float64(b.GetCumulativeCount()), "le", formatFloat(b.GetUpperBound()))
+			}
+			if n := len(m.GetHistogram().GetBucket()); n == 0 ||
+				!math.IsInf(m.GetHistogram().GetBucket()[n-1].GetUpperBound(), 1) {
+				add("_bucket", float64(m.GetHistogram().GetSampleCount()), "le", "+Inf")
+			}
+			add("_sum", m.GetHistogram().GetSampleSum(), "", "")
+			add("_count", float64(m.GetHistogram().GetSampleCount()), "", "")
+		}
+	}
+
+	return series
+}
+
+// Same formatting as the text exposition format
+func formatFloat(f float64) string {
+	switch {
+	case math.IsInf(f, 1):
+		return "+Inf"
+	case math.IsInf(f, -1):
+		return "-Inf"
+	case math.IsNaN(f):
+		return "NaN"
+	}
+
+	return strconv.FormatFloat(f, 'g', -1, 64)
+}
+
+func shardOf(labels []rwLabel, nShards int) int {
+	h := fnv.New64a()
+	for _, l := range labels {
+		io.WriteString(h, l.name)
+		h.Write([]byte{0xff})
+		io.WriteString(h, l.value)
+		h.Write([]byte{0xff})
+	}
+
+	return int(h.Sum64() % uint64(nShards))
+}
+
+// Gathers the registry and queues its samples on the shards
+func (w *remoteWriter) snapshot() {
+	mfs, err := prometheus.DefaultGatherer.Gather()
+	if err != nil && len(mfs) == 0 {
+		return
+	}
+
+	now := time.Now().UnixNano() / int64(time.Millisecond)
+	var series []rwSeries
+	for _, mf := range mfs {
+		series = appendSeries(series, mf, now)
+	}
+
+	shards := make([][]rwSeries, len(w.queues))
+	for _, s := range series {
+		i := shardOf(s.labels, len(w.queues))
+		shards[i] = append(shards[i], s)
+	}
+
+	for i, shard := range shards {
+		for len(shard) > 0 {
+			n := len(shard)
+			if n > w.maxSamplesPerSend {
+				n = w.maxSamplesPerSend
+			}
+			w.enqueue(w.queues[i], shard[:n])
+			shard = shard[n:]
+		}
+	}
+}
+
+// Queues the batch, dropping the queue's oldest batches if it's full
+func (w *remoteWriter) enqueue(queue chan []rwSeries, batch []rwSeries) {
+	for {
+		select {
+		case queue <- batch:
+			return
+		default:
+		}
+
+		select {
+		case dropped := <-queue:
+			remoteWriteSamples.WithLabelValues("dropped").Add(float64(len(dropped)))
+		default:
+		}
+	}
+}
+
+func (w *remoteWriter) runSender(queue chan []rwSeries) {
+	defer w.senders.Done()
+
+	for batch := range queue {
+		body := snappyEncode(encodeWriteRequest(batch))
+
+		backoff := w.minBackoff
+		for attempt := 0; ; attempt++ {
+			retryable, err := w.post(body)
+			if err == nil {
+				remoteWriteSamples.WithLabelValues("sent").Add(float64(len(batch)))
+				remoteWriteSentBytes.Add(float64(len(body)))
+				break
+			} else if !retryable || attempt >= w.maxRetries {
+				remoteWriteSamples.WithLabelValues("failed").Add(float64(len(batch)))
+				break
+			}
+
+			remoteWriteRetries.Inc()
+			time.Sleep(backoff)
+			if backoff *= 2; backoff > w.maxBackoff {
+				backoff = w.maxBackoff
+			}
+		}
+	}
+}
+
+type remoteWriteError struct {
+	status string
+}
+
+func (e *remoteWriteError) Error() string {
+	return "remote write failed: " + e.status
+}
+
+// Returns whether a failed request may be retried
+func (w *remoteWriter) post(body []byte) (bool, error) {
+	req, err := http.NewRequest(http.MethodPost, w.url, bytes.NewReader(body))
+	if err != nil {
+		return false, err
+	}
+	req.Header.Set("Content-Encoding", "snappy")
+	req.Header.Set("Content-Type", "application/x-protobuf")
+	req.Header.Set("User-Agent", "easy-prom-client-c")
+	req.Header.Set("X-Prometheus-Remote-Write-Version", "0.1.0")
+
+	resp, err := w.client.Do(req)
+	if err != nil {
+		return true, err
+	}
+	io.Copy(ioutil.Discard, resp.Body)
+	resp.Body.Close()
+
+	if resp.StatusCode/100 == 2 {
+		return false, nil
+	}
+
+	retryable := resp.StatusCode/100 == 5 || resp.StatusCode == http.StatusTooManyRequests
+	return retryable, &remoteWriteError{resp.Status}
+}
+
+func (w *remoteWriter) run() {
+	ticker := time.NewTicker(w.interval)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-ticker.C:
+			w.snapshot()
+		case <-w.stop:
+			w.snapshot()
+			for _, queue := range w.queues {
+				close(queue)
+			}
+			close(w.stopped)
+			return
+		}
+	}
+}
+
+/* ========== PROTOBUF ENCODING ========== */
+// Encodes a prometheus.WriteRequest:
+//   message WriteRequest { repeated TimeSeries timeseries = 1; }
+//   message TimeSeries { repeated Label labels = 1; repeated Sample samples = 2; }
+//   message Label { string name = 1; string value = 2; }
+//   message Sample { double value = 1; int64 timestamp = 2; }
+func appendVarint(buf []byte, v uint64) []byte {
+	for v >= 0x80 {
+		buf = append(buf, byte(v)|0x80)
+		v >>= 7
+	}
+
+	return append(buf, byte(v))
+}
+
+func appendStringField(buf []byte, tag byte, s string) []byte {
+	buf = append(buf, tag)
+	buf = appendVarint(buf, uint64(len(s)))
+	return append(buf, s...)
+}
+
+func varintLen(v uint64) int {
+	n := 1
+	for v >= 0x80 {
+		v >>= 7
+		n++
+	}
+
+	return n
+}
+
+func encodeWriteRequest(batch []rwSeries) []byte {
+	var buf []byte
+	for _, s := range batch {
+		// Sizes are computed up front, as each message is length-prefixed
+		labelsLen := 0
+		for _, l := range s.labels {
+			n := 1 + varintLen(uint64(len(l.name))) + len(l.name) +
+				1 + varintLen(uint64(len(l.value))) + len(l.value)
+			labelsLen += 1 + varintLen(uint64(n)) + n
+		}
+		sampleLen := 1 + 8 + 1 + varintLen(uint64(s.timestamp))
+		seriesLen := labelsLen + 1 + varintLen(uint64(sampleLen)) + sampleLen
+
+		buf = append(buf, 0x0a) // timeseries, length-delimited
+		buf = appendVarint(buf, uint64(seriesLen))
+		for _, l := range s.labels {
+			n := 1 + varintLen(uint64(len(l.name))) + len(l.name) +
+				1 + varintLen(uint64(len(l.value))) + len(l.value)
+			buf = append(buf, 0x0a) // labels
+			buf = appendVarint(buf, uint64(n))
+			buf = appendStringField(buf, 0x0a, l.name)
+			buf = appendStringField(buf, 0x12, l.value)
+		}
+
+		buf = append(buf, 0x12) // samples
+		buf = appendVarint(buf, uint64(sampleLen))
+		buf = append(buf, 0x09) // value, fixed64
+		var value [8]byte
+		binary.LittleEndian.PutUint64(value[:], math.Float64bits(s.value))
+		buf = append(buf, value[:]...)
+		buf = append(buf, 0x10) // timestamp, varint
+		buf = appendVarint(buf, uint64(s.timestamp))
+	}
+
+	return buf
+}
+
+/* ========== SNAPPY COMPRESSION ========== */
+// Snappy block format (as expected by remote-write receivers): the varint
+// uncompressed length, then literals and copies. Input is compressed in
+// independent 64KB blocks, so that copy offsets always fit in 16 bits, with
+// a greedy single-probe hash table for finding matches of 4+ bytes.
+const (
+	snappyBlockSize = 1 << 16
+	snappyHashBits  = 14
+)
+
+func snappyEmitLiteral(dst, lit []byte) []byte {
+	n := uint32(len(lit) - 1)
+	switch {
+	case n < 60:
+		dst = append(dst, byte(n)<<2)
+	case n < 1<<8:
+		dst = append(dst, 60<<2, byte(n))
+	default: // Literals never exceed a block, so n < 1<<16
+		dst = append(dst, 61<<2, byte(n), byte(n>>8))
+	}
+
+	return append(dst, lit...)
+}
+
+func snappyEmitCopy(dst []byte, offset, length int) []byte {
+	for length >= 68 {
+		dst = append(dst, 63<<2|2, byte(offset), byte(offset>>8))
+		length -= 64
+	}
+	if length > 64 {
+		dst = append(dst, 59<<2|2, byte(offset), byte(offset>>8))
+		length -= 60
+	}
+	if length >= 12 || offset >= 2048 {
+		return append(dst, byte(length-1)<<2|2, byte(offset), byte(offset>>8))
+	}
+
+	return append(dst, byte(offset>>8)<<5|byte(length-4)<<2|1, byte(offset))
+}
+
+func snappyEncode(src []byte) []byte {
+	dst := appendVarint(make([]byte, 0, len(src)/2+16), uint64(len(src)))
+
+	var table [1 << snappyHashBits]int32
+	for len(src) > 0 {
+		block := src
+		if len(block) > snappyBlockSize {
+			block = block[:snappyBlockSize]
+		}
+		src = src[len(block):]
+
+		for i := range table {
+			table[i] = -1
+		}
+
+		lit := 0
+		for s := 0; s+4 <= len(block); {
+			cur := binary.LittleEndian.Uint32(block[s:])
+			h := (cur * 0x1e35a7bd) >> (32 - snappyHashBits)
+			cand := int(table[h])
+			table[h] = int32(s)
+
+			if cand < 0 || binary.LittleEndian.Uint32(block[cand:]) != cur {
+				s++
+				continue
+			}
+
+			if lit < s {
+				dst = snappyEmitLiteral(dst, block[lit:s])
+			}
+			length := 4
+			for s+length < len(block) && block[cand+length] == block[s+length] {
+				length++
+			}
+			dst = snappyEmitCopy(dst, s-cand, length)
+			s += length
+			lit = s
+		}
+		if lit < len(block) {
+			dst = snappyEmitLiteral(dst, block[lit:])
+		}
+	}
+
+	return dst
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Starts pushing to 'url', with the options described by remoteWriter.
+// Durations are in milliseconds; other than intervalMs, 0 means the
+// default. Only one remote writer may run at a time.
+//export goStartRemoteWrite
+func goStartRemoteWrite(url string, intervalMs, maxSamplesPerSend, nShards, queueCapacity,
+	minBackoffMs, maxBackoffMs, maxRetries, timeoutMs uint32) {
+
+	orDefault := func(v, def uint32) uint32 {
+		if v == 0 {
+			return def
+		}
+		return v
+	}
+
+	if intervalMs == 0 {
+		panic("Remote write interval must be positive")
+	}
+
+	w := &remoteWriter{
+		url:               stringCopy(url),
+		interval:          time.Duration(intervalMs) * time.Millisecond,
+		maxSamplesPerSend: int(orDefault(maxSamplesPerSend, 2000)),
+		queueCapacity:     int(orDefault(queueCapacity, 16)),
+		minBackoff:        time.Duration(orDefault(minBackoffMs, 30)) * time.Millisecond,
+		maxBackoff:        time.Duration(orDefault(maxBackoffMs, 5000)) * time.Millisecond,
+		maxRetries:        int(orDefault(maxRetries, 10)),
+		client:            &http.Client{Timeout: time.Duration(orDefault(timeoutMs, 30000)) * time.Millisecond},
+		queues:            make([]chan []rwSeries, orDefault(nShards, 1)),
+		stop:              make(chan struct{}),
+		stopped:           make(chan struct{}),
+	}
+
+	remoteWriterMu.Lock()
+	defer remoteWriterMu.Unlock()
+	if activeRemoteWriter != nil {
+		panic("Remote write has already been started")
+	}
+	activeRemoteWriter = w
+
+	for i := range w.queues {
+		w.queues[i] = make(chan []rwSeries, w.queueCapacity)
+		w.senders.Add(1)
+		go w.runSender(w.queues[i])
+	}
+	go w.run()
+}
+
+// Takes a final snapshot and waits up to flushTimeoutMs for it, and any
+// queued batches, to be sent. Returns false on timeout.
+//export goStopRemoteWrite
+func goStopRemoteWrite(flushTimeoutMs uint32) bool {
+	remoteWriterMu.Lock()
+	w := activeRemoteWriter
+	activeRemoteWriter = nil
+	remoteWriterMu.Unlock()
+
+	if w == nil {
+		return true
+	}
+
+	close(w.stop)
+	<-w.stopped
+
+	drained := make(chan struct{})
+	go func() {
+		w.senders.Wait()
+		close(drained)
+	}()
+
+	select {
+	case <-drained:
+		return true
+	case <-time.After(time.Duration(flushTimeoutMs) * time.Millisecond):
+		return false
+	}
+}
@@ -0,0 +1,157 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"bytes"
+	"unsafe"
+
+	dto "github.com/prometheus/client_model/go"
+	"github.com/prometheus/common/expfmt"
+)
+
+/* ===========================================================================
+ * RENDERING INTO "C-LAND" BUFFERS
+ * =========================================================================== */
+// For programs that serve /metrics from their own HTTP stack (e.g. an epoll
+// loop) rather than through StartPromHandler(). Renders are written straight
+// into the caller's buffer, or handed out incrementally by a render stream,
+// which only encodes as many families as each read needs.
+
+// Exposition formats. These must match the EASYPROM_FORMAT_* values in
+// promClient.h.
+var renderFormats = []expfmt.Format{
+	expfmt.FmtText,
+	expfmt.FmtProtoDelim,
+}
+
+// Largest buffer a cBufWriter can address
+const maxCBufLen = 1 << 30
+
+// Writes into a buffer in "C-land" memory, counting (but dropping) the bytes
+// that don't fit
+type cBufWriter struct {
+	buf []byte
+	n   int
+}
+
+func newCBufWriter(buf unsafe.Pointer, bufCap uint64) *cBufWriter {
+	if buf == nil || bufCap == 0 {
+		return &cBufWriter{}
+	}
+	if bufCap > maxCBufLen {
+		bufCap = maxCBufLen
+	}
+
+	return &cBufWriter{buf: (*[maxCBufLen]byte)(buf)[:bufCap:bufCap]}
+}
+
+func (w *cBufWriter) Write(p []byte) (int, error) {
+	if w.n < len(w.buf) {
+		copy(w.buf[w.n:], p)
+	}
+	w.n += len(p)
+
+	return len(p), nil
+}
+
+// Families gathered when the stream is opened, encoded as they're read
+type renderStream struct {
+	mfs     []*dto.MetricFamily
+	enc     expfmt.Encoder
+	pending bytes.Buffer // Encoded but not yet read
+	err     error
+}
+
+var renderStreamHandles = newHandleTable("render_stream")
+
+// Copies up to len(dst) bytes of the rendering into dst, encoding further
+// families as needed. Returns 0 at the end of the rendering (or on error).
+func (s *renderStream) read(dst []byte) int {
+	for s.pending.Len() < len(dst) && len(s.mfs) > 0 && s.err == nil {
+		s.err = s.enc.Encode(s.mfs[0])
+		s.mfs[0] = nil // Let it be collected
+		s.mfs = s.mfs[1:]
+	}
+
+	n, _ := s.pending.Read(dst)
+	return n
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Renders the registry into buf, returning the rendering's full size, of
+// which only the first bufCap bytes are written. Returns -1 if the format
+// is unknown or the gather fails.
+//export goRenderMetrics
+func goRenderMetrics(uPtrRegistry uintptr, buf unsafe.Pointer, bufCap uint64, format uint32) int64 {
+	if int(format) >= len(renderFormats) {
+		return -1
+	}
+
+	mfs, err := gathererOf(uPtrRegistry).Gather()
+	if err != nil {
+		return -1
+	}
+
+	w := newCBufWriter(buf, bufCap)
+	enc := expfmt.NewEncoder(w, renderFormats[format])
+	for _, mf := range mfs {
+		if err := enc.Encode(mf); err != nil {
+			return -1
+		}
+	}
+
+	return int64(w.n)
+}
+
+// Gathers the registry, returning a stream of its rendering, or 0 if the
+// format is unknown or the gather fails
+//export goOpenRenderStream
+func goOpenRenderStream(uPtrRegistry uintptr, format uint32) uintptr {
+	if int(format) >= len(renderFormats) {
+		return 0
+	}
+
+	mfs, err := gathererOf(uPtrRegistry).Gather()
+	if err != nil {
+		return 0
+	}
+
+	s := &renderStream{mfs: mfs}
+	s.enc = expfmt.NewEncoder(&s.pending, renderFormats[format])
+
+	return renderStreamHandles.Put(s)
+}
+
+//export goReadRenderStream
+func goReadRenderStream(uPtrStream uintptr, buf unsafe.Pointer, bufCap uint64) uint64 {
+	if s, ok := renderStreamHandles.Get(uPtrStream).(*renderStream); ok {
+		return uint64(s.read(newCBufWriter(buf, bufCap).buf))
+	}
+
+	return 0
+}
+
+//export goCloseRenderStream
+func goCloseRenderStream(uPtrStream uintptr) {
+	if s, ok := renderStreamHandles.Get(uPtrStream).(*renderStream); ok {
+		renderStreamHandles.DeleteObj(s)
+	}
+}
@@ -0,0 +1,122 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"math"
+	"sync/atomic"
+	"time"
+
+	"github.com/prometheus/client_golang/prometheus"
+	dto "github.com/prometheus/client_model/go"
+)
+
+/* ===========================================================================
+ * SAMPLED SUMMARIES
+ * =========================================================================== */
+// Summaries for paths too hot to observe every value: "C-land" only passes
+// on a sample of the observations (see SampledSummary in promClient.h), each
+// weighted by how many observations it stands for. Quantiles are estimated
+// from the samples themselves, while count and sum are scaled by the
+// weights, so that rates computed from them stay accurate.
+type sampledSummary struct {
+	summary prometheus.Summary // Unregistered; estimates the quantiles
+	desc    *prometheus.Desc
+	count   uint64 // Observations represented by the samples
+	sumBits uint64 // Their (estimated) sum, as the bits of a float64
+}
+
+// Unweighted observations, e.g. through goSummaryObserve
+func (s *sampledSummary) Observe(val float64) {
+	s.observeWeighted(val, 1)
+}
+
+func (s *sampledSummary) observeWeighted(val float64, weight uint32) {
+	s.summary.Observe(val)
+	atomic.AddUint64(&s.count, uint64(weight))
+	for {
+		old := atomic.LoadUint64(&s.sumBits)
+		sum := math.Float64bits(math.Float64frombits(old) + val*float64(weight))
+		if atomic.CompareAndSwapUint64(&s.sumBits, old, sum) {
+			return
+		}
+	}
+}
+
+func (s *sampledSummary) Describe(ch chan<- *prometheus.Desc) {
+	ch <- s.desc
+}
+
+func (s *sampledSummary) Collect(ch chan<- prometheus.Metric) {
+	var pb dto.Metric
+	if err := s.summary.Write(&pb); err != nil {
+		return
+	}
+
+	quantiles := make(map[float64]float64, len(pb.GetSummary().GetQuantile()))
+	for _, q := range pb.GetSummary().GetQuantile() {
+		quantiles[q.GetQuantile()] = q.GetValue()
+	}
+
+	ch <- prometheus.MustNewConstSummary(s.desc, atomic.LoadUint64(&s.count),
+		math.Float64frombits(atomic.LoadUint64(&s.sumBits)), quantiles)
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Like goNewSummary, in the default registry. The handle is a summary handle,
+// so goSummaryObserve works too, with a weight of 1.
+//export goNewSampledSummary
+func goNewSampledSummary(name, help string, quantiles, errors []float64,
+	maxAge, nAgeBkts uint32) uintptr {
+
+	countCall(callNew)
+	obj := makeObjectives(quantiles, errors)
+	if obj == nil {
+		panic("Unable to make objectives map for Summary")
+	}
+
+	s := &sampledSummary{
+		summary: prometheus.NewSummary(prometheus.SummaryOpts{
+			Name:       stringCopy(name),
+			Help:       stringCopy(help),
+			Objectives: obj,
+			MaxAge:     time.Duration(maxAge) * time.Second,
+			AgeBuckets: nAgeBkts,
+		}),
+		desc: prometheus.NewDesc(stringCopy(name), stringCopy(help), nil, nil),
+	}
+	prometheus.MustRegister(s)
+	trackFamily(stringCopy(name), 1)
+
+	return summaryHandles.Put(s)
+}
+
+// Observes val as standing for 'weight' observations. Summaries that aren't
+// sampled observe it once.
+//export goSummaryObserveWeighted
+func goSummaryObserveWeighted(uPtrSummary uintptr, val float64, weight uint32) {
+	countCall(callSummaryObserve)
+	switch summary := summaryHandles.Get(uPtrSummary).(type) {
+	case *sampledSummary:
+		summary.observeWeighted(val, weight)
+	case prometheus.Observer:
+		summary.Observe(val)
+	}
+}
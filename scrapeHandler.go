@@ -0,0 +1,290 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"bytes"
+	"compress/gzip"
+	"net"
+	"net/http"
+	"os"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/prometheus/client_golang/prometheus"
+	dto "github.com/prometheus/client_model/go"
+	"github.com/prometheus/common/expfmt"
+)
+
+/* ===========================================================================
+ * SCRAPE HANDLER
+ * =========================================================================== */
+// Metrics handler that lets scrapes share gathers of the registry, instead
+// of each one running its own (as promhttp.Handler() does):
+//   - A scrape arriving while a gather is in flight, or within
+//     coalesceWindow of the last gather starting, gets that gather's result.
+//   - A finished gather's rendered response is reused for cacheTTL.
+//   - At most maxInFlight gathers run at once (0 means no limit); scrapes
+//     that would exceed it get a 503, like promhttp's MaxRequestsInFlight.
+// With gzip enabled, each result is also compressed once, when gathered,
+// and served to clients that accept it.
+// Responses are always in the text format (no content negotiation).
+type scrapeResult struct {
+	start  time.Time
+	end    time.Time
+	body   []byte
+	gzBody []byte // nil unless gzip is enabled
+	err    error
+	done   chan struct{} // Closed once the gather completes
+}
+
+type scrapeHandler struct {
+	gatherer       prometheus.Gatherer
+	coalesceWindow time.Duration
+	cacheTTL       time.Duration
+	gzip           bool
+	slots          chan struct{} // Gather slots; nil if unlimited
+
+	mu      sync.Mutex
+	pending *scrapeResult // Gather in flight, if any
+	last    *scrapeResult // Last successful gather
+}
+
+// Returns a gather result to serve, or nil if too many gathers are in flight
+func (h *scrapeHandler) result() *scrapeResult {
+	shared := h.coalesceWindow > 0 || h.cacheTTL > 0
+
+	h.mu.Lock()
+	if shared {
+		now := time.Now()
+		if r := h.last; r != nil &&
+			(now.Sub(r.start) < h.coalesceWindow || now.Sub(r.end) < h.cacheTTL) {
+			h.mu.Unlock()
+			return r
+		}
+		if r := h.pending; r != nil {
+			h.mu.Unlock()
+			<-r.done
+			return r
+		}
+	}
+
+	if h.slots != nil {
+		select {
+		case h.slots <- struct{}{}:
+			defer func() { <-h.slots }()
+		default:
+			h.mu.Unlock()
+			return nil
+		}
+	}
+
+	r := &scrapeResult{start: time.Now(), done: make(chan struct{})}
+	if shared {
+		h.pending = r
+	}
+	h.mu.Unlock()
+
+	r.body, r.err = gatherText(h.gatherer)
+	if r.err == nil && h.gzip {
+		r.gzBody, r.err = gzipBytes(r.body)
+	}
+	r.end = time.Now()
+
+	if shared {
+		h.mu.Lock()
+		h.pending = nil
+		if r.err == nil {
+			h.last = r
+		}
+		h.mu.Unlock()
+	}
+	close(r.done)
+
+	return r
+}
+
+func (h *scrapeHandler) ServeHTTP(w http.ResponseWriter, req *http.Request) {
+	r := h.result()
+	if r == nil {
+		http.Error(w, "Too many concurrent gathers, try again later", http.StatusServiceUnavailable)
+		return
+	} else if r.err != nil {
+		http.Error(w, "Error gathering metrics: "+r.err.Error(), http.StatusInternalServerError)
+		return
+	}
+
+	body := r.body
+	w.Header().Set("Content-Type", string(expfmt.FmtText))
+	if r.gzBody != nil && strings.Contains(req.Header.Get("Accept-Encoding"), "gzip") {
+		body = r.gzBody
+		w.Header().Set("Content-Encoding", "gzip")
+	}
+	w.Write(body)
+}
+
+// Gathers g and renders it in the text format. For sharded registries, the
+// gathered families (merged across shards and sorted by name) are split into
+// as many contiguous, equally sized chunks as there are shards, which are
+// rendered concurrently. Chunks don't correspond to shards.
+func gatherText(g prometheus.Gatherer) ([]byte, error) {
+	mfs, err := g.Gather()
+	if err != nil {
+		return nil, err
+	}
+
+	nChunks := 1
+	if r, ok := g.(*registry); ok {
+		nChunks = len(r.shards)
+	}
+	if nChunks > len(mfs) {
+		nChunks = len(mfs)
+	}
+	if nChunks <= 1 {
+		return renderText(mfs)
+	}
+
+	chunks := make([][]byte, nChunks)
+	errs := make([]error, nChunks)
+	var wg sync.WaitGroup
+	for i := 0; i < nChunks; i++ {
+		wg.Add(1)
+		go func(i int) {
+			defer wg.Done()
+			chunks[i], errs[i] = renderText(mfs[i*len(mfs)/nChunks : (i+1)*len(mfs)/nChunks])
+		}(i)
+	}
+	wg.Wait()
+
+	for _, err := range errs {
+		if err != nil {
+			return nil, err
+		}
+	}
+
+	return bytes.Join(chunks, nil), nil
+}
+
+func renderText(mfs []*dto.MetricFamily) ([]byte, error) {
+	var buf bytes.Buffer
+	enc := expfmt.NewEncoder(&buf, expfmt.FmtText)
+	for _, mf := range mfs {
+		if err := enc.Encode(mf); err != nil {
+			return nil, err
+		}
+	}
+
+	return buf.Bytes(), nil
+}
+
+func gzipBytes(in []byte) ([]byte, error) {
+	var buf bytes.Buffer
+	gz := gzip.NewWriter(&buf)
+	if _, err := gz.Write(in); err != nil {
+		return nil, err
+	}
+	if err := gz.Close(); err != nil {
+		return nil, err
+	}
+
+	return buf.Bytes(), nil
+}
+
+// Endpoints of the form "unix:<path>" listen on a Unix domain socket, for
+// hosts where opening a TCP port isn't allowed
+const unixEndpointPrefix = "unix:"
+
+// One server per endpoint; later handlers on the same endpoint share it
+// (and thus the timeouts it was created with).
+var promMuxesMu sync.Mutex
+var promMuxes = make(map[string]*http.ServeMux)
+
+// Returns the mux of the server listening on endpoint, starting the server
+// if there isn't one yet. Timeouts of 0 mean none.
+func promMux(endpoint string, readTimeout, writeTimeout time.Duration) *http.ServeMux {
+	promMuxesMu.Lock()
+	defer promMuxesMu.Unlock()
+
+	mux, ok := promMuxes[endpoint]
+	if !ok {
+		mux = http.NewServeMux()
+		promMuxes[endpoint] = mux
+
+		server := &http.Server{
+			Addr:         endpoint,
+			Handler:      mux,
+			ReadTimeout:  readTimeout,
+			WriteTimeout: writeTimeout,
+		}
+		if path := strings.TrimPrefix(endpoint, unixEndpointPrefix); path != endpoint {
+			go serveUnix(server, path)
+		} else {
+			go server.ListenAndServe()
+		}
+	}
+
+	return mux
+}
+
+// Serves on a Unix domain socket at path, replacing a stale socket left by
+// an earlier process (but never any other kind of file)
+func serveUnix(server *http.Server, path string) error {
+	if fi, err := os.Lstat(path); err == nil && fi.Mode()&os.ModeSocket != 0 {
+		os.Remove(path)
+	}
+
+	l, err := net.Listen("unix", path)
+	if err != nil {
+		return err
+	}
+
+	return server.Serve(l)
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Like goStartPromHandler, but with the options described by scrapeHandler.
+// Durations are in milliseconds; 0 disables the respective feature.
+//export goStartPromHandlerOpts
+func goStartPromHandlerOpts(promEndpoint, metricsPath string, coalesceWindowMs,
+	cacheTTLMs uint32, enableGzip bool, maxInFlight, readTimeoutMs, writeTimeoutMs uint32) {
+
+	startScrapeHandler(prometheus.DefaultGatherer, promEndpoint, metricsPath, coalesceWindowMs,
+		cacheTTLMs, enableGzip, maxInFlight, readTimeoutMs, writeTimeoutMs)
+}
+
+func startScrapeHandler(gatherer prometheus.Gatherer, promEndpoint, metricsPath string,
+	coalesceWindowMs, cacheTTLMs uint32, enableGzip bool, maxInFlight, readTimeoutMs,
+	writeTimeoutMs uint32) {
+
+	handler := &scrapeHandler{
+		gatherer:       gatherer,
+		coalesceWindow: time.Duration(coalesceWindowMs) * time.Millisecond,
+		cacheTTL:       time.Duration(cacheTTLMs) * time.Millisecond,
+		gzip:           enableGzip,
+	}
+	if maxInFlight > 0 {
+		handler.slots = make(chan struct{}, maxInFlight)
+	}
+
+	mux := promMux(stringCopy(promEndpoint), time.Duration(readTimeoutMs)*time.Millisecond,
+		time.Duration(writeTimeoutMs)*time.Millisecond)
+	mux.Handle(stringCopy(metricsPath), instrumentScrapes(handler))
+}
@@ -0,0 +1,257 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import (
+	"net/http"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"time"
+	_ "unsafe" // For go:linkname
+
+	"github.com/prometheus/client_golang/prometheus"
+	"github.com/prometheus/client_golang/prometheus/promauto"
+)
+
+/* ===========================================================================
+ * CALL COUNTS
+ * =========================================================================== */
+// Calls from "C-land", by operation. Each operation's count is striped
+// across cache-line-padded cells, picked by the P (processor) the calling
+// thread holds while it runs Go code. Threads calling in at the same time
+// hold different Ps, so they (almost) never share a cell, even when updating
+// the same metric.
+const (
+	callNew = iota
+	callWithLabelValues
+	callDeleteLabelValues
+	callGaugeSet
+	callGaugeAdd
+	callGaugeSub
+	callCounterAdd
+	callHistogramObserve
+	callSummaryObserve
+	callBatch
+	callApplyRecords
+	numCallOps
+)
+
+var callOpNames = [numCallOps]string{
+	"new",
+	"with_label_values",
+	"delete_label_values",
+	"gauge_set",
+	"gauge_add",
+	"gauge_sub",
+	"counter_add",
+	"histogram_observe",
+	"summary_observe",
+	"batch",
+	"apply_records",
+}
+
+const callStripes = 64 // Ps beyond this (i.e. GOMAXPROCS > 64) share cells
+
+type paddedCount struct {
+	n uint64
+	_ [56]byte
+}
+
+var callCounts [numCallOps][callStripes]paddedCount
+
+// Same as sync.Pool: procPin() pins the goroutine to its P, returning the
+// P's ID, and procUnpin() releases it.
+
+//go:linkname runtime_procPin runtime.procPin
+func runtime_procPin() int
+
+//go:linkname runtime_procUnpin runtime.procUnpin
+func runtime_procUnpin()
+
+func countCall(op int) {
+	stripe := runtime_procPin() % callStripes
+	runtime_procUnpin()
+	atomic.AddUint64(&callCounts[op][stripe].n, 1)
+}
+
+/* ===========================================================================
+ * SERIES PER FAMILY
+ * =========================================================================== */
+// Live series of each metric family created from "C-land". Only updated
+// when series are created or deleted, never on the update paths.
+type familyInfo struct {
+	name     string
+	series   int64
+	rejected uint64 // New label values over the Vec's series limit
+	evicted  uint64 // Idle series deleted by the sweeper
+}
+
+var familiesMu sync.Mutex
+var families []*familyInfo
+var vecFamilies sync.Map // Vec handle -> *familyInfo
+
+func trackFamily(name string, series int64) *familyInfo {
+	family := &familyInfo{name: name, series: series}
+
+	familiesMu.Lock()
+	families = append(families, family)
+	familiesMu.Unlock()
+
+	return family
+}
+
+func trackVecFamily(uPtrVec uintptr, name string) {
+	vecFamilies.Store(uPtrVec, trackFamily(name, 0))
+}
+
+func addVecSeries(uPtrVec uintptr, delta int64) {
+	if family, ok := vecFamilies.Load(uPtrVec); ok {
+		atomic.AddInt64(&family.(*familyInfo).series, delta)
+	}
+}
+
+/* ===========================================================================
+ * SELF COLLECTOR
+ * =========================================================================== */
+// Exports the library's own easyprom_* metrics, computed at scrape time
+type selfCollector struct {
+	callsDesc    *prometheus.Desc
+	handlesDesc  *prometheus.Desc
+	missesDesc   *prometheus.Desc
+	seriesDesc   *prometheus.Desc
+	rejectedDesc *prometheus.Desc
+	evictedDesc  *prometheus.Desc
+	cgoDesc      *prometheus.Desc
+}
+
+func (c *selfCollector) Describe(ch chan<- *prometheus.Desc) {
+	ch <- c.callsDesc
+	ch <- c.handlesDesc
+	ch <- c.missesDesc
+	ch <- c.seriesDesc
+	ch <- c.rejectedDesc
+	ch <- c.evictedDesc
+	ch <- c.cgoDesc
+}
+
+func (c *selfCollector) Collect(ch chan<- prometheus.Metric) {
+	for op := 0; op < numCallOps; op++ {
+		var n uint64
+		for i := range callCounts[op] {
+			n += atomic.LoadUint64(&callCounts[op][i].n)
+		}
+		ch <- prometheus.MustNewConstMetric(c.callsDesc, prometheus.CounterValue,
+			float64(n), callOpNames[op])
+	}
+	ch <- prometheus.MustNewConstMetric(c.cgoDesc, prometheus.CounterValue,
+		float64(runtime.NumCgoCall()))
+
+	for _, t := range handleTables {
+		ch <- prometheus.MustNewConstMetric(c.handlesDesc, prometheus.GaugeValue,
+			float64(t.Len()), t.kind)
+		ch <- prometheus.MustNewConstMetric(c.missesDesc, prometheus.CounterValue,
+			float64(t.Misses()), t.kind)
+	}
+
+	for _, family := range familyTotals() {
+		ch <- prometheus.MustNewConstMetric(c.seriesDesc, prometheus.GaugeValue,
+			float64(family.series), family.name)
+		ch <- prometheus.MustNewConstMetric(c.rejectedDesc, prometheus.CounterValue,
+			float64(family.rejected), family.name)
+		ch <- prometheus.MustNewConstMetric(c.evictedDesc, prometheus.CounterValue,
+			float64(family.evicted), family.name)
+	}
+}
+
+// Sums the families sharing a name, i.e. the same name registered in several
+// registries, as one sample per name is all the "family" label can tell apart
+func familyTotals() []familyInfo {
+	familiesMu.Lock()
+	defer familiesMu.Unlock()
+
+	totals := make([]familyInfo, 0, len(families))
+	index := make(map[string]int, len(families))
+	for _, family := range families {
+		i, ok := index[family.name]
+		if !ok {
+			i = len(totals)
+			index[family.name] = i
+			totals = append(totals, familyInfo{name: family.name})
+		}
+		totals[i].series += atomic.LoadInt64(&family.series)
+		totals[i].rejected += atomic.LoadUint64(&family.rejected)
+		totals[i].evicted += atomic.LoadUint64(&family.evicted)
+	}
+
+	return totals
+}
+
+func init() {
+	prometheus.MustRegister(&selfCollector{
+		callsDesc: prometheus.NewDesc("easyprom_cgo_calls_total",
+			"Calls into the Go library from C/C++, by operation", []string{"op"}, nil),
+		handlesDesc: prometheus.NewDesc("easyprom_handle_table_size",
+			"Live handles passed to C/C++, by kind of object", []string{"kind"}, nil),
+		missesDesc: prometheus.NewDesc("easyprom_invalid_handle_lookups_total",
+			"Lookups of unknown or deleted handles, which are ignored", []string{"kind"}, nil),
+		seriesDesc: prometheus.NewDesc("easyprom_series",
+			"Live series per metric family created from C/C++", []string{"family"}, nil),
+		rejectedDesc: prometheus.NewDesc("easyprom_series_rejected_total",
+			"New series rejected or folded by their Vec's series limit", []string{"family"}, nil),
+		evictedDesc: prometheus.NewDesc("easyprom_series_evicted_total",
+			"Series evicted after being idle for their Vec's TTL", []string{"family"}, nil),
+		cgoDesc: prometheus.NewDesc("easyprom_runtime_cgo_calls_total",
+			"Calls from Go into C made by the process (e.g. func metric callbacks)", nil, nil),
+	})
+}
+
+/* ===========================================================================
+ * SCRAPE INSTRUMENTATION
+ * =========================================================================== */
+var scrapeDuration = promauto.NewHistogram(prometheus.HistogramOpts{
+	Name:    "easyprom_scrape_duration_seconds",
+	Help:    "Time taken to gather, render and write each scrape's response",
+	Buckets: prometheus.ExponentialBuckets(0.0005, 2, 16),
+})
+
+var scrapeResponseBytes = promauto.NewGauge(prometheus.GaugeOpts{
+	Name: "easyprom_scrape_response_bytes",
+	Help: "Size of the last scrape's response body, as written (i.e. after compression)",
+})
+
+type countingResponseWriter struct {
+	http.ResponseWriter
+	n int
+}
+
+func (w *countingResponseWriter) Write(b []byte) (int, error) {
+	n, err := w.ResponseWriter.Write(b)
+	w.n += n
+	return n, err
+}
+
+// Wraps a metrics handler to record the duration and size of each scrape
+func instrumentScrapes(handler http.Handler) http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, req *http.Request) {
+		start := time.Now()
+		cw := &countingResponseWriter{ResponseWriter: w}
+		handler.ServeHTTP(cw, req)
+
+		scrapeDuration.Observe(time.Since(start).Seconds())
+		scrapeResponseBytes.Set(float64(cw.n))
+	})
+}
@@ -0,0 +1,238 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"sync"
+
+	"github.com/prometheus/client_golang/prometheus"
+	dto "github.com/prometheus/client_model/go"
+)
+
+/* ===========================================================================
+ * SERIES DELETION
+ * =========================================================================== */
+// Deletes a Vec's children given their handles, or a subset of their labels
+// (e.g. every series of one tenant). client_golang can only delete children
+// given all of their label values, so the labels of a child are read back
+// from the child itself, which unlike WithLabelValues never (re)creates it.
+type deletableVec interface {
+	prometheus.Collector
+	Delete(labels prometheus.Labels) bool
+}
+
+var vecDescs sync.Map // Vec -> *prometheus.Desc
+
+// Returns the Desc shared by the Vec's children
+func vecDesc(vec prometheus.Collector) *prometheus.Desc {
+	if desc, ok := vecDescs.Load(vec); ok {
+		return desc.(*prometheus.Desc)
+	}
+
+	ch := make(chan *prometheus.Desc, 1)
+	vec.Describe(ch)
+	desc := <-ch
+	vecDescs.Store(vec, desc)
+
+	return desc
+}
+
+// Returns the labels of obj, or nil if it isn't a child of vec
+func childLabels(vec prometheus.Collector, obj interface{}) prometheus.Labels {
+	m, ok := obj.(prometheus.Metric)
+	if !ok || m.Desc() != vecDesc(vec) {
+		return nil
+	}
+
+	var pb dto.Metric
+	if err := m.Write(&pb); err != nil {
+		return nil
+	}
+
+	labels := make(prometheus.Labels, len(pb.Label))
+	for _, pair := range pb.Label {
+		labels[pair.GetName()] = pair.GetValue()
+	}
+
+	return labels
+}
+
+// Whether labels has every name-value pair of match
+func labelsMatch(labels, match prometheus.Labels) bool {
+	if labels == nil {
+		return false
+	}
+	for name, val := range match {
+		if v, ok := labels[name]; !ok || v != val {
+			return false
+		}
+	}
+
+	return true
+}
+
+// Returns whether the child with handle uPtrChild was deleted from vec
+func deleteChild(vec deletableVec, uPtrVec uintptr, handles *handleTable, uPtrChild uintptr) bool {
+	if limits := limitsOf(vec); limits != nil {
+		return limits.deleteHandle(uPtrChild)
+	}
+
+	obj := handles.Get(uPtrChild)
+	labels := childLabels(vec, obj)
+	if labels == nil {
+		return false
+	}
+
+	if handles.DeleteObj(obj) {
+		addVecSeries(uPtrVec, -1)
+	}
+
+	return vec.Delete(labels)
+}
+
+// Deletes every child of vec whose labels include all of the given ones,
+// returning how many were deleted
+func deletePartialMatch(vec deletableVec, uPtrVec uintptr, handles *handleTable,
+	labelNames, labelVals []string) int {
+
+	match := make(prometheus.Labels, len(labelNames))
+	for i := 0; i < len(labelNames) && i < len(labelVals); i++ {
+		match[labelNames[i]] = labelVals[i]
+	}
+
+	if limits := limitsOf(vec); limits != nil {
+		return limits.deleteMatching(func(obj interface{}) bool {
+			return labelsMatch(childLabels(vec, obj), match)
+		})
+	}
+
+	// Collected children are the objects in the handle table
+	ch := make(chan prometheus.Metric, 64)
+	go func() {
+		vec.Collect(ch)
+		close(ch)
+	}()
+
+	var matched []prometheus.Metric
+	var matchedLabels []prometheus.Labels
+	for m := range ch {
+		if labels := childLabels(vec, m); labelsMatch(labels, match) {
+			matched = append(matched, m)
+			matchedLabels = append(matchedLabels, labels)
+		}
+	}
+
+	n := 0
+	for i, m := range matched {
+		if handles.DeleteObj(m) {
+			addVecSeries(uPtrVec, -1)
+		}
+		if vec.Delete(matchedLabels[i]) {
+			n++
+		}
+	}
+
+	return n
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Deletes the child with handle uPtrGauge from the Vec, returning whether it
+// was one of its children
+//export goGaugeDelete
+func goGaugeDelete(uPtrGaugeVec, uPtrGauge uintptr) bool {
+	countCall(callDeleteLabelValues)
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		return deleteChild(gaugeVec, uPtrGaugeVec, gaugeHandles, uPtrGauge)
+	}
+
+	return false
+}
+
+// Deletes the children whose label labelNames[i] has value labelVals[i] for
+// every i, returning how many were deleted
+//export goGaugeDeletePartialMatch
+func goGaugeDeletePartialMatch(uPtrGaugeVec uintptr, labelNames, labelVals []string) uint32 {
+	countCall(callDeleteLabelValues)
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		return uint32(deletePartialMatch(gaugeVec, uPtrGaugeVec, gaugeHandles, labelNames, labelVals))
+	}
+
+	return 0
+}
+
+//export goCounterDelete
+func goCounterDelete(uPtrCounterVec, uPtrCounter uintptr) bool {
+	countCall(callDeleteLabelValues)
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		return deleteChild(counterVec, uPtrCounterVec, counterHandles, uPtrCounter)
+	}
+
+	return false
+}
+
+//export goCounterDeletePartialMatch
+func goCounterDeletePartialMatch(uPtrCounterVec uintptr, labelNames, labelVals []string) uint32 {
+	countCall(callDeleteLabelValues)
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		return uint32(deletePartialMatch(counterVec, uPtrCounterVec, counterHandles, labelNames, labelVals))
+	}
+
+	return 0
+}
+
+//export goHistogramDelete
+func goHistogramDelete(uPtrHistogramVec, uPtrHistogram uintptr) bool {
+	countCall(callDeleteLabelValues)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		return deleteChild(histogramVec, uPtrHistogramVec, histogramHandles, uPtrHistogram)
+	}
+
+	return false
+}
+
+//export goHistogramDeletePartialMatch
+func goHistogramDeletePartialMatch(uPtrHistogramVec uintptr, labelNames, labelVals []string) uint32 {
+	countCall(callDeleteLabelValues)
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		return uint32(deletePartialMatch(histogramVec, uPtrHistogramVec, histogramHandles, labelNames, labelVals))
+	}
+
+	return 0
+}
+
+//export goSummaryDelete
+func goSummaryDelete(uPtrSummaryVec, uPtrSummary uintptr) bool {
+	countCall(callDeleteLabelValues)
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		return deleteChild(summaryVec, uPtrSummaryVec, summaryHandles, uPtrSummary)
+	}
+
+	return false
+}
+
+//export goSummaryDeletePartialMatch
+func goSummaryDeletePartialMatch(uPtrSummaryVec uintptr, labelNames, labelVals []string) uint32 {
+	countCall(callDeleteLabelValues)
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		return uint32(deletePartialMatch(summaryVec, uPtrSummaryVec, summaryHandles, labelNames, labelVals))
+	}
+
+	return 0
+}
@@ -21,6 +21,14 @@ int main() {
     StartPromHandler(listen, "/metrics");
     printf("Prometheus scrape handler started on %s\n", listen);
 
+    // Same metrics on another path, with scrapes sharing gathers
+    PromHandlerOpts handlerOpts = {0};
+    handlerOpts.coalesceWindowMs = 500;
+    handlerOpts.cacheTtlMs = 1000;
+    handlerOpts.gzip = 1;
+    handlerOpts.maxInFlight = 2;
+    StartPromHandlerWithOpts(listen, "/metrics-cached", &handlerOpts);
+
     // Create a test gauge
     void* testGauge = NewGauge("test_gauge", "Test gauge's help");
 
@@ -82,6 +90,21 @@ int main() {
         sleep(1);
     }
 
+    // Label values with explicit lengths needn't be null-terminated
+    const char* labelValBuf = "label-val-ONElabel-val-TWO";
+    const char* lenLabelVals[2] = {labelValBuf, labelValBuf + 13};
+    size_t labelLens[2] = {13, 13};
+    void* testCounter3 = CounterWithLabelValuesLen(testCounterVec, nLabels, lenLabelVals, labelLens);
+    CounterAdd(testCounter3, 1); // Same child as testCounter2
+
+    // Pre-create every combination of label values in a single call
+    const char* precreateVals[] = {"a", "b", "x", "y", "z"}; // label1: a, b; label2: x, y, z
+    int nPrecreateVals[2] = {2, 3};
+    void* precreated[6];
+    CounterWithLabelValuesProduct(testCounterVec, nLabels, nPrecreateVals, precreateVals,
+                                    precreated);
+    CounterAdd(precreated[5], 1); // label1="b", label2="z"
+
     CounterDeleteLabelValues(testCounterVec, nLabels, labelVals);
 
     // Test adding summary created by NewSummary and SummaryVec.WithLabelValues
@@ -113,7 +136,38 @@ int main() {
         sleep(1);
     }
 
+    // Test observing a batch of values in one call
+    double batch[NUM_ITER];
+    for (int i = 0; i < NUM_ITER; i++) {
+        batch[i] = generateRandVal();
+    }
+    printf("Updating summary w/ a batch of %d observations\n", NUM_ITER);
+    SummaryObserveBatch(testSummary, batch, NUM_ITER);
+
     SummaryDeleteLabelValues(testSummaryVec, nLabels, labelVals);
 
+    // Test observing histograms created by NewHistogram and HistogramVec.WithLabelValues
+    labelVals[0] = "label-val-EINS"; labelVals[1] = "label-val-ZWEI";
+
+    int nBuckets = 10;
+    double buckets[10];
+    ExponentialBuckets(1, 2, nBuckets, buckets); // 1, 2, 4, ..., 512
+    void* testHistogram = NewHistogram("test_histogram", "Test histogram's help",
+            nBuckets, buckets);
+
+    void* testHistogramVec = NewHistogramVec("testHistogramVec", "Test histogram vec",
+            nLabels, labels, nBuckets, buckets);
+    void* testHistogram2 = HistogramWithLabelValues(testHistogramVec, nLabels, labelVals);
+
+    for (int i = 0; i < NUM_ITER; i++) {
+        temp = generateRandVal();
+        printf("%d: Updating histogram w/ observation %lf\n", i + 1, temp);
+        HistogramObserve(testHistogram, temp);
+        HistogramObserve(testHistogram2, temp);
+        sleep(1);
+    }
+
+    HistogramDeleteLabelValues(testHistogramVec, nLabels, labelVals);
+
     return 0;
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/wait.h>
 
 #include <vector>
 #include <string>
@@ -14,6 +15,10 @@
 using namespace std;
 using namespace EasyProm;
 
+// Global metrics, registered by StartPromHandler() in main()
+constexpr MetricDesc kLoopsDesc{"test_static_loops_total", "Loops run by this test", "phase"};
+StaticCounterVec<1> testLoops{kLoopsDesc};
+
 // Generates random value between [0, MY_RAND_MAX]
 double generateRandVal() {
     return (double)rand() / ((double)RAND_MAX / MY_RAND_MAX);
@@ -26,8 +31,26 @@ int main() {
     StartPromHandler(listen, "/metrics");
     printf("Prometheus scrape handler started on %s\n", listen);
 
+    // A separate registry, exposed on its own path
+    Registry hotRegistry(2);
+    hotRegistry.StartHandler(listen, "/metrics/hot");
+
     // Create a test gauge
     Gauge testGauge = Gauge("test_gauge", "Test gauge's help");
+    Gauge testHotGauge = Gauge(hotRegistry, "test_hot_gauge", "Test gauge in hotRegistry");
+
+    // The same name may be used in several registries, with the library's own
+    // easyprom_series{family="test_gauge"} summing both
+    Gauge testHotGaugeTwin = Gauge(hotRegistry, "test_gauge", "Test gauge's twin in hotRegistry");
+    string rendered;
+    if (!AppendMetrics(rendered)) {
+        fprintf(stderr, "Gathering failed with test_gauge in two registries\n");
+        return 1;
+    }
+    if (rendered.find("easyprom_series{family=\"test_gauge\"} 2") == string::npos) {
+        fprintf(stderr, "test_gauge's series aren't summed across registries\n");
+        return 1;
+    }
 
     vector<string> labels = {"label1", "label2"};
     vector<string> labelVals = {"label-val-1", "label-val-2"};
@@ -41,6 +64,9 @@ int main() {
         printf("%d: Setting gauge to %lf\n", i + 1, temp);
         testGauge.Set(temp);
         testGauge2.Set(temp);
+        testHotGauge.Set(temp);
+        testHotGaugeTwin.Set(temp);
+        testLoops->WithLabelValues("gauge").Add(1);
         sleep(1);
     }
 
@@ -85,8 +111,44 @@ int main() {
         sleep(1);
     }
 
+    // Looking up an existing child again is served by the vec's C++ cache
+    testCounterVec.WithLabelValues({"label-val-ONE", "label-val-TWO"}).Add(1);
+
+    // Vecs with the number of labels in their type reject the wrong number of
+    // label values at compile time
+    Typed::CounterVec<2> testTypedCounterVec = Typed::CounterVec<2>("testTypedCounterVec",
+                                                    "Test typed counter vec", {"label1", "label2"});
+    testTypedCounterVec.WithLabelValues("label-val-ONE", "label-val-TWO").Add(1);
+    testTypedCounterVec.DeleteLabelValues("label-val-ONE", "label-val-TWO");
+
     testCounterVec.DeleteLabelValues(labelVals);
 
+    // Vecs with limits keep at most maxSeries children, folding the rest into
+    // one labeled "other", and evict children that go idle for idleTtlSec
+    CounterVec testLimitedCounterVec = CounterVec("testLimitedCounterVec",
+                                                "Test limited counter vec", {"peer"});
+    VecLimits limits = {};
+    limits.maxSeries = 3;
+    limits.foldOverflow = 1;
+    limits.idleTtlSec = 5;
+    testLimitedCounterVec.SetLimits(limits);
+    for (int i = 0; i < NUM_ITER; i++) {
+        testLimitedCounterVec.WithLabelValues({"peer-" + to_string(i)}).Add(1);
+    }
+
+    // Deleting the "other" child drops every label set folded into it from
+    // the vec's cache, so they get a new "other" child
+    Counter testOtherCounter = testLimitedCounterVec.WithLabelValues({"peer-"
+                                                                    + to_string(NUM_ITER)});
+    testLimitedCounterVec.Delete(testOtherCounter);
+    for (int i = 3; i <= NUM_ITER; i++) {
+        Counter folded = testLimitedCounterVec.WithLabelValues({"peer-" + to_string(i)});
+        if (folded.Handle() == testOtherCounter.Handle()) {
+            fprintf(stderr, "peer-%d is still cached as the deleted \"other\" child\n", i);
+            return 1;
+        }
+    }
+
     // Test adding summary created by NewSummary and SummaryVec.WithLabelValues
     labelVals[0] = "label-val-UN"; labelVals[1] = "label-val-DEUX";
 
@@ -105,15 +167,129 @@ int main() {
                                         labels, objectives, nMaxAge, nAgeBkts);
     Summary testSummary2 = testSummaryVec.WithLabelValues(labelVals);
 
+    // Native summaries keep a sketch in C++, and are only read by Go at scrape time
+    NativeSummary testNativeSummary = NativeSummary("test_native_summary",
+                                        "Test native summary's help", objectives,
+                                        nMaxAge, nAgeBkts);
+
     for (int i = 0; i < NUM_ITER; i++) {
         temp = generateRandVal();
         printf("%d: Updating summary w/ observation %lf\n", i + 1, temp);
         testSummary.Observe(temp);
         testSummary2.Observe(temp);
+        testNativeSummary.Observe(temp);
         sleep(1);
     }
 
+    // Test observing a batch of values in one call
+    vector<double> batch(NUM_ITER);
+    for (int i = 0; i < NUM_ITER; i++) {
+        batch[i] = generateRandVal();
+    }
+    printf("Updating summary w/ a batch of %d observations\n", NUM_ITER);
+    testSummary.ObserveMany(batch);
+
     testSummaryVec.DeleteLabelValues(labelVals);
 
+    // Test observing histograms created by Histogram and HistogramVec.WithLabelValues
+    labelVals[0] = "label-val-EINS"; labelVals[1] = "label-val-ZWEI";
+    vector<double> buckets = ExponentialBuckets(1, 2, 10); // 1, 2, 4, ..., 512
+    Histogram testHistogram = Histogram("test_histogram", "Test histogram's help", buckets);
+    HistogramVec testHistogramVec = HistogramVec("testHistogramVec", "Test histogram vec",
+                                                labels, buckets);
+    Histogram testHistogram2 = testHistogramVec.WithLabelValues(labelVals);
+
+    // Native histograms keep their buckets in C++, and are only read by Go at scrape time
+    NativeHistogram testNativeHistogram = NativeHistogram("test_native_histogram",
+                                                "Test native histogram's help", buckets);
+
+    for (int i = 0; i < NUM_ITER; i++) {
+        temp = generateRandVal();
+        printf("%d: Updating histograms w/ observation %lf\n", i + 1, temp);
+        testHistogram.Observe(temp);
+        testHistogram2.Observe(temp);
+        testNativeHistogram.Observe(temp);
+        sleep(1);
+    }
+
+    // Test timing a block into a histogram, in milliseconds
+    for (int i = 0; i < NUM_ITER; i++) {
+        auto timer = ObserveDuration<std::milli>(testNativeHistogram);
+        usleep(generateRandVal() * 1000);
+    }
+
+    testHistogramVec.DeleteLabelValues(labelVals);
+
+    // Test native counters and gauges, whose values live in C++ and are only
+    // read by Go at scrape time
+    NativeCounter testNativeCounter = NativeCounter("test_native_counter",
+                                                    "Test native counter's help");
+    NativeIntCounter testNativeIntCounter = NativeIntCounter("test_native_int_counter",
+                                                    "Test native int counter's help");
+    NativeGauge testNativeGauge = NativeGauge("test_native_gauge", "Test native gauge's help");
+
+    for (int i = 0; i < NUM_ITER; i++) {
+        temp = generateRandVal();
+        printf("%d: Setting native counter and gauge to %lf\n", i + 1, temp);
+        testNativeCounter.Add(temp);
+        testNativeIntCounter.Inc();
+        testNativeGauge.Set(temp);
+        sleep(1);
+    }
+
+    // Test func metrics, whose values are only computed when scraped
+    int queueDepths[2] = {0, 0};
+    GaugeFunc testGaugeFunc = GaugeFunc("test_gauge_func", "Test gauge func's help",
+                                        [&]() { return (double)queueDepths[0]; });
+    GaugeVecFunc testGaugeVecFunc = GaugeVecFunc("test_gauge_vec_func",
+                                        "Test gauge vec func's help", {"queue"},
+                                        [&](FuncVecEmitter& emitter) {
+                                            emitter.Emit({"queue-0"}, queueDepths[0]);
+                                            emitter.Emit({"queue-1"}, queueDepths[1]);
+                                        });
+    for (int i = 0; i < NUM_ITER; i++) {
+        printf("%d: Setting queue depths to %d and %d\n", i + 1, i, 2 * i);
+        queueDepths[0] = i;
+        queueDepths[1] = 2 * i;
+        sleep(1);
+    }
+
+    // Test asynchronous recording, where updates are staged in a per-thread
+    // ring and applied to the Go objects in batches by a background thread
+    AsyncRecorderOpts asyncOpts;
+    asyncOpts.flushIntervalMs = 500;
+    AsyncRecorder::Start(asyncOpts);
+    for (int i = 0; i < NUM_ITER; i++) {
+        temp = generateRandVal();
+        printf("%d: Asynchronously setting gauge and counter to %lf\n", i + 1, temp);
+        testGauge.Set(temp);
+        testCounter.Add(temp);
+        sleep(1);
+    }
+    AsyncRecorder::Flush();
+    printf("Async recorder dropped %lu updates\n", (unsigned long)AsyncRecorder::Dropped());
+    AsyncRecorder::Stop();
+
+    // Test shared-memory metrics, updated by a forked worker (which must not
+    // call into Go) and exported by this process
+    SharedMetrics::Init();
+    SharedCounter testSharedCounter = SharedCounter("test_shared_counter",
+                                            "Test shared counter's help");
+    SharedGauge testSharedGauge = SharedGauge("test_shared_gauge", "Test shared gauge's help",
+                                            SharedAggregation::PerProcess);
+    pid_t worker = fork();
+    if (worker == 0) {
+        SharedMetrics::Attach();
+        for (int i = 0; i < NUM_ITER; i++) {
+            testSharedCounter.Inc();
+            testSharedGauge.Set(i);
+            sleep(1);
+        }
+        _exit(0);
+    }
+    waitpid(worker, NULL, 0);
+    SharedMetrics::Release(worker);
+    printf("Worker %d exited, its shared counter increments are kept\n", (int)worker);
+
     return 0;
 }
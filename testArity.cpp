@@ -0,0 +1,35 @@
+// Compile-time checks of the Typed vecs' arity, run by "make check-arity".
+// ARITY_CASE 0 must compile, and every other case must fail to, for each
+// ARITY_VEC (GaugeVec, CounterVec, HistogramVec or SummaryVec).
+#include "promClient.h"
+
+#ifndef ARITY_VEC
+#define ARITY_VEC CounterVec
+#endif
+
+#ifndef ARITY_CASE
+#define ARITY_CASE 0
+#endif
+
+using namespace EasyProm;
+
+void arityCase(Typed::ARITY_VEC<2>& vec) {
+#if ARITY_CASE == 0
+    vec.WithLabelValues("label-val-1", std::string("label-val-2"));
+    vec.DeleteLabelValues(std::string_view("label-val-1"), "label-val-2");
+#elif ARITY_CASE == 1
+    vec.WithLabelValues("label-val-1");
+#elif ARITY_CASE == 2
+    vec.WithLabelValues({"label-val-1"}); // Would be padded by an array parameter
+#elif ARITY_CASE == 3
+    vec.WithLabelValues("label-val-1", "label-val-2", "label-val-3");
+#elif ARITY_CASE == 4
+    vec.DeleteLabelValues("label-val-1");
+#elif ARITY_CASE == 5
+    vec.DeleteLabelValues({"label-val-1"});
+#endif
+}
+
+int main() {
+    return 0;
+}
@@ -0,0 +1,444 @@
+// End-to-end check of remote write, run by "make check-remote-write": pushes
+// the default registry to a stub receiver, which decodes each request's
+// snappy-compressed WriteRequest, then checks the requests' headers, series,
+// label sets and values, and how they were split into shards and batches.
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "promClient.h"
+
+using namespace std;
+using namespace EasyProm;
+
+#define MAX_SAMPLES_PER_SEND 7
+#define NUM_SHARDS 3
+#define NUM_SHARD_SERIES 50 // Series of rw_test_shard, so each shard gets several batches
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+/* ========== DECODING ========== */
+typedef vector<pair<string, string>> Labels;
+
+struct Sample {
+    Labels labels;
+    double value;
+    int64_t timestamp;
+};
+
+struct Request {
+    string requestLine;
+    map<string, string> headers; // Names in lower case
+    vector<Sample> samples;
+    bool decoded = false;
+};
+
+static bool readVarint(const string& buf, size_t& pos, uint64_t& val) {
+    val = 0;
+    for (int shift = 0; pos < buf.size() && shift < 64; shift += 7) {
+        unsigned char c = buf[pos++];
+        val |= (uint64_t)(c & 0x7f) << shift;
+        if (c < 0x80) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Decodes a snappy block (not the framing format), as sent by remote write
+static bool snappyDecode(const string& src, string& dst) {
+    size_t pos = 0;
+    uint64_t len;
+    if (!readVarint(src, pos, len)) {
+        return false;
+    }
+
+    dst.clear();
+    while (pos < src.size()) {
+        unsigned char tag = src[pos++];
+        size_t n, offset = 0;
+        switch (tag & 3) {
+        case 0: // Literal, with the length - 1 in the tag or the next 1-4 bytes
+            n = tag >> 2;
+            if (n >= 60) {
+                size_t nBytes = n - 59;
+                if (pos + nBytes > src.size()) {
+                    return false;
+                }
+                n = 0;
+                for (size_t i = 0; i < nBytes; i++) {
+                    n |= (size_t)(unsigned char)src[pos++] << (8 * i);
+                }
+            }
+            n++;
+            if (pos + n > src.size()) {
+                return false;
+            }
+            dst.append(src, pos, n);
+            pos += n;
+            continue;
+        case 1: // Copy with a 11-bit offset
+            if (pos + 1 > src.size()) {
+                return false;
+            }
+            n = 4 + ((tag >> 2) & 7);
+            offset = ((size_t)(tag >> 5) << 8) | (unsigned char)src[pos++];
+            break;
+        default: // Copy with a 16 or 32-bit offset
+            n = (tag >> 2) + 1;
+            for (size_t i = 0, nBytes = ((tag & 3) == 2) ? 2 : 4; i < nBytes; i++, pos++) {
+                if (pos >= src.size()) {
+                    return false;
+                }
+                offset |= (size_t)(unsigned char)src[pos] << (8 * i);
+            }
+            break;
+        }
+
+        if (offset == 0 || offset > dst.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) { // Copies may overlap their own output
+            dst += dst[dst.size() - offset];
+        }
+    }
+
+    return dst.size() == len;
+}
+
+// Calls field(number, wireType, value) for each field of the message in buf,
+// where value is the payload of length-delimited fields, or else the varint
+// or fixed64 as raw bytes
+template <typename F>
+static bool forEachField(const string& buf, F field) {
+    size_t pos = 0;
+    while (pos < buf.size()) {
+        uint64_t key, len;
+        if (!readVarint(buf, pos, key)) {
+            return false;
+        }
+
+        size_t start = pos;
+        switch (key & 7) {
+        case 0:
+            if (!readVarint(buf, pos, len)) {
+                return false;
+            }
+            break;
+        case 1:
+            pos += 8;
+            break;
+        case 2:
+            if (!readVarint(buf, pos, len) || len > buf.size() - pos) {
+                return false;
+            }
+            start = pos;
+            pos += len;
+            break;
+        case 5:
+            pos += 4;
+            break;
+        default:
+            return false;
+        }
+        if (pos > buf.size() || !field(key >> 3, key & 7, buf.substr(start, pos - start))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Decodes a WriteRequest (see encodeWriteRequest in remoteWrite.go)
+static bool decodeWriteRequest(const string& buf, vector<Sample>& samples) {
+    return forEachField(buf, [&](uint64_t num, int wireType, const string& ts) {
+        if (num != 1 || wireType != 2) {
+            return true;
+        }
+
+        Labels labels;
+        vector<pair<double, int64_t>> values;
+        bool ok = forEachField(ts, [&](uint64_t num, int wireType, const string& msg) {
+            if (num == 1 && wireType == 2) {
+                pair<string, string> label;
+                labels.push_back(label);
+                return forEachField(msg, [&](uint64_t num, int wireType, const string& str) {
+                    if (num == 1 && wireType == 2) {
+                        labels.back().first = str;
+                    } else if (num == 2 && wireType == 2) {
+                        labels.back().second = str;
+                    }
+                    return true;
+                });
+            } else if (num == 2 && wireType == 2) {
+                values.emplace_back(0, 0);
+                return forEachField(msg, [&](uint64_t num, int wireType, const string& raw) {
+                    if (num == 1 && wireType == 1) {
+                        memcpy(&values.back().first, raw.data(), sizeof(double));
+                    } else if (num == 2 && wireType == 0) {
+                        size_t pos = 0;
+                        uint64_t ms;
+                        readVarint(raw, pos, ms);
+                        values.back().second = (int64_t)ms;
+                    }
+                    return true;
+                });
+            }
+            return true;
+        });
+
+        for (auto& value : values) {
+            samples.push_back({labels, value.first, value.second});
+        }
+        return ok;
+    });
+}
+
+/* ========== STUB RECEIVER ========== */
+static mutex receivedMu;
+static vector<Request> received;
+
+static void serveRequest(int fd) {
+    string raw;
+    char buf[65536];
+    size_t headerLen = string::npos, contentLen = 0;
+    ssize_t n;
+    Request request;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        raw.append(buf, n);
+        if (headerLen == string::npos && (headerLen = raw.find("\r\n\r\n")) != string::npos) {
+            size_t end = raw.find("\r\n");
+            request.requestLine = raw.substr(0, end);
+            for (size_t start = end + 2; start < headerLen; start = end + 2) {
+                end = raw.find("\r\n", start);
+                size_t colon = raw.find(':', start);
+                if (colon < end) {
+                    string name = raw.substr(start, colon - start);
+                    transform(name.begin(), name.end(), name.begin(), ::tolower);
+                    request.headers[name] = raw.substr(colon + 2, end - colon - 2);
+                }
+            }
+            headerLen += 4;
+            contentLen = strtoull(request.headers["content-length"].c_str(), nullptr, 10);
+        }
+        if (headerLen != string::npos && raw.size() >= headerLen + contentLen) {
+            break;
+        }
+    }
+    if (headerLen == string::npos) {
+        close(fd);
+        return;
+    }
+
+    string body;
+    request.decoded = snappyDecode(raw.substr(headerLen, contentLen), body) &&
+                        decodeWriteRequest(body, request.samples);
+    {
+        lock_guard<mutex> lock(receivedMu);
+        received.push_back(move(request));
+    }
+
+    const char* response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    send(fd, response, strlen(response), MSG_NOSIGNAL);
+    close(fd);
+}
+
+// Listens on an ephemeral loopback port, returning it (or 0 on failure)
+static unsigned startReceiver() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0 ||
+            getsockname(fd, (struct sockaddr*)&addr, &addrLen) != 0) {
+        return 0;
+    }
+
+    thread([fd]() {
+        while (true) {
+            int connFd = accept(fd, nullptr, nullptr);
+            if (connFd >= 0) {
+                thread(serveRequest, connFd).detach();
+            }
+        }
+    }).detach();
+
+    return ntohs(addr.sin_port);
+}
+
+/* ========== CHECKS ========== */
+// Same sharding as shardOf in remoteWrite.go
+static size_t shardOf(const Labels& labels) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const string& str) {
+        for (unsigned char c : str) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    };
+    for (auto& label : labels) {
+        add(label.first);
+        add(label.second);
+    }
+
+    return hash % NUM_SHARDS;
+}
+
+static string labelsString(const Labels& labels) {
+    string str;
+    for (auto& label : labels) {
+        str += (str.empty() ? "" : ",") + label.first + "=\"" + label.second + "\"";
+    }
+
+    return "{" + str + "}";
+}
+
+int main() {
+    // Metrics with known values, in the default registry pushed by remote write
+    Gauge gauge = Gauge("rw_test_gauge", "Remote write test gauge");
+    gauge.Set(42.5);
+
+    CounterVec counterVec = CounterVec("rw_test_requests_total", "Remote write test counter",
+                                        {"code", "method"});
+    counterVec.WithLabelValues({"200", "GET"}).Add(3);
+    counterVec.WithLabelValues({"500", "POST"}).Add(1);
+
+    Histogram histogram = Histogram("rw_test_latency_seconds", "Remote write test histogram",
+                                    {1, 2});
+    for (double val : {0.5, 1.5, 3.0}) {
+        histogram.Observe(val);
+    }
+
+    GaugeVec shardVec = GaugeVec("rw_test_shard", "Remote write test series", {"series"});
+    for (int i = 0; i < NUM_SHARD_SERIES; i++) {
+        shardVec.WithLabelValues({to_string(i)}).Set(i);
+    }
+
+    unsigned port = startReceiver();
+    if (port == 0) {
+        fprintf(stderr, "Unable to start the stub remote-write receiver\n");
+        return 1;
+    }
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/api/v1/write", port);
+
+    // The interval is never reached, so the final flush sends the only snapshot
+    RemoteWriteOpts rwOpts = {};
+    rwOpts.maxSamplesPerSend = MAX_SAMPLES_PER_SEND;
+    rwOpts.nShards = NUM_SHARDS;
+    rwOpts.queueCapacity = 1 << 10; // Never drop, so all samples arrive
+    StartRemoteWrite(url, 3600 * 1000, &rwOpts);
+    usleep(200 * 1000);
+    {
+        lock_guard<mutex> lock(receivedMu);
+        CHECK(received.empty(), "%zu requests sent before StopRemoteWrite()", received.size());
+    }
+    CHECK(StopRemoteWrite(10 * 1000) != 0, "StopRemoteWrite() timed out");
+
+    lock_guard<mutex> lock(receivedMu);
+    CHECK(!received.empty(), "No requests received after StopRemoteWrite()");
+
+    // Headers, and how samples are split into shards and batches
+    map<string, Sample> series;
+    size_t shardSamples[NUM_SHARDS] = {}, shardRequests[NUM_SHARDS] = {};
+    for (const Request& request : received) {
+        CHECK(request.requestLine == "POST /api/v1/write HTTP/1.1",
+                "Request line \"%s\"", request.requestLine.c_str());
+        auto header = [&request](const char* name) {
+            auto it = request.headers.find(name);
+            return (it == request.headers.end()) ? string() : it->second;
+        };
+        CHECK(header("content-encoding") == "snappy", "Content-Encoding \"%s\"",
+                header("content-encoding").c_str());
+        CHECK(header("content-type") == "application/x-protobuf", "Content-Type \"%s\"",
+                header("content-type").c_str());
+        CHECK(header("x-prometheus-remote-write-version") == "0.1.0",
+                "X-Prometheus-Remote-Write-Version \"%s\"",
+                header("x-prometheus-remote-write-version").c_str());
+        CHECK(request.decoded, "Undecodable request body");
+
+        CHECK(!request.samples.empty() && request.samples.size() <= MAX_SAMPLES_PER_SEND,
+                "Batch of %zu samples", request.samples.size());
+        if (request.samples.empty()) {
+            continue;
+        }
+        size_t shard = shardOf(request.samples[0].labels);
+        shardRequests[shard]++;
+        for (const Sample& sample : request.samples) {
+            string key = labelsString(sample.labels);
+            CHECK(is_sorted(sample.labels.begin(), sample.labels.end()),
+                    "Unsorted labels %s", key.c_str());
+            CHECK(shardOf(sample.labels) == shard, "%s batched with another shard's series",
+                    key.c_str());
+            CHECK(series.emplace(key, sample).second, "%s sent twice", key.c_str());
+            CHECK(sample.timestamp > 0, "%s has timestamp %lld", key.c_str(),
+                    (long long)sample.timestamp);
+            shardSamples[shard]++;
+        }
+    }
+    for (size_t i = 0; i < NUM_SHARDS; i++) {
+        size_t batches = (shardSamples[i] + MAX_SAMPLES_PER_SEND - 1) / MAX_SAMPLES_PER_SEND;
+        CHECK(shardRequests[i] == batches, "Shard %zu sent %zu samples in %zu requests, not %zu",
+                i, shardSamples[i], shardRequests[i], batches);
+    }
+
+    // Series and their values
+    map<string, double> expected = {
+        {"{__name__=\"rw_test_gauge\"}", 42.5},
+        {"{__name__=\"rw_test_requests_total\",code=\"200\",method=\"GET\"}", 3},
+        {"{__name__=\"rw_test_requests_total\",code=\"500\",method=\"POST\"}", 1},
+        {"{__name__=\"rw_test_latency_seconds_bucket\",le=\"1\"}", 1},
+        {"{__name__=\"rw_test_latency_seconds_bucket\",le=\"2\"}", 2},
+        {"{__name__=\"rw_test_latency_seconds_bucket\",le=\"+Inf\"}", 3},
+        {"{__name__=\"rw_test_latency_seconds_sum\"}", 5},
+        {"{__name__=\"rw_test_latency_seconds_count\"}", 3},
+    };
+    for (int i = 0; i < NUM_SHARD_SERIES; i++) {
+        expected["{__name__=\"rw_test_shard\",series=\"" + to_string(i) + "\"}"] = i;
+    }
+    for (auto& want : expected) {
+        auto got = series.find(want.first);
+        if (got == series.end()) {
+            CHECK(false, "%s not sent", want.first.c_str());
+        } else {
+            CHECK(got->second.value == want.second, "%s = %g, not %g", want.first.c_str(),
+                    got->second.value, want.second);
+        }
+    }
+    for (auto& got : series) {
+        CHECK(got.first.compare(0, 18, "{__name__=\"rw_test") != 0 || expected.count(got.first),
+                "Unexpected series %s", got.first.c_str());
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d remote write checks failed\n", failures);
+        return 1;
+    }
+    printf("Remote write: %zu requests, %zu series, as expected\n", received.size(),
+            series.size());
+
+    return 0;
+}
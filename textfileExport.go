@@ -0,0 +1,130 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"bytes"
+	"fmt"
+	"os"
+	"time"
+
+	"github.com/prometheus/client_golang/prometheus"
+	"github.com/prometheus/common/expfmt"
+)
+
+/* ===========================================================================
+ * TEXTFILE EXPORT
+ * =========================================================================== */
+// Periodically renders a registry into a file, in the format read by
+// node_exporter's textfile collector, for hosts where no port may be opened.
+// The file is replaced atomically (written to a temporary file in the same
+// directory, then renamed over it), so readers never see a partial render,
+// and is left alone when the rendering hasn't changed since the last write.
+// Renders alternate between two buffers, which are reused across intervals.
+type textfileExporter struct {
+	gatherer prometheus.Gatherer
+	path     string
+	tmpPath  string // Doesn't end in ".prom", so the collector ignores it
+	interval time.Duration
+
+	last   bytes.Buffer // As last written
+	next   bytes.Buffer
+	failed bool // Whether the last write failed, so failures are only logged once
+}
+
+const defaultTextfileInterval = 15 * time.Second
+
+func (e *textfileExporter) run() {
+	for {
+		if err := e.export(); err != nil {
+			if !e.failed {
+				fmt.Fprintf(os.Stderr, "easyprom: textfile export to %s failed: %v\n", e.path, err)
+			}
+			e.failed = true
+		} else {
+			e.failed = false
+		}
+
+		time.Sleep(e.interval)
+	}
+}
+
+func (e *textfileExporter) export() error {
+	mfs, err := e.gatherer.Gather()
+	if err != nil {
+		return err
+	}
+
+	e.next.Reset()
+	enc := expfmt.NewEncoder(&e.next, expfmt.FmtText)
+	for _, mf := range mfs {
+		if err := enc.Encode(mf); err != nil {
+			return err
+		}
+	}
+
+	if !e.failed && e.last.Len() > 0 && bytes.Equal(e.next.Bytes(), e.last.Bytes()) {
+		return nil
+	}
+	if err := e.write(e.next.Bytes()); err != nil {
+		return err
+	}
+
+	e.last, e.next = e.next, e.last
+	return nil
+}
+
+func (e *textfileExporter) write(data []byte) error {
+	f, err := os.OpenFile(e.tmpPath, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0644)
+	if err != nil {
+		return err
+	}
+
+	_, err = f.Write(data)
+	if closeErr := f.Close(); err == nil {
+		err = closeErr
+	}
+	if err == nil {
+		err = os.Rename(e.tmpPath, e.path)
+	}
+	if err != nil {
+		os.Remove(e.tmpPath)
+	}
+
+	return err
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Exports the registry to the file at path every intervalMs (0 meaning 15s),
+// starting right away
+//export goStartTextfileExport
+func goStartTextfileExport(uPtrRegistry uintptr, path string, intervalMs uint32) {
+	e := &textfileExporter{
+		gatherer: gathererOf(uPtrRegistry),
+		path:     stringCopy(path),
+		tmpPath:  stringCopy(path) + ".tmp",
+		interval: time.Duration(intervalMs) * time.Millisecond,
+	}
+	if e.interval == 0 {
+		e.interval = defaultTextfileInterval
+	}
+
+	go e.run()
+}
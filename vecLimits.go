@@ -0,0 +1,305 @@
+/* Copyright 2020 Thomas Lin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package main
+
+import "C"
+
+import (
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+	"unsafe"
+
+	"github.com/prometheus/client_golang/prometheus"
+)
+
+/* ===========================================================================
+ * SERIES LIMITS
+ * =========================================================================== */
+// Optional bounds on the children (series) of a Vec, so that label values
+// derived from users or peers can't grow memory and scrapes without bound:
+//   - At most maxSeries children exist at once (0 means no limit). Children
+//     for further label values are either rejected (WithLabelValues returns
+//     0, a handle whose updates are ignored) or folded into a single
+//     overflow child, whose label values are all overflowLabelValue.
+//   - Children whose handle hasn't been looked up (i.e. updated) for idleTTL
+//     are evicted by the sweeper, from both the Vec and its handle table.
+//     Their handles become stale, so they must be looked up again.
+// Every sweep that evicts children increments 'evictions', a counter in
+// "C-land" memory, which lets the C++ classes know to flush their caches of
+// children.
+const overflowLabelValue = "other"
+
+type limitedChild struct {
+	labelVals []string
+	obj       interface{}
+	handle    uintptr
+}
+
+type vecLimits struct {
+	maxSeries int
+	fold      bool
+	idleTTL   int64   // Seconds; 0 means children never expire
+	evictions *uint64 // In "C-land" memory; may be nil
+
+	handles *handleTable
+	family  *familyInfo
+	create  func(labelVals []string) interface{} // The Vec's WithLabelValues
+	remove  func(labelVals []string)             // The Vec's DeleteLabelValues
+
+	mu       sync.Mutex
+	children map[string]*limitedChild  // Keyed by label values, joined
+	byHandle map[uintptr]*limitedChild // The same children, keyed by handle
+}
+
+var limitedVecs sync.Map // Vec -> *vecLimits
+
+// Seconds since the epoch, as of the sweeper's last tick (0 until it starts)
+var coarseNow int64
+
+var sweeperOnce sync.Once
+
+func labelValsKey(labelVals []string) string {
+	return strings.Join(labelVals, "\xff") // Never appears in UTF-8
+}
+
+func (l *vecLimits) withLabelValues(labelVals []string) uintptr {
+	key := labelValsKey(labelVals)
+
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	child, ok := l.children[key]
+	if !ok && l.maxSeries > 0 && len(l.children) >= l.maxSeries {
+		atomic.AddUint64(&l.family.rejected, 1)
+		if !l.fold {
+			return 0
+		}
+
+		labelVals = make([]string, len(labelVals))
+		for i := range labelVals {
+			labelVals[i] = overflowLabelValue
+		}
+		key = labelValsKey(labelVals)
+		child, ok = l.children[key]
+	}
+
+	if ok {
+		l.handles.Get(child.handle) // Counts as a use, so it isn't swept right away
+		return child.handle
+	}
+
+	child = &limitedChild{labelVals: labelVals, obj: l.create(labelVals)}
+	var isNew bool
+	child.handle, isNew = l.handles.PutNew(child.obj)
+	if isNew {
+		atomic.AddInt64(&l.family.series, 1)
+	}
+	l.children[key] = child
+	l.byHandle[child.handle] = child
+
+	return child.handle
+}
+
+func (l *vecLimits) deleteLabelValues(labelVals []string) {
+	key := labelValsKey(labelVals)
+
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	if child, ok := l.children[key]; ok {
+		l.deleteLocked(key, child)
+	}
+}
+
+func (l *vecLimits) deleteLocked(key string, child *limitedChild) {
+	if l.handles.DeleteObj(child.obj) {
+		atomic.AddInt64(&l.family.series, -1)
+	}
+	l.remove(child.labelVals)
+	delete(l.children, key)
+	delete(l.byHandle, child.handle)
+}
+
+// Returns whether the child with the handle was deleted
+func (l *vecLimits) deleteHandle(handle uintptr) bool {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	child, ok := l.byHandle[handle]
+	if ok {
+		l.deleteLocked(labelValsKey(child.labelVals), child)
+	}
+
+	return ok
+}
+
+// Deletes the children whose object satisfies match, returning how many
+func (l *vecLimits) deleteMatching(match func(obj interface{}) bool) int {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	n := 0
+	for key, child := range l.children {
+		if match(child.obj) {
+			l.deleteLocked(key, child)
+			n++
+		}
+	}
+
+	return n
+}
+
+// Evicts children idle for idleTTL or more, as of 'now' (a coarseNow value)
+func (l *vecLimits) sweep(now int64) {
+	if l.idleTTL == 0 {
+		return
+	}
+
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	var nEvicted uint64
+	for key, child := range l.children {
+		if now-l.handles.LastUsed(child.handle) >= l.idleTTL {
+			l.deleteLocked(key, child)
+			nEvicted++
+		}
+	}
+
+	if nEvicted > 0 {
+		atomic.AddUint64(&l.family.evicted, nEvicted)
+		if l.evictions != nil {
+			atomic.AddUint64(l.evictions, 1)
+		}
+	}
+}
+
+func startSweeper() {
+	sweeperOnce.Do(func() {
+		atomic.StoreInt64(&coarseNow, time.Now().Unix())
+		go func() {
+			for range time.Tick(time.Second) {
+				now := time.Now().Unix()
+				atomic.StoreInt64(&coarseNow, now)
+				limitedVecs.Range(func(_, limits interface{}) bool {
+					limits.(*vecLimits).sweep(now)
+					return true
+				})
+			}
+		}()
+	})
+}
+
+// Returns the limits of vec, or nil if it has none
+func limitsOf(vec interface{}) *vecLimits {
+	if limits, ok := limitedVecs.Load(vec); ok {
+		return limits.(*vecLimits)
+	}
+
+	return nil
+}
+
+func setLimits(vec interface{}, uPtrVec uintptr, limits *vecLimits) {
+	family, ok := vecFamilies.Load(uPtrVec)
+	if !ok || atomic.LoadInt64(&family.(*familyInfo).series) != 0 {
+		panic("Limits must be set on a Vec before it has any children")
+	}
+
+	limits.family = family.(*familyInfo)
+	limits.children = make(map[string]*limitedChild)
+	limits.byHandle = make(map[uintptr]*limitedChild)
+	if _, loaded := limitedVecs.LoadOrStore(vec, limits); loaded {
+		panic("Limits have already been set on this Vec")
+	}
+
+	if limits.idleTTL > 0 {
+		startSweeper()
+	}
+}
+
+/* ===========================================================================
+ * EXPORTED FUNCTIONS
+ * =========================================================================== */
+// Sets the limits described by vecLimits. 'evictions' may be nil.
+//export goGaugeVecSetLimits
+func goGaugeVecSetLimits(uPtrGaugeVec uintptr, maxSeries uint32, foldOverflow bool,
+	idleTTLSec uint32, evictions unsafe.Pointer) {
+
+	if gaugeVec, ok := gaugeVecHandles.Get(uPtrGaugeVec).(*prometheus.GaugeVec); ok {
+		setLimits(gaugeVec, uPtrGaugeVec, &vecLimits{
+			maxSeries: int(maxSeries),
+			fold:      foldOverflow,
+			idleTTL:   int64(idleTTLSec),
+			evictions: (*uint64)(evictions),
+			handles:   gaugeHandles,
+			create:    func(labelVals []string) interface{} { return gaugeVec.WithLabelValues(labelVals...) },
+			remove:    func(labelVals []string) { gaugeVec.DeleteLabelValues(labelVals...) },
+		})
+	}
+}
+
+//export goCounterVecSetLimits
+func goCounterVecSetLimits(uPtrCounterVec uintptr, maxSeries uint32, foldOverflow bool,
+	idleTTLSec uint32, evictions unsafe.Pointer) {
+
+	if counterVec, ok := counterVecHandles.Get(uPtrCounterVec).(*prometheus.CounterVec); ok {
+		setLimits(counterVec, uPtrCounterVec, &vecLimits{
+			maxSeries: int(maxSeries),
+			fold:      foldOverflow,
+			idleTTL:   int64(idleTTLSec),
+			evictions: (*uint64)(evictions),
+			handles:   counterHandles,
+			create:    func(labelVals []string) interface{} { return counterVec.WithLabelValues(labelVals...) },
+			remove:    func(labelVals []string) { counterVec.DeleteLabelValues(labelVals...) },
+		})
+	}
+}
+
+//export goHistogramVecSetLimits
+func goHistogramVecSetLimits(uPtrHistogramVec uintptr, maxSeries uint32, foldOverflow bool,
+	idleTTLSec uint32, evictions unsafe.Pointer) {
+
+	if histogramVec, ok := histogramVecHandles.Get(uPtrHistogramVec).(*prometheus.HistogramVec); ok {
+		setLimits(histogramVec, uPtrHistogramVec, &vecLimits{
+			maxSeries: int(maxSeries),
+			fold:      foldOverflow,
+			idleTTL:   int64(idleTTLSec),
+			evictions: (*uint64)(evictions),
+			handles:   histogramHandles,
+			create:    func(labelVals []string) interface{} { return histogramVec.WithLabelValues(labelVals...) },
+			remove:    func(labelVals []string) { histogramVec.DeleteLabelValues(labelVals...) },
+		})
+	}
+}
+
+//export goSummaryVecSetLimits
+func goSummaryVecSetLimits(uPtrSummaryVec uintptr, maxSeries uint32, foldOverflow bool,
+	idleTTLSec uint32, evictions unsafe.Pointer) {
+
+	if summaryVec, ok := summaryVecHandles.Get(uPtrSummaryVec).(*prometheus.SummaryVec); ok {
+		setLimits(summaryVec, uPtrSummaryVec, &vecLimits{
+			maxSeries: int(maxSeries),
+			fold:      foldOverflow,
+			idleTTL:   int64(idleTTLSec),
+			evictions: (*uint64)(evictions),
+			handles:   summaryHandles,
+			create:    func(labelVals []string) interface{} { return summaryVec.WithLabelValues(labelVals...) },
+			remove:    func(labelVals []string) { summaryVec.DeleteLabelValues(labelVals...) },
+		})
+	}
+}